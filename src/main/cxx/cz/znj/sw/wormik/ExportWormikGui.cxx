@@ -0,0 +1,548 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Replay to video export GUI class
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <limits.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/soft_blit.hxx"
+#include "cz/znj/sw/wormik/replay.hxx"
+
+#include "cz/znj/sw/wormik/SdlSeasonLoader.hxx"
+#include "cz/znj/sw/wormik/SoftCompositor.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+using namespace gui4x6x16;
+
+
+/**
+ * GUI playing recorded replay and writing raw video frames.
+ *
+ * Waits return immediately, the time is advanced by the game intervals
+ * only, so export runs as fast as frames can be composed. Every frame is
+ * captured as small snapshot of game state on the game thread and then
+ * composed and converted by pool of worker threads; finished frames are
+ * written in order by the game thread.
+ */
+class ExportWormikGui: public WormikGui
+{
+public:
+	enum {
+		FRAME_WIDTH = SoftCompositor::FRAME_WIDTH,
+		FRAME_HEIGHT = SoftCompositor::FRAME_HEIGHT,
+		MAX_THREADS = 64,
+	};
+
+	enum {
+		FORMAT_RGBA		= 0,		/**< raw 8-bit RGBA */
+		FORMAT_Y4M		= 1,		/**< YUV4MPEG2, 4:2:0 */
+	};
+
+	enum {
+		EF_FREE			= 0,		/**< slot can be filled */
+		EF_QUEUED		= 1,		/**< snapshot waits for worker */
+		EF_COMPOSING		= 2,		/**< worker composes frame */
+		EF_DONE			= 3,		/**< output ready to be written */
+	};
+
+	static const double		START_TIME;
+	static const double		ANNOUNCE_TIME;
+
+protected:
+	typedef struct export_frame
+	{
+		int				state;		/**< see EF_* */
+		unsigned long			seq;		/**< frame number */
+		board_snapshot			snapshot;	/**< captured game state */
+		double				diffGameTime;	/**< frame time since step */
+		uint32_t *			pixels;		/**< composed frame */
+		unsigned char *			output;		/**< converted frame */
+		size_t				outputLength;
+	} export_frame;
+
+	WormikGame *			game;			/**< game interface */
+
+	SdlSeasonLoader			seasonLoader;		/**< decodes season images */
+	SoftCompositor			compositor;		/**< draws frame parts */
+	uint32_t *			basicScreen;		/**< static board and panels of level */
+
+	ReplayPlayer			replay;			/**< played replay */
+
+	FILE *				output;			/**< video output */
+	int				format;			/**< FORMAT_* */
+	int				fps;			/**< frames per second of video */
+
+	SDL_Thread *			threads[MAX_THREADS];	/**< composing workers */
+	unsigned			threadsCount;
+	export_frame *			frames;			/**< ring of frames in flight */
+	unsigned			framesCount;
+	SDL_mutex *			lock;			/**< protects frames states */
+	SDL_cond *			changed;		/**< signalled when frame state changes */
+	bool				aborted;		/**< workers should stop */
+	unsigned long			nextSeq;		/**< next frame to capture */
+	unsigned long			nextWrite;		/**< next frame to write */
+
+	double				gameTime;		/**< game time at current step */
+	double				diffGameTime;		/**< time of captured frame since step */
+
+	double				statsStart;		/**< export start */
+
+public:
+	/* constructor */		ExportWormikGui();
+	virtual				~ExportWormikGui();
+
+public:
+	virtual int			init(WormikGame *game);
+	virtual void			shutdown(WormikGame *game);
+	virtual int			newLevel(int season);
+
+	virtual void			drawStatic(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual void			drawPoint(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual int			drawNewdef(void *gc, unsigned x, unsigned y, unsigned short type, double timeout, double total);
+
+	virtual void			invalidateOutput(int len, unsigned (*points)[2]);
+
+	virtual bool			waitStart();
+	virtual bool			waitNext(double interval);
+	virtual bool			announce(int type);
+
+protected:
+	void				closeGui();
+
+	/** captures frames until game time advances by duration */
+	void				captureFrames(double duration, int announcement);
+	void				capture(int announcement);
+	/** writes finished frames in order, waits for frame to be free if given, called locked */
+	void				writeFrames(export_frame *waitFree);
+	void				writeAll();
+
+	static int			threadMain(void *self);
+	void				compose(export_frame *frame);
+	void				convert(export_frame *frame);
+};
+
+static double getDoubleTime(void)
+{
+	return (double)SDL_GetPerformanceCounter()/SDL_GetPerformanceFrequency();
+}
+
+const double ExportWormikGui::START_TIME = 0.5;
+const double ExportWormikGui::ANNOUNCE_TIME = 1.5;
+
+ExportWormikGui::ExportWormikGui()
+{
+	game = NULL;
+	basicScreen = NULL;
+	output = NULL;
+	format = FORMAT_Y4M;
+	fps = 30;
+	threadsCount = 0;
+	frames = NULL;
+	framesCount = 0;
+	lock = NULL;
+	changed = NULL;
+	aborted = false;
+	nextSeq = 0;
+	nextWrite = 0;
+	gameTime = 0;
+	diffGameTime = 0;
+	statsStart = 0;
+
+	static_assert((int)SoftCompositor::CLR_COUNT <= (int)SdlSeasonLoader::MAX_COLORS);
+}
+
+ExportWormikGui::~ExportWormikGui()
+{
+	closeGui();
+}
+
+int ExportWormikGui::init(WormikGame *game_)
+{
+	char buf[PATH_MAX];
+	const blit_kernels *kernels;
+	int workers;
+	game = game_;
+
+	if ((unsigned)game->getConfigStr("replay", buf, sizeof(buf)) >= sizeof(buf)) {
+		game->error("Replay to export not set, use -o replay=file\n");
+		return -1;
+	}
+	if (replay.open(game, buf) < 0) {
+		game->error("Failed to read replay %s: %s\n", buf, strerror(errno));
+		return -1;
+	}
+
+	if ((unsigned)game->getConfigStr("exportformat", buf, sizeof(buf)) >= sizeof(buf) || strcmp(buf, "y4m") == 0) {
+		format = FORMAT_Y4M;
+	}
+	else if (strcmp(buf, "rgba") == 0) {
+		format = FORMAT_RGBA;
+	}
+	else {
+		game->error("Unknown export format %s, use y4m or rgba\n", buf);
+		return -1;
+	}
+	if ((fps = game->getConfigInt("fps", 30)) <= 0) {
+		game->error("Invalid fps\n");
+		return -1;
+	}
+	if ((unsigned)game->getConfigStr("simd", buf, sizeof(buf)) >= sizeof(buf))
+		strcpy(buf, "auto");
+	if ((kernels = selectBlitKernels(buf)) == NULL) {
+		game->error("Blitting kernels %s not supported\n", buf);
+		return -1;
+	}
+
+	if (SDL_Init(SDL_INIT_TIMER) < 0) {
+		game->error("Couldn't init SDL: %s\n", SDL_GetError());
+		return -1;
+	}
+	if ((unsigned)game->getConfigStr("export", buf, sizeof(buf)) >= sizeof(buf) || strcmp(buf, "-") == 0) {
+		output = stdout;
+	}
+	else if ((output = fopen(buf, "wb")) == NULL) {
+		game->error("Failed to create %s: %s\n", buf, strerror(errno));
+		goto err;
+	}
+	if (format == FORMAT_Y4M && fprintf(output, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", FRAME_WIDTH, FRAME_HEIGHT, fps) < 0) {
+		game->error("Failed to write video header: %s\n", strerror(errno));
+		goto err;
+	}
+
+	if ((unsigned)game->getConfigStr("datapath", buf, sizeof(buf)) >= sizeof(buf))
+		buf[0] = '\0';
+	if (seasonLoader.start(buf, GRECT_XSIZE, GRECT_YSIZE, 0) < 0) {
+		game->error("Couldn't start season loader: %s\n", SDL_GetError());
+		goto err;
+	}
+	if (compositor.init(kernels) < 0 || (basicScreen = (uint32_t *)malloc(FRAME_WIDTH*FRAME_HEIGHT*sizeof(uint32_t))) == NULL) {
+		game->error("Couldn't allocate frame buffers\n");
+		goto err;
+	}
+
+	workers = game->getConfigInt("threads", SDL_GetCPUCount());
+	threadsCount = workers < 1 ? 1 : workers > MAX_THREADS ? MAX_THREADS : workers;
+	// two frames per worker, so workers don't wait for writing
+	framesCount = 2*threadsCount;
+	if ((frames = (export_frame *)calloc(framesCount, sizeof(export_frame))) == NULL) {
+		game->error("Couldn't allocate frames\n");
+		goto err;
+	}
+	for (unsigned i = 0; i < framesCount; i++) {
+		frames[i].pixels = (uint32_t *)malloc(FRAME_WIDTH*FRAME_HEIGHT*sizeof(uint32_t));
+		// rgba is the larger one
+		frames[i].output = (unsigned char *)malloc(16+FRAME_WIDTH*FRAME_HEIGHT*4);
+		if (!frames[i].pixels || !frames[i].output) {
+			game->error("Couldn't allocate frames\n");
+			goto err;
+		}
+	}
+	if ((lock = SDL_CreateMutex()) == NULL || (changed = SDL_CreateCond()) == NULL) {
+		game->error("Couldn't create workers synchronization: %s\n", SDL_GetError());
+		goto err;
+	}
+	for (unsigned i = 0; i < threadsCount; i++) {
+		if ((threads[i] = SDL_CreateThread(&threadMain, "wormik export", this)) == NULL) {
+			game->error("Couldn't create worker: %s\n", SDL_GetError());
+			threadsCount = i;
+			goto err;
+		}
+	}
+	game->debug("Exporting with %u workers, %s blitting kernels\n", threadsCount, kernels->name);
+	statsStart = getDoubleTime();
+	return 0;
+
+err:
+	closeGui();
+	SDL_Quit();
+	return -1;
+}
+
+void ExportWormikGui::closeGui()
+{
+	if (lock) {
+		SDL_LockMutex(lock);
+		aborted = true;
+		SDL_CondBroadcast(changed);
+		SDL_UnlockMutex(lock);
+	}
+	for (unsigned i = 0; i < threadsCount; i++)
+		SDL_WaitThread(threads[i], NULL);
+	threadsCount = 0;
+	if (changed) {
+		SDL_DestroyCond(changed);
+		changed = NULL;
+	}
+	if (lock) {
+		SDL_DestroyMutex(lock);
+		lock = NULL;
+	}
+	if (frames) {
+		for (unsigned i = 0; i < framesCount; i++) {
+			free(frames[i].pixels);
+			free(frames[i].output);
+		}
+		free(frames);
+		frames = NULL;
+	}
+	seasonLoader.stop();
+	compositor.close();
+	free(basicScreen);
+	basicScreen = NULL;
+	if (output) {
+		if (output != stdout)
+			fclose(output);
+		else
+			fflush(output);
+		output = NULL;
+	}
+	replay.close();
+}
+
+void ExportWormikGui::shutdown(WormikGame *game)
+{
+	if (lock) {
+		writeAll();
+		double t = getDoubleTime()-statsStart;
+		game->debug("Exported %lu frames (%.1f s of video) in %.3f s, %.1f frames/s\n", nextWrite, (double)nextWrite/fps, t, nextWrite/t);
+	}
+	closeGui();
+	SDL_Quit();
+}
+
+int ExportWormikGui::newLevel(int season)
+{
+	// workers read compositor and basic screen, let them finish first
+	writeAll();
+
+	if (seasonLoader.wait(season) != SdlSeasonLoader::SL_READY) {
+		if (season == 0 || seasonLoader.wait(0) != SdlSeasonLoader::SL_READY)
+			game->fatal("failed to load season image: %s\n", seasonLoader.getError(season));
+		season = 0;
+	}
+	if (compositor.loadSeason(seasonLoader.getIcons(season), seasonLoader.getColors(season)) < 0)
+		game->fatal("cannot convert season image: %s\n", SDL_GetError());
+	WormikGame::board_view view;
+	game->getBoardView(&view);
+	compositor.drawStatics(basicScreen, &view);
+	compositor.drawMenu(basicScreen);
+	compositor.drawDesc(basicScreen);
+	return season;
+}
+
+void ExportWormikGui::drawStatic(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	compositor.drawCell(basicScreen, x, y, cont);
+}
+
+void ExportWormikGui::drawPoint(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	SoftCompositor::snapshotPoint((board_snapshot *)gc, x, y, cont);
+}
+
+int ExportWormikGui::drawNewdef(void *gc, unsigned x, unsigned y, unsigned short cont, double timeout, double total)
+{
+	SoftCompositor::snapshotNewdef((board_snapshot *)gc, x, y, cont, timeout, total);
+	return timeout > diffGameTime;
+}
+
+void ExportWormikGui::invalidateOutput(int len, unsigned (*points)[2])
+{
+	// every frame is captured whole
+}
+
+void ExportWormikGui::captureFrames(double duration, int announcement)
+{
+	// frame times are derived from frame number, so there is no drift
+	for (;;) {
+		double frameTime = (double)nextSeq/fps;
+		if (frameTime >= gameTime+duration)
+			break;
+		diffGameTime = frameTime-gameTime;
+		capture(announcement);
+	}
+	gameTime += duration;
+}
+
+void ExportWormikGui::capture(int announcement)
+{
+	export_frame *frame = &frames[nextSeq%framesCount];
+
+	SDL_LockMutex(lock);
+	writeFrames(frame);
+	SDL_UnlockMutex(lock);
+
+	// frame is free, no worker touches it
+	frame->seq = nextSeq++;
+	frame->diffGameTime = diffGameTime;
+	board_snapshot *snapshot = &frame->snapshot;
+	WormikGame::board_view view;
+	game->getBoardView(&view);
+	SoftCompositor::resetSnapshot(snapshot);
+	SoftCompositor::snapshotBoard(snapshot, &view);
+	snapshot->recordNow = game->getRecord(&snapshot->record, &snapshot->rectime);
+	game->getState(&snapshot->level, NULL);
+	snapshot->exit = game->getScore(&snapshot->score, &snapshot->total);
+	game->getSnakeInfo(&snapshot->health, &snapshot->length);
+	snapshot->announce = announcement;
+
+	SDL_LockMutex(lock);
+	frame->state = EF_QUEUED;
+	SDL_CondBroadcast(changed);
+	SDL_UnlockMutex(lock);
+}
+
+void ExportWormikGui::writeFrames(export_frame *waitFree)
+{
+	for (;;) {
+		export_frame *next = &frames[nextWrite%framesCount];
+		if (nextWrite < nextSeq && next->state == EF_DONE) {
+			SDL_UnlockMutex(lock);
+			if (fwrite(next->output, 1, next->outputLength, output) != next->outputLength)
+				game->fatal("failed to write video: %s\n", strerror(errno));
+			SDL_LockMutex(lock);
+			next->state = EF_FREE;
+			nextWrite++;
+			continue;
+		}
+		if (waitFree == NULL ? nextWrite >= nextSeq : waitFree->state == EF_FREE)
+			break;
+		SDL_CondWait(changed, lock);
+	}
+}
+
+void ExportWormikGui::writeAll()
+{
+	SDL_LockMutex(lock);
+	writeFrames(NULL);
+	SDL_UnlockMutex(lock);
+}
+
+int ExportWormikGui::threadMain(void *self_)
+{
+	ExportWormikGui *self = (ExportWormikGui *)self_;
+
+	SDL_LockMutex(self->lock);
+	for (;;) {
+		export_frame *frame = NULL;
+		// oldest queued frame first, keeps the writer busy
+		for (unsigned i = 0; i < self->framesCount; i++) {
+			export_frame *f = &self->frames[i];
+			if (f->state == EF_QUEUED && (frame == NULL || f->seq < frame->seq))
+				frame = f;
+		}
+		if (frame == NULL) {
+			if (self->aborted)
+				break;
+			SDL_CondWait(self->changed, self->lock);
+			continue;
+		}
+		frame->state = EF_COMPOSING;
+		SDL_UnlockMutex(self->lock);
+
+		self->compose(frame);
+		self->convert(frame);
+
+		SDL_LockMutex(self->lock);
+		frame->state = EF_DONE;
+		SDL_CondBroadcast(self->changed);
+	}
+	SDL_UnlockMutex(self->lock);
+	return 0;
+}
+
+void ExportWormikGui::compose(export_frame *frame)
+{
+	compositor.drawSnapshot(frame->pixels, basicScreen, &frame->snapshot, frame->diffGameTime);
+}
+
+void ExportWormikGui::convert(export_frame *frame)
+{
+	const uint32_t *p = frame->pixels;
+	unsigned char *o = frame->output;
+
+	switch (format) {
+	case FORMAT_RGBA:
+		for (unsigned i = 0; i < FRAME_WIDTH*FRAME_HEIGHT; i++) {
+			*o++ = p[i]>>16;
+			*o++ = p[i]>>8;
+			*o++ = p[i]>>0;
+			*o++ = 0xff;
+		}
+		break;
+
+	case FORMAT_Y4M:
+		{
+			// BT.601 limited range, chroma averaged over 2x2 pixels
+			unsigned char *yp, *up, *vp;
+			memcpy(o, "FRAME\n", 6);
+			yp = o+6;
+			up = yp+FRAME_WIDTH*FRAME_HEIGHT;
+			vp = up+FRAME_WIDTH*FRAME_HEIGHT/4;
+			for (unsigned i = 0; i < FRAME_WIDTH*FRAME_HEIGHT; i++) {
+				int r = (p[i]>>16)&0xff, g = (p[i]>>8)&0xff, b = p[i]&0xff;
+				yp[i] = ((66*r+129*g+25*b+128)>>8)+16;
+			}
+			for (unsigned y = 0; y < FRAME_HEIGHT; y += 2) {
+				for (unsigned x = 0; x < FRAME_WIDTH; x += 2) {
+					const uint32_t *q = p+y*FRAME_WIDTH+x;
+					int r = ((q[0]>>16)&0xff)+((q[1]>>16)&0xff)+((q[FRAME_WIDTH]>>16)&0xff)+((q[FRAME_WIDTH+1]>>16)&0xff);
+					int g = ((q[0]>>8)&0xff)+((q[1]>>8)&0xff)+((q[FRAME_WIDTH]>>8)&0xff)+((q[FRAME_WIDTH+1]>>8)&0xff);
+					int b = (q[0]&0xff)+(q[1]&0xff)+(q[FRAME_WIDTH]&0xff)+(q[FRAME_WIDTH+1]&0xff);
+					*up++ = ((-38*r-74*g+112*b+512)>>10)+128;
+					*vp++ = ((112*r-94*g-18*b+512)>>10)+128;
+				}
+			}
+			o = vp;
+		}
+		break;
+	}
+	frame->outputLength = o-frame->output;
+}
+
+bool ExportWormikGui::waitStart()
+{
+	captureFrames(START_TIME, -1);
+	return replay.finishWait();
+}
+
+bool ExportWormikGui::waitNext(double interval)
+{
+	captureFrames(interval, -1);
+	return replay.finishWait();
+}
+
+bool ExportWormikGui::announce(int announcement)
+{
+	captureFrames(ANNOUNCE_TIME, announcement);
+	// replay without quit event (game killed) ends with the first announcement after it
+	return replay.finishWait() || replay.isFinished();
+}
+
+WormikGui *create_ExportWormikGui()
+{
+	return new ExportWormikGui();
+}
+
+
+} } } };
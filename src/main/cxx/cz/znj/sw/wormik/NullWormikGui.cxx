@@ -0,0 +1,42 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Gui of games driven without display (environments, tournaments)
+ */
+
+#include <time.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/**
+ * Nothing is drawn and nobody waits, games are stepped by caller through
+ * startLevel() and stepGame(). Stateless, so single instance can be shared
+ * by many games and threads.
+ */
+class NullWormikGui: public WormikGui
+{
+public:
+	virtual int			init(WormikGame *game)					{ return 0; }
+	virtual void			shutdown(WormikGame *game)				{}
+	virtual int			newLevel(int season)					{ return stockSeason(season); }
+	virtual void			drawStatic(void *gc, unsigned x, unsigned y, unsigned short cont) {}
+	virtual void			drawPoint(void *gc, unsigned x, unsigned y, unsigned short cont) {}
+	virtual int			drawNewdef(void *gc, unsigned x, unsigned y, unsigned short newcont, double left, double total) { return 0; }
+	virtual void			invalidateOutput(int length, unsigned (*points)[2])	{}
+	virtual bool			waitStart()						{ return true; }
+	virtual bool			waitNext(double interval)				{ return true; }
+	virtual bool			announce(int type)					{ return true; }
+};
+
+WormikGui *create_NullWormikGui()
+{
+	return new NullWormikGui();
+}
+
+
+} } } };
@@ -0,0 +1,284 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL background season image loader
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/resource_resolver.hxx"
+
+#include "cz/znj/sw/wormik/SdlSeasonLoader.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+using namespace gui4x6x16;
+
+
+static void unpackColors(SDL_Color *colors, const pack_entry *entry)
+{
+	for (unsigned i = 0; i < PACK_COLORS; i++) {
+		colors[i].r = (Uint8)(entry->colors[i]>>16);
+		colors[i].g = (Uint8)(entry->colors[i]>>8);
+		colors[i].b = (Uint8)(entry->colors[i]>>0);
+		colors[i].a = 255;
+	}
+}
+
+SdlSeasonLoader::SdlSeasonLoader()
+{
+	memset(seasons, 0, sizeof(seasons));
+	thread = NULL;
+	lock = NULL;
+	changed = NULL;
+	aborted = false;
+	tileWidth = 0;
+	tileHeight = 0;
+	readyEvent = 0;
+}
+
+SdlSeasonLoader::~SdlSeasonLoader()
+{
+	stop();
+}
+
+int SdlSeasonLoader::start(const char *dataPath, int tileWidth_, int tileHeight_, Uint32 readyEvent_)
+{
+	char fname[32];
+	char path[PATH_MAX];
+	bool missing = false;
+
+	if (thread && tileWidth == tileWidth_ && tileHeight == tileHeight_)
+		return 0;
+	stop();
+
+	tileWidth = tileWidth_;
+	tileHeight = tileHeight_;
+	readyEvent = readyEvent_;
+	aborted = false;
+	if (dataPath == NULL || dataPath[0] == '\0')
+		dataPath = ".";
+	// paths are resolved here, resolver is not thread safe
+	if (resolveResource(path, sizeof(path), "wormik.pak", "d", RESOURCE_DIR, "d", dataPath, NULL) == 0)
+		pack.open(path);
+	for (int season = 0; season < MAX_SEASONS; season++) {
+		season_data *data = &seasons[season];
+		const pack_entry *scaled;
+		data->packed = NULL;
+		data->state = SL_MISSING;
+		if (missing)
+			continue;
+		if ((scaled = pack.find(season, tileWidth, tileHeight)) != NULL) {
+			// already in requested size, surface only wraps the mapping
+			if ((data->icons = wrapPacked(scaled)) == NULL)
+				goto err;
+			unpackColors(data->colors, scaled);
+			data->state = SL_READY;
+			continue;
+		}
+		if ((data->packed = pack.find(season, GRECT_XSIZE, GRECT_YSIZE)) != NULL) {
+			data->state = SL_PENDING;
+			continue;
+		}
+		snprintf(fname, sizeof(fname), "wormik_%d.png", season);
+		if (resolveResource(data->path, sizeof(data->path), fname, "d", RESOURCE_DIR, "d", dataPath, NULL) < 0) {
+			data->state = SL_MISSING;
+			snprintf(data->error, sizeof(data->error), "failed to find %s", fname);
+			missing = true;
+		}
+		else {
+			data->state = SL_PENDING;
+		}
+	}
+	if ((lock = SDL_CreateMutex()) == NULL || (changed = SDL_CreateCond()) == NULL)
+		goto err;
+	if ((thread = SDL_CreateThread(&threadMain, "season loader", this)) == NULL)
+		goto err;
+	return 0;
+
+err:
+	stop();
+	return -1;
+}
+
+void SdlSeasonLoader::stop()
+{
+	if (thread) {
+		SDL_LockMutex(lock);
+		aborted = true;
+		SDL_UnlockMutex(lock);
+		SDL_WaitThread(thread, NULL);
+		thread = NULL;
+	}
+	if (changed) {
+		SDL_DestroyCond(changed);
+		changed = NULL;
+	}
+	if (lock) {
+		SDL_DestroyMutex(lock);
+		lock = NULL;
+	}
+	for (int season = 0; season < MAX_SEASONS; season++) {
+		if (seasons[season].icons) {
+			SDL_FreeSurface(seasons[season].icons);
+			seasons[season].icons = NULL;
+		}
+		seasons[season].packed = NULL;
+		seasons[season].state = SL_MISSING;
+	}
+	// surfaces may point to the mapping, so it is closed last
+	pack.close();
+	tileWidth = tileHeight = 0;
+}
+
+int SdlSeasonLoader::wait(int season)
+{
+	int state;
+	if (season < 0 || season >= MAX_SEASONS || !thread)
+		return SL_MISSING;
+	SDL_LockMutex(lock);
+	while ((state = seasons[season].state) == SL_PENDING)
+		SDL_CondWait(changed, lock);
+	SDL_UnlockMutex(lock);
+	return state;
+}
+
+int SdlSeasonLoader::poll(int season)
+{
+	int state;
+	if (season < 0 || season >= MAX_SEASONS || !thread)
+		return SL_MISSING;
+	SDL_LockMutex(lock);
+	state = seasons[season].state;
+	SDL_UnlockMutex(lock);
+	return state;
+}
+
+int SdlSeasonLoader::threadMain(void *self_)
+{
+	SdlSeasonLoader *self = (SdlSeasonLoader *)self_;
+	for (int season = 0; season < MAX_SEASONS; season++) {
+		season_data *data = &self->seasons[season];
+		bool stop;
+		SDL_LockMutex(self->lock);
+		stop = self->aborted || data->state == SL_MISSING;
+		SDL_UnlockMutex(self->lock);
+		if (stop)
+			break;
+		if (data->state != SL_PENDING)
+			continue;
+		// decoding runs unlocked, data is not accessed by others until
+		// state changes
+		self->decode(data);
+		SDL_LockMutex(self->lock);
+		data->state = data->icons ? SL_READY : SL_FAILED;
+		SDL_CondBroadcast(self->changed);
+		SDL_UnlockMutex(self->lock);
+		if (self->readyEvent != 0) {
+			SDL_Event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.type = self->readyEvent;
+			ev.user.code = season;
+			SDL_PushEvent(&ev);
+		}
+	}
+	return 0;
+}
+
+SDL_Surface *SdlSeasonLoader::wrapPacked(const pack_entry *entry)
+{
+	return SDL_CreateRGBSurfaceWithFormatFrom(pack.getPixels(entry), entry->width, entry->height, 32, entry->pitch, pack.getPixelFormat());
+}
+
+void SdlSeasonLoader::decode(season_data *data)
+{
+	SDL_Surface *base;
+
+	if (!data->packed) {
+		decodePng(data);
+		return;
+	}
+	// pack has only base size, scaling is still needed but no decoding
+	unpackColors(data->colors, data->packed);
+	base = wrapPacked(data->packed);
+	data->icons = SDL_CreateRGBSurfaceWithFormat(0, SIMG_WIDTH*tileWidth/GRECT_XSIZE, SIMG_HEIGTH*tileHeight/GRECT_YSIZE, 32, pack.getPixelFormat());
+	if (!base || !data->icons) {
+		snprintf(data->error, sizeof(data->error), "cannot create season surfaces: %s", SDL_GetError());
+	}
+	else {
+		SDL_SetSurfaceBlendMode(base, SDL_BLENDMODE_NONE);
+		if (SDL_BlitScaled(base, NULL, data->icons, NULL) < 0) {
+			snprintf(data->error, sizeof(data->error), "cannot scale season image: %s", SDL_GetError());
+		}
+		else {
+			SDL_FreeSurface(base);
+			return;
+		}
+	}
+	if (base)
+		SDL_FreeSurface(base);
+	if (data->icons) {
+		SDL_FreeSurface(data->icons);
+		data->icons = NULL;
+	}
+}
+
+void SdlSeasonLoader::decodePng(season_data *data)
+{
+	SDL_Surface *img, *onlyIcons;
+
+	if (!(img = IMG_Load(data->path))) {
+		snprintf(data->error, sizeof(data->error), "failed to process image %s: %s", data->path, SDL_GetError());
+		return;
+	}
+	if (img->w != SIMG_WIDTH || img->h != SIMG_HEIGTH+1 || img->format->BytesPerPixel != 4) {
+		snprintf(data->error, sizeof(data->error), "%s: image has to be %dx%dx32 sized (is %dx%dx%d)", data->path, SIMG_WIDTH, SIMG_HEIGTH+1, img->w, img->h, img->format->BytesPerPixel*8);
+		SDL_FreeSurface(img);
+		return;
+	}
+
+	SDL_LockSurface(img);
+	// find basic drawing colors, these have alpha 0 in original image
+	for (unsigned i = 0; i < MAX_COLORS; ++i) {
+		Uint8 a;
+		SDL_GetRGBA(*(Uint32 *)((char *)img->pixels+SIMG_HEIGTH*img->pitch+i*img->format->BytesPerPixel), img->format, &data->colors[i].r, &data->colors[i].g, &data->colors[i].b, &a);
+		data->colors[i].a = 255;
+	}
+
+	onlyIcons = SDL_CreateRGBSurfaceFrom((char *)img->pixels, img->w, SIMG_HEIGTH, img->format->BitsPerPixel, img->pitch, img->format->Rmask, img->format->Gmask, img->format->Bmask, img->format->Amask);
+	// scale once here, so the tiles are drawn 1:1 later
+	data->icons = SDL_CreateRGBSurface(0, SIMG_WIDTH*tileWidth/GRECT_XSIZE, SIMG_HEIGTH*tileHeight/GRECT_YSIZE, img->format->BitsPerPixel, img->format->Rmask, img->format->Gmask, img->format->Bmask, img->format->Amask);
+	if (!onlyIcons || !data->icons) {
+		snprintf(data->error, sizeof(data->error), "cannot create season surfaces: %s", SDL_GetError());
+	}
+	else {
+		SDL_SetSurfaceBlendMode(onlyIcons, SDL_BLENDMODE_NONE);
+		if (SDL_BlitScaled(onlyIcons, NULL, data->icons, NULL) < 0) {
+			snprintf(data->error, sizeof(data->error), "cannot scale season image: %s", SDL_GetError());
+			SDL_FreeSurface(data->icons);
+			data->icons = NULL;
+		}
+	}
+	SDL_UnlockSurface(img);
+	if (onlyIcons)
+		SDL_FreeSurface(onlyIcons);
+	if (!onlyIcons && data->icons) {
+		SDL_FreeSurface(data->icons);
+		data->icons = NULL;
+	}
+	SDL_FreeSurface(img);
+}
+
+
+} } } };
@@ -0,0 +1,124 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL background season image loader
+ */
+
+#ifndef SdlSeasonLoader_hxx__
+# define SdlSeasonLoader_hxx__
+
+#include <limits.h>
+
+#include <SDL2/SDL.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/resource_pack.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/**
+ * Decodes all season images on background thread, once per tile size.
+ *
+ * Decoded images are kept as surfaces already scaled to tile size, so
+ * the textures can be (re)created from them without touching the disk.
+ * When resource pack is available, the images are taken from it without
+ * decoding, directly from the mapping if the tile size is pre-scaled.
+ * Only surfaces are handled here, textures must be created by the
+ * renderer thread.
+ */
+class SdlSeasonLoader
+{
+public:
+	enum {
+		MAX_SEASONS		= 16,
+		MAX_COLORS		= PACK_COLORS,		/**< basic colors read from image */
+	};
+
+	enum {
+		SL_PENDING		= 0,			/**< not decoded yet */
+		SL_READY		= 1,			/**< decoded, icons and colors valid */
+		SL_MISSING		= 2,			/**< no such season */
+		SL_FAILED		= 3,			/**< image invalid, see error */
+	};
+
+protected:
+	typedef struct season_data
+	{
+		int				state;		/**< see SL_* */
+		char				path[PATH_MAX];	/**< resolved image file */
+		const pack_entry *		packed;		/**< base image in pack, NULL to decode png */
+		SDL_Surface *			icons;		/**< tiles scaled to tile size */
+		SDL_Color			colors[MAX_COLORS];	/**< basic drawing colors */
+		char				error[256];	/**< error description for SL_FAILED */
+	} season_data;
+
+	season_data			seasons[MAX_SEASONS];	/**< decoded seasons */
+	ResourcePack			pack;			/**< pre-decoded images, if found */
+	SDL_Thread *			thread;			/**< decoding thread */
+	SDL_mutex *			lock;			/**< protects seasons states */
+	SDL_cond *			changed;		/**< signalled when season state changes */
+	bool				aborted;		/**< decoding thread should stop */
+	int				tileWidth;		/**< tile size the images are scaled to */
+	int				tileHeight;
+	Uint32				readyEvent;		/**< event pushed when season is decoded, 0 for none */
+
+public:
+	/* constructor */		SdlSeasonLoader();
+	/* destructor */		~SdlSeasonLoader();
+
+public:
+	/**
+	 * starts decoding seasons found in dataPath or RESOURCE_DIR (pack or
+	 * png files), does nothing when already started with the same tile
+	 * size
+	 */
+	int				start(const char *dataPath, int tileWidth, int tileHeight, Uint32 readyEvent);
+	void				stop();
+
+	/** returns season state, waits until it is decoded */
+	int				wait(int season);
+	/** returns season state without waiting */
+	int				poll(int season);
+
+	/** returns true if images come from resource pack */
+	bool				isPacked() const;
+
+	/* accessors, valid only for SL_READY (or SL_FAILED for error) state */
+	SDL_Surface *			getIcons(int season) const;
+	const SDL_Color *		getColors(int season) const;
+	const char *			getError(int season) const;
+
+protected:
+	static int			threadMain(void *self);
+	void				decode(season_data *data);
+	void				decodePng(season_data *data);
+	SDL_Surface *			wrapPacked(const pack_entry *entry);
+};
+
+inline bool SdlSeasonLoader::isPacked() const
+{
+	return pack.isOpen();
+}
+
+inline SDL_Surface *SdlSeasonLoader::getIcons(int season) const
+{
+	return seasons[season].icons;
+}
+
+inline const SDL_Color *SdlSeasonLoader::getColors(int season) const
+{
+	return seasons[season].colors;
+}
+
+inline const char *SdlSeasonLoader::getError(int season) const
+{
+	return seasons[season].error;
+}
+
+
+} } } };
+
+#endif
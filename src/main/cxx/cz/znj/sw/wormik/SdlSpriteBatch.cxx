@@ -0,0 +1,59 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL sprite batcher
+ */
+
+#include <assert.h>
+
+#include "cz/znj/sw/wormik/SdlSpriteBatch.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+SdlSpriteBatch::SdlSpriteBatch()
+{
+	renderer = NULL;
+	texture = NULL;
+	texXScale = texYScale = 0;
+	quads = 0;
+	flushes = 0;
+	for (unsigned i = 0; i < MAX_QUADS; i++) {
+		indices[i*6+0] = i*4+0; indices[i*6+1] = i*4+1; indices[i*6+2] = i*4+2;
+		indices[i*6+3] = i*4+0; indices[i*6+4] = i*4+2; indices[i*6+5] = i*4+3;
+	}
+}
+
+void SdlSpriteBatch::setRenderer(SDL_Renderer *renderer_)
+{
+	renderer = renderer_;
+	texture = NULL;
+	quads = 0;
+}
+
+void SdlSpriteBatch::begin(SDL_Texture *texture_)
+{
+	int w, h;
+	if (texture_ == texture)
+		return;
+	flush();
+	texture = texture_;
+	if (SDL_QueryTexture(texture, NULL, NULL, &w, &h) < 0) {
+		w = h = 1;
+	}
+	texXScale = 1.0f/w; texYScale = 1.0f/h;
+}
+
+void SdlSpriteBatch::flush()
+{
+	if (quads == 0)
+		return;
+	assert(renderer != NULL && texture != NULL);
+	SDL_RenderGeometry(renderer, texture, vertices, quads*4, indices, quads*6);
+	quads = 0;
+	flushes++;
+}
+
+
+} } } };
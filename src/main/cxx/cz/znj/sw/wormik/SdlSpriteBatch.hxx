@@ -0,0 +1,91 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL sprite batcher
+ */
+
+#ifndef SdlSpriteBatch_hxx__
+# define SdlSpriteBatch_hxx__
+
+#include <SDL2/SDL.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/**
+ * Collects textured quads from single texture and submits them with one
+ * SDL_RenderGeometry call.
+ */
+class SdlSpriteBatch
+{
+public:
+	enum {
+		MAX_QUADS		= 1024,
+	};
+
+protected:
+	SDL_Renderer *			renderer;		/**< renderer to submit to */
+	SDL_Texture *			texture;		/**< current atlas */
+	float				texXScale;		/**< 1/texture width */
+	float				texYScale;		/**< 1/texture height */
+
+	unsigned			quads;			/**< number of quads collected */
+	SDL_Vertex			vertices[MAX_QUADS*4];	/**< collected vertices */
+	int				indices[MAX_QUADS*6];	/**< constant indices, two triangles per quad */
+
+	unsigned			flushes;		/**< number of submits since resetStats() */
+
+public:
+	/* constructor */		SdlSpriteBatch();
+
+public:
+	void				setRenderer(SDL_Renderer *renderer);
+
+	/** starts collecting quads from texture, flushing pending ones if different */
+	void				begin(SDL_Texture *texture);
+	/** adds quad, alpha is multiplied with texture alpha */
+	void				add(const SDL_Rect *s, const SDL_Rect *d, Uint8 alpha = 255);
+	/** adds quad, color is multiplied with texture color */
+	void				add(const SDL_Rect *s, const SDL_Rect *d, SDL_Color color);
+	/** submits collected quads */
+	void				flush();
+
+	unsigned			getFlushes() const;
+	void				resetStats();
+};
+
+inline void SdlSpriteBatch::add(const SDL_Rect *s, const SDL_Rect *d, Uint8 alpha)
+{
+	SDL_Color c = { 255, 255, 255, alpha };
+	add(s, d, c);
+}
+
+inline void SdlSpriteBatch::add(const SDL_Rect *s, const SDL_Rect *d, SDL_Color c)
+{
+	if (quads == MAX_QUADS)
+		flush();
+	SDL_Vertex *v = vertices+quads*4;
+	float sx0 = s->x*texXScale, sy0 = s->y*texYScale, sx1 = (s->x+s->w)*texXScale, sy1 = (s->y+s->h)*texYScale;
+	float dx0 = d->x, dy0 = d->y, dx1 = d->x+d->w, dy1 = d->y+d->h;
+	v[0].position.x = dx0; v[0].position.y = dy0; v[0].color = c; v[0].tex_coord.x = sx0; v[0].tex_coord.y = sy0;
+	v[1].position.x = dx1; v[1].position.y = dy0; v[1].color = c; v[1].tex_coord.x = sx1; v[1].tex_coord.y = sy0;
+	v[2].position.x = dx1; v[2].position.y = dy1; v[2].color = c; v[2].tex_coord.x = sx1; v[2].tex_coord.y = sy1;
+	v[3].position.x = dx0; v[3].position.y = dy1; v[3].color = c; v[3].tex_coord.x = sx0; v[3].tex_coord.y = sy1;
+	quads++;
+}
+
+inline unsigned SdlSpriteBatch::getFlushes() const
+{
+	return flushes;
+}
+
+inline void SdlSpriteBatch::resetStats()
+{
+	flushes = 0;
+}
+
+
+} } } };
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL cached text renderer
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "cz/znj/sw/wormik/embedded_font.hxx"
+
+#include "cz/znj/sw/wormik/SdlSpriteBatch.hxx"
+
+#include "cz/znj/sw/wormik/SdlTextCache.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+SdlTextCache::SdlTextCache()
+{
+	atlas = NULL;
+	lineHeight = 0;
+	memset(glyphs, 0, sizeof(glyphs));
+	memset(entries, 0, sizeof(entries));
+	useCounter = 0;
+	statsHits = 0;
+	statsMisses = 0;
+}
+
+SdlTextCache::~SdlTextCache()
+{
+	close();
+}
+
+int SdlTextCache::init(SDL_Renderer *renderer, TTF_Font *font)
+{
+	SDL_Surface *gs[GLYPH_COUNT];
+	SDL_Surface *as;
+	SDL_Color white = { 255, 255, 255, 255 };
+	SDL_Rect d;
+	int rowHeight;
+	int err = -1;
+
+	close();
+	memset(gs, 0, sizeof(gs));
+
+	lineHeight = TTF_FontHeight(font);
+	d.x = 0; d.y = 0; rowHeight = 0;
+	for (unsigned i = 0; i < GLYPH_COUNT; i++) {
+		int minx, maxx, miny, maxy, advance;
+		if ((gs[i] = TTF_RenderGlyph_Blended(font, FIRST_GLYPH+i, white)) == NULL) {
+			// keep the surface for space
+			if ((gs[i] = SDL_CreateRGBSurfaceWithFormat(0, 1, lineHeight, 32, SDL_PIXELFORMAT_ARGB8888)) == NULL)
+				goto out;
+		}
+		if (TTF_GlyphMetrics(font, FIRST_GLYPH+i, &minx, &maxx, &miny, &maxy, &advance) < 0)
+			advance = gs[i]->w;
+		if (d.x+gs[i]->w > ATLAS_WIDTH) {
+			d.x = 0; d.y += rowHeight; rowHeight = 0;
+		}
+		glyphs[i].src.x = d.x; glyphs[i].src.y = d.y; glyphs[i].src.w = gs[i]->w; glyphs[i].src.h = gs[i]->h;
+		glyphs[i].advance = advance;
+		d.x += gs[i]->w;
+		if (gs[i]->h > rowHeight)
+			rowHeight = gs[i]->h;
+	}
+
+	if ((as = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, d.y+rowHeight, 32, SDL_PIXELFORMAT_ARGB8888)) != NULL) {
+		SDL_FillRect(as, NULL, 0);
+		for (unsigned i = 0; i < GLYPH_COUNT; i++) {
+			d = glyphs[i].src;
+			// copy including alpha channel
+			SDL_SetSurfaceBlendMode(gs[i], SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(gs[i], NULL, as, &d);
+		}
+		err = createAtlas(renderer, as);
+		SDL_FreeSurface(as);
+	}
+
+out:
+	for (unsigned i = 0; i < GLYPH_COUNT; i++) {
+		if (gs[i] == NULL)
+			break;
+		SDL_FreeSurface(gs[i]);
+	}
+	return err;
+}
+
+int SdlTextCache::initEmbedded(SDL_Renderer *renderer, int height)
+{
+	SDL_Surface *as;
+	int scale, cw, perRow;
+	int err;
+
+	close();
+
+	scale = height/EMBEDDED_FONT_LINE;
+	if (scale < 1)
+		scale = 1;
+	cw = EMBEDDED_FONT_ADVANCE*scale;
+	lineHeight = EMBEDDED_FONT_LINE*scale;
+	perRow = ATLAS_WIDTH/cw;
+	if ((as = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, (GLYPH_COUNT+perRow-1)/perRow*lineHeight, 32, SDL_PIXELFORMAT_ARGB8888)) == NULL)
+		return -1;
+	SDL_FillRect(as, NULL, 0);
+	SDL_LockSurface(as);
+	for (unsigned i = 0; i < GLYPH_COUNT; i++) {
+		glyph_info *g = &glyphs[i];
+		g->src.x = i%perRow*cw; g->src.y = i/perRow*lineHeight; g->src.w = cw; g->src.h = lineHeight;
+		g->advance = cw;
+		if (FIRST_GLYPH+i < EMBEDDED_FONT_FIRST || FIRST_GLYPH+i >= EMBEDDED_FONT_FIRST+EMBEDDED_FONT_GLYPHS)
+			continue;
+		const unsigned char *rows = embedded_font[FIRST_GLYPH+i-EMBEDDED_FONT_FIRST];
+		// one pixel of top spacing, the rest is below the glyph
+		for (int y = 0; y < EMBEDDED_FONT_HEIGHT*scale; y++) {
+			Uint32 *p = (Uint32 *)((char *)as->pixels+(g->src.y+scale+y)*as->pitch)+g->src.x;
+			for (int x = 0; x < EMBEDDED_FONT_WIDTH*scale; x++) {
+				if ((rows[y/scale]>>(EMBEDDED_FONT_WIDTH-1-x/scale))&1)
+					p[x] = 0xffffffff;
+			}
+		}
+	}
+	SDL_UnlockSurface(as);
+	err = createAtlas(renderer, as);
+	SDL_FreeSurface(as);
+	return err;
+}
+
+int SdlTextCache::createAtlas(SDL_Renderer *renderer, SDL_Surface *surface)
+{
+	if ((atlas = SDL_CreateTextureFromSurface(renderer, surface)) == NULL)
+		return -1;
+	SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+	return 0;
+}
+
+void SdlTextCache::close()
+{
+	if (atlas) {
+		SDL_DestroyTexture(atlas);
+		atlas = NULL;
+	}
+	memset(entries, 0, sizeof(entries));
+}
+
+void SdlTextCache::layout(text_entry *entry, const char *text, unsigned length)
+{
+	int x = 0;
+	entry->count = 0;
+	for (unsigned i = 0; i < length; i++) {
+		unsigned char c = text[i];
+		unsigned gi = (c >= FIRST_GLYPH && c <= LAST_GLYPH) ? c-FIRST_GLYPH : '?'-FIRST_GLYPH;
+		if (c != ' ') {
+			entry->glyphs[entry->count] = gi;
+			entry->offsets[entry->count] = x;
+			entry->count++;
+		}
+		x += glyphs[gi].advance;
+	}
+	entry->width = x;
+}
+
+const SdlTextCache::text_entry *SdlTextCache::lookup(const char *text, unsigned length)
+{
+	text_entry *oldest = &entries[0];
+	assert(length <= MAX_TEXT);
+	++useCounter;
+	for (unsigned i = 0; i < LRU_SIZE; i++) {
+		text_entry *e = &entries[i];
+		if (e->lastUse != 0 && e->length == length && memcmp(e->text, text, length) == 0) {
+			e->lastUse = useCounter;
+			statsHits++;
+			return e;
+		}
+		if (e->lastUse < oldest->lastUse)
+			oldest = e;
+	}
+	statsMisses++;
+	oldest->lastUse = useCounter;
+	oldest->length = length;
+	memcpy(oldest->text, text, length);
+	layout(oldest, text, length);
+	return oldest;
+}
+
+int SdlTextCache::measure(const char *text, unsigned length)
+{
+	if (length <= MAX_TEXT)
+		return lookup(text, length)->width;
+	return measure(text, MAX_TEXT)+measure(text+MAX_TEXT, length-MAX_TEXT);
+}
+
+void SdlTextCache::draw(SdlSpriteBatch *batch, int x, int y, SDL_Color color, const char *text, unsigned length)
+{
+	if (length > MAX_TEXT) {
+		// split to cacheable chunks, keeping alignment of the whole
+		int w = measure(text, length);
+		if (x < 0)
+			x = -x-w;
+		draw(batch, x, y, color, text, MAX_TEXT);
+		draw(batch, x+measure(text, MAX_TEXT), y, color, text+MAX_TEXT, length-MAX_TEXT);
+		return;
+	}
+	const text_entry *e = lookup(text, length);
+	SDL_Rect d;
+	if (x < 0)
+		x = -x-e->width;
+	if (y < 0)
+		y = -y-lineHeight;
+	batch->begin(atlas);
+	for (unsigned i = 0; i < e->count; i++) {
+		const glyph_info *g = &glyphs[e->glyphs[i]];
+		d.x = x+e->offsets[i]; d.y = y; d.w = g->src.w; d.h = g->src.h;
+		batch->add(&g->src, &d, color);
+	}
+}
+
+
+} } } };
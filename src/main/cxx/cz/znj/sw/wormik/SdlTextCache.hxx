@@ -0,0 +1,109 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * SDL cached text renderer
+ */
+
+#ifndef SdlTextCache_hxx__
+# define SdlTextCache_hxx__
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+class SdlSpriteBatch;
+
+/**
+ * Text renderer drawing from glyph atlas rasterized once per font.
+ *
+ * Layout of recently drawn strings is kept in small LRU, so repeated
+ * draws of the same text only emit the cached quads.
+ */
+class SdlTextCache
+{
+public:
+	enum {
+		FIRST_GLYPH		= 32,
+		LAST_GLYPH		= 126,
+		GLYPH_COUNT		= LAST_GLYPH-FIRST_GLYPH+1,
+		ATLAS_WIDTH		= 512,
+		MAX_TEXT		= 64,			/**< longest cached string */
+		LRU_SIZE		= 32,
+	};
+
+protected:
+	typedef struct glyph_info
+	{
+		SDL_Rect			src;		/**< position in atlas */
+		int				advance;	/**< pen advance */
+	} glyph_info;
+
+	typedef struct text_entry
+	{
+		unsigned long			lastUse;	/**< LRU stamp, 0 for empty */
+		unsigned			length;
+		char				text[MAX_TEXT];
+		int				width;
+		unsigned char			glyphs[MAX_TEXT];	/**< glyph indices of drawn characters */
+		short				offsets[MAX_TEXT];	/**< x offsets of drawn characters */
+		unsigned			count;
+	} text_entry;
+
+	SDL_Texture *			atlas;			/**< glyph atlas texture */
+	glyph_info			glyphs[GLYPH_COUNT];	/**< glyph positions and metrics */
+	int				lineHeight;		/**< font height */
+
+	text_entry			entries[LRU_SIZE];	/**< cached layouts */
+	unsigned long			useCounter;
+
+	unsigned long			statsHits;
+	unsigned long			statsMisses;
+
+public:
+	/* constructor */		SdlTextCache();
+	/* destructor */		~SdlTextCache();
+
+public:
+	/** rasterizes glyph atlas, returns negative on error */
+	int				init(SDL_Renderer *renderer, TTF_Font *font);
+	/** builds glyph atlas from embedded bitmap font, scaled close to height */
+	int				initEmbedded(SDL_Renderer *renderer, int height);
+	void				close();
+
+	int				getLineHeight() const;
+	/** returns width of the text */
+	int				measure(const char *text, unsigned length);
+	/** draws text, negative x or y mean right or bottom aligned at -x or -y */
+	void				draw(SdlSpriteBatch *batch, int x, int y, SDL_Color color, const char *text, unsigned length);
+
+	unsigned long			getHits() const;
+	unsigned long			getMisses() const;
+
+protected:
+	int				createAtlas(SDL_Renderer *renderer, SDL_Surface *surface);
+	const text_entry *		lookup(const char *text, unsigned length);
+	void				layout(text_entry *entry, const char *text, unsigned length);
+};
+
+inline int SdlTextCache::getLineHeight() const
+{
+	return lineHeight;
+}
+
+inline unsigned long SdlTextCache::getHits() const
+{
+	return statsHits;
+}
+
+inline unsigned long SdlTextCache::getMisses() const
+{
+	return statsMisses;
+}
+
+
+} } } };
+
+#endif
@@ -28,6 +28,14 @@
 #include "cz/znj/sw/wormik/WormikGui.hxx"
 
 #include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/replay.hxx"
+#include "cz/znj/sw/wormik/perf_counters.hxx"
+#include "cz/znj/sw/wormik/timing_histogram.hxx"
+#include "cz/znj/sw/wormik/resource_resolver.hxx"
+
+#include "cz/znj/sw/wormik/SdlSpriteBatch.hxx"
+#include "cz/znj/sw/wormik/SdlTextCache.hxx"
+#include "cz/znj/sw/wormik/SdlSeasonLoader.hxx"
 
 namespace cz { namespace znj { namespace sw { namespace wormik {
 
@@ -38,6 +46,7 @@ using namespace gui4x6x16;
 class SdlWormikGui: public WormikGui
 {
 public:
+	/* layout at base tile size, scaled by tileWidth/tileHeight when drawing */
 	enum {
 		WINDOW_WIDTH = 640,
 		WINDOW_HEIGHT = 480,
@@ -77,21 +86,70 @@ public:
 
 	static const double		REDRAW_TIME;
 
+	enum {
+		REPLAY_SKIP_SHORT	= 25,		/**< waits skipped by left and right */
+		REPLAY_SKIP_LONG	= 250,		/**< waits skipped by page up and page down */
+		INSTANT_REPLAY_WAITS	= 24,		/**< waits before death shown by instant replay */
+	};
+
+	static const double		REPLAY_START_TIME;
+	static const double		REPLAY_ANNOUNCE_TIME;
+	static const double		INSTANT_REPLAY_STEP_TIME;
+
+#ifdef IDLECHECK
+	/* screens checked by idle check (make check), in order */
+	enum {
+		IC_OFF			= -1,
+		IC_START		= 0,
+		IC_PAUSE		= 1,
+		IC_HELP			= 2,
+		IC_DEAD			= 3,
+		IC_DONE			= 4,
+	};
+
+	static const double		IDLE_CHECK_TIME;
+#endif
+
 protected:
 	SDL_Window *			window;			/**< main window */
 	SDL_Renderer *			windowRenderer;		/**< main renderer */
 	SDL_PixelFormat *		windowPixelFormat;	/**< main window pixel format */
 
+	int				tileWidth;		/**< on-screen tile width */
+	int				tileHeight;		/**< on-screen tile height */
+	SDL_Rect			screenArea;		/**< game screen within renderer output */
+
 	SDL_Renderer *			textureRenderer;	/**< generic texture renderer */
 
 	Uint32				alphaPixelFormat;	/**< preferred alpha pixel format */
 
-	SDL_Texture *			seasonImage;		/**< season image */
-	SDL_Texture *			bgSeasonImage;		/**< season image (without alpha, with drawn background) */
+	typedef struct season_textures
+	{
+		SDL_Texture *			image;		/**< season image */
+		SDL_Texture *			bgImage;	/**< season image (without alpha, with drawn background and faded newdefs) */
+	} season_textures;
+
+	SdlSeasonLoader			seasonLoader;		/**< decodes season images in background */
+	Uint32				seasonEvent;		/**< event sent by seasonLoader when season is decoded */
+	season_textures			seasonTextures[SdlSeasonLoader::MAX_SEASONS];	/**< textures of prepared seasons */
+
+	SDL_Texture *			seasonImage;		/**< current season image (owned by seasonTextures) */
+	SDL_Texture *			bgSeasonImage;		/**< current season background image (owned by seasonTextures) */
 
 	SDL_Texture *                   basicScreen;            /**< screen rendered with basic level decoration */
+	SDL_Texture *			boardScreen;		/**< persistent screen with board and panels drawn */
 
-	TTF_Font *			font;			/**< output font */
+	double				startTime;		/**< init time, for startup measurement */
+	bool				measureStartup;		/**< report startup times and quit after first frame */
+	PerfCounters *			perf;			/**< game counters, NULL if disabled */
+	int				perfDraw;		/**< site of drawBase */
+
+	SdlSpriteBatch			cellBatch;		/**< batch restoring cells from basicScreen */
+	SdlSpriteBatch			tileBatch;		/**< batch drawing tiles from season images */
+
+	TTF_Font *			font;			/**< output font, NULL when embedded font is used */
+	int				fontSize;		/**< font size in pixels */
+	SdlTextCache			textCache;		/**< glyph atlas and cached text layouts */
 
 	WormikGame *			game;			/**< game interface */
 
@@ -100,10 +158,39 @@ protected:
 	double				diffGameTime;		/**< difference to game time */
 	double				lastMove;		/**< time of last game update */
 
-	InvalidatedList			invalidatedList[2];	/**< invalid regions list */
-	unsigned			nextInvalidatedList;		/**< current invlist */
+	bool				smooth;			/**< redraw on every display refresh, moving snake in between steps */
+	bool				vsync;			/**< presenting waits for display refresh */
+	double				frameTime;		/**< display refresh period */
+	double				motionProgress;		/**< part of step the snake is drawn moved by */
+
+	InvalidatedList			invalidatedList;	/**< invalid regions list */
 	bool				redraw;			/**< screen needs redraw */
 
+	unsigned			frameCells;		/**< cells drawn in current frame */
+	double				frameStart;		/**< start of current frame */
+	unsigned long			statsFrames;		/**< frames drawn in total */
+	unsigned long			statsCells;		/**< cells drawn in total */
+	unsigned long			statsBatches;		/**< batches flushed in total */
+	TimingHistogram			statsFrameTimes;	/**< drawing and presenting frames */
+	unsigned long			statsWakeups;		/**< returns from event waiting */
+	unsigned long			statsTimerWakeups;	/**< wakeups by timeout */
+	unsigned long			statsIdleWakeups;	/**< timeouts with nothing to draw or step */
+
+#ifdef IDLECHECK
+	int				idleCheck;		/**< IC_* screen checked next */
+	bool				idleCheckArmed;		/**< idle period of checked screen is being measured */
+	unsigned long			idleCheckTimerWakeups;	/**< statsTimerWakeups when checked screen became idle */
+	unsigned long			idleCheckIdleWakeups;	/**< statsIdleWakeups when checked screen became idle */
+	Uint32				idleCheckEvent;		/**< event ending idle period of checked screen */
+#endif
+
+	ReplayPlayer			replay;			/**< replay being viewed */
+	bool				replaying;		/**< game is driven by replay, waits pass by themselves */
+	bool				replayPaused;		/**< replay waits do not expire */
+	bool				replayDragging;		/**< progress bar is dragged by mouse */
+	unsigned			instantStep;		/**< waits shown by instant replay */
+	unsigned			instantTotal;		/**< waits of instant replay, 0 if not playing */
+
 public:
 	/* constructor */		SdlWormikGui();
 	virtual				~SdlWormikGui();
@@ -125,13 +212,26 @@ public:
 	virtual bool			announce(int type);
 
 protected:
+	int				scaleX(int px) const;
+	int				scaleY(int px) const;
+
+	int				fitTile(int ow, int oh);
+	void				initLayout();
+	void				updateLayout();
 	int				initWindow();
-	int				initSeasonImage(SDL_Surface *img);
+	int				initTextures();
+	void				closeTextures();
+	int				toggleFullscreen();
+	int				initSeasonImage(season_textures *textures, SDL_Surface *img);
+	int				prepareSeason(int season);
+	void				dropSeasons();
 	int				initLevelImage(int season);
 
 	int				initGui();
 	void				closeGui();
 
+	void				startupMark(const char *what);
+
 	void				drawLinedTextf(int x, int y, Uint32 color, const char *fmt, ...);
 	void				drawText(int x, int y, Uint32 color, const char *text);
 
@@ -140,19 +240,57 @@ protected:
 	 * 	next refresh flags
 	 */
 	void                            drawStaticScreen(int flags);
+	void				restoreCell(unsigned x, unsigned y);
 	unsigned			drawBase();
 	unsigned			drawAnnounce(unsigned n, const char *const text[]);
+	/** draws snake head and tail moved by part of step over copied board */
+	void				drawMotion(double progress);
 	void				drawFinish(unsigned renderFlags);
 	int				showPopup(int stde);
 
-	SDL_TimerID			createDrawTimer();
+	/**
+	 * waits for event until expire time (INFINITY waits without any timer)
+	 *
+	 * @return
+	 * 	1 when event was received, 0 on timeout
+	 */
+	int				waitEvent(SDL_Event *ev, double expire);
 
 	int				processStandardEvent(SDL_Event *ev);
 
-	static Uint32			drawTimerCallback(Uint32 timeout, void *this_);
-	static Uint32			gameTimerCallback(Uint32 timeout, void *this_);
+#ifdef IDLECHECK
+	/** starts measuring idle period if screen is the one checked next */
+	void				idleCheckArm(int screen);
+	/** verifies idle period did not wake up and drives the game to next checked screen */
+	void				idleCheckVerify();
+	static Uint32			idleCheckExpired(Uint32 interval, void *self);
+	static void			pushKey(SDL_Keycode key);
+#endif
+
+	/** finishes gui wait, applying replay events when replaying, returns true to quit */
+	bool				waitDone();
+	/** returns replay wait the event seeks to, negative if it does not seek */
+	int				replayControl(SDL_Event *ev);
+	/** seeks replay so that the next wait is the target one, returns true to quit */
+	bool				seekReplay(int target);
+	void				getReplayBar(SDL_Rect *bar);
+	void				drawReplayBar(uint32_t step, uint32_t last, const char *note);
+	/** plays recent waits kept by game, returns true to quit */
+	bool				showInstantReplay();
+	/** converts mouse event position to screen area coordinates */
+	void				mouseToScreen(int *x, int *y);
 };
 
+inline int SdlWormikGui::scaleX(int px) const
+{
+	return px*tileWidth/GRECT_XSIZE;
+}
+
+inline int SdlWormikGui::scaleY(int px) const
+{
+	return px*tileHeight/GRECT_YSIZE;
+}
+
 static double getDoubleTime(void)
 {
 #if (defined _WIN32) || (defined _WIN64)
@@ -165,6 +303,15 @@ static double getDoubleTime(void)
 }
 
 const double SdlWormikGui::REDRAW_TIME = 1/20.0;
+const double SdlWormikGui::REPLAY_START_TIME = 0.5;
+const double SdlWormikGui::REPLAY_ANNOUNCE_TIME = 1.5;
+const double SdlWormikGui::INSTANT_REPLAY_STEP_TIME = 0.2;
+#ifdef IDLECHECK
+const double SdlWormikGui::IDLE_CHECK_TIME = 0.5;
+#endif
+
+/* cell offsets of SDIR_* directions */
+static const int direction_moves[4][2] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1} };
 
 SdlWormikGui::SdlWormikGui()
 {
@@ -173,27 +320,110 @@ SdlWormikGui::SdlWormikGui()
 	windowPixelFormat = NULL;
 	bgSeasonImage = NULL;
 	seasonImage = NULL;
+	seasonEvent = 0;
+	memset(seasonTextures, 0, sizeof(seasonTextures));
+	basicScreen = NULL;
+	boardScreen = NULL;
 	font = NULL;
+	fontSize = 0;
 	game = NULL;
 
+	startTime = 0;
+	measureStartup = false;
+	perf = NULL;
+	perfDraw = -1;
+
+	smooth = false;
+	vsync = false;
+	frameTime = 1/60.0;
+	motionProgress = 0;
+
+	tileWidth = GRECT_XSIZE;
+	tileHeight = GRECT_YSIZE;
+
+	frameStart = 0;
+	statsFrames = 0;
+	statsCells = 0;
+	statsBatches = 0;
+	statsWakeups = 0;
+	statsTimerWakeups = 0;
+	statsIdleWakeups = 0;
+
+#ifdef IDLECHECK
+	idleCheck = IC_START;
+	idleCheckArmed = false;
+	idleCheckTimerWakeups = 0;
+	idleCheckIdleWakeups = 0;
+	idleCheckEvent = 0;
+#endif
+
+	replaying = false;
+	replayPaused = false;
+	replayDragging = false;
+	instantStep = 0;
+	instantTotal = 0;
+
 	static_assert((MENU_X_POINTS+MENU_WIDTH_POINTS)*GRECT_XSIZE == WINDOW_WIDTH);
 	static_assert((MENU_HEIGHT_POINTS)*GRECT_XSIZE == WINDOW_HEIGHT);
+	static_assert((int)CLR_COUNT <= (int)SdlSeasonLoader::MAX_COLORS);
 }
 
 SdlWormikGui::~SdlWormikGui()
 {
 }
 
-int SdlWormikGui::initWindow()
+int SdlWormikGui::fitTile(int ow, int oh)
 {
-	SDL_SetWindowTitle(window, "Wormik");
-	SDL_ShowCursor(SDL_DISABLE);
+	int tile;
+	// square tiles, as large as the output allows unless configured smaller
+	tile = GRECT_XSIZE*ow/WINDOW_WIDTH;
+	if (GRECT_YSIZE*oh/WINDOW_HEIGHT < tile)
+		tile = GRECT_YSIZE*oh/WINDOW_HEIGHT;
+	int configured = game->getConfigInt("tilesize", 0);
+	if (configured > 0 && configured < tile)
+		tile = configured;
+	if (tile < 1)
+		tile = 1;
+	return tile;
+}
 
-	if (!(bgSeasonImage = SDL_CreateTexture(windowRenderer, alphaPixelFormat, SDL_TEXTUREACCESS_TARGET, SIMG_WIDTH, SIMG_HEIGTH))) {
-		game->error("couldn't create bgSeasonImage texture: %s\n", SDL_GetError());
-		return -1;
+void SdlWormikGui::initLayout()
+{
+	int ow, oh;
+	if (SDL_GetRendererOutputSize(windowRenderer, &ow, &oh) < 0) {
+		ow = WINDOW_WIDTH; oh = WINDOW_HEIGHT;
 	}
-	SDL_SetTextureBlendMode(bgSeasonImage, SDL_BLENDMODE_BLEND);
+	tileWidth = tileHeight = fitTile(ow, oh);
+	screenArea.w = scaleX(WINDOW_WIDTH); screenArea.h = scaleY(WINDOW_HEIGHT);
+	screenArea.x = (ow-screenArea.w)/2; screenArea.y = (oh-screenArea.h)/2;
+	SDL_RenderSetLogicalSize(windowRenderer, 0, 0);
+	SDL_RenderSetViewport(windowRenderer, &screenArea);
+	game->debug("Output %dx%d, tile size %dx%d\n", ow, oh, tileWidth, tileHeight);
+}
+
+void SdlWormikGui::updateLayout()
+{
+	int ow, oh;
+	if (SDL_GetRendererOutputSize(windowRenderer, &ow, &oh) < 0)
+		return;
+	// textures stay at current tile size, so the screen is only centered
+	// when it still fits the output best, otherwise SDL scales it
+	if (fitTile(ow, oh) == tileWidth) {
+		screenArea.x = (ow-screenArea.w)/2; screenArea.y = (oh-screenArea.h)/2;
+		SDL_RenderSetLogicalSize(windowRenderer, 0, 0);
+		SDL_RenderSetViewport(windowRenderer, &screenArea);
+	}
+	else {
+		SDL_RenderSetLogicalSize(windowRenderer, screenArea.w, screenArea.h);
+	}
+	game->debug("Output %dx%d, tile size %dx%d kept\n", ow, oh, tileWidth, tileHeight);
+	redraw = true;
+}
+
+int SdlWormikGui::initWindow()
+{
+	SDL_SetWindowTitle(window, "Wormik");
+	SDL_ShowCursor(replaying ? SDL_ENABLE : SDL_DISABLE);
 
 #if 0
 	colors[CLR_MENU_BG] = SDL_MapRGB(windowPixelFormat, 0, 0, 0);
@@ -201,92 +431,67 @@ int SdlWormikGui::initWindow()
 	colors[CLR_MENUEXC] = SDL_MapRGB(windowPixelFormat, 255, 255, 200);
 #endif
 
-	nextInvalidatedList = 0;
-	invalidatedList[0].resetFlags(INVO_SDL_FULL); invalidatedList[1].resetFlags(INVO_SDL_FULL);
+	invalidatedList.resetFlags(INVO_SDL_FULL);
 
 	return 0;
 }
 
-static SDL_RWops *findopenfile(const char *fname, ...)
+void SdlWormikGui::startupMark(const char *what)
 {
-	SDL_RWops *f = NULL;
-	const char *p;
-	va_list va;
-	va_start(va, fname);
-
-	while (!f && (p = va_arg(va, const char *))) {
-		const char *arg = va_arg(va, const char *);
-		switch (*p) {
-		case 'l':
-			{
-				FILE *lp;
-				char buf[PATH_MAX+16];
-				unsigned fl = strlen(fname);
-				if (snprintf(buf, sizeof(buf), "locate /%s", fname) >= (int)sizeof(buf))
-					break;
-				if (!(lp = popen(buf, "r")))
-					break;
-				while (fgets(buf, sizeof(buf), lp)) {
-					unsigned bl;
-					if ((bl = strlen(buf)) <= fl+2 || buf[--bl] != '\n')
-						continue;
-					buf[bl] = '\0';
-					if (buf[bl-fl-1] == '/' && memcmp(buf+bl-fl, fname, fl) == 0) {
-						if ((f = SDL_RWFromFile(buf, "r")))
-							break;
-					}
-				}
-				pclose(lp);
-			}
-			break;
-
-		case 'd':
-			{
-				char buf[PATH_MAX];
-				if (snprintf(buf, sizeof(buf), "%s/%s", arg, fname) >= (int)sizeof(buf))
-					break;
-				f = SDL_RWFromFile(buf, "r");
-			}
-			break;
-
-		case 's':
-			{
-				FILE *fp;
-				char buf[PATH_MAX+32];
-				unsigned fl = strlen(fname);
-				if (snprintf(buf, sizeof(buf), "find %s -follow -name %s -print", arg, fname) >= (int)sizeof(buf))
-					break;
-				if (!(fp = popen(buf, "r")))
-					break;
-				while (fgets(buf, sizeof(buf), fp)) {
-					unsigned bl;
-					if ((bl = strlen(buf)) <= fl+1 || buf[--bl] != '\n')
-						continue;
-					buf[bl] = '\0';
-					if ((f = SDL_RWFromFile(buf, "r")))
-						break;
-				}
-				pclose(fp);
-			}
-			break;
-
-		default:
-			assert(0);
-			break;
-		}
-	}
-	va_end(va);
-	return f;
+	if (measureStartup)
+		game->error("startup: %s at %.1f ms\n", what, (getDoubleTime()-startTime)*1000);
 }
 
 int SdlWormikGui::init(WormikGame *game_)
 {
+	char buf[PATH_MAX];
 	game = game_;
+	startTime = getDoubleTime();
+	measureStartup = game->getConfigInt("startuptime", 0) != 0;
+	if ((perf = game->getPerfCounters()) != NULL && (perfDraw = perf->addSite("draw")) < 0)
+		perf = NULL;
+
+	if ((unsigned)game->getConfigStr("replay", buf, sizeof(buf)) < sizeof(buf)) {
+		if (replay.open(game, buf) < 0) {
+			game->error("Failed to read replay %s: %s\n", buf, strerror(errno));
+			return -1;
+		}
+		replaying = true;
+	}
 
-	if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0) {
+	// no timers are used, waiting is driven by events and timeouts only
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
 		game->error("Couldn't init SDL: %s\n", SDL_GetError());
 		return -1;
 	}
+	startupMark("SDL initialized");
+	// events not handled by game would only wake it up for nothing
+	SDL_EventState(SDL_MOUSEMOTION, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEBUTTONDOWN, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEBUTTONUP, SDL_IGNORE);
+	SDL_EventState(SDL_MOUSEWHEEL, SDL_IGNORE);
+	SDL_EventState(SDL_FINGERMOTION, SDL_IGNORE);
+	SDL_EventState(SDL_FINGERDOWN, SDL_IGNORE);
+	SDL_EventState(SDL_FINGERUP, SDL_IGNORE);
+	SDL_EventState(SDL_KEYUP, SDL_IGNORE);
+	SDL_EventState(SDL_TEXTINPUT, SDL_IGNORE);
+	SDL_EventState(SDL_TEXTEDITING, SDL_IGNORE);
+	if (replaying) {
+		// progress bar of replay is scrubbed by mouse
+		SDL_EventState(SDL_MOUSEMOTION, SDL_ENABLE);
+		SDL_EventState(SDL_MOUSEBUTTONDOWN, SDL_ENABLE);
+		SDL_EventState(SDL_MOUSEBUTTONUP, SDL_ENABLE);
+	}
+	if ((seasonEvent = SDL_RegisterEvents(1)) == (Uint32)-1)
+		seasonEvent = 0;
+#ifdef IDLECHECK
+	// the only timer, it ends measured idle period
+	if (SDL_InitSubSystem(SDL_INIT_TIMER) < 0 || (idleCheckEvent = SDL_RegisterEvents(1)) == (Uint32)-1) {
+		game->error("Couldn't init idle check: %s\n", SDL_GetError());
+		shutdown(game);
+		return -1;
+	}
+#endif
 	if (initGui() < 0) {
 		shutdown(game);
 		return -1;
@@ -297,22 +502,44 @@ int SdlWormikGui::init(WormikGame *game_)
 int SdlWormikGui::initGui()
 {
 	char buf[PATH_MAX];
-	SDL_RWops *ffo = NULL;
 
-	if ((window = SDL_CreateWindow("Wormik", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, (game->getConfigInt("fullscreen", 1) ? SDL_WINDOW_FULLSCREEN : 0))) == NULL) {
+	int windowTile = game->getConfigInt("tilesize", 0);
+	SDL_DisplayMode displayMode;
+
+	if (windowTile <= 0) {
+		// largest multiple of base size fitting comfortably to desktop
+		windowTile = GRECT_XSIZE;
+		if (SDL_GetDesktopDisplayMode(0, &displayMode) == 0) {
+			int m = displayMode.w*3/4/WINDOW_WIDTH;
+			if (displayMode.h*3/4/WINDOW_HEIGHT < m)
+				m = displayMode.h*3/4/WINDOW_HEIGHT;
+			if (m > 1)
+				windowTile *= m;
+		}
+	}
+	if ((window = SDL_CreateWindow("Wormik", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH*windowTile/GRECT_XSIZE, WINDOW_HEIGHT*windowTile/GRECT_YSIZE, (game->getConfigInt("fullscreen", 1) ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0)|SDL_WINDOW_ALLOW_HIGHDPI)) == NULL) {
 		game->error("Couldn't create window: %s\n", SDL_GetError());
 		goto err;
 	}
-	if ((windowRenderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_TARGETTEXTURE)) == NULL) {
+	smooth = game->getConfigInt("smooth", 0) != 0;
+	if ((windowRenderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_TARGETTEXTURE|(smooth ? SDL_RENDERER_PRESENTVSYNC : 0))) == NULL) {
 		game->error("Couldn't create window renderer: %s\n", SDL_GetError());
 		goto err;
 	}
-	SDL_RenderSetLogicalSize(windowRenderer, WINDOW_WIDTH, WINDOW_HEIGHT);
-	SDL_RenderSetIntegerScale(windowRenderer, SDL_TRUE);
+	startupMark("renderer created");
+	// everything is drawn in native resolution from pre-scaled images
+	initLayout();
 	alphaPixelFormat = SDL_PIXELFORMAT_ARGB8888;
 	SDL_RendererInfo rendererInfo;
 	SDL_GetRendererInfo(windowRenderer, &rendererInfo);
 	game->error("Using renderer %s\n", rendererInfo.name);
+	if (smooth) {
+		// without vsync the frames are paced by display refresh rate
+		vsync = (rendererInfo.flags&SDL_RENDERER_PRESENTVSYNC) != 0;
+		if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &displayMode) == 0 && displayMode.refresh_rate > 0)
+			frameTime = 1.0/displayMode.refresh_rate;
+		game->debug("Smooth mode, %s, refresh %.1f Hz\n", vsync ? "vsync" : "no vsync", 1/frameTime);
+	}
 	windowPixelFormat = SDL_AllocFormat(SDL_GetWindowPixelFormat(window));
 	for (size_t i = 0; i < rendererInfo.num_texture_formats; ++i) {
 		if (SDL_ISPIXELFORMAT_ALPHA(rendererInfo.texture_formats[i])) {
@@ -321,51 +548,66 @@ int SdlWormikGui::initGui()
 		}
 	}
 
-	textureRenderer = windowRenderer;
-
-	if ((basicScreen = SDL_CreateTexture(textureRenderer, windowPixelFormat->format, SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT)) == NULL) {
-		game->error("Couldn't get basic screen texture: %s\n", SDL_GetError());
+	if ((unsigned)game->getConfigStr("datapath", buf, sizeof(buf)) >= sizeof(buf))
+		buf[0] = '\0';
+	// restarted only when tile size changed, images are decoded while
+	// the rest is initialized
+	if (seasonLoader.start(buf, tileWidth, tileHeight, seasonEvent) < 0) {
+		game->error("Couldn't start season loader: %s\n", SDL_GetError());
 		goto err;
 	}
+	game->debug("Season images from %s\n", seasonLoader.isPacked() ? "resource pack" : "png files");
+
+	textureRenderer = windowRenderer;
+	cellBatch.setRenderer(windowRenderer);
+	tileBatch.setRenderer(windowRenderer);
 
 	if (TTF_Init() < 0) {
 		game->error("Couldn't init TTF lib: %s\n", TTF_GetError());
 		goto err;
 	}
+	fontSize = scaleY(game->getConfigInt("fontsize", 15));
 	if ((unsigned)game->getConfigStr("font", buf, sizeof(buf)) < sizeof(buf)) {
-		if (!(ffo = SDL_RWFromFile(buf, "r"))) {
-			game->error("Couldn't open font file specified in config (trying default): %s\n", strerror(errno));
+		if (!(font = TTF_OpenFont(buf, fontSize))) {
+			game->error("Couldn't open font file specified in config (trying default): %s\n", TTF_GetError());
 		}
 	}
+	if (!font && (unsigned)game->getConfigStr("fontcache", buf, sizeof(buf)) < sizeof(buf)) {
+		// previously found font, avoids searching the disk on each start
+		font = TTF_OpenFont(buf, fontSize);
+	}
+	if (!font) {
+		const char *fname;
+		int found;
 #if (defined _WIN32) || (defined _WIN64)
-	if (!ffo) {
-		if (GetSystemDirectory(buf, sizeof(buf)) <= sizeof(buf)) {
-			strcat(buf, "/../fonts");
-			ffo = findopenfile("courbd.ttf", "d", buf, NULL);
+		char sysfonts[PATH_MAX];
+		fname = "courbd.ttf";
+		found = -1;
+		if (GetSystemDirectory(sysfonts, sizeof(sysfonts)) <= sizeof(sysfonts)) {
+			strcat(sysfonts, "/../fonts");
+			found = resolveResource(buf, sizeof(buf), fname, "d", sysfonts, NULL);
 		}
-	}
 #elif (defined __APPLE__)
-	if (!ffo) {
-		ffo = findopenfile("Andale Mono.ttf", "d", "/Library/Fonts", "l", "", NULL);
-	}
+		fname = "Andale Mono.ttf";
+		found = resolveResource(buf, sizeof(buf), fname, "d", "/Library/Fonts", "d", "/System/Library/Fonts/Supplemental", "s", "/Library/Fonts", NULL);
 #else
-	if (!ffo) {
-		ffo = findopenfile("FreeMonoBold.ttf", "d", "/usr/share/fonts/truetype/freefont", "l", "", "s", "/usr/share/fonts", "s", "/usr/lib/X11/fonts", NULL);
-	}
+		fname = "FreeMonoBold.ttf";
+		found = resolveResource(buf, sizeof(buf), fname, "d", "/usr/share/fonts/truetype/freefont", "d", "/usr/share/fonts/gnu-free", "s", "/usr/share/fonts", "s", "/usr/local/share/fonts", "s", "/usr/lib/X11/fonts", NULL);
 #endif
-	if (!ffo) {
-		game->fatal("Couldn't find/open output font\n");
-		goto err;
+		startupMark("font resolved");
+		if (found >= 0) {
+			if ((font = TTF_OpenFont(buf, fontSize)) != NULL) {
+				game->setConfig("fontcache", buf);
+			}
+			else {
+				forgetResource(fname);
+			}
+		}
 	}
-#if (defined _WIN32) || (defined _WIN64)
-	strcat(buf, "/courbd.ttf");
-	SDL_RWclose(ffo);
-	font = TTF_OpenFont(buf, 15);
-#else
-	font = TTF_OpenFontRW(ffo, 1, game->getConfigInt("fontsize", 15));
-#endif
-	if (!font) {
-		game->error("Couldn't open output font: %s\n", TTF_GetError());
+	if (!font)
+		game->error("Couldn't find/open output font, using embedded one\n");
+	startupMark("font loaded");
+	if (initTextures() < 0) {
 		goto err;
 	}
 	if (initWindow() < 0) {
@@ -380,8 +622,54 @@ err:
 	return -1;
 }
 
+int SdlWormikGui::initTextures()
+{
+	if ((basicScreen = SDL_CreateTexture(textureRenderer, windowPixelFormat->format, SDL_TEXTUREACCESS_TARGET, screenArea.w, screenArea.h)) == NULL) {
+		game->error("Couldn't get basic screen texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	if ((boardScreen = SDL_CreateTexture(textureRenderer, windowPixelFormat->format, SDL_TEXTUREACCESS_TARGET, screenArea.w, screenArea.h)) == NULL) {
+		game->error("Couldn't get board screen texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	// glyphs are rasterized again from font kept in memory
+	if ((font ? textCache.init(windowRenderer, font) : textCache.initEmbedded(windowRenderer, fontSize)) < 0) {
+		game->error("Couldn't create font atlas: %s\n", SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+void SdlWormikGui::closeTextures()
+{
+	textCache.close();
+	dropSeasons();
+	if (basicScreen) {
+		SDL_DestroyTexture(basicScreen);
+		basicScreen = NULL;
+	}
+	if (boardScreen) {
+		SDL_DestroyTexture(boardScreen);
+		boardScreen = NULL;
+	}
+}
+
+int SdlWormikGui::toggleFullscreen()
+{
+	int fullscreen = game->getConfigInt("fullscreen", 0) == 0;
+	// window, renderer and all textures stay, only the layout is updated
+	if (SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0) < 0) {
+		game->error("Failed to switch fullscreen mode: %s\n", SDL_GetError());
+		return -1;
+	}
+	game->setConfig("fullscreen", fullscreen);
+	updateLayout();
+	return 0;
+}
+
 void SdlWormikGui::closeGui()
 {
+	closeTextures();
 	if (font) {
 		TTF_CloseFont(font);
 		font = NULL;
@@ -389,19 +677,7 @@ void SdlWormikGui::closeGui()
 	if (TTF_WasInit()) {
 		TTF_Quit();
 	}
-	if (seasonImage) {
-		SDL_DestroyTexture(seasonImage);
-		seasonImage = NULL;
-	}
 	SDL_ShowCursor(SDL_ENABLE);
-	if (bgSeasonImage) {
-		SDL_DestroyTexture(bgSeasonImage);
-		bgSeasonImage = NULL;
-	}
-	if (basicScreen) {
-		SDL_DestroyTexture(basicScreen);
-		basicScreen = NULL;
-	}
 	if (textureRenderer) {
 		if (textureRenderer != windowRenderer)
 			SDL_DestroyRenderer(textureRenderer);
@@ -423,114 +699,157 @@ void SdlWormikGui::closeGui()
 
 void SdlWormikGui::shutdown(WormikGame *game)
 {
+	char stats[512];
+
+	if (statsFrames != 0)
+		game->debug("Drawn %lu frames, %lu cells in %lu batches (%.1f cells, %.1f batches per frame)\n", statsFrames, statsCells, statsBatches, (double)statsCells/statsFrames, (double)statsBatches/statsFrames);
+	if (statsFrameTimes.getSamples() != 0) {
+		statsFrameTimes.format(stats, sizeof(stats));
+		game->debug("Frame times: %s\n", stats);
+	}
+	game->debug("Text cache: %lu hits, %lu misses\n", textCache.getHits(), textCache.getMisses());
+	game->debug("Woke up %lu times (%.2f per second), %lu by timeout, %lu idle\n", statsWakeups, statsWakeups/(getDoubleTime()-startTime), statsTimerWakeups, statsIdleWakeups);
 	closeGui();
+	seasonLoader.stop();
+	replay.close();
 	SDL_Quit();
 }
 
-int SdlWormikGui::initSeasonImage(SDL_Surface *img)
+int SdlWormikGui::initSeasonImage(season_textures *textures, SDL_Surface *img)
 {
 	SDL_Rect s, d;
-	if (seasonImage) {
-		SDL_DestroyTexture(seasonImage);
-	}
-	if ((seasonImage = SDL_CreateTextureFromSurface(windowRenderer, img)) == NULL) {
+	SDL_Texture *fadeSource;
+	SDL_Texture *seasonImage, *bgSeasonImage;
+	if ((seasonImage = textures->image = SDL_CreateTextureFromSurface(windowRenderer, img)) == NULL) {
 		game->error("Failed to convert season image to current video texture: %s\n", SDL_GetError());
 		return -1;
 	}
+	if (!(bgSeasonImage = textures->bgImage = SDL_CreateTexture(windowRenderer, alphaPixelFormat, SDL_TEXTUREACCESS_TARGET, scaleX(BGIMG_WIDTH), scaleY(BGIMG_HEIGHT)))) {
+		game->error("couldn't create bgSeasonImage texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	SDL_SetTextureBlendMode(bgSeasonImage, SDL_BLENDMODE_BLEND);
 
 	if (SDL_SetRenderTarget(textureRenderer, bgSeasonImage) < 0) {
 		game->fatal("failed to set rendering to bgSeasonImage: %s\n", SDL_GetError());
 		return -1;
 	}
-	s.x = SP_BACK_X*GRECT_XSIZE; s.y = SP_BACK_Y*GRECT_YSIZE; s.w = GRECT_XSIZE; s.h = GRECT_YSIZE;
+	s.x = SP_BACK_X*tileWidth; s.y = SP_BACK_Y*tileHeight; s.w = tileWidth; s.h = tileHeight;
 	d.w = s.w; d.h = s.h;
-	for (d.y = 0; d.y < SIMG_HEIGTH; d.y += GRECT_YSIZE) {
-		for (d.x = 0; d.x < SIMG_WIDTH; d.x += GRECT_XSIZE) {
-			if (SDL_RenderCopy(textureRenderer, seasonImage, &s, &d) < 0) {
-				game->fatal("failed to render to bgSeasonImage from seasonImage: %s\n", SDL_GetError());
+	tileBatch.begin(seasonImage);
+	for (d.y = 0; d.y < scaleY(SIMG_HEIGTH); d.y += tileHeight) {
+		for (d.x = 0; d.x < scaleX(SIMG_WIDTH); d.x += tileWidth) {
+			tileBatch.add(&s, &d);
+		}
+	}
+	tileBatch.flush();
+	d.x = 0; d.y = 0; d.w = scaleX(SIMG_WIDTH); d.h = scaleY(SIMG_HEIGTH);
+	if (SDL_RenderCopy(textureRenderer, seasonImage, NULL, &d) < 0) {
+		game->fatal("failed to render to bgSeasonImage from seasonImage: %s\n", SDL_GetError());
+	}
+
+	// fading newdefs are drawn from pre-faded copies composed over empty
+	// field, so they can be batched as any other tile
+	if ((fadeSource = SDL_CreateTexture(textureRenderer, alphaPixelFormat, SDL_TEXTUREACCESS_TARGET, scaleX(SIMG_WIDTH), scaleY(SIMG_HEIGTH))) == NULL) {
+		game->fatal("couldn't create fade source texture: %s\n", SDL_GetError());
+	}
+	SDL_SetRenderTarget(textureRenderer, fadeSource);
+	SDL_SetTextureBlendMode(bgSeasonImage, SDL_BLENDMODE_NONE);
+	SDL_RenderCopy(textureRenderer, bgSeasonImage, &d, NULL);
+	SDL_SetTextureBlendMode(bgSeasonImage, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderTarget(textureRenderer, bgSeasonImage);
+	s.w = d.w = tileWidth; s.h = d.h = tileHeight;
+	for (int pass = 0; pass < 2; pass++) {
+		SDL_SetTextureBlendMode(fadeSource, pass == 0 ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+		tileBatch.begin(fadeSource);
+		for (WormikGame::board_def t = WormikGame::GR_POSITIVE; t <= WormikGame::GR_EXIT; t++) {
+			unsigned x, y;
+			findImagePos(pass == 0 ? WormikGame::GR_NONE : t, &x, &y, tileWidth, tileHeight);
+			s.x = x; s.y = y;
+			for (unsigned level = 0; level < FADE_LEVELS; level++) {
+				findFadePos(t, level, &x, &y, tileWidth, tileHeight);
+				d.x = x; d.y = y;
+				tileBatch.add(&s, &d, pass == 0 ? 255 : level*255/(FADE_LEVELS-1));
 			}
 		}
+		tileBatch.flush();
 	}
-	SDL_RenderCopy(textureRenderer, seasonImage, NULL, NULL);
 	SDL_SetRenderTarget(textureRenderer, NULL);
+	SDL_DestroyTexture(fadeSource);
 	return 0;
 }
 
-int SdlWormikGui::initLevelImage(int season)
+int SdlWormikGui::prepareSeason(int season)
 {
-	SDL_RWops *sf;
-	int err;
-	char fname[PATH_MAX];
-	char dpath[PATH_MAX];
-	// we have to use SDL_Surface as the texture does not allow us to read
-	// pixel values
-	SDL_Surface *img;
-	SDL_Color c[sizeof(colors)/sizeof(colors[0])];
-	unsigned i;
+	season_textures *textures;
+	if (season < 0 || season >= SdlSeasonLoader::MAX_SEASONS)
+		return -1;
+	textures = &seasonTextures[season];
+	if (textures->bgImage)
+		return 0;
+	switch (seasonLoader.wait(season)) {
+	case SdlSeasonLoader::SL_READY:
+		break;
 
-	if ((unsigned)game->getConfigStr("datapath", dpath, sizeof(dpath)) >= sizeof(dpath))
-		dpath[0] = '\0';
+	case SdlSeasonLoader::SL_FAILED:
+		game->fatal("%s\n", seasonLoader.getError(season));
+		return -1;
 
-	for (;;) {
-		if (snprintf(fname, sizeof(fname), "wormik_%d.png", season) >= (int)sizeof(fname)) {
-			game->fatal("filename too long\n");
-		}
-		if (!(sf = findopenfile(fname, "d", RESOURCE_DIR, "d", (dpath[0] == '\0') ? "." : dpath, NULL))) {
-			if (season == 0)
-				game->fatal("failed to open %s: %s\n", fname, strerror(errno));
-			season = 0;
-		}
-		else
-			break;
-	}
-#if (defined _WIN32) || (defined _WIN64)
-	sprintf(fname, "wormik_%d.png", season);
-	SDL_RWclose(sf);
-	img = IMG_Load(fname);
-#else
-	img = IMG_Load_RW(sf, 1);
-#endif
-	if (!img) {
-		game->fatal("failed to process image %s: %s\n", fname, SDL_GetError());
+	default:
+		return -1;
 	}
-	if (img->w != SIMG_WIDTH || img->h != SIMG_HEIGTH+1 || img->format->BytesPerPixel != 4) {
-		game->fatal("%s: image has to be %dx%dx32 sized (is %dx%dx%d)\n", fname, SIMG_WIDTH, SIMG_HEIGTH+1, img->w, img->h, img->format->BytesPerPixel*8);
+	if (initSeasonImage(textures, seasonLoader.getIcons(season)) < 0) {
+		if (textures->image)
+			SDL_DestroyTexture(textures->image);
+		if (textures->bgImage)
+			SDL_DestroyTexture(textures->bgImage);
+		textures->image = textures->bgImage = NULL;
+		game->fatal();
 	}
+	return 0;
+}
 
-	if (SDL_LockSurface(img) < 0) {
-		game->fatal("cannot lock surface: %s\n", SDL_GetError());
-	}
-	// find basic drawing colors, these have alpha 0 in original image
-#if 1
-	i = 0;
-	for (unsigned i = 0; i < sizeof(c)/sizeof(c[0]); ++i) {
-		Uint8 a;
-		SDL_GetRGBA(*(Uint32 *)((char *)img->pixels+SIMG_HEIGTH*img->pitch+i*img->format->BytesPerPixel), img->format, &c[i].r, &c[i].g, &c[i].b, &a);
+void SdlWormikGui::dropSeasons()
+{
+	for (int season = 0; season < SdlSeasonLoader::MAX_SEASONS; season++) {
+		season_textures *textures = &seasonTextures[season];
+		if (textures->image) {
+			SDL_DestroyTexture(textures->image);
+			textures->image = NULL;
+		}
+		if (textures->bgImage) {
+			SDL_DestroyTexture(textures->bgImage);
+			textures->bgImage = NULL;
+		}
 	}
-#else
-	for (i = 0; i < sizeof(c)/sizeof(c[0]); i++) {
-		Uint8 a;
-		SDL_GetRGBA(*(Uint32 *)((char *)imgPixels+5*GRECT_YSIZE*imgPitch+(2*GRECT_XSIZE+i)*SDL_BYTESPERPIXEL(imgFormat)), imgFormat, &c[i].r, &c[i].g, &c[i].b, &a);
-		printf("found %dx%d: (%d, %d, %d)\n", y, x, c[i].r, c[i].g, c[i].b);
+	seasonImage = NULL;
+	bgSeasonImage = NULL;
+}
+
+int SdlWormikGui::initLevelImage(int season)
+{
+	const SDL_Color *c;
+
+	// seasons are decoded in background and converted to textures once,
+	// level switch then only picks the cached ones
+	if (prepareSeason(season) < 0) {
+		if (season == 0 || prepareSeason(0) < 0)
+			game->fatal("failed to load season image: %s\n", seasonLoader.getError(season));
+		season = 0;
 	}
-#endif
-	for (i = 0; i < sizeof(c)/sizeof(c[0]); i++) {
+	seasonImage = seasonTextures[season].image;
+	bgSeasonImage = seasonTextures[season].bgImage;
+	c = seasonLoader.getColors(season);
+	for (unsigned i = 0; i < sizeof(colors)/sizeof(colors[0]); i++) {
 		colors[i] = SDL_MapRGB(windowPixelFormat, c[i].r, c[i].g, c[i].b);
 	}
 
-	SDL_Surface *onlyIcons = SDL_CreateRGBSurfaceFrom((char *)img->pixels, img->w, SIMG_HEIGTH, img->format->BitsPerPixel, img->pitch, img->format->Rmask, img->format->Gmask, img->format->Bmask, img->format->Amask);
-	SDL_UnlockSurface(img);
-	err = initSeasonImage(onlyIcons);
-	SDL_FreeSurface(img);
-	SDL_FreeSurface(onlyIcons);
-	if (err < 0)
-		return err;
-
 	SDL_SetRenderTarget(textureRenderer, basicScreen);
 	drawStaticScreen(INVO_SDL_FULL);
 	SDL_SetRenderTarget(textureRenderer, NULL);
 
 	invalidateOutput(-INVO_SDL_FULL, NULL);
+	startupMark("level image loaded");
 	return season;
 }
 
@@ -546,12 +865,11 @@ int SdlWormikGui::newLevel(int season)
 void SdlWormikGui::drawStatic(void *gc, unsigned x, unsigned y, unsigned short cont)
 {
 	SDL_Rect s, d;
-	unsigned sx, sy;
-	d.x = x*GRECT_XSIZE; d.y = y*GRECT_YSIZE;
-	d.w = s.w = GRECT_XSIZE; d.h = s.h = GRECT_YSIZE;
-	findImagePos(cont, &sx, &sy);
-	s.x = sx; s.y = sy;
-	SDL_RenderCopy(windowRenderer, bgSeasonImage, &s, &d);
+	d.x = x*tileWidth; d.y = y*tileHeight;
+	d.w = s.w = tileWidth; d.h = s.h = tileHeight;
+	s.x = board_image_pos[cont].x*tileWidth; s.y = board_image_pos[cont].y*tileHeight;
+	tileBatch.begin(bgSeasonImage);
+	tileBatch.add(&s, &d);
 }
 
 void SdlWormikGui::drawPoint(void *gc, unsigned x, unsigned y, unsigned short cont)
@@ -559,12 +877,11 @@ void SdlWormikGui::drawPoint(void *gc, unsigned x, unsigned y, unsigned short co
 	if (cont == WormikGame::GR_NONE || cont == WormikGame::GR_WALL)
 		return;
 	SDL_Rect s, d;
-	unsigned sx, sy;
-	d.x = x*GRECT_XSIZE; d.y = y*GRECT_YSIZE;
-	d.w = s.w = GRECT_XSIZE; d.h = s.h = GRECT_YSIZE;
-	findImagePos(cont, &sx, &sy);
-	s.x = sx; s.y = sy;
-	SDL_RenderCopy(windowRenderer, bgSeasonImage, &s, &d);
+	d.x = x*tileWidth; d.y = y*tileHeight;
+	d.w = s.w = tileWidth; d.h = s.h = tileHeight;
+	s.x = board_image_pos[cont].x*tileWidth; s.y = board_image_pos[cont].y*tileHeight;
+	tileBatch.begin(bgSeasonImage);
+	tileBatch.add(&s, &d);
 }
 
 int SdlWormikGui::drawNewdef(void *gc, unsigned x, unsigned y, unsigned short cont, double timeout, double total)
@@ -572,24 +889,27 @@ int SdlWormikGui::drawNewdef(void *gc, unsigned x, unsigned y, unsigned short co
 	SDL_Rect s, d;
 	unsigned sx, sy;
 	int alpha = (int)(255*(timeout-diffGameTime)/total);
-	d.x = x*GRECT_XSIZE; d.y = y*GRECT_YSIZE;
-	d.w = s.w = GRECT_XSIZE; d.h = s.h = GRECT_YSIZE;
-	findImagePos(cont, &sx, &sy);
+	d.x = x*tileWidth; d.y = y*tileHeight;
+	d.w = s.w = tileWidth; d.h = s.h = tileHeight;
+	findImagePos(cont, &sx, &sy, tileWidth, tileHeight);
+	// boardScreen keeps previous fade step, start from clean background
+	restoreCell(x, y);
+	s.x = sx; s.y = sy;
+	tileBatch.begin(bgSeasonImage);
 	if (alpha <= 0) {
-		s.x = sx; s.y = sy;
-		SDL_RenderCopy(windowRenderer, bgSeasonImage, &s, &d);
+		tileBatch.add(&s, &d);
 		return 0;
 	}
 	else {
 		if (alpha >= 256) // possible because of newdef latency
 			alpha = 255;
-		// not needed as we start from fresh copy always
-		//s.x = SP_BACK_X*GRECT_XSIZE; s.y = SP_BACK_Y*GRECT_YSIZE;
-		//SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
-		s.x = sx; s.y = sy;
-		SDL_SetTextureAlphaMod(bgSeasonImage, 255-alpha);
-		SDL_RenderCopy(windowRenderer, bgSeasonImage, &s, &d);
-		SDL_SetTextureAlphaMod(bgSeasonImage, 255);
+		if (findFadePos(cont, (255-alpha)*(FADE_LEVELS-1)/255, &sx, &sy, tileWidth, tileHeight)) {
+			s.x = sx; s.y = sy;
+			tileBatch.add(&s, &d);
+		}
+		else {
+			tileBatch.add(&s, &d, 255-alpha);
+		}
 		return 1;
 	}
 }
@@ -600,13 +920,11 @@ void SdlWormikGui::invalidateOutput(int len, unsigned (*points)[2])
 		return;
 	}
 	else if (len < 0) {
-		invalidatedList[0].addFlags(-len);
-		invalidatedList[1].addFlags(-len);
+		invalidatedList.addFlags(-len);
 	}
 	else {
 		while (len-- > 0) {
-			invalidatedList[0].addObject(points[len][0], points[len][1]);
-			invalidatedList[1].addObject(points[len][0], points[len][1]);
+			invalidatedList.addObject(points[len][0], points[len][1]);
 		}
 	}
 	redraw = true;
@@ -620,16 +938,8 @@ void SdlWormikGui::invalidateAll()
 void SdlWormikGui::drawText(int x, int y, Uint32 color, const char *text)
 {
 	SDL_Color clr;
-	SDL_Surface *fs;
-	SDL_Rect d;
-	SDL_GetRGB(color, windowPixelFormat, &clr.r, &clr.g, &clr.b);
-	fs = TTF_RenderText_Blended(font, text, clr);
-	SDL_Texture *texture = SDL_CreateTextureFromSurface(windowRenderer, fs);
-	d.x = (x >= 0) ? x : (-x-fs->w); d.y = (y >= 0) ? y : (-y-fs->h);
-	d.w = fs->w; d.h = fs->h;
-	SDL_RenderCopy(windowRenderer, texture, NULL, &d);
-	SDL_DestroyTexture(texture);
-	SDL_FreeSurface(fs);
+	SDL_GetRGB(color, windowPixelFormat, &clr.r, &clr.g, &clr.b); clr.a = 255;
+	textCache.draw(&tileBatch, x, y, clr, text, strlen(text));
 }
 
 void SdlWormikGui::drawLinedTextf(int x, int y, Uint32 color, const char *fmt, ...)
@@ -638,37 +948,29 @@ void SdlWormikGui::drawLinedTextf(int x, int y, Uint32 color, const char *fmt, .
 	va_list va;
 	char buf[256];
 	int nrows;
-	SDL_Rect d;
-	SDL_Surface *fs[256];
 	char *p;
-	int mw, th;
-	SDL_GetRGB(color, windowPixelFormat, &clr.r, &clr.g, &clr.b);
+	int th;
+	SDL_GetRGB(color, windowPixelFormat, &clr.r, &clr.g, &clr.b); clr.a = 255;
 	va_start(va, fmt);
 	if (vsnprintf(buf, sizeof(buf), fmt, va) >= (int)sizeof(buf))
 		buf[sizeof(buf)-1] = '\0';
+	va_end(va);
 
-	mw = 0; th = 0;
 	for (p = buf, nrows = 0; *p != '\0'; nrows++) {
+		while (*p != '\0' && *p != '\n')
+			p++;
+		if (*p != '\0')
+			p++;
+	}
+	th = nrows*textCache.getLineHeight();
+	y = (y >= 0) ? y : (-y-th);
+	for (p = buf; *p != '\0'; y += textCache.getLineHeight()) {
 		char *o = p;
 		while (*p != '\0' && *p != '\n')
 			p++;
+		textCache.draw(&tileBatch, x, y, clr, o, p-o);
 		if (*p != '\0')
-			*p++ = '\0';
-		fs[nrows] = TTF_RenderText_Blended(font, o, clr);
-		if (fs[nrows]->w > mw)
-			mw = fs[nrows]->w;
-		th += fs[nrows]->h;
-	}
-	d.y = (y >= 0) ? y : (-y-th);
-	fs[nrows] = NULL;
-	for (nrows = 0; fs[nrows]; nrows++) {
-		d.x = (x >= 0) ? x : (-x-fs[nrows]->w);
-		d.w = fs[nrows]->w; d.h = fs[nrows]->h;
-		SDL_Texture *texture = SDL_CreateTextureFromSurface(windowRenderer, fs[nrows]);
-		SDL_RenderCopy(windowRenderer, texture, NULL, &d);
-		d.y += fs[nrows]->h;
-		SDL_DestroyTexture(texture);
-		SDL_FreeSurface(fs[nrows]);
+			p++;
 	}
 }
 
@@ -678,96 +980,148 @@ void SdlWormikGui::drawStaticScreen(int flags)
 	SDL_Rect s, d;
 
 	if ((flags&INVO_BOARD) != 0) {
-		s.x = SP_BACK_X*GRECT_XSIZE; s.y = SP_BACK_Y*GRECT_YSIZE; s.w = GRECT_XSIZE; s.h = GRECT_YSIZE;
-		game->outStatic(NULL, 0, 0, game->GAME_XSIZE-1, game->GAME_YSIZE-1);
+		WormikGame::board_view view;
+		game->getBoardView(&view);
+		for (y = 0; y < WormikGame::GAME_YSIZE; y++) {
+			const WormikGame::board_def *row = view.board+y*view.stride;
+			for (x = 0; x < WormikGame::GAME_XSIZE; x++)
+				SdlWormikGui::drawStatic(NULL, x, y, row[x] == WormikGame::GR_WALL ? WormikGame::GR_WALL : WormikGame::GR_NONE);
+		}
+		tileBatch.flush();
 	}
 
 	if ((flags&INVO_MENU) != 0) {
-		findImagePos(WormikGame::GR_WALL, &x, &y);
-		s.x = x; s.y = y; s.w = GRECT_XSIZE; s.h = GRECT_YSIZE;
-		d.w = GRECT_XSIZE; d.h = GRECT_YSIZE;
-		SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_MENU_BG]>>16), (Uint8)(colors[CLR_MENU_BG]>>8), (Uint8)(colors[CLR_MENU_BG]>>0), (Uint8)(colors[CLR_MENU_BG]>>24));
+		SDL_Rect fills[MENU_HEIGHT_POINTS+5*MENU_WIDTH_POINTS];
+		int nfills = 0;
+		findImagePos(WormikGame::GR_WALL, &x, &y, tileWidth, tileHeight);
+		s.x = x; s.y = y; s.w = tileWidth; s.h = tileHeight;
+		d.w = tileWidth; d.h = tileHeight;
 		for (y = 1; y < MENU_HEIGHT_POINTS-1; y++) {
-			d.x = AREA_INFO_X+(MENU_WIDTH_POINTS-1)*GRECT_XSIZE; d.y = y*GRECT_YSIZE;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
+			d.x = scaleX(AREA_INFO_X)+(MENU_WIDTH_POINTS-1)*tileWidth; d.y = y*tileHeight;
+			fills[nfills++] = d;
 		}
 		for (x = 0; x < MENU_WIDTH_POINTS; x++) {
-			d.x = AREA_INFO_X+x*GRECT_XSIZE;
+			d.x = scaleX(AREA_INFO_X)+x*tileWidth;
 			d.y = 0;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
-			d.y = MENU_SEP_SCORE_POINTS*GRECT_YSIZE;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
-			d.y = MENU_SEP_SNAKE_POINTS*GRECT_YSIZE;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
-			d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
-			d.y = (MENU_HEIGHT_POINTS-1)*GRECT_YSIZE;
-			SDL_RenderFillRect(windowRenderer, &d);
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
+			fills[nfills++] = d;
+			d.y = MENU_SEP_SCORE_POINTS*tileHeight;
+			fills[nfills++] = d;
+			d.y = MENU_SEP_SNAKE_POINTS*tileHeight;
+			fills[nfills++] = d;
+			d.y = MENU_SEP_INFO_POINTS*tileHeight;
+			fills[nfills++] = d;
+			d.y = (MENU_HEIGHT_POINTS-1)*tileHeight;
+			fills[nfills++] = d;
 		}
+		assert(nfills <= (int)(sizeof(fills)/sizeof(fills[0])));
+		SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_MENU_BG]>>16), (Uint8)(colors[CLR_MENU_BG]>>8), (Uint8)(colors[CLR_MENU_BG]>>0), (Uint8)(colors[CLR_MENU_BG]>>24));
+		SDL_RenderFillRects(windowRenderer, fills, nfills);
+		tileBatch.begin(seasonImage);
+		for (int i = 0; i < nfills; i++)
+			tileBatch.add(&s, &fills[i]);
+		tileBatch.flush();
 	}
 
 	if ((flags&INVO_DESC) != 0) {
-		s.w = GRECT_XSIZE; s.h = GRECT_YSIZE;
-		d.x = AREA_INFO_X; d.y = (MENU_SEP_INFO_POINTS+1)*GRECT_YSIZE; d.w = (MENU_WIDTH_POINTS-1)*GRECT_XSIZE; d.h = (MENU_HEIGHT_POINTS-MENU_SEP_INFO_POINTS-2)*GRECT_YSIZE;
+		s.w = tileWidth; s.h = tileHeight;
+		d.x = scaleX(AREA_INFO_X); d.y = (MENU_SEP_INFO_POINTS+1)*tileHeight; d.w = (MENU_WIDTH_POINTS-1)*tileWidth; d.h = (MENU_HEIGHT_POINTS-MENU_SEP_INFO_POINTS-2)*tileHeight;
 		SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_MENU_BG]>>16), (Uint8)(colors[CLR_MENU_BG]>>8), (Uint8)(colors[CLR_MENU_BG]>>0), (Uint8)(colors[CLR_MENU_BG]>>24));
 		SDL_RenderFillRect(windowRenderer, &d);
-		d.w = GRECT_XSIZE; d.h = GRECT_YSIZE;
-		findImagePos(WormikGame::GR_POSITIVE, &x, &y); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE+GRECT_YSIZE+MENU_DESC_SPACING_PX;
-		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-MENU_DESC_RIGHT_PX, d.y, colors[CLR_MENU_FONT], "S+2");
-		findImagePos(WormikGame::GR_POSITIVE_2, &x, &y); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE+GRECT_YSIZE+MENU_DESC_SPACING_PX+GRECT_YSIZE*2;
-		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-MENU_DESC_RIGHT_PX, d.y, colors[CLR_MENU_FONT], "S+5");
-		findImagePos(WormikGame::GR_NEGATIVE, &x, &y); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE+GRECT_YSIZE+MENU_DESC_SPACING_PX+GRECT_YSIZE*4;
-		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-MENU_DESC_RIGHT_PX, d.y, colors[CLR_MENU_FONT], "H-1");
-		findImagePos(WormikGame::GR_DEATH, &x, &y); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE+GRECT_YSIZE+MENU_DESC_SPACING_PX+GRECT_YSIZE*6;
-		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-MENU_DESC_RIGHT_PX, d.y, colors[CLR_MENU_FONT], "Death");
-		findImagePos(WormikGame::GR_EXIT, &x, &y); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*GRECT_YSIZE+GRECT_YSIZE+MENU_DESC_SPACING_PX+GRECT_YSIZE*8;
-		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-MENU_DESC_RIGHT_PX, d.y, colors[CLR_MENU_FONT], "Exit");
+		d.w = tileWidth; d.h = tileHeight;
+		findImagePos(WormikGame::GR_POSITIVE, &x, &y, tileWidth, tileHeight); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*tileHeight+tileHeight+scaleY(MENU_DESC_SPACING_PX);
+		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-scaleX(MENU_DESC_RIGHT_PX), d.y, colors[CLR_MENU_FONT], "S+2");
+		findImagePos(WormikGame::GR_POSITIVE_2, &x, &y, tileWidth, tileHeight); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*tileHeight+tileHeight+scaleY(MENU_DESC_SPACING_PX)+tileHeight*2;
+		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-scaleX(MENU_DESC_RIGHT_PX), d.y, colors[CLR_MENU_FONT], "S+5");
+		findImagePos(WormikGame::GR_NEGATIVE, &x, &y, tileWidth, tileHeight); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*tileHeight+tileHeight+scaleY(MENU_DESC_SPACING_PX)+tileHeight*4;
+		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-scaleX(MENU_DESC_RIGHT_PX), d.y, colors[CLR_MENU_FONT], "H-1");
+		findImagePos(WormikGame::GR_DEATH, &x, &y, tileWidth, tileHeight); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*tileHeight+tileHeight+scaleY(MENU_DESC_SPACING_PX)+tileHeight*6;
+		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-scaleX(MENU_DESC_RIGHT_PX), d.y, colors[CLR_MENU_FONT], "Death");
+		findImagePos(WormikGame::GR_EXIT, &x, &y, tileWidth, tileHeight); s.x = x; s.y = y; d.y = MENU_SEP_INFO_POINTS*tileHeight+tileHeight+scaleY(MENU_DESC_SPACING_PX)+tileHeight*8;
+		SDL_RenderCopy(windowRenderer, seasonImage, &s, &d); drawText(-scaleX(MENU_DESC_RIGHT_PX), d.y, colors[CLR_MENU_FONT], "Exit");
+		tileBatch.flush();
 	}
 }
 
+void SdlWormikGui::restoreCell(unsigned x, unsigned y)
+{
+	SDL_Rect d;
+	d.x = x*tileWidth; d.y = y*tileHeight; d.w = tileWidth; d.h = tileHeight;
+	cellBatch.begin(basicScreen);
+	cellBatch.add(&d, &d);
+	frameCells++;
+}
+
 unsigned SdlWormikGui::drawBase(void)
 {
 	unsigned ret = 0;
 	SDL_Rect d;
-	InvalidatedList *currentIl = &invalidatedList[nextInvalidatedList];
-
-	// reset all screen prior to drawing, reusing old one does not work everywhere correctly
-	currentIl->resetFlags(INVO_SDL_FULL);
-
-	SDL_RenderCopy(windowRenderer, basicScreen, NULL, NULL);
+	InvalidatedList *currentIl = &invalidatedList;
+	perf_sample sample;
+
+	frameStart = getDoubleTime();
+	if (perf != NULL)
+		perf->begin(&sample);
+	// boardScreen keeps its content between frames, so only invalidated
+	// cells and panels are redrawn into it and the result is then copied
+	// to the (undefined) back buffer as whole
+	if (SDL_SetRenderTarget(windowRenderer, boardScreen) < 0) {
+		game->fatal("failed to set rendering to boardScreen: %s\n", SDL_GetError());
+	}
+	frameCells = 0;
+	cellBatch.resetStats();
+	tileBatch.resetStats();
 
+	// board is read directly, qualified drawPoint calls are not virtual
+	WormikGame::board_view view;
+	game->getBoardView(&view);
 	if ((currentIl->flags&INVO_BOARD) != 0) {
-		game->outGame(NULL, 0, 0, WormikGame::GAME_XSIZE-1, WormikGame::GAME_YSIZE-1);
+		SDL_RenderCopy(windowRenderer, basicScreen, NULL, NULL);
+		for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+			const WormikGame::board_def *row = view.board+y*view.stride;
+			for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++) {
+				if (row[x] != WormikGame::GR_NEW_DEF)
+					SdlWormikGui::drawPoint(NULL, x, y, row[x]);
+			}
+		}
+		frameCells += WormikGame::GAME_XSIZE*WormikGame::GAME_YSIZE;
+		// newdefs are not part of board
+		currentIl->flags |= INVO_NEW_DEFS;
 	}
 	else {
 		unsigned i;
 		for (i = 0; i < currentIl->invalidatedLength; i++) {
-			game->outPoint(NULL, currentIl->invalidatedList[i][0], currentIl->invalidatedList[i][1]);
+			unsigned x = currentIl->invalidatedList[i][0], y = currentIl->invalidatedList[i][1];
+			WormikGame::board_def t = view.board[y*view.stride+x];
+			restoreCell(x, y);
+			if (t != WormikGame::GR_NEW_DEF)
+				SdlWormikGui::drawPoint(NULL, x, y, t);
 		}
 	}
 	currentIl->invalidatedLength = 0;
 
 	if ((currentIl->flags&INVO_NEW_DEFS) != 0) {
-		if (game->outNewdefs(NULL) > 0)
+		int timing = 0;
+		for (unsigned i = 0; i < view.newdefsLength; i++) {
+			const WormikGame::board_newdef *nd = &view.newdefs[i];
+			timing += SdlWormikGui::drawNewdef(NULL, nd->x, nd->y, nd->def, WormikGame::GT_SECONDS(nd->timeout), WormikGame::GT_SECONDS(nd->total));
+		}
+		if (timing > 0)
 			ret |= INVO_NEW_DEFS;
 	}
+	// background layer has to go first
+	cellBatch.flush();
+	tileBatch.flush();
 
 	if ((currentIl->flags&(INVO_RECORD|INVO_SCORE|INVO_GAME_STATE|INVO_HEALTH|INVO_LENGTH)) != 0) {
-		d.w = (MENU_WIDTH_POINTS-1)*GRECT_XSIZE; d.x = AREA_INFO_X;
+		d.w = (MENU_WIDTH_POINTS-1)*tileWidth; d.x = scaleX(AREA_INFO_X);
 		if ((currentIl->flags&INVO_RECORD) != 0) {
 			struct tm t; char tc[32];
 			int record; time_t rectime; bool isNow;
 			isNow = game->getRecord(&record, &rectime);
 			t = *localtime(&rectime); strftime(tc, sizeof(tc), "%Y-%m-%d %H:%M", &t);
 			SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_MENU_BG]>>16), (Uint8)(colors[CLR_MENU_BG]>>8), (Uint8)(colors[CLR_MENU_BG]>>0), (Uint8)(colors[CLR_MENU_BG]>>24));
-			d.y = GRECT_YSIZE; d.h = (MENU_SEP_FIRST_POINTS-1)*GRECT_YSIZE; SDL_RenderFillRect(windowRenderer, &d);
-			drawLinedTextf(-MENU_TEXT_RIGHT_PX, d.y+MENU_FONT_HEIGHT_PX, colors[isNow ? CLR_EXCEPTION_FONT : CLR_MENU_FONT], "Record: %d\n%s\n", record, (rectime == 0) ? " " : tc);
+			d.y = tileHeight; d.h = (MENU_SEP_FIRST_POINTS-1)*tileHeight; SDL_RenderFillRect(windowRenderer, &d);
+			drawLinedTextf(-scaleX(MENU_TEXT_RIGHT_PX), d.y+scaleY(MENU_FONT_HEIGHT_PX), colors[isNow ? CLR_EXCEPTION_FONT : CLR_MENU_FONT], "Record: %d\n%s\n", record, (rectime == 0) ? " " : tc);
 		}
 		if ((currentIl->flags&(INVO_SCORE|INVO_GAME_STATE)) != 0) {
 			int score, total, exit;
@@ -775,18 +1129,31 @@ unsigned SdlWormikGui::drawBase(void)
 			game->getState(&level, &season);
 			exit = game->getScore(&score, &total);
 			SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[0]>>16), (Uint8)(colors[0]>>8), (Uint8)(colors[0]>>0), (Uint8)(colors[0]>>24));
-			d.y = (MENU_SEP_FIRST_POINTS+1)*GRECT_YSIZE; d.h = (MENU_SEP_SNAKE_POINTS-MENU_SEP_FIRST_POINTS-1)*GRECT_YSIZE; SDL_RenderFillRect(windowRenderer, &d);
-			drawLinedTextf(-MENU_TEXT_RIGHT_PX, d.y+MENU_FONT_HEIGHT_PX, colors[(score >= exit)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Score: %d\nLevel: %d/%d\n", total, level, (total-score)+exit);
+			d.y = (MENU_SEP_FIRST_POINTS+1)*tileHeight; d.h = (MENU_SEP_SNAKE_POINTS-MENU_SEP_FIRST_POINTS-1)*tileHeight; SDL_RenderFillRect(windowRenderer, &d);
+			drawLinedTextf(-scaleX(MENU_TEXT_RIGHT_PX), d.y+scaleY(MENU_FONT_HEIGHT_PX), colors[(score >= exit)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Score: %d\nLevel: %d/%d\n", total, level, (total-score)+exit);
 		}
 		if ((currentIl->flags&(INVO_HEALTH|INVO_LENGTH)) != 0) {
 			int health, length;
 			game->getSnakeInfo(&health, &length);
 			SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[0]>>16), (Uint8)(colors[0]>>8), (Uint8)(colors[0]>>0), (Uint8)(colors[0]>>24));
-			d.y = (MENU_SEP_SNAKE_POINTS+1)*GRECT_YSIZE; d.h = (MENU_SEP_INFO_POINTS-MENU_SEP_SNAKE_POINTS-1)*GRECT_YSIZE; SDL_RenderFillRect(windowRenderer, &d);
-			drawLinedTextf(-MENU_TEXT_RIGHT_PX, d.y+MENU_FONT_HEIGHT_PX, colors[(health <= 1)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Health: %d\nLength: %d\n", health, length);
+			d.y = (MENU_SEP_SNAKE_POINTS+1)*tileHeight; d.h = (MENU_SEP_INFO_POINTS-MENU_SEP_SNAKE_POINTS-1)*tileHeight; SDL_RenderFillRect(windowRenderer, &d);
+			drawLinedTextf(-scaleX(MENU_TEXT_RIGHT_PX), d.y+scaleY(MENU_FONT_HEIGHT_PX), colors[(health <= 1)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Health: %d\nLength: %d\n", health, length);
 		}
+		tileBatch.flush();
 	}
 
+	SDL_SetRenderTarget(windowRenderer, NULL);
+	// clear also borders outside of screenArea
+	SDL_SetRenderDrawColor(windowRenderer, 0, 0, 0, 255);
+	SDL_RenderClear(windowRenderer);
+	SDL_RenderCopy(windowRenderer, boardScreen, NULL, NULL);
+	if (replaying)
+		drawReplayBar(replay.getStep(), replay.getLastStep(), replayPaused ? " paused" : "");
+	else if (instantTotal != 0)
+		drawReplayBar(instantStep, instantTotal, " instant replay");
+	if (perf != NULL)
+		perf->end(perfDraw, &sample);
+
 	return ret;
 }
 
@@ -794,52 +1161,98 @@ unsigned SdlWormikGui::drawAnnounce(unsigned n, const char *const text[])
 {
 	SDL_Color clr;
 	unsigned i;
-	SDL_Surface **fs = (SDL_Surface **)alloca(n*sizeof(SDL_Surface *));
+	int *tw = (int *)alloca(n*sizeof(int));
 	SDL_Rect s, d;
 	int w, h;
 	int ey, ex;
 
-	SDL_GetRGB(colors[CLR_ANNOUNCEMENT_FONT], windowPixelFormat, &clr.r, &clr.g, &clr.b);
+	SDL_GetRGB(colors[CLR_ANNOUNCEMENT_FONT], windowPixelFormat, &clr.r, &clr.g, &clr.b); clr.a = 255;
 
 	w = h = 0;
 	for (i = 0; i < n; i++) {
-		fs[i] = TTF_RenderText_Blended(font, text[i], clr);
-		if (fs[i]->w > w)
-			w = fs[i]->w;
-		h += fs[i]->h;
-	}
-	w += 2*GRECT_XSIZE; h += GRECT_YSIZE;
-	s.x = SP_MSG_X*GRECT_XSIZE; s.y = SP_MSG_Y*GRECT_YSIZE; s.h = GRECT_YSIZE;
-	for (d.y = (WINDOW_HEIGHT-h)/2, ey = d.y+h; d.y < ey; d.y += GRECT_YSIZE) {
+		tw[i] = textCache.measure(text[i], strlen(text[i]));
+		if (tw[i] > w)
+			w = tw[i];
+		h += textCache.getLineHeight();
+	}
+	w += 2*tileWidth; h += tileHeight;
+	s.x = SP_MSG_X*tileWidth; s.y = SP_MSG_Y*tileHeight; s.h = tileHeight;
+	tileBatch.begin(seasonImage);
+	for (d.y = (scaleY(WINDOW_HEIGHT)-h)/2, ey = d.y+h; d.y < ey; d.y += tileHeight) {
 		if (d.y+s.h > ey)
 			s.h = ey-d.y;
-		s.w = GRECT_XSIZE;
+		s.w = tileWidth;
 		d.w = s.w; d.h = s.h;
-		for (d.x = (MENU_X_POINTS*GRECT_XSIZE-w)/2, ex = d.x+w; d.x < ex; d.x += GRECT_XSIZE) {
+		for (d.x = (MENU_X_POINTS*tileWidth-w)/2, ex = d.x+w; d.x < ex; d.x += tileWidth) {
 			if (d.x+s.w > ex)
 				s.w = ex-d.x;
-			SDL_RenderCopy(windowRenderer, seasonImage, &s, &d);
+			tileBatch.add(&s, &d);
 		}
 	}
-	d.y = (WINDOW_HEIGHT-h+GRECT_YSIZE)/2;
+	d.y = (scaleY(WINDOW_HEIGHT)-h+tileHeight)/2;
 	for (i = 0; i < n; i++) {
-		d.x = (WINDOW_HEIGHT-fs[i]->w)/2;
-		d.w = fs[i]->w; d.h = fs[i]->h;
-		SDL_Texture *texture = SDL_CreateTextureFromSurface(windowRenderer, fs[i]);
-		SDL_RenderCopy(windowRenderer, texture, NULL, &d);
-		d.y += fs[i]->h;
-		SDL_DestroyTexture(texture);
-		SDL_FreeSurface(fs[i]);
+		textCache.draw(&tileBatch, (MENU_X_POINTS*tileWidth-tw[i])/2, d.y, clr, text[i], strlen(text[i]));
+		d.y += textCache.getLineHeight();
 	}
+	tileBatch.flush();
 	return 0;
 }
 
+void SdlWormikGui::drawMotion(double progress)
+{
+	WormikGame::snake_motion motion;
+	SDL_Rect s, d;
+	unsigned sx, sy;
+	int moved = game->getSnakeMotion(&motion);
+	if (moved == 0)
+		return;
+
+	// board shows state after the step, snake parts are moved back to
+	// where they are at given progress, all drawn to back buffer only
+	d.w = s.w = tileWidth; d.h = s.h = tileHeight;
+	if ((moved&WormikGame::SM_HEAD) != 0) {
+		d.x = motion.headX*tileWidth; d.y = motion.headY*tileHeight;
+		cellBatch.begin(basicScreen);
+		cellBatch.add(&d, &d);
+		frameCells++;
+	}
+	cellBatch.flush();
+	if ((moved&WormikGame::SM_TAIL) != 0) {
+		// new tail cell is still body, joined to tail coming from previous cell
+		findImagePos(WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_BODY, (motion.tailDir+2)&3, motion.tailOut), &sx, &sy, tileWidth, tileHeight);
+		s.x = sx; s.y = sy;
+		d.x = motion.tailX*tileWidth; d.y = motion.tailY*tileHeight;
+		tileBatch.begin(bgSeasonImage);
+		tileBatch.add(&s, &d);
+		findImagePos(WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_TAIL, 0, motion.tailDir), &sx, &sy, tileWidth, tileHeight);
+		s.x = sx; s.y = sy;
+		d.x -= (int)((1-progress)*tileWidth*direction_moves[motion.tailDir][0]);
+		d.y -= (int)((1-progress)*tileHeight*direction_moves[motion.tailDir][1]);
+		tileBatch.begin(seasonImage);
+		tileBatch.add(&s, &d);
+		frameCells += 2;
+	}
+	if ((moved&WormikGame::SM_HEAD) != 0) {
+		findImagePos(WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_HEAD, (motion.headDir+2)&3, motion.headDir), &sx, &sy, tileWidth, tileHeight);
+		s.x = sx; s.y = sy;
+		d.x = motion.headX*tileWidth-(int)((1-progress)*tileWidth*direction_moves[motion.headDir][0]);
+		d.y = motion.headY*tileHeight-(int)((1-progress)*tileHeight*direction_moves[motion.headDir][1]);
+		tileBatch.begin(seasonImage);
+		tileBatch.add(&s, &d);
+		frameCells++;
+	}
+	tileBatch.flush();
+}
+
 void SdlWormikGui::drawFinish(unsigned rerenderFlags)
 {
 	SDL_RenderPresent(windowRenderer);
-	invalidatedList[nextInvalidatedList].resetFlags(rerenderFlags);
-	nextInvalidatedList ^= 1;
+	invalidatedList.resetFlags(rerenderFlags);
 	redraw = false;
+	statsFrames++;
+	statsCells += frameCells;
+	statsBatches += cellBatch.getFlushes()+tileBatch.getFlushes();
+	statsFrameTimes.add(getDoubleTime()-frameStart);
 }
 
 enum {
@@ -857,6 +1270,19 @@ enum {
 int SdlWormikGui::processStandardEvent(SDL_Event *ev)
 {
 	game->debug("Got event: %d\n", ev->type);
+#ifdef IDLECHECK
+	if (ev->type == idleCheckEvent) {
+		idleCheckVerify();
+		return STDE_PROCESSED;
+	}
+#endif
+	if (seasonEvent != 0 && ev->type == seasonEvent) {
+		// convert newly decoded season to textures while idle, so the
+		// level switch does not have to
+		if (windowRenderer && seasonLoader.poll(ev->user.code) == SdlSeasonLoader::SL_READY)
+			prepareSeason(ev->user.code);
+		return STDE_PROCESSED;
+	}
 	switch (ev->type) {
 	case SDL_QUIT:
 		return STDE_QUIT;
@@ -868,23 +1294,7 @@ int SdlWormikGui::processStandardEvent(SDL_Event *ev)
 			return STDE_QUIT;
 
 		case SDLK_f:
-			{
-				closeGui();
-				game->setConfig("fullscreen", game->getConfigInt("fullscreen", 0) == 0);
-				if (initGui() < 0) {
-					game->error("Failed to set video mode, trying to set the old one: %s\n", SDL_GetError());
-					game->setConfig("fullscreen", game->getConfigInt("fullscreen", 0) == 0);
-					if (initGui() < 0) {
-						game->fatal("Failed to set video mode: %s\n", SDL_GetError());
-					}
-				}
-				int season;
-				game->getState(NULL, &season);
-				if (initLevelImage(season) < 0) {
-					game->fatal("Failed to load season image\n");
-				}
-			}
-			invalidateAll();
+			toggleFullscreen();
 			return STDE_SHOW_PAUSE;
 
 		case SDLK_h:
@@ -901,17 +1311,142 @@ int SdlWormikGui::processStandardEvent(SDL_Event *ev)
 		break;
 
 	case SDL_WINDOWEVENT:
-		invalidatedList[0].resetFlags(INVO_SDL_FULL); invalidatedList[1].resetFlags(INVO_SDL_FULL);
+		// boardScreen survives, it's enough to copy it again
+		if (ev->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+			updateLayout();
 		redraw = true;
 		return STDE_PROCESSED;
+
+	case SDL_RENDER_TARGETS_RESET:
+		// content of target textures was lost, rebuild them from decoded
+		// images
+		{
+			int season;
+			dropSeasons();
+			game->getState(NULL, &season);
+			if (initLevelImage(season) < 0) {
+				game->fatal("Failed to load season image\n");
+			}
+		}
+		return STDE_PROCESSED;
+
+	case SDL_RENDER_DEVICE_RESET:
+		// all textures were lost, recreate them from surfaces and font
+		// kept in memory
+		{
+			int season;
+			closeTextures();
+			if (initTextures() < 0)
+				game->fatal("Failed to recreate textures after device reset\n");
+			game->getState(NULL, &season);
+			if (initLevelImage(season) < 0) {
+				game->fatal("Failed to load season image\n");
+			}
+		}
+		return STDE_PROCESSED;
 	}
 	return STDE_UNKNOWN;
 }
 
+int SdlWormikGui::waitEvent(SDL_Event *ev, double expire)
+{
+	int r;
+	if (expire == INFINITY) {
+		// SDL_WaitEventTimeout with huge timeout still counts down the
+		// time, this one sleeps until some event really comes
+		if (SDL_WaitEvent(ev) == 0)
+			game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+		r = 1;
+	}
+	else {
+		double eventWaitMs = ceil((expire-getDoubleTime())*1000);
+		int eventWaitMsCut = eventWaitMs < 0 ? 0 : eventWaitMs > INT_MAX ? INT_MAX : (int)eventWaitMs;
+		game->debug("waiting for %d\n", eventWaitMsCut);
+		// returns 0 on error too, which looks as timeout; zero timeout
+		// only polls before redraw and does not sleep at all
+		if ((r = SDL_WaitEventTimeout(ev, eventWaitMsCut)) == 0 && eventWaitMsCut > 0)
+			statsTimerWakeups++;
+	}
+	statsWakeups++;
+	return r;
+}
+
+#ifdef IDLECHECK
+void SdlWormikGui::idleCheckArm(int screen)
+{
+	if (idleCheck != screen || idleCheckArmed)
+		return;
+	idleCheckArmed = true;
+	idleCheckTimerWakeups = statsTimerWakeups;
+	idleCheckIdleWakeups = statsIdleWakeups;
+	if (SDL_AddTimer((Uint32)(IDLE_CHECK_TIME*1000), &idleCheckExpired, this) == 0)
+		game->fatal("Failed to add idle check timer: %s\n", SDL_GetError());
+}
+
+Uint32 SdlWormikGui::idleCheckExpired(Uint32 interval, void *self)
+{
+	// runs in SDL timer thread, leaves everything to the event
+	SDL_Event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = ((SdlWormikGui *)self)->idleCheckEvent;
+	SDL_PushEvent(&ev);
+	return 0;
+}
+
+void SdlWormikGui::pushKey(SDL_Keycode key)
+{
+	SDL_Event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = SDL_KEYDOWN;
+	ev.key.state = SDL_PRESSED;
+	ev.key.keysym.sym = key;
+	SDL_PushEvent(&ev);
+}
+
+void SdlWormikGui::idleCheckVerify()
+{
+	static const char *const names[] = { "start", "pause", "help", "death" };
+	unsigned long timerWakeups = statsTimerWakeups-idleCheckTimerWakeups;
+	unsigned long idleWakeups = statsIdleWakeups-idleCheckIdleWakeups;
+
+	if (!idleCheckArmed)
+		return;
+	idleCheckArmed = false;
+	if (timerWakeups != 0 || idleWakeups != 0)
+		game->fatal("Idle check failed on %s screen: %lu wakeups by timeout, %lu idle in %.1f s\n", names[idleCheck], timerWakeups, idleWakeups, IDLE_CHECK_TIME);
+	game->error("Idle check passed on %s screen\n", names[idleCheck]);
+	// keys moving to next screen, the snake goes right until it crashes
+	switch (idleCheck) {
+	case IC_START:
+		pushKey(SDLK_RIGHT);
+		pushKey(SDLK_p);
+		break;
+
+	case IC_PAUSE:
+		pushKey(SDLK_h);
+		break;
+
+	case IC_HELP:
+		pushKey(SDLK_RETURN);
+		pushKey(SDLK_RIGHT);
+		break;
+
+	case IC_DEAD:
+		pushKey(SDLK_q);
+		break;
+
+	default:
+		assert(0);
+	}
+	idleCheck++;
+}
+#endif
+
 int SdlWormikGui::showPopup(int messageEventId)
 {
 	int ret = -1;
-	invalidateAll();
+	// popup is drawn over composed board, board itself stays untouched
+	redraw = true;
 	do {
 		if (redraw) {
 			int ntext = 0;
@@ -948,8 +1483,11 @@ int SdlWormikGui::showPopup(int messageEventId)
 			drawFinish(0);
 		}
 		SDL_Event ev;
-		if (SDL_WaitEvent(&ev) < 0)
-			game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+#ifdef IDLECHECK
+		if (messageEventId == STDE_SHOW_HELP)
+			idleCheckArm(IC_HELP);
+#endif
+		waitEvent(&ev, INFINITY);
 		int stdEvent = processStandardEvent(&ev);
 		if (stdEvent >= STDE_SHOW_BASE && stdEvent <= STDE_SHOW_MAX) {
 			ret = stdEvent;
@@ -981,23 +1519,27 @@ int SdlWormikGui::showPopup(int messageEventId)
 			break;
 		}
 	} while (ret < 0);
-	invalidateAll();
+	redraw = true;
 	return ret;
 }
 
 bool SdlWormikGui::announce(int announcement)
 {
-	invalidateAll();
+	// replay moves on by itself, except at its end
+	double expire = replaying && !replayPaused && replay.getStep() < replay.getLastStep() ? getDoubleTime()+REPLAY_ANNOUNCE_TIME : INFINITY;
+	redraw = true;
 	for (;;) {
 		if (redraw) {
 			int ntext = 0;
-			const char *text[2];
+			const char *text[3];
 
 			drawBase();
 			game->debug("Drawing announce\n");
 			switch (announcement) {
 			case ANC_DEAD:
 				text[ntext++] = "You are dead!";
+				if (!replaying)
+					text[ntext++] = "r - instant replay";
 				break;
 
 			case ANC_EXIT:
@@ -1012,10 +1554,20 @@ bool SdlWormikGui::announce(int announcement)
 			drawFinish(0);
 		}
 		SDL_Event ev;
-		if (SDL_WaitEvent(&ev) < 0)
-			game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+#ifdef IDLECHECK
+		if (expire == INFINITY && announcement == ANC_DEAD)
+			idleCheckArm(IC_DEAD);
+#endif
+		if (waitEvent(&ev, expire) == 0) {
+			lastMove = getDoubleTime();
+			return waitDone();
+		}
 		int stdEvent = processStandardEvent(&ev);
 reswitch:
+		if (replaying && stdEvent >= STDE_SHOW_BASE && stdEvent <= STDE_SHOW_MAX) {
+			replayPaused = true;
+			expire = INFINITY;
+		}
 		if (stdEvent == STDE_SHOW_PAUSE) {
 			continue;
 		}
@@ -1032,13 +1584,37 @@ reswitch:
 			return true;
 
 		case STDE_UNKNOWN:
+			if (replaying) {
+				int target = replayControl(&ev);
+				if (target >= 0)
+					return seekReplay(target);
+				if (ev.type == SDL_KEYDOWN && (ev.key.keysym.sym == SDLK_p || ev.key.keysym.sym == SDLK_SPACE)) {
+					if (replayPaused) {
+						replayPaused = false;
+						lastMove = getDoubleTime();
+						return waitDone();
+					}
+					stdEvent = STDE_SHOW_PAUSE;
+					redraw = true;
+					goto reswitch;
+				}
+			}
 			switch (ev.type) {
 			case SDL_KEYDOWN:
 				switch (ev.key.keysym.sym) {
 				case SDLK_SPACE:
 				case SDLK_RETURN:
 					invalidateAll();
-					return false;
+					lastMove = getDoubleTime();
+					return waitDone();
+
+				case SDLK_r:
+					if (announcement == ANC_DEAD && !replaying) {
+						if (showInstantReplay())
+							return true;
+						redraw = true;
+					}
+					break;
 
 				default:
 					break;
@@ -1050,14 +1626,67 @@ reswitch:
 	}
 }
 
+bool SdlWormikGui::showInstantReplay()
+{
+	bool playing = true;
+
+	if ((instantTotal = game->rewindRecent(INSTANT_REPLAY_WAITS)) == 0)
+		return false;
+	instantStep = 0;
+	invalidateAll();
+	while (playing) {
+		double expire = getDoubleTime()+INSTANT_REPLAY_STEP_TIME;
+		SDL_Event ev;
+		drawFinish(drawBase());
+		while (playing && waitEvent(&ev, expire) != 0) {
+			switch (processStandardEvent(&ev)) {
+			case STDE_QUIT:
+				// quit is recorded in the live wait
+				game->stopRecent();
+				instantTotal = 0;
+				return true;
+
+			case STDE_UNKNOWN:
+				if (ev.type == SDL_KEYDOWN && (ev.key.keysym.sym == SDLK_SPACE || ev.key.keysym.sym == SDLK_RETURN || ev.key.keysym.sym == SDLK_r)) {
+					game->stopRecent();
+					playing = false;
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+		if (playing) {
+			playing = game->playRecent();
+			instantStep++;
+		}
+	}
+	instantTotal = 0;
+	invalidateAll();
+	return false;
+}
+
 bool SdlWormikGui::waitStart()
 {
+	if (replaying) {
+		lastMove = getDoubleTime();
+		return waitNext(REPLAY_START_TIME);
+	}
 	return waitNext(INFINITY);
 }
 
 bool SdlWormikGui::waitNext(double waitInterval)
 {
-	double nextRedraw = invalidatedList[nextInvalidatedList^1].flags != 0 ? getDoubleTime()+REDRAW_TIME : INFINITY;
+	// replay stays at its end, so it can be still sought back
+	if (replaying && (replayPaused || replay.getStep() >= replay.getLastStep()))
+		waitInterval = INFINITY;
+	// fading is animated only while game runs, paused or start screen is
+	// static and waits for events only
+	double nextRedraw = ((invalidatedList.flags&INVO_DYN_FLAGS) != 0 || smooth) && waitInterval != INFINITY ? getDoubleTime()+(smooth ? 0 : REDRAW_TIME) : INFINITY;
+#ifdef IDLECHECK
+	bool paused = false;
+#endif
 	for (;;) {
 		int r;
 		SDL_Event ev;
@@ -1065,7 +1694,7 @@ bool SdlWormikGui::waitNext(double waitInterval)
 		if (redraw) {
 			expire = 0;
 		}
-		else if ((invalidatedList[nextInvalidatedList].flags&INVO_DYN_FLAGS) != 0) {
+		else if ((invalidatedList.flags&INVO_DYN_FLAGS) != 0 || (smooth && waitInterval != INFINITY)) {
 			if (nextRedraw < expire) {
 				expire = nextRedraw;
 			}
@@ -1076,21 +1705,27 @@ bool SdlWormikGui::waitNext(double waitInterval)
 		if (lastMove+waitInterval < expire) {
 			expire = lastMove+waitInterval;
 		}
-		double eventWaitMs = ceil((expire-getDoubleTime())*1000);
-		int eventWaitMsCut = eventWaitMs < 0 ? 0 : eventWaitMs > INT_MAX ? INT_MAX : (int)eventWaitMs;
-		game->debug("waiting for %d\n", eventWaitMsCut);
-		if ((r = SDL_WaitEventTimeout(&ev, eventWaitMsCut)) < 0)
-			game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+#ifdef IDLECHECK
+		if (expire == INFINITY)
+			idleCheckArm(paused ? IC_PAUSE : IC_START);
+#endif
+		r = waitEvent(&ev, expire);
 		int stdEvent = r == 0 ? STDE_TIMEOUT : processStandardEvent(&ev);
 reswitch:
 		game->debug("std event: %d\n", stdEvent);
 		if (stdEvent >= STDE_SHOW_BASE && stdEvent <= STDE_SHOW_MAX) {
+			// replay stays paused until p or space
+			replayPaused = replaying;
 			lastMove = 0;
 			diffGameTime = waitInterval;
 			waitInterval = INFINITY;
 			nextRedraw = INFINITY;
-			if (stdEvent == STDE_SHOW_PAUSE)
+			if (stdEvent == STDE_SHOW_PAUSE) {
+#ifdef IDLECHECK
+				paused = true;
+#endif
 				continue;
+			}
 			stdEvent = showPopup(stdEvent);
 			goto reswitch;
 		}
@@ -1110,7 +1745,7 @@ reswitch:
 				if (lastMove+waitInterval <= currentTime) {
 					game->debug("Game time\n");
 					lastMove = lastMove+waitInterval;
-					return false;
+					return waitDone();
 				}
 				if (redraw) {
 					game->debug("Redrawing\n");
@@ -1123,13 +1758,48 @@ reswitch:
 						diffGameTime = 0;
 					}
 					rerenderFlags = drawBase();
+					if (smooth) {
+						// kept while paused, so the snake does not jump back
+						if (waitInterval != INFINITY)
+							motionProgress = diffGameTime/waitInterval;
+						drawMotion(motionProgress);
+					}
 					drawFinish(rerenderFlags);
-					nextRedraw = rerenderFlags != 0 && waitInterval != INFINITY ? currentTime+REDRAW_TIME : INFINITY;
+					if (measureStartup) {
+						startupMark("first frame presented");
+						return true;
+					}
+					if (smooth && waitInterval != INFINITY) {
+						// presenting with vsync already waited for refresh
+						nextRedraw = vsync ? currentTime : currentTime+frameTime;
+					}
+					else {
+						nextRedraw = rerenderFlags != 0 && waitInterval != INFINITY ? currentTime+REDRAW_TIME : INFINITY;
+					}
+				}
+				else {
+					statsIdleWakeups++;
 				}
 			}
 			break;
 
 		case STDE_UNKNOWN:
+			if (replaying) {
+				int target = replayControl(&ev);
+				if (target >= 0)
+					return seekReplay(target);
+				if (ev.type == SDL_KEYDOWN && (ev.key.keysym.sym == SDLK_p || ev.key.keysym.sym == SDLK_SPACE)) {
+					if (replayPaused) {
+						replayPaused = false;
+						lastMove = getDoubleTime();
+						return waitDone();
+					}
+					redraw = true;
+					stdEvent = STDE_SHOW_PAUSE;
+					goto reswitch;
+				}
+				break;
+			}
 			switch (ev.type) {
 			case SDL_KEYDOWN:
 				{
@@ -1173,6 +1843,146 @@ reswitch:
 	}
 }
 
+bool SdlWormikGui::waitDone()
+{
+	return replaying && replay.finishWait();
+}
+
+int SdlWormikGui::replayControl(SDL_Event *ev)
+{
+	int step = replay.getStep(), target;
+	int x, y;
+	SDL_Rect bar;
+
+	switch (ev->type) {
+	case SDL_KEYDOWN:
+		switch (ev->key.keysym.sym) {
+		case SDLK_LEFT:
+			target = step-REPLAY_SKIP_SHORT;
+			break;
+
+		case SDLK_RIGHT:
+			target = step+REPLAY_SKIP_SHORT;
+			break;
+
+		case SDLK_PAGEUP:
+			target = step-REPLAY_SKIP_LONG;
+			break;
+
+		case SDLK_PAGEDOWN:
+			target = step+REPLAY_SKIP_LONG;
+			break;
+
+		case SDLK_HOME:
+			target = 0;
+			break;
+
+		case SDLK_END:
+			target = replay.getLastStep();
+			break;
+
+		case SDLK_COMMA:
+			target = step-1;
+			break;
+
+		case SDLK_PERIOD:
+			target = step+1;
+			break;
+
+		default:
+			return -1;
+		}
+		break;
+
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEMOTION:
+		if (ev->type == SDL_MOUSEBUTTONDOWN) {
+			x = ev->button.x; y = ev->button.y;
+			mouseToScreen(&x, &y);
+			getReplayBar(&bar);
+			if (ev->button.button != SDL_BUTTON_LEFT || y < bar.y || y >= bar.y+bar.h)
+				return -1;
+			replayDragging = true;
+		}
+		else {
+			// button may be released outside of window
+			if (!replayDragging || (ev->motion.state&SDL_BUTTON_LMASK) == 0) {
+				replayDragging = false;
+				return -1;
+			}
+			x = ev->motion.x; y = ev->motion.y;
+			mouseToScreen(&x, &y);
+			getReplayBar(&bar);
+		}
+		x = x < bar.x ? 0 : x >= bar.x+bar.w ? bar.w-1 : x-bar.x;
+		target = (int)((int64_t)x*(replay.getLastStep()+1)/bar.w);
+		break;
+
+	case SDL_MOUSEBUTTONUP:
+		replayDragging = false;
+		return -1;
+
+	default:
+		return -1;
+	}
+	return target < 0 ? 0 : target;
+}
+
+bool SdlWormikGui::seekReplay(int target)
+{
+	// lands in the wait before target and finishes it right away, so the
+	// game enters the target wait as usual
+	if (replay.seek(target > 0 ? target-1 : 0) < 0)
+		return true;
+	lastMove = getDoubleTime();
+	invalidateAll();
+	return waitDone();
+}
+
+void SdlWormikGui::getReplayBar(SDL_Rect *bar)
+{
+	// bottom wall row of the board
+	bar->x = tileWidth; bar->w = (WormikGame::GAME_XSIZE-2)*tileWidth;
+	bar->y = (WormikGame::GAME_YSIZE-1)*tileHeight; bar->h = tileHeight;
+}
+
+void SdlWormikGui::drawReplayBar(uint32_t step, uint32_t last, const char *note)
+{
+	SDL_Rect bar, d;
+	char text[48];
+	SDL_Color clr;
+
+	// drawn over copied boardScreen, so it needs no restoring
+	getReplayBar(&bar);
+	SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_MENU_BG]>>16), (Uint8)(colors[CLR_MENU_BG]>>8), (Uint8)(colors[CLR_MENU_BG]>>0), 255);
+	SDL_RenderFillRect(windowRenderer, &bar);
+	d = bar;
+	d.w = last == 0 ? bar.w : (int)((int64_t)bar.w*(step < last ? step : last)/last);
+	SDL_SetRenderDrawColor(windowRenderer, (Uint8)(colors[CLR_EXCEPTION_FONT]>>16), (Uint8)(colors[CLR_EXCEPTION_FONT]>>8), (Uint8)(colors[CLR_EXCEPTION_FONT]>>0), 255);
+	d.y += bar.h/3; d.h = bar.h-2*(bar.h/3);
+	SDL_RenderFillRect(windowRenderer, &d);
+	snprintf(text, sizeof(text), "%u/%u%s", step, last, note);
+	SDL_GetRGB(colors[CLR_MENU_FONT], windowPixelFormat, &clr.r, &clr.g, &clr.b); clr.a = 255;
+	textCache.draw(&tileBatch, bar.x+bar.w-textCache.measure(text, strlen(text))-tileWidth, bar.y+(bar.h-textCache.getLineHeight())/2, clr, text, strlen(text));
+	tileBatch.flush();
+}
+
+void SdlWormikGui::mouseToScreen(int *x, int *y)
+{
+	int lw, lh, ow, oh, ww, wh;
+	// SDL itself scales events when logical size is set
+	SDL_RenderGetLogicalSize(windowRenderer, &lw, &lh);
+	if (lw != 0)
+		return;
+	if (SDL_GetRendererOutputSize(windowRenderer, &ow, &oh) < 0)
+		return;
+	SDL_GetWindowSize(window, &ww, &wh);
+	if (ww > 0 && wh > 0) {
+		*x = *x*ow/ww; *y = *y*oh/wh;
+	}
+	*x -= screenArea.x; *y -= screenArea.y;
+}
+
 WormikGui *create_WormikGui(void)
 {
 	return new SdlWormikGui();
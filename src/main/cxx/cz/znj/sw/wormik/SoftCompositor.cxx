@@ -0,0 +1,355 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Software frame compositor
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/embedded_font.hxx"
+
+#include "cz/znj/sw/wormik/SoftCompositor.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+using namespace gui4x6x16;
+
+
+SoftCompositor::SoftCompositor()
+{
+	kernels = NULL;
+	seasonImage = NULL;
+	bgSeasonImage = NULL;
+	memset(colors, 0, sizeof(colors));
+
+	static_assert((MENU_X_POINTS+MENU_WIDTH_POINTS)*GRECT_XSIZE == FRAME_WIDTH);
+	static_assert((MENU_HEIGHT_POINTS)*GRECT_XSIZE == FRAME_HEIGHT);
+}
+
+SoftCompositor::~SoftCompositor()
+{
+	close();
+}
+
+int SoftCompositor::init(const blit_kernels *kernels_)
+{
+	kernels = kernels_;
+	seasonImage = (uint32_t *)malloc(SIMG_WIDTH*SIMG_HEIGTH*sizeof(uint32_t));
+	bgSeasonImage = (uint32_t *)malloc(SIMG_WIDTH*SIMG_HEIGTH*sizeof(uint32_t));
+	if (!seasonImage || !bgSeasonImage) {
+		close();
+		return -1;
+	}
+	return 0;
+}
+
+void SoftCompositor::close()
+{
+	free(seasonImage);
+	seasonImage = NULL;
+	free(bgSeasonImage);
+	bgSeasonImage = NULL;
+}
+
+int SoftCompositor::loadSeason(SDL_Surface *icons, const SDL_Color *c)
+{
+	SDL_Surface *converted;
+
+	if ((converted = SDL_ConvertSurfaceFormat(icons, SDL_PIXELFORMAT_ARGB8888, 0)) == NULL)
+		return -1;
+	SDL_LockSurface(converted);
+	kernels->copy(seasonImage, SIMG_WIDTH, (const uint32_t *)converted->pixels, converted->pitch/4, SIMG_WIDTH, SIMG_HEIGTH);
+	SDL_UnlockSurface(converted);
+	SDL_FreeSurface(converted);
+
+	// opaque tiles composed over empty field, board cells are then
+	// plain copies
+	for (unsigned y = 0; y < SIMG_HEIGTH; y += GRECT_YSIZE) {
+		for (unsigned x = 0; x < SIMG_WIDTH; x += GRECT_XSIZE) {
+			uint32_t *d = bgSeasonImage+y*SIMG_WIDTH+x;
+			kernels->copy(d, SIMG_WIDTH, seasonImage+SP_BACK_Y*GRECT_YSIZE*SIMG_WIDTH+SP_BACK_X*GRECT_XSIZE, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE);
+			kernels->blend(d, SIMG_WIDTH, seasonImage+y*SIMG_WIDTH+x, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE, 255);
+		}
+	}
+
+	for (unsigned i = 0; i < CLR_COUNT; i++)
+		colors[i] = 0xff000000|(c[i].r<<16)|(c[i].g<<8)|(c[i].b<<0);
+	return 0;
+}
+
+void SoftCompositor::fillRect(uint32_t *frame, int x, int y, int w, int h, uint32_t color) const
+{
+	kernels->fill(pixelAt(frame, x, y), FRAME_WIDTH, w, h, color);
+}
+
+void SoftCompositor::copyRect(uint32_t *frame, const uint32_t *src, int x, int y, int w, int h) const
+{
+	kernels->copy(pixelAt(frame, x, y), FRAME_WIDTH, src+y*FRAME_WIDTH+x, FRAME_WIDTH, w, h);
+}
+
+void SoftCompositor::drawCell(uint32_t *frame, unsigned x, unsigned y, unsigned short cont) const
+{
+	const image_pos *pos = &board_image_pos[cont];
+	kernels->copy(pixelAt(frame, x*GRECT_XSIZE, y*GRECT_YSIZE), FRAME_WIDTH, bgSeasonImage+pos->y*GRECT_YSIZE*SIMG_WIDTH+pos->x*GRECT_XSIZE, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE);
+}
+
+void SoftCompositor::drawStatics(uint32_t *frame, const WormikGame::board_view *view) const
+{
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+		const WormikGame::board_def *row = view->board+y*view->stride;
+		for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++)
+			drawCell(frame, x, y, row[x] == WormikGame::GR_WALL ? WormikGame::GR_WALL : WormikGame::GR_NONE);
+	}
+}
+
+void SoftCompositor::drawFadedCell(uint32_t *frame, const uint32_t *basic, unsigned x, unsigned y, unsigned short cont, unsigned alpha) const
+{
+	unsigned sx, sy;
+	findImagePos(cont, &sx, &sy);
+	// frame may keep previous fade step, start from clean background
+	copyRect(frame, basic, x*GRECT_XSIZE, y*GRECT_YSIZE, GRECT_XSIZE, GRECT_YSIZE);
+	kernels->blend(pixelAt(frame, x*GRECT_XSIZE, y*GRECT_YSIZE), FRAME_WIDTH, bgSeasonImage+sy*SIMG_WIDTH+sx, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE, alpha);
+}
+
+int SoftCompositor::measureText(const char *text, unsigned length) const
+{
+	return length*EMBEDDED_FONT_ADVANCE;
+}
+
+void SoftCompositor::drawText(uint32_t *frame, int x, int y, uint32_t color, const char *text, unsigned length) const
+{
+	if (x < 0)
+		x = -x-measureText(text, length);
+	if (y < 0)
+		y = -y-EMBEDDED_FONT_LINE;
+	// one pixel of top spacing, as in the glyph atlas of SDL GUI
+	y++;
+	for (unsigned i = 0; i < length; i++, x += EMBEDDED_FONT_ADVANCE) {
+		unsigned char ch = text[i];
+		if (ch < EMBEDDED_FONT_FIRST || ch >= EMBEDDED_FONT_FIRST+EMBEDDED_FONT_GLYPHS)
+			ch = '?';
+		if (x < 0 || y < 0 || x+EMBEDDED_FONT_WIDTH > FRAME_WIDTH || y+EMBEDDED_FONT_HEIGHT > FRAME_HEIGHT)
+			continue;
+		const unsigned char *rows = embedded_font[ch-EMBEDDED_FONT_FIRST];
+		for (int gy = 0; gy < EMBEDDED_FONT_HEIGHT; gy++) {
+			uint32_t *p = pixelAt(frame, x, y+gy);
+			for (int gx = 0; gx < EMBEDDED_FONT_WIDTH; gx++) {
+				if ((rows[gy]>>(EMBEDDED_FONT_WIDTH-1-gx))&1)
+					p[gx] = color;
+			}
+		}
+	}
+}
+
+void SoftCompositor::drawLinedTextf(uint32_t *frame, int x, int y, uint32_t color, const char *fmt, ...) const
+{
+	va_list va;
+	char buf[256];
+	int nrows;
+	char *p;
+	va_start(va, fmt);
+	if (vsnprintf(buf, sizeof(buf), fmt, va) >= (int)sizeof(buf))
+		buf[sizeof(buf)-1] = '\0';
+	va_end(va);
+
+	for (p = buf, nrows = 0; *p != '\0'; nrows++) {
+		while (*p != '\0' && *p != '\n')
+			p++;
+		if (*p != '\0')
+			p++;
+	}
+	y = (y >= 0) ? y : (-y-nrows*EMBEDDED_FONT_LINE);
+	for (p = buf; *p != '\0'; y += EMBEDDED_FONT_LINE) {
+		char *o = p;
+		while (*p != '\0' && *p != '\n')
+			p++;
+		drawText(frame, x, y, color, o, p-o);
+		if (*p != '\0')
+			p++;
+	}
+}
+
+void SoftCompositor::drawMenu(uint32_t *frame) const
+{
+	unsigned sx, sy;
+	findImagePos(WormikGame::GR_WALL, &sx, &sy);
+	for (unsigned y = 0; y < MENU_HEIGHT_POINTS; y++) {
+		for (unsigned x = 0; x < MENU_WIDTH_POINTS; x++) {
+			if (y != 0 && y != MENU_SEP_SCORE_POINTS && y != MENU_SEP_SNAKE_POINTS && y != MENU_SEP_INFO_POINTS && y != MENU_HEIGHT_POINTS-1 && x != MENU_WIDTH_POINTS-1)
+				continue;
+			fillRect(frame, AREA_INFO_X+x*GRECT_XSIZE, y*GRECT_YSIZE, GRECT_XSIZE, GRECT_YSIZE, colors[CLR_MENU_BG]);
+			kernels->blend(pixelAt(frame, AREA_INFO_X+x*GRECT_XSIZE, y*GRECT_YSIZE), FRAME_WIDTH, seasonImage+sy*SIMG_WIDTH+sx, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE, 255);
+		}
+	}
+}
+
+void SoftCompositor::drawDesc(uint32_t *frame) const
+{
+	static const struct { WormikGame::board_def type; const char *text; } descs[] = {
+		{ WormikGame::GR_POSITIVE, "S+2" },
+		{ WormikGame::GR_POSITIVE_2, "S+5" },
+		{ WormikGame::GR_NEGATIVE, "H-1" },
+		{ WormikGame::GR_DEATH, "Death" },
+		{ WormikGame::GR_EXIT, "Exit" },
+	};
+	fillRect(frame, AREA_INFO_X, (MENU_SEP_INFO_POINTS+1)*GRECT_YSIZE, (MENU_WIDTH_POINTS-1)*GRECT_XSIZE, (MENU_HEIGHT_POINTS-MENU_SEP_INFO_POINTS-2)*GRECT_YSIZE, colors[CLR_MENU_BG]);
+	for (unsigned i = 0; i < sizeof(descs)/sizeof(descs[0]); i++) {
+		unsigned sx, sy;
+		int dy = (MENU_SEP_INFO_POINTS+1)*GRECT_YSIZE+MENU_DESC_SPACING_PX+i*2*GRECT_YSIZE;
+		findImagePos(descs[i].type, &sx, &sy);
+		kernels->blend(pixelAt(frame, AREA_INFO_X, dy), FRAME_WIDTH, seasonImage+sy*SIMG_WIDTH+sx, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE, 255);
+		drawText(frame, -MENU_DESC_RIGHT_PX, dy, colors[CLR_MENU_FONT], descs[i].text, strlen(descs[i].text));
+	}
+}
+
+void SoftCompositor::drawRecord(uint32_t *frame, int record, time_t rectime, bool isNow) const
+{
+	struct tm t; char tc[32];
+	t = *localtime(&rectime); strftime(tc, sizeof(tc), "%Y-%m-%d %H:%M", &t);
+	fillRect(frame, AREA_INFO_X, GRECT_YSIZE, (MENU_WIDTH_POINTS-1)*GRECT_XSIZE, (MENU_SEP_FIRST_POINTS-1)*GRECT_YSIZE, colors[CLR_MENU_BG]);
+	drawLinedTextf(frame, -MENU_TEXT_RIGHT_PX, GRECT_YSIZE+MENU_FONT_HEIGHT_PX, colors[isNow ? CLR_EXCEPTION_FONT : CLR_MENU_FONT], "Record: %d\n%s\n", record, (rectime == 0) ? " " : tc);
+}
+
+void SoftCompositor::drawScore(uint32_t *frame, int level, int score, int total, int exit) const
+{
+	fillRect(frame, AREA_INFO_X, (MENU_SEP_FIRST_POINTS+1)*GRECT_YSIZE, (MENU_WIDTH_POINTS-1)*GRECT_XSIZE, (MENU_SEP_SNAKE_POINTS-MENU_SEP_FIRST_POINTS-1)*GRECT_YSIZE, colors[CLR_MENU_BG]);
+	drawLinedTextf(frame, -MENU_TEXT_RIGHT_PX, (MENU_SEP_FIRST_POINTS+1)*GRECT_YSIZE+MENU_FONT_HEIGHT_PX, colors[(score >= exit)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Score: %d\nLevel: %d/%d\n", total, level, (total-score)+exit);
+}
+
+void SoftCompositor::drawSnakeInfo(uint32_t *frame, int health, int length) const
+{
+	fillRect(frame, AREA_INFO_X, (MENU_SEP_SNAKE_POINTS+1)*GRECT_YSIZE, (MENU_WIDTH_POINTS-1)*GRECT_XSIZE, (MENU_SEP_INFO_POINTS-MENU_SEP_SNAKE_POINTS-1)*GRECT_YSIZE, colors[CLR_MENU_BG]);
+	drawLinedTextf(frame, -MENU_TEXT_RIGHT_PX, (MENU_SEP_SNAKE_POINTS+1)*GRECT_YSIZE+MENU_FONT_HEIGHT_PX, colors[(health <= 1)?CLR_EXCEPTION_FONT:CLR_MENU_FONT], "Health: %d\nLength: %d\n", health, length);
+}
+
+void SoftCompositor::drawAnnounce(uint32_t *frame, unsigned n, const char *const text[]) const
+{
+	int w, h;
+	int x0, y0;
+
+	w = h = 0;
+	for (unsigned i = 0; i < n; i++) {
+		int tw = measureText(text[i], strlen(text[i]));
+		if (tw > w)
+			w = tw;
+		h += EMBEDDED_FONT_LINE;
+	}
+	// whole tiles only, unlike SDL GUI, keeps the kernels simple
+	w = (w+2*GRECT_XSIZE+GRECT_XSIZE-1)/GRECT_XSIZE*GRECT_XSIZE;
+	h = (h+GRECT_YSIZE+GRECT_YSIZE-1)/GRECT_YSIZE*GRECT_YSIZE;
+	x0 = (MENU_X_POINTS*GRECT_XSIZE-w)/2;
+	y0 = (FRAME_HEIGHT-h)/2;
+	for (int y = y0; y < y0+h; y += GRECT_YSIZE) {
+		for (int x = x0; x < x0+w; x += GRECT_XSIZE)
+			kernels->blend(pixelAt(frame, x, y), FRAME_WIDTH, seasonImage+SP_MSG_Y*GRECT_YSIZE*SIMG_WIDTH+SP_MSG_X*GRECT_XSIZE, SIMG_WIDTH, GRECT_XSIZE, GRECT_YSIZE, 255);
+	}
+	y0 += (h-n*EMBEDDED_FONT_LINE)/2;
+	for (unsigned i = 0; i < n; i++) {
+		int tw = measureText(text[i], strlen(text[i]));
+		drawText(frame, (MENU_X_POINTS*GRECT_XSIZE-tw)/2, y0, colors[CLR_ANNOUNCEMENT_FONT], text[i], strlen(text[i]));
+		y0 += EMBEDDED_FONT_LINE;
+	}
+}
+
+void SoftCompositor::resetSnapshot(board_snapshot *snapshot)
+{
+	memset(snapshot->cells, WormikGame::GR_NONE, sizeof(snapshot->cells));
+	snapshot->newdefsLength = 0;
+	snapshot->announce = -1;
+}
+
+void SoftCompositor::snapshotPoint(board_snapshot *snapshot, unsigned x, unsigned y, unsigned short cont)
+{
+	if (cont == WormikGame::GR_NONE || cont == WormikGame::GR_WALL)
+		return;
+	snapshot->cells[y][x] = cont;
+}
+
+void SoftCompositor::snapshotNewdef(board_snapshot *snapshot, unsigned x, unsigned y, unsigned short cont, double timeout, double total)
+{
+	if (snapshot->newdefsLength >= board_snapshot::NEWDEFS_MAX)
+		return;
+	board_snapshot::newdef *nd = &snapshot->newdefs[snapshot->newdefsLength++];
+	nd->x = x; nd->y = y;
+	nd->cont = cont;
+	nd->timeout = timeout;
+	nd->total = total;
+}
+
+void SoftCompositor::snapshotBoard(board_snapshot *snapshot, const WormikGame::board_view *view)
+{
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+		const WormikGame::board_def *row = view->board+y*view->stride;
+		unsigned char *cells = snapshot->cells[y];
+		for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++) {
+			WormikGame::board_def t = row[x];
+			cells[x] = t == WormikGame::GR_WALL || t == WormikGame::GR_NEW_DEF ? WormikGame::GR_NONE : t;
+		}
+	}
+	unsigned n = view->newdefsLength < board_snapshot::NEWDEFS_MAX ? view->newdefsLength : board_snapshot::NEWDEFS_MAX;
+	for (unsigned i = 0; i < n; i++) {
+		board_snapshot::newdef *nd = &snapshot->newdefs[i];
+		nd->x = view->newdefs[i].x; nd->y = view->newdefs[i].y;
+		nd->cont = view->newdefs[i].def;
+		nd->timeout = WormikGame::GT_SECONDS(view->newdefs[i].timeout);
+		nd->total = WormikGame::GT_SECONDS(view->newdefs[i].total);
+	}
+	snapshot->newdefsLength = n;
+}
+
+int SoftCompositor::drawSnapshot(uint32_t *frame, const uint32_t *basic, const board_snapshot *snapshot, double diffGameTime) const
+{
+	int fading = 0;
+	copyRect(frame, basic, 0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+		for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++) {
+			if (snapshot->cells[y][x] != WormikGame::GR_NONE)
+				drawCell(frame, x, y, snapshot->cells[y][x]);
+		}
+	}
+	for (unsigned i = 0; i < snapshot->newdefsLength; i++) {
+		const board_snapshot::newdef *nd = &snapshot->newdefs[i];
+		int alpha = (int)(255*(nd->timeout-diffGameTime)/nd->total);
+		if (alpha <= 0) {
+			drawCell(frame, nd->x, nd->y, nd->cont);
+			continue;
+		}
+		if (alpha >= 256) // possible because of newdef latency
+			alpha = 255;
+		drawFadedCell(frame, basic, nd->x, nd->y, nd->cont, 255-alpha);
+		fading++;
+	}
+	drawRecord(frame, snapshot->record, snapshot->rectime, snapshot->recordNow);
+	drawScore(frame, snapshot->level, snapshot->score, snapshot->total, snapshot->exit);
+	drawSnakeInfo(frame, snapshot->health, snapshot->length);
+	switch (snapshot->announce) {
+	case WormikGui::ANC_DEAD:
+		{
+			static const char *const text[] = { "You are dead!" };
+			drawAnnounce(frame, 1, text);
+		}
+		break;
+
+	case WormikGui::ANC_EXIT:
+		{
+			static const char *const text[] = { "You moved to next level,", "congratulations!" };
+			drawAnnounce(frame, 2, text);
+		}
+		break;
+	}
+	return fading;
+}
+
+
+} } } };
@@ -0,0 +1,171 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Software frame compositor
+ */
+
+#ifndef SoftCompositor_hxx__
+# define SoftCompositor_hxx__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/soft_blit.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/**
+ * Game state needed to compose frame, captured on game thread from the
+ * game board view (or through drawPoint and drawNewdef with the snapshot
+ * passed as gc), so the frame can be composed later or on other thread.
+ */
+typedef struct board_snapshot
+{
+	enum {
+		NEWDEFS_MAX		= 32,
+	};
+
+	typedef struct newdef
+	{
+		unsigned char			x, y;
+		unsigned short			cont;
+		float				timeout;	/**< remaining fade time at step */
+		float				total;		/**< whole fade time */
+	} newdef;
+
+	unsigned char			cells[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< dynamic board content, GR_NONE to keep basic screen */
+	newdef				newdefs[NEWDEFS_MAX];	/**< fading cells */
+	unsigned			newdefsLength;
+	int				record;
+	time_t				rectime;
+	bool				recordNow;
+	int				level, score, total, exit;
+	int				health, length;
+	int				announce;	/**< ANC_* or -1 */
+} board_snapshot;
+
+/**
+ * Draws game screen parts into 32-bit ARGB frame buffers at base tile size.
+ *
+ * Only the season images and colors are kept here, all drawing functions
+ * take destination buffer and are const, so several threads can compose
+ * different frames at once once the season is loaded.
+ */
+class SoftCompositor
+{
+public:
+	enum {
+		FRAME_WIDTH = 640,
+		FRAME_HEIGHT = 480,
+		AREA_INFO_X = 480,
+	};
+
+	enum {
+		CLR_MENU_BG		= 0,		/**< menu background */
+		CLR_MENU_FONT		= 1,		/**< menu font color */
+		CLR_EXCEPTION_FONT	= 2,		/**< exceptions font color */
+		CLR_ANNOUNCEMENT_FONT	= 3,		/**< announcement font color */
+		CLR_COUNT		= 4,
+	};
+
+	enum {
+		MENU_PADDING            = 2,
+		MENU_WIDTH_POINTS       = 10,
+		MENU_X_POINTS           = WormikGame::GAME_XSIZE,
+		MENU_HEIGHT_POINTS      = WormikGame::GAME_YSIZE,
+		MENU_SEP_FIRST_POINTS   = 6,
+		MENU_SEP_SCORE_POINTS   = 6,
+		MENU_SEP_SNAKE_POINTS   = 12,
+		MENU_SEP_INFO_POINTS    = 18,
+		MENU_FONT_HEIGHT_PX     = gui4x6x16::GRECT_YSIZE-4,
+		MENU_TEXT_RIGHT_PX      = FRAME_WIDTH-gui4x6x16::GRECT_XSIZE-MENU_PADDING,
+		MENU_DESC_RIGHT_PX      = FRAME_WIDTH-gui4x6x16::GRECT_XSIZE-gui4x6x16::GRECT_XSIZE,
+		MENU_DESC_SPACING_PX    = 8,
+	};
+
+protected:
+	const blit_kernels *		kernels;		/**< tile drawing functions */
+	uint32_t *			seasonImage;		/**< season tiles, straight alpha */
+	uint32_t *			bgSeasonImage;		/**< season tiles composed over empty field */
+	uint32_t			colors[CLR_COUNT];	/**< colors (see CLR_* definitions) */
+
+public:
+	/* constructor */		SoftCompositor();
+	/* destructor */		~SoftCompositor();
+
+public:
+	/** allocates season buffers, returns negative on error */
+	int				init(const blit_kernels *kernels);
+	void				close();
+
+	const blit_kernels *		getKernels() const;
+
+	/** takes season tiles (at base size) and colors, returns negative on error */
+	int				loadSeason(SDL_Surface *icons, const SDL_Color *colors);
+
+	uint32_t *			pixelAt(uint32_t *frame, int x, int y) const;
+	void				fillRect(uint32_t *frame, int x, int y, int w, int h, uint32_t color) const;
+	/** copies frame area from other frame */
+	void				copyRect(uint32_t *frame, const uint32_t *src, int x, int y, int w, int h) const;
+
+	/** draws opaque board cell (type over empty field) */
+	void				drawCell(uint32_t *frame, unsigned x, unsigned y, unsigned short cont) const;
+	/** draws static part (walls and empty fields) of whole board from game board view */
+	void				drawStatics(uint32_t *frame, const WormikGame::board_view *view) const;
+	/** draws board cell faded in over basic frame, alpha 0 for empty, 255 for full */
+	void				drawFadedCell(uint32_t *frame, const uint32_t *basic, unsigned x, unsigned y, unsigned short cont, unsigned alpha) const;
+
+	int				measureText(const char *text, unsigned length) const;
+	/** draws text, negative x or y mean right or bottom aligned at -x or -y */
+	void				drawText(uint32_t *frame, int x, int y, uint32_t color, const char *text, unsigned length) const;
+	void				drawLinedTextf(uint32_t *frame, int x, int y, uint32_t color, const char *fmt, ...) const;
+
+	/* side panel parts */
+	void				drawMenu(uint32_t *frame) const;
+	void				drawDesc(uint32_t *frame) const;
+	void				drawRecord(uint32_t *frame, int record, time_t rectime, bool isNow) const;
+	void				drawScore(uint32_t *frame, int level, int score, int total, int exit) const;
+	void				drawSnakeInfo(uint32_t *frame, int health, int length) const;
+
+	/** draws announcement box over board */
+	void				drawAnnounce(uint32_t *frame, unsigned n, const char *const text[]) const;
+
+	/* snapshots */
+	/** clears snapshot before capturing */
+	static void			resetSnapshot(board_snapshot *snapshot);
+	static void			snapshotPoint(board_snapshot *snapshot, unsigned x, unsigned y, unsigned short cont);
+	static void			snapshotNewdef(board_snapshot *snapshot, unsigned x, unsigned y, unsigned short cont, double timeout, double total);
+	/** captures board cells and newdefs from game board view at once */
+	static void			snapshotBoard(board_snapshot *snapshot, const WormikGame::board_view *view);
+	/**
+	 * composes whole frame from basic screen and snapshot, newdefs faded
+	 * as at diffGameTime after the step
+	 *
+	 * @return
+	 * 	number of newdefs still fading
+	 */
+	int				drawSnapshot(uint32_t *frame, const uint32_t *basic, const board_snapshot *snapshot, double diffGameTime) const;
+};
+
+inline const blit_kernels *SoftCompositor::getKernels() const
+{
+	return kernels;
+}
+
+inline uint32_t *SoftCompositor::pixelAt(uint32_t *frame, int x, int y) const
+{
+	return frame+y*FRAME_WIDTH+x;
+}
+
+
+} } } };
+
+#endif
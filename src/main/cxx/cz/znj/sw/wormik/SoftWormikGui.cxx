@@ -0,0 +1,1086 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Software compositor GUI class
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include <limits.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/soft_blit.hxx"
+#include "cz/znj/sw/wormik/timing_histogram.hxx"
+#include "cz/znj/sw/wormik/perf_counters.hxx"
+
+#include "cz/znj/sw/wormik/SdlSeasonLoader.hxx"
+#include "cz/znj/sw/wormik/SoftCompositor.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+using namespace gui4x6x16;
+
+
+/**
+ * GUI composing whole frame in CPU memory at base tile size.
+ *
+ * Tiles are drawn by SIMD kernels into framebuffer, which is uploaded to
+ * single streaming texture and scaled by SDL to the window. In headless
+ * mode no window is created, the game runs as fast as possible without
+ * input and the last frame can be dumped to file. Output depends only on
+ * the game state, so it's usable for pixel-exact comparisons.
+ *
+ * With render thread, the game thread only handles input and steps, and
+ * publishes snapshot of the game state after each step through triple
+ * buffer. Render thread composes and presents the latest snapshot, so
+ * neither of them ever waits for the other.
+ */
+class SoftWormikGui: public WormikGui
+{
+public:
+	enum {
+		WINDOW_WIDTH = SoftCompositor::FRAME_WIDTH,
+		WINDOW_HEIGHT = SoftCompositor::FRAME_HEIGHT,
+		AREA_INFO_X = SoftCompositor::AREA_INFO_X,
+	};
+
+	enum {
+		INVO_DESC		= INVO_NEXT_BASE,
+		INVO_MENU		= INVO_NEXT_BASE<<1,
+		INVO_MESSAGE		= INVO_NEXT_BASE<<2,
+		INVO_SOFT_FULL		= INVO_FULL|INVO_DESC|INVO_MENU|INVO_MESSAGE,
+		INVO_DYN_FLAGS		= INVO_NEW_DEFS,
+		INVO_INFO		= INVO_RECORD|INVO_SCORE|INVO_HEALTH|INVO_LENGTH|INVO_GAME_STATE,
+	};
+
+	enum {
+		SE_PROCESSED		= 0,
+		SE_QUIT			= 1,
+		SE_UNKNOWN		= 2,
+	};
+
+	enum {
+		RENDER_SLOTS		= 3,
+		RS_FRESH		= 4,		/**< published slot not taken by render thread yet */
+	};
+
+	enum {
+		RR_REDRAW		= 1,		/**< draw latest snapshot again */
+		RR_QUIT			= 2,		/**< render thread should finish */
+	};
+
+	static const double		REDRAW_TIME;
+
+protected:
+	/** game state published to render thread, immutable once published */
+	typedef struct render_slot
+	{
+		board_snapshot			snapshot;	/**< state after step */
+		unsigned long			level;		/**< newLevel count, 0 before first level */
+		int				season;		/**< season of level */
+		unsigned char			statics[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< static board of level */
+		double				stepTime;	/**< time of step */
+		double				interval;	/**< step interval, INFINITY when stopped */
+	} render_slot;
+
+	bool				headless;		/**< no window, no input, run as fast as possible */
+	bool				threaded;		/**< frames drawn by render thread */
+	bool				vsync;			/**< presenting waits for display refresh */
+
+	SDL_Window *			window;			/**< main window, NULL in headless mode */
+	SDL_Renderer *			renderer;		/**< window renderer */
+	SDL_Texture *			screen;			/**< streaming texture receiving frame */
+
+	SdlSeasonLoader			seasonLoader;		/**< decodes season images */
+	SoftCompositor			compositor;		/**< draws frame parts */
+
+	uint32_t *			basicScreen;		/**< static board and panels */
+	uint32_t *			frame;			/**< composed frame, persistent between frames */
+	uint32_t *			target;			/**< buffer currently drawn to */
+	SDL_Rect			dirty;			/**< frame area changed since last upload */
+
+	WormikGame *			game;			/**< game interface */
+
+	double				diffGameTime;		/**< difference to game time */
+	double				lastMove;		/**< time of last game update */
+
+	InvalidatedList			invalidatedList;	/**< invalid regions list */
+	bool				redraw;			/**< screen needs redraw */
+
+	SDL_Thread *			renderThread;		/**< composes and presents frames */
+	SDL_sem *			renderWake;		/**< posted when snapshot or request comes */
+	SDL_sem *			renderStarted;		/**< posted when render thread created renderer */
+	int				renderStatus;		/**< renderer initialization result */
+	SDL_atomic_t			renderMiddle;		/**< slot passed between threads, with RS_FRESH */
+	SDL_atomic_t			renderRequests;		/**< RR_* flags */
+	SDL_atomic_t			renderSleeping;		/**< render thread waits for renderWake, cleared by the one posting it */
+	SDL_atomic_t			renderFailed;		/**< render thread stopped on error in renderError */
+	char				renderError[256];
+	Uint32				renderFailedEvent;	/**< event pushed when render thread fails, 0 for none */
+	render_slot			renderSlots[RENDER_SLOTS];
+	unsigned			engineSlot;		/**< slot owned by game thread */
+	unsigned			renderSlot;		/**< slot owned by render thread */
+	unsigned char			levelStatics[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< static board of current level */
+	int				levelSeason;		/**< season of current level */
+	unsigned long			levelCount;		/**< newLevel calls */
+
+	unsigned long			frameLimit;		/**< quit after number of frames, 0 for unlimited */
+	unsigned long			statsFrames;		/**< frames drawn in total */
+	double				statsComposeTime;	/**< time spent composing frames */
+	double				frameStart;		/**< start of current frame */
+	TimingHistogram			statsFrameTimes;	/**< composing and presenting frames */
+	TimingHistogram			statsTickJitter;	/**< delay of steps after their time */
+	PerfCounters *			perf;			/**< game counters, NULL if disabled */
+	int				perfDraw;		/**< site of drawBase */
+
+public:
+	/* constructor */		SoftWormikGui(bool headless);
+	virtual				~SoftWormikGui();
+
+public:
+	virtual int			init(WormikGame *game);
+	virtual void			shutdown(WormikGame *game);
+	virtual int			newLevel(int season);
+
+	virtual void			drawStatic(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual void			drawPoint(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual int			drawNewdef(void *gc, unsigned x, unsigned y, unsigned short type, double timeout, double total);
+
+	virtual void			invalidateOutput(int len, unsigned (*points)[2]);
+	virtual void			invalidateAll();
+
+	virtual bool			waitStart();
+	virtual bool			waitNext(double interval);
+	virtual bool			announce(int type);
+
+protected:
+	int				initWindow();
+	int				initRenderer();
+	void				closeRenderer();
+	void				closeGui();
+
+	void				markDirty(int x, int y, int w, int h);
+	void				markCellDirty(unsigned x, unsigned y);
+
+	/** draws INVO_BOARD, INVO_MENU and INVO_DESC parts given by flags into frame */
+	void				drawStaticScreen(int flags);
+	/**
+	 * @return
+	 * 	next refresh flags
+	 */
+	unsigned			drawBase();
+	void				drawAnnounce(unsigned n, const char *const text[]);
+	void				drawFinish(unsigned renderFlags);
+	int				dumpFrame(const char *fname);
+
+	int				processStandardEvent(SDL_Event *ev);
+
+	/** publishes current game state to render thread */
+	void				publish(int announcement, double interval);
+	void				requestRender(int requests);
+	/** posts renderWake if render thread sleeps, so posts never pile up */
+	void				wakeRender();
+	/** reports render thread failure, game is terminated by game thread */
+	void				checkRender();
+	static int			renderMain(void *self);
+	void				render();
+	/** waits for renderWake unless there is work already, with timeout if timed */
+	void				sleepRender(bool timed);
+	/** stops rendering, game thread is notified by renderFailedEvent */
+	void				failRender(const char *fmt, ...);
+	/** draws static part of level from slot into basic screen, returns negative on error */
+	int				renderLevel(const render_slot *slot);
+};
+
+static double getDoubleTime(void)
+{
+	return (double)SDL_GetPerformanceCounter()/SDL_GetPerformanceFrequency();
+}
+
+const double SoftWormikGui::REDRAW_TIME = 1/20.0;
+
+SoftWormikGui::SoftWormikGui(bool headless_)
+{
+	headless = headless_;
+	threaded = false;
+	vsync = false;
+	window = NULL;
+	renderer = NULL;
+	screen = NULL;
+	basicScreen = NULL;
+	frame = NULL;
+	target = NULL;
+	memset(&dirty, 0, sizeof(dirty));
+	game = NULL;
+	diffGameTime = 0;
+	lastMove = 0;
+	invalidatedList.resetFlags(INVO_SOFT_FULL);
+	redraw = true;
+	renderThread = NULL;
+	renderWake = NULL;
+	renderStarted = NULL;
+	renderStatus = 0;
+	SDL_AtomicSet(&renderMiddle, 1);
+	SDL_AtomicSet(&renderRequests, 0);
+	SDL_AtomicSet(&renderSleeping, 0);
+	SDL_AtomicSet(&renderFailed, 0);
+	renderError[0] = '\0';
+	renderFailedEvent = 0;
+	memset(renderSlots, 0, sizeof(renderSlots));
+	engineSlot = 0;
+	renderSlot = 2;
+	memset(levelStatics, WormikGame::GR_NONE, sizeof(levelStatics));
+	levelSeason = 0;
+	levelCount = 0;
+	frameLimit = 0;
+	statsFrames = 0;
+	statsComposeTime = 0;
+	frameStart = 0;
+	perf = NULL;
+	perfDraw = -1;
+
+	static_assert((int)SoftCompositor::CLR_COUNT <= (int)SdlSeasonLoader::MAX_COLORS);
+}
+
+SoftWormikGui::~SoftWormikGui()
+{
+	closeGui();
+}
+
+int SoftWormikGui::init(WormikGame *game_)
+{
+	char buf[PATH_MAX];
+	const blit_kernels *kernels;
+	game = game_;
+
+	if ((unsigned)game->getConfigStr("simd", buf, sizeof(buf)) >= sizeof(buf))
+		strcpy(buf, "auto");
+	if ((kernels = selectBlitKernels(buf)) == NULL) {
+		game->error("Blitting kernels %s not supported\n", buf);
+		return -1;
+	}
+	game->debug("Using %s blitting kernels\n", kernels->name);
+	frameLimit = game->getConfigInt("frames", headless ? 1000 : 0);
+	threaded = !headless && game->getConfigInt("renderthread", 0) != 0;
+	if ((perf = game->getPerfCounters()) != NULL && (perfDraw = perf->addSite("draw")) < 0)
+		perf = NULL;
+
+	if (SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0) {
+		game->error("Couldn't init SDL: %s\n", SDL_GetError());
+		return -1;
+	}
+	if ((unsigned)game->getConfigStr("datapath", buf, sizeof(buf)) >= sizeof(buf))
+		buf[0] = '\0';
+	// frame is always composed at base size, so no scaled images are needed
+	if (seasonLoader.start(buf, GRECT_XSIZE, GRECT_YSIZE, 0) < 0) {
+		game->error("Couldn't start season loader: %s\n", SDL_GetError());
+		goto err;
+	}
+	basicScreen = (uint32_t *)malloc(WINDOW_WIDTH*WINDOW_HEIGHT*sizeof(uint32_t));
+	frame = (uint32_t *)malloc(WINDOW_WIDTH*WINDOW_HEIGHT*sizeof(uint32_t));
+	if (compositor.init(kernels) < 0 || !basicScreen || !frame) {
+		game->error("Couldn't allocate frame buffers\n");
+		goto err;
+	}
+	compositor.fillRect(frame, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 0xff000000);
+	markDirty(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!headless && initWindow() < 0)
+		goto err;
+	game->debug("Initialized GUI\n");
+	return 0;
+
+err:
+	closeGui();
+	SDL_Quit();
+	return -1;
+}
+
+int SoftWormikGui::initWindow()
+{
+	SDL_DisplayMode displayMode;
+	int scale = 1;
+	if (SDL_GetDesktopDisplayMode(0, &displayMode) == 0) {
+		scale = displayMode.w*3/4/WINDOW_WIDTH;
+		if (displayMode.h*3/4/WINDOW_HEIGHT < scale)
+			scale = displayMode.h*3/4/WINDOW_HEIGHT;
+		if (scale < 1)
+			scale = 1;
+	}
+	if ((window = SDL_CreateWindow("Wormik", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH*scale, WINDOW_HEIGHT*scale, game->getConfigInt("fullscreen", 1) ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0)) == NULL) {
+		game->error("Couldn't create window: %s\n", SDL_GetError());
+		return -1;
+	}
+	SDL_ShowCursor(SDL_DISABLE);
+	if (!threaded)
+		return initRenderer();
+
+	// renderer is created and used by render thread only
+	if ((renderFailedEvent = SDL_RegisterEvents(1)) == (Uint32)-1)
+		renderFailedEvent = 0;
+	if ((renderWake = SDL_CreateSemaphore(0)) == NULL || (renderStarted = SDL_CreateSemaphore(0)) == NULL) {
+		game->error("Couldn't create render thread synchronization: %s\n", SDL_GetError());
+		return -1;
+	}
+	if ((renderThread = SDL_CreateThread(&renderMain, "wormik render", this)) == NULL) {
+		game->error("Couldn't create render thread: %s\n", SDL_GetError());
+		return -1;
+	}
+	SDL_SemWait(renderStarted);
+	return renderStatus;
+}
+
+int SoftWormikGui::initRenderer()
+{
+	SDL_RendererInfo rendererInfo;
+	// render thread is paced by display, game thread is not affected
+	if ((renderer = SDL_CreateRenderer(window, -1, threaded ? SDL_RENDERER_PRESENTVSYNC : 0)) == NULL) {
+		game->error("Couldn't create window renderer: %s\n", SDL_GetError());
+		return -1;
+	}
+	if (SDL_GetRendererInfo(renderer, &rendererInfo) == 0)
+		vsync = (rendererInfo.flags&SDL_RENDERER_PRESENTVSYNC) != 0;
+	// whole frame is scaled by SDL, any output size works
+	SDL_RenderSetLogicalSize(renderer, WINDOW_WIDTH, WINDOW_HEIGHT);
+	if ((screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WINDOW_WIDTH, WINDOW_HEIGHT)) == NULL) {
+		game->error("Couldn't create screen texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+void SoftWormikGui::closeRenderer()
+{
+	if (screen) {
+		SDL_DestroyTexture(screen);
+		screen = NULL;
+	}
+	if (renderer) {
+		SDL_DestroyRenderer(renderer);
+		renderer = NULL;
+	}
+}
+
+void SoftWormikGui::closeGui()
+{
+	if (renderThread) {
+		requestRender(RR_QUIT);
+		SDL_WaitThread(renderThread, NULL);
+		renderThread = NULL;
+	}
+	if (renderWake) {
+		SDL_DestroySemaphore(renderWake);
+		renderWake = NULL;
+	}
+	if (renderStarted) {
+		SDL_DestroySemaphore(renderStarted);
+		renderStarted = NULL;
+	}
+	closeRenderer();
+	if (window) {
+		SDL_ShowCursor(SDL_ENABLE);
+		SDL_DestroyWindow(window);
+		window = NULL;
+	}
+	seasonLoader.stop();
+	compositor.close();
+	free(basicScreen);
+	basicScreen = NULL;
+	free(frame);
+	frame = NULL;
+	target = NULL;
+}
+
+void SoftWormikGui::shutdown(WormikGame *game)
+{
+	char fname[PATH_MAX];
+	char stats[512];
+	// render thread has to stop before its stats are read
+	if (renderThread) {
+		requestRender(RR_QUIT);
+		SDL_WaitThread(renderThread, NULL);
+		renderThread = NULL;
+	}
+	if (statsFrames != 0)
+		game->debug("Composed %lu frames in %.3f s (%.1f us per frame)\n", statsFrames, statsComposeTime, statsComposeTime*1000000/statsFrames);
+	if (statsFrameTimes.getSamples() != 0) {
+		statsFrameTimes.format(stats, sizeof(stats));
+		game->debug("Frame times%s: %s\n", threaded ? " (render thread)" : "", stats);
+	}
+	if (statsTickJitter.getSamples() != 0) {
+		statsTickJitter.format(stats, sizeof(stats));
+		game->debug("Step jitter: %s\n", stats);
+	}
+	if (frame && (unsigned)game->getConfigStr("dumpframe", fname, sizeof(fname)) < sizeof(fname)) {
+		if (dumpFrame(fname) < 0)
+			game->error("Failed to write frame to %s: %s\n", fname, strerror(errno));
+	}
+	closeGui();
+	SDL_Quit();
+}
+
+int SoftWormikGui::dumpFrame(const char *fname)
+{
+	FILE *fo;
+	int err = 0;
+	if ((fo = fopen(fname, "wb")) == NULL)
+		return -1;
+	// binary PPM, trivial to compare or convert
+	fprintf(fo, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+	for (unsigned i = 0; i < WINDOW_WIDTH*WINDOW_HEIGHT; i++) {
+		unsigned char rgb[3] = { (unsigned char)(frame[i]>>16), (unsigned char)(frame[i]>>8), (unsigned char)(frame[i]>>0) };
+		if (fwrite(rgb, 3, 1, fo) != 1) {
+			err = -1;
+			break;
+		}
+	}
+	if (fclose(fo) != 0)
+		err = -1;
+	return err;
+}
+
+void SoftWormikGui::markDirty(int x, int y, int w, int h)
+{
+	if (target != frame && target != NULL)
+		return;
+	if (dirty.w == 0) {
+		dirty.x = x; dirty.y = y; dirty.w = w; dirty.h = h;
+		return;
+	}
+	int x1 = dirty.x+dirty.w, y1 = dirty.y+dirty.h;
+	if (x < dirty.x)
+		dirty.x = x;
+	if (y < dirty.y)
+		dirty.y = y;
+	if (x+w > x1)
+		x1 = x+w;
+	if (y+h > y1)
+		y1 = y+h;
+	dirty.w = x1-dirty.x; dirty.h = y1-dirty.y;
+}
+
+void SoftWormikGui::markCellDirty(unsigned x, unsigned y)
+{
+	markDirty(x*GRECT_XSIZE, y*GRECT_YSIZE, GRECT_XSIZE, GRECT_YSIZE);
+}
+
+int SoftWormikGui::newLevel(int season)
+{
+	if (seasonLoader.wait(season) != SdlSeasonLoader::SL_READY) {
+		if (season == 0 || seasonLoader.wait(0) != SdlSeasonLoader::SL_READY)
+			game->fatal("failed to load season image: %s\n", seasonLoader.getError(season));
+		season = 0;
+	}
+	if (threaded) {
+		// compositor belongs to render thread, it gets the level with
+		// next snapshot
+		WormikGame::board_view view;
+		game->getBoardView(&view);
+		for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+			const WormikGame::board_def *row = view.board+y*view.stride;
+			for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++)
+				levelStatics[y][x] = row[x] == WormikGame::GR_WALL ? WormikGame::GR_WALL : WormikGame::GR_NONE;
+		}
+		levelSeason = season;
+		levelCount++;
+		return season;
+	}
+	if (compositor.loadSeason(seasonLoader.getIcons(season), seasonLoader.getColors(season)) < 0)
+		game->fatal("cannot convert season image: %s\n", SDL_GetError());
+
+	target = basicScreen;
+	drawStaticScreen(INVO_SOFT_FULL);
+	target = frame;
+
+	invalidateOutput(-INVO_SOFT_FULL, NULL);
+	return season;
+}
+
+void SoftWormikGui::drawStatic(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	if (gc != NULL) {
+		((unsigned char (*)[WormikGame::GAME_XSIZE])gc)[y][x] = cont;
+		return;
+	}
+	compositor.drawCell(target, x, y, cont);
+	markCellDirty(x, y);
+}
+
+void SoftWormikGui::drawPoint(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	if (gc != NULL) {
+		SoftCompositor::snapshotPoint((board_snapshot *)gc, x, y, cont);
+		return;
+	}
+	if (cont == WormikGame::GR_NONE || cont == WormikGame::GR_WALL)
+		return;
+	compositor.drawCell(target, x, y, cont);
+	markCellDirty(x, y);
+}
+
+int SoftWormikGui::drawNewdef(void *gc, unsigned x, unsigned y, unsigned short cont, double timeout, double total)
+{
+	if (gc != NULL) {
+		SoftCompositor::snapshotNewdef((board_snapshot *)gc, x, y, cont, timeout, total);
+		return timeout > 0;
+	}
+	int alpha = (int)(255*(timeout-diffGameTime)/total);
+	markCellDirty(x, y);
+	if (alpha <= 0) {
+		compositor.drawCell(target, x, y, cont);
+		return 0;
+	}
+	if (alpha >= 256) // possible because of newdef latency
+		alpha = 255;
+	compositor.drawFadedCell(target, basicScreen, x, y, cont, 255-alpha);
+	return 1;
+}
+
+void SoftWormikGui::invalidateOutput(int len, unsigned (*points)[2])
+{
+	if (len == 0) {
+		return;
+	}
+	else if (len < 0) {
+		invalidatedList.addFlags(-len);
+	}
+	else {
+		while (len-- > 0) {
+			invalidatedList.addObject(points[len][0], points[len][1]);
+		}
+	}
+	redraw = true;
+}
+
+void SoftWormikGui::invalidateAll()
+{
+	invalidateOutput(-INVO_SOFT_FULL, NULL);
+}
+
+void SoftWormikGui::drawStaticScreen(int flags)
+{
+	if ((flags&INVO_BOARD) != 0) {
+		WormikGame::board_view view;
+		game->getBoardView(&view);
+		compositor.drawStatics(target, &view);
+		markDirty(0, 0, WormikGame::GAME_XSIZE*GRECT_XSIZE, WormikGame::GAME_YSIZE*GRECT_YSIZE);
+	}
+	if ((flags&INVO_MENU) != 0) {
+		compositor.drawMenu(target);
+	}
+	if ((flags&INVO_DESC) != 0) {
+		compositor.drawDesc(target);
+	}
+}
+
+unsigned SoftWormikGui::drawBase(void)
+{
+	unsigned ret = 0;
+	InvalidatedList *currentIl = &invalidatedList;
+	double start = frameStart = getDoubleTime();
+	perf_sample sample;
+
+	if (perf != NULL)
+		perf->begin(&sample);
+	target = frame;
+	WormikGame::board_view view;
+	game->getBoardView(&view);
+	if ((currentIl->flags&INVO_BOARD) != 0) {
+		compositor.copyRect(frame, basicScreen, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+		markDirty(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+		for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+			const WormikGame::board_def *row = view.board+y*view.stride;
+			for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++) {
+				WormikGame::board_def t = row[x];
+				if (t != WormikGame::GR_NONE && t != WormikGame::GR_WALL && t != WormikGame::GR_NEW_DEF)
+					compositor.drawCell(frame, x, y, t);
+			}
+		}
+		// newdefs are not part of board
+		currentIl->flags |= INVO_NEW_DEFS;
+	}
+	else {
+		for (unsigned i = 0; i < currentIl->invalidatedLength; i++) {
+			unsigned x = currentIl->invalidatedList[i][0], y = currentIl->invalidatedList[i][1];
+			WormikGame::board_def t = view.board[y*view.stride+x];
+			compositor.copyRect(frame, basicScreen, x*GRECT_XSIZE, y*GRECT_YSIZE, GRECT_XSIZE, GRECT_YSIZE);
+			markCellDirty(x, y);
+			if (t != WormikGame::GR_NONE && t != WormikGame::GR_WALL && t != WormikGame::GR_NEW_DEF)
+				compositor.drawCell(frame, x, y, t);
+		}
+	}
+	currentIl->invalidatedLength = 0;
+
+	if ((currentIl->flags&INVO_NEW_DEFS) != 0) {
+		int timing = 0;
+		for (unsigned i = 0; i < view.newdefsLength; i++) {
+			const WormikGame::board_newdef *nd = &view.newdefs[i];
+			timing += SoftWormikGui::drawNewdef(NULL, nd->x, nd->y, nd->def, WormikGame::GT_SECONDS(nd->timeout), WormikGame::GT_SECONDS(nd->total));
+		}
+		if (timing > 0)
+			ret |= INVO_NEW_DEFS;
+	}
+
+	if ((currentIl->flags&INVO_RECORD) != 0) {
+		int record; time_t rectime; bool isNow;
+		isNow = game->getRecord(&record, &rectime);
+		compositor.drawRecord(frame, record, rectime, isNow);
+	}
+	if ((currentIl->flags&(INVO_SCORE|INVO_GAME_STATE)) != 0) {
+		int score, total, exit;
+		int level;
+		game->getState(&level, NULL);
+		exit = game->getScore(&score, &total);
+		compositor.drawScore(frame, level, score, total, exit);
+	}
+	if ((currentIl->flags&(INVO_HEALTH|INVO_LENGTH)) != 0) {
+		int health, length;
+		game->getSnakeInfo(&health, &length);
+		compositor.drawSnakeInfo(frame, health, length);
+	}
+	if ((currentIl->flags&INVO_INFO) != 0) {
+		markDirty(AREA_INFO_X, 0, WINDOW_WIDTH-AREA_INFO_X, WINDOW_HEIGHT);
+	}
+	statsComposeTime += getDoubleTime()-start;
+	if (perf != NULL)
+		perf->end(perfDraw, &sample);
+
+	return ret;
+}
+
+void SoftWormikGui::drawAnnounce(unsigned n, const char *const text[])
+{
+	compositor.drawAnnounce(frame, n, text);
+	markDirty(0, 0, AREA_INFO_X, WINDOW_HEIGHT);
+	// the box covers board, it's restored on next frame
+	invalidatedList.addFlags(INVO_BOARD);
+}
+
+void SoftWormikGui::drawFinish(unsigned rerenderFlags)
+{
+	if (screen && dirty.w != 0) {
+		if (SDL_UpdateTexture(screen, &dirty, compositor.pixelAt(frame, dirty.x, dirty.y), WINDOW_WIDTH*sizeof(uint32_t)) < 0)
+			game->fatal("failed to upload frame: %s\n", SDL_GetError());
+	}
+	if (renderer) {
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+		SDL_RenderClear(renderer);
+		SDL_RenderCopy(renderer, screen, NULL, NULL);
+		SDL_RenderPresent(renderer);
+	}
+	memset(&dirty, 0, sizeof(dirty));
+	invalidatedList.resetFlags(rerenderFlags|(invalidatedList.flags&INVO_BOARD));
+	redraw = false;
+	statsFrames++;
+	if (renderer)
+		statsFrameTimes.add(getDoubleTime()-frameStart);
+}
+
+void SoftWormikGui::publish(int announcement, double interval)
+{
+	render_slot *slot = &renderSlots[engineSlot];
+	board_snapshot *snapshot = &slot->snapshot;
+
+	WormikGame::board_view view;
+	game->getBoardView(&view);
+	SoftCompositor::resetSnapshot(snapshot);
+	SoftCompositor::snapshotBoard(snapshot, &view);
+	snapshot->recordNow = game->getRecord(&snapshot->record, &snapshot->rectime);
+	game->getState(&snapshot->level, NULL);
+	snapshot->exit = game->getScore(&snapshot->score, &snapshot->total);
+	game->getSnakeInfo(&snapshot->health, &snapshot->length);
+	snapshot->announce = announcement;
+	slot->level = levelCount;
+	slot->season = levelSeason;
+	memcpy(slot->statics, levelStatics, sizeof(slot->statics));
+	slot->stepTime = lastMove;
+	slot->interval = interval;
+
+	// swap with middle slot, full barrier makes the slot content visible
+	engineSlot = SDL_AtomicSet(&renderMiddle, engineSlot|RS_FRESH)&~RS_FRESH;
+	wakeRender();
+	checkRender();
+}
+
+void SoftWormikGui::requestRender(int requests)
+{
+	int old;
+	do {
+		old = SDL_AtomicGet(&renderRequests);
+	} while (!SDL_AtomicCAS(&renderRequests, old, old|requests));
+	wakeRender();
+}
+
+void SoftWormikGui::wakeRender()
+{
+	if (SDL_AtomicCAS(&renderSleeping, 1, 0))
+		SDL_SemPost(renderWake);
+}
+
+void SoftWormikGui::checkRender()
+{
+	if (SDL_AtomicGet(&renderFailed) != 0)
+		game->fatal("%s\n", renderError);
+}
+
+int SoftWormikGui::renderMain(void *self_)
+{
+	SoftWormikGui *self = (SoftWormikGui *)self_;
+	self->renderStatus = self->initRenderer();
+	SDL_SemPost(self->renderStarted);
+	if (self->renderStatus == 0)
+		self->render();
+	self->closeRenderer();
+	return 0;
+}
+
+void SoftWormikGui::failRender(const char *fmt, ...)
+{
+	va_list va;
+	va_start(va, fmt);
+	vsnprintf(renderError, sizeof(renderError), fmt, va);
+	va_end(va);
+	// full barrier, message is complete before the flag is seen
+	SDL_AtomicSet(&renderFailed, 1);
+	if (renderFailedEvent != 0) {
+		SDL_Event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.type = renderFailedEvent;
+		SDL_PushEvent(&ev);
+	}
+}
+
+void SoftWormikGui::sleepRender(bool timed)
+{
+	int consumed = -1;
+	SDL_AtomicSet(&renderSleeping, 1);
+	// work coming before the flag was set did not post, so look once more
+	if (SDL_AtomicGet(&renderRequests) == 0 && (SDL_AtomicGet(&renderMiddle)&RS_FRESH) == 0)
+		consumed = timed ? SDL_SemWaitTimeout(renderWake, (Uint32)(REDRAW_TIME*1000)) : SDL_SemWait(renderWake);
+	// the one clearing the flag posts, the post has to be taken even if not waited for
+	if (consumed != 0 && !SDL_AtomicCAS(&renderSleeping, 1, 0))
+		SDL_SemWait(renderWake);
+}
+
+int SoftWormikGui::renderLevel(const render_slot *slot)
+{
+	if (compositor.loadSeason(seasonLoader.getIcons(slot->season), seasonLoader.getColors(slot->season)) < 0) {
+		failRender("cannot convert season image: %s", SDL_GetError());
+		return -1;
+	}
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+		for (unsigned x = 0; x < WormikGame::GAME_XSIZE; x++)
+			compositor.drawCell(basicScreen, x, y, slot->statics[y][x]);
+	}
+	compositor.drawMenu(basicScreen);
+	compositor.drawDesc(basicScreen);
+	return 0;
+}
+
+void SoftWormikGui::render()
+{
+	unsigned long level = 0;
+	bool animated = false;
+
+	for (;;) {
+		int requests = SDL_AtomicSet(&renderRequests, 0);
+		bool fresh = false;
+		if ((requests&RR_QUIT) != 0)
+			break;
+		if ((SDL_AtomicGet(&renderMiddle)&RS_FRESH) != 0) {
+			renderSlot = SDL_AtomicSet(&renderMiddle, renderSlot)&~RS_FRESH;
+			fresh = true;
+		}
+		const render_slot *slot = &renderSlots[renderSlot];
+		// redraw request composes again too, texture may have been lost
+		if ((fresh || animated || (requests&RR_REDRAW) != 0) && slot->level != 0) {
+			double start = getDoubleTime();
+			double diff = 0;
+			if (slot->level != level) {
+				if (renderLevel(slot) < 0)
+					break;
+				level = slot->level;
+			}
+			if (slot->interval != INFINITY) {
+				if ((diff = start-slot->stepTime) > slot->interval)
+					diff = slot->interval;
+				else if (diff < 0)
+					diff = 0;
+			}
+			animated = compositor.drawSnapshot(frame, basicScreen, &slot->snapshot, diff) > 0 && slot->interval != INFINITY;
+			statsComposeTime += getDoubleTime()-start;
+			if (SDL_UpdateTexture(screen, NULL, frame, WINDOW_WIDTH*sizeof(uint32_t)) < 0) {
+				failRender("failed to upload frame: %s", SDL_GetError());
+				break;
+			}
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+			SDL_RenderClear(renderer);
+			SDL_RenderCopy(renderer, screen, NULL, NULL);
+			SDL_RenderPresent(renderer);
+			statsFrames++;
+			statsFrameTimes.add(getDoubleTime()-start);
+		}
+		if (!animated) {
+			// nothing moves, sleep until game publishes something
+			sleepRender(false);
+		}
+		else if (!vsync) {
+			// presenting does not wait for display, fades are paced here
+			sleepRender(true);
+		}
+	}
+}
+
+int SoftWormikGui::processStandardEvent(SDL_Event *ev)
+{
+	if (renderFailedEvent != 0 && ev->type == renderFailedEvent)
+		checkRender();
+	switch (ev->type) {
+	case SDL_QUIT:
+		return SE_QUIT;
+
+	case SDL_KEYDOWN:
+		switch (ev->key.keysym.sym) {
+		case SDLK_ESCAPE:
+		case SDLK_q:
+			return SE_QUIT;
+
+		case SDLK_f:
+			{
+				int fullscreen = game->getConfigInt("fullscreen", 0) == 0;
+				if (SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0) < 0)
+					game->error("Failed to switch fullscreen mode: %s\n", SDL_GetError());
+				else
+					game->setConfig("fullscreen", fullscreen);
+			}
+			redraw = true;
+			return SE_PROCESSED;
+
+		default:
+			break;
+		}
+		break;
+
+	case SDL_WINDOWEVENT:
+		redraw = true;
+		return SE_PROCESSED;
+
+	case SDL_RENDER_TARGETS_RESET:
+	case SDL_RENDER_DEVICE_RESET:
+		// frame lives in memory, upload it whole again
+		markDirty(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+		redraw = true;
+		return SE_PROCESSED;
+	}
+	return SE_UNKNOWN;
+}
+
+bool SoftWormikGui::announce(int announcement)
+{
+	int ntext = 0;
+	const char *text[2];
+
+	switch (announcement) {
+	case ANC_DEAD:
+		text[ntext++] = "You are dead!";
+		break;
+
+	case ANC_EXIT:
+		text[ntext++] = "You moved to next level,";
+		text[ntext++] = "congratulations!";
+		break;
+
+	default:
+		assert(0);
+	}
+	if (headless) {
+		drawBase();
+		drawAnnounce(ntext, text);
+		drawFinish(0);
+		invalidateAll();
+		return frameLimit != 0 && statsFrames >= frameLimit;
+	}
+	if (threaded) {
+		publish(announcement, INFINITY);
+		redraw = false;
+	}
+	else {
+		redraw = true;
+	}
+	for (;;) {
+		if (redraw && threaded) {
+			requestRender(RR_REDRAW);
+			redraw = false;
+		}
+		else if (redraw) {
+			drawBase();
+			drawAnnounce(ntext, text);
+			drawFinish(0);
+		}
+		SDL_Event ev;
+		if (SDL_WaitEvent(&ev) < 0)
+			game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+		switch (processStandardEvent(&ev)) {
+		case SE_QUIT:
+			return true;
+
+		case SE_UNKNOWN:
+			if (ev.type == SDL_KEYDOWN && (ev.key.keysym.sym == SDLK_SPACE || ev.key.keysym.sym == SDLK_RETURN)) {
+				invalidateAll();
+				return false;
+			}
+			break;
+		}
+	}
+}
+
+bool SoftWormikGui::waitStart()
+{
+	return waitNext(INFINITY);
+}
+
+bool SoftWormikGui::waitNext(double waitInterval)
+{
+	if (headless) {
+		// every game step is one frame, drawn at its exact game time
+		diffGameTime = 0;
+		drawFinish(drawBase());
+		return frameLimit != 0 && statsFrames >= frameLimit;
+	}
+	if (threaded) {
+		// snapshot carries the whole state, nothing is drawn here
+		publish(-1, waitInterval);
+		redraw = false;
+	}
+	double nextRedraw = (invalidatedList.flags&INVO_DYN_FLAGS) != 0 && waitInterval != INFINITY && !threaded ? getDoubleTime()+REDRAW_TIME : INFINITY;
+	for (;;) {
+		int r;
+		SDL_Event ev;
+		double expire = INFINITY;
+		if (redraw && threaded) {
+			requestRender(RR_REDRAW);
+			redraw = false;
+		}
+		if (redraw) {
+			expire = 0;
+		}
+		else if ((invalidatedList.flags&INVO_DYN_FLAGS) != 0 && !threaded) {
+			if (nextRedraw < expire) {
+				expire = nextRedraw;
+			}
+		}
+		else {
+			nextRedraw = INFINITY;
+		}
+		if (lastMove+waitInterval < expire) {
+			expire = lastMove+waitInterval;
+		}
+		if (expire == INFINITY) {
+			// paused or start screen, sleep until event comes
+			if ((r = SDL_WaitEvent(&ev)) == 0)
+				game->fatal("SDL WaitEvent: %s\n", SDL_GetError());
+		}
+		else {
+			double eventWaitMs = ceil((expire-getDoubleTime())*1000);
+			int eventWaitMsCut = eventWaitMs < 0 ? 0 : eventWaitMs > INT_MAX ? INT_MAX : (int)eventWaitMs;
+			r = SDL_WaitEventTimeout(&ev, eventWaitMsCut);
+		}
+		if (r == 0) {
+			double currentTime = getDoubleTime();
+			if (nextRedraw <= currentTime) {
+				redraw = true;
+			}
+			if (lastMove+waitInterval <= currentTime) {
+				statsTickJitter.add(currentTime-(lastMove+waitInterval));
+				lastMove = lastMove+waitInterval;
+				return false;
+			}
+			if (redraw) {
+				unsigned rerenderFlags;
+				if ((diffGameTime = currentTime-lastMove) > waitInterval) {
+					diffGameTime = waitInterval;
+				}
+				else if (diffGameTime < 0 || waitInterval == INFINITY) {
+					diffGameTime = 0;
+				}
+				rerenderFlags = drawBase();
+				drawFinish(rerenderFlags);
+				if (frameLimit != 0 && statsFrames >= frameLimit)
+					return true;
+				nextRedraw = rerenderFlags != 0 && waitInterval != INFINITY ? currentTime+REDRAW_TIME : INFINITY;
+			}
+			continue;
+		}
+		switch (processStandardEvent(&ev)) {
+		case SE_QUIT:
+			return true;
+
+		case SE_UNKNOWN:
+			if (ev.type == SDL_KEYDOWN) {
+				int dir = -1;
+				switch (ev.key.keysym.sym) {
+				case SDLK_p:
+					// paused until next direction key, as in SDL GUI
+					lastMove = 0;
+					diffGameTime = waitInterval;
+					waitInterval = INFINITY;
+					nextRedraw = INFINITY;
+					if (threaded)
+						publish(-1, INFINITY);
+					break;
+
+				case SDLK_RIGHT:
+					dir = WormikGame::SDIR_EAST;
+					break;
+
+				case SDLK_UP:
+					dir = WormikGame::SDIR_NORTH;
+					break;
+
+				case SDLK_LEFT:
+					dir = WormikGame::SDIR_WEST;
+					break;
+
+				case SDLK_DOWN:
+					dir = WormikGame::SDIR_SOUTH;
+					break;
+
+				default:
+					break;
+				}
+				if (dir >= 0) {
+					game->changeDirection(dir);
+					if (waitInterval == INFINITY) {
+						lastMove = getDoubleTime();
+						return false;
+					}
+				}
+			}
+			break;
+		}
+	}
+}
+
+WormikGui *create_SoftWormikGui(bool headless)
+{
+	return new SoftWormikGui(headless);
+}
+
+
+} } } };
@@ -0,0 +1,862 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * ANSI terminal GUI class
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+using namespace gui4x6x16;
+
+
+/**
+ * GUI drawing the board as characters on ANSI terminal.
+ *
+ * Engine output goes to shadow board, the frame then compares it with
+ * what the terminal already shows and emits only cursor moves, colors
+ * and glyphs of changed cells, coalescing close changes into single run.
+ * Whole frame is sent by one write(), so slow links never show half drawn
+ * board. Each cell takes two columns to keep the board square.
+ */
+class TermWormikGui: public WormikGui
+{
+public:
+	enum {
+		CELL_WIDTH = 2,					/**< columns per board cell */
+		BOARD_COL = 1,					/**< first terminal column of board */
+		BOARD_ROW = 1,					/**< first terminal row of board */
+		STATUS_COL = BOARD_COL+WormikGame::GAME_XSIZE*CELL_WIDTH+1,
+		STATUS_WIDTH = 18,
+		SCREEN_COLS = STATUS_COL+STATUS_WIDTH-1,
+		SCREEN_ROWS = BOARD_ROW+WormikGame::GAME_YSIZE-1,
+	};
+
+	enum {
+		INVO_STATUS		= INVO_RECORD|INVO_SCORE|INVO_HEALTH|INVO_LENGTH|INVO_GAME_STATE,
+		INVO_DYN_FLAGS		= INVO_NEW_DEFS,
+	};
+
+	enum {
+		ST_INVALID		= 0,		/**< cell not known to be shown */
+		ST_FADE_BASE		= 16,		/**< styles of newdefs being faded in */
+		ST_COUNT		= 32,
+	};
+
+	enum {
+		STATUS_RECORD		= 0,
+		STATUS_RECORD_TIME,
+		STATUS_SCORE,
+		STATUS_LEVEL,
+		STATUS_HEALTH,
+		STATUS_LENGTH,
+		STATUS_LINES,
+		STATUS_FIRST_ROW	= BOARD_ROW+1,
+	};
+
+	enum {
+		RUN_GAP_MAX		= 3,		/**< unchanged cells rewritten rather than moving cursor */
+		OUTPUT_SIZE		= 65536,
+	};
+
+	enum {
+		KEY_NONE		= -1,
+		KEY_QUIT		= -2,
+		KEY_PAUSE		= -3,
+		KEY_CONFIRM		= -4,
+	};
+
+	enum {
+		ESCAPE_MAX		= 16,		/**< longest escape sequence kept between reads */
+		ESCAPE_WAIT_MS		= 250,		/**< wait for rest of escape sequence split by link */
+	};
+
+	static const double		REDRAW_TIME;
+	static const double		ANNOUNCE_TIME;
+
+protected:
+	typedef struct cell_style
+	{
+		char				glyph[CELL_WIDTH+1];	/**< characters drawn */
+		const char *			sgr;			/**< select graphic rendition parameters */
+	} cell_style;
+
+	static const cell_style		styles[ST_COUNT];	/**< styles indexed by full board type */
+	static const char		SGR_MENU[];
+	static const char		SGR_EXCEPTION[];
+	static const char		SGR_ANNOUNCEMENT[];
+
+	WormikGame *			game;			/**< game interface */
+
+	int				inputFd;		/**< keyboard, -1 if not available */
+	int				outputFd;		/**< terminal output */
+	bool				rawMode;		/**< terminal attributes were changed */
+	struct termios			savedAttrs;		/**< terminal attributes to restore */
+	unsigned char			escape[ESCAPE_MAX];	/**< unfinished escape sequence from last read */
+	unsigned			escapeLength;		/**< length of unfinished escape sequence */
+
+	unsigned char			statics[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< static board styles */
+	unsigned char			cells[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< wanted board styles */
+	unsigned char			shown[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< styles shown by terminal */
+	char				statusShown[STATUS_LINES][STATUS_WIDTH+1];	/**< status lines shown by terminal */
+	const char *			statusSgr[STATUS_LINES];	/**< rendition of shown status lines */
+
+	char				output[OUTPUT_SIZE];	/**< frame being built */
+	size_t				outputLength;		/**< length of frame data */
+	int				cursorX;		/**< terminal cursor column, -1 if unknown */
+	int				cursorY;		/**< terminal cursor row */
+	const char *			currentSgr;		/**< current rendition, NULL if unknown */
+
+	double				diffGameTime;		/**< difference to game time */
+	double				lastMove;		/**< time of last game update */
+
+	InvalidatedList			invalidatedList;	/**< invalid regions list */
+	bool				redraw;			/**< screen needs redraw */
+
+	unsigned long			statsFrames;		/**< frames written */
+	unsigned long long		statsBytes;		/**< bytes written */
+
+	static volatile sig_atomic_t	resized;		/**< terminal window changed */
+	static TermWormikGui *		active;			/**< instance to restore terminal at exit */
+
+public:
+	/* constructor */		TermWormikGui();
+	virtual				~TermWormikGui();
+
+public:
+	virtual int			init(WormikGame *game);
+	virtual void			shutdown(WormikGame *game);
+	virtual int			newLevel(int season);
+
+	virtual void			drawStatic(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual void			drawPoint(void *gc, unsigned x, unsigned y, unsigned short type);
+	virtual int			drawNewdef(void *gc, unsigned x, unsigned y, unsigned short type, double timeout, double total);
+
+	virtual void			invalidateOutput(int len, unsigned (*points)[2]);
+
+	virtual bool			waitStart();
+	virtual bool			waitNext(double interval);
+	virtual bool			announce(int type);
+
+protected:
+	void				restoreTerminal();
+	static void			restoreAtExit();
+	static void			onResize(int sig);
+
+	void				append(const char *data, size_t length);
+	void				appendf(const char *fmt, ...);
+	void				moveTo(int col, int row);
+	void				setSgr(const char *sgr);
+	void				flush();
+	void				forgetScreen();
+
+	void				drawStatus(unsigned line, const char *sgr, const char *fmt, ...);
+	/**
+	 * @return
+	 * 	next refresh flags
+	 */
+	unsigned			drawBase();
+	void				drawBoardDiff();
+	void				drawAnnounce(unsigned n, const char *const text[]);
+	void				drawFinish(unsigned rerenderFlags);
+
+	/**
+	 * @return
+	 * 	direction, or one of KEY_* values
+	 */
+	int				readKey();
+};
+
+const double TermWormikGui::REDRAW_TIME = 1/10.0;
+const double TermWormikGui::ANNOUNCE_TIME = 1.0;
+
+const TermWormikGui::cell_style TermWormikGui::styles[ST_COUNT] = {
+	{ "", NULL },			/* ST_INVALID */
+	{ "  ", "0" },			/* GR_NONE */
+	{ "##", "0;2;37" },		/* GR_WALL */
+	{ "()", "0;32" },		/* GR_POSITIVE */
+	{ "{}", "0;1;33" },		/* GR_POSITIVE_2 */
+	{ "--", "0;35" },		/* GR_NEGATIVE */
+	{ "XX", "0;1;31" },		/* GR_DEATH */
+	{ "[]", "0;1;36" },		/* GR_EXIT */
+	{ "", NULL },
+	{ "", NULL },
+	{ "", NULL },
+	{ "", NULL },
+	{ "oo", "0;1;32" },		/* GR_BASE_SNAKE+GSF_SNAKE_BODY */
+	{ "@@", "0;1;32" },		/* GR_BASE_SNAKE+GSF_SNAKE_HEAD */
+	{ "..", "0;32" },		/* GR_BASE_SNAKE+GSF_SNAKE_TAIL */
+	{ "", NULL },
+	{ "", NULL },			/* ST_FADE_BASE */
+	{ "", NULL },
+	{ "", NULL },
+	{ "()", "0;2;32" },		/* ST_FADE_BASE+GR_POSITIVE */
+	{ "{}", "0;2;33" },		/* ST_FADE_BASE+GR_POSITIVE_2 */
+	{ "--", "0;2;35" },		/* ST_FADE_BASE+GR_NEGATIVE */
+	{ "XX", "0;2;31" },		/* ST_FADE_BASE+GR_DEATH */
+	{ "[]", "0;2;36" },		/* ST_FADE_BASE+GR_EXIT */
+};
+
+const char TermWormikGui::SGR_MENU[] = "0";
+const char TermWormikGui::SGR_EXCEPTION[] = "0;1;31";
+const char TermWormikGui::SGR_ANNOUNCEMENT[] = "0;1;7";
+
+volatile sig_atomic_t TermWormikGui::resized = 0;
+TermWormikGui *TermWormikGui::active = NULL;
+
+static double getDoubleTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1000000000.0;
+}
+
+TermWormikGui::TermWormikGui()
+{
+	game = NULL;
+	inputFd = -1;
+	outputFd = -1;
+	rawMode = false;
+	escapeLength = 0;
+	memset(statics, WormikGame::GR_NONE, sizeof(statics));
+	memset(cells, WormikGame::GR_NONE, sizeof(cells));
+	memset(shown, ST_INVALID, sizeof(shown));
+	memset(statusShown, 0, sizeof(statusShown));
+	memset(statusSgr, 0, sizeof(statusSgr));
+	outputLength = 0;
+	cursorX = cursorY = -1;
+	currentSgr = NULL;
+	diffGameTime = 0;
+	lastMove = 0;
+	invalidatedList.resetFlags(INVO_FULL);
+	redraw = true;
+	statsFrames = 0;
+	statsBytes = 0;
+
+	static_assert(SCREEN_COLS <= 80);
+	static_assert(STATUS_FIRST_ROW+2*STATUS_LINES <= SCREEN_ROWS);
+}
+
+TermWormikGui::~TermWormikGui()
+{
+	restoreTerminal();
+}
+
+int TermWormikGui::init(WormikGame *game_)
+{
+	struct winsize ws;
+	struct sigaction sa;
+
+	game = game_;
+	outputFd = STDOUT_FILENO;
+	if (ioctl(outputFd, TIOCGWINSZ, &ws) == 0 && ws.ws_col != 0 && (ws.ws_col < SCREEN_COLS || ws.ws_row < SCREEN_ROWS)) {
+		game->error("Terminal is %dx%d, at least %dx%d is needed\n", ws.ws_col, ws.ws_row, SCREEN_COLS, SCREEN_ROWS);
+		return -1;
+	}
+	// without terminal input the game runs unattended (soak and bot runs)
+	if (isatty(STDIN_FILENO)) {
+		struct termios attrs;
+		inputFd = STDIN_FILENO;
+		if (tcgetattr(inputFd, &savedAttrs) < 0) {
+			game->error("Couldn't get terminal attributes: %s\n", strerror(errno));
+			return -1;
+		}
+		attrs = savedAttrs;
+		attrs.c_lflag &= ~(ICANON|ECHO|ISIG);
+		attrs.c_iflag &= ~(IXON|ICRNL);
+		attrs.c_cc[VMIN] = 1;
+		attrs.c_cc[VTIME] = 0;
+		if (tcsetattr(inputFd, TCSAFLUSH, &attrs) < 0) {
+			game->error("Couldn't set terminal attributes: %s\n", strerror(errno));
+			return -1;
+		}
+		rawMode = true;
+	}
+	active = this;
+	atexit(&restoreAtExit);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onResize;
+	sigemptyset(&sa.sa_mask);
+	// no SA_RESTART, poll() has to be interrupted
+	sigaction(SIGWINCH, &sa, NULL);
+
+	// alternate screen, hidden cursor
+	append("\033[?1049h\033[?25l", 14);
+	forgetScreen();
+	flush();
+	game->debug("Initialized GUI\n");
+	return 0;
+}
+
+void TermWormikGui::restoreTerminal()
+{
+	if (outputFd >= 0) {
+		outputLength = 0;
+		append("\033[0m\033[?25h\033[?1049l", 18);
+		flush();
+		outputFd = -1;
+	}
+	if (rawMode) {
+		tcsetattr(inputFd, TCSAFLUSH, &savedAttrs);
+		rawMode = false;
+	}
+	if (active == this)
+		active = NULL;
+}
+
+void TermWormikGui::restoreAtExit()
+{
+	if (active)
+		active->restoreTerminal();
+}
+
+void TermWormikGui::onResize(int sig)
+{
+	resized = 1;
+}
+
+void TermWormikGui::shutdown(WormikGame *game)
+{
+	if (statsFrames != 0)
+		game->debug("Written %lu frames, %llu bytes (%.1f bytes per frame)\n", statsFrames, statsBytes, (double)statsBytes/statsFrames);
+	restoreTerminal();
+	signal(SIGWINCH, SIG_DFL);
+}
+
+void TermWormikGui::append(const char *data, size_t length)
+{
+	// frames fit the buffer, so flushing here is only safety net
+	if (outputLength+length > sizeof(output))
+		flush();
+	memcpy(output+outputLength, data, length);
+	outputLength += length;
+}
+
+void TermWormikGui::appendf(const char *fmt, ...)
+{
+	va_list va;
+	char buf[64];
+	int l;
+	va_start(va, fmt);
+	l = vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	append(buf, l < (int)sizeof(buf) ? l : sizeof(buf)-1);
+}
+
+void TermWormikGui::moveTo(int col, int row)
+{
+	if (col == cursorX && row == cursorY)
+		return;
+	if (row == cursorY && col > cursorX && col-cursorX < 4)
+		appendf("\033[%dC", col-cursorX);
+	else
+		appendf("\033[%d;%dH", row, col);
+	cursorX = col;
+	cursorY = row;
+}
+
+void TermWormikGui::setSgr(const char *sgr)
+{
+	if (sgr == currentSgr)
+		return;
+	appendf("\033[%sm", sgr);
+	currentSgr = sgr;
+}
+
+void TermWormikGui::flush()
+{
+	size_t pos = 0;
+	while (pos < outputLength) {
+		ssize_t w = write(outputFd, output+pos, outputLength-pos);
+		if (w < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			game->fatal("failed to write terminal output: %s\n", strerror(errno));
+		}
+		pos += w;
+	}
+	statsBytes += outputLength;
+	outputLength = 0;
+}
+
+void TermWormikGui::forgetScreen()
+{
+	append("\033[0m\033[2J", 8);
+	memset(shown, ST_INVALID, sizeof(shown));
+	memset(statusShown, 0, sizeof(statusShown));
+	memset(statusSgr, 0, sizeof(statusSgr));
+	cursorX = cursorY = -1;
+	currentSgr = NULL;
+	invalidatedList.addFlags(INVO_STATUS);
+	redraw = true;
+}
+
+int TermWormikGui::newLevel(int season)
+{
+	// seasons differ by images only, terminal has none, but the level still counts them as image guis do
+	memset(statics, WormikGame::GR_NONE, sizeof(statics));
+	game->outStatic(NULL, 0, 0, WormikGame::GAME_XSIZE-1, WormikGame::GAME_YSIZE-1);
+	invalidateOutput(-INVO_FULL, NULL);
+	return stockSeason(season);
+}
+
+void TermWormikGui::drawStatic(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	statics[y][x] = WormikGame::GR_GET_FULL_TYPE(cont);
+}
+
+void TermWormikGui::drawPoint(void *gc, unsigned x, unsigned y, unsigned short cont)
+{
+	if (cont == WormikGame::GR_NONE || cont == WormikGame::GR_WALL)
+		return;
+	cells[y][x] = WormikGame::GR_GET_FULL_TYPE(cont);
+}
+
+int TermWormikGui::drawNewdef(void *gc, unsigned x, unsigned y, unsigned short cont, double timeout, double total)
+{
+	unsigned char style = WormikGame::GR_GET_FULL_TYPE(cont);
+	if (timeout-diffGameTime <= 0 || styles[ST_FADE_BASE+style].sgr == NULL) {
+		cells[y][x] = style;
+		return 0;
+	}
+	cells[y][x] = ST_FADE_BASE+style;
+	return 1;
+}
+
+void TermWormikGui::invalidateOutput(int len, unsigned (*points)[2])
+{
+	if (len == 0) {
+		return;
+	}
+	else if (len < 0) {
+		invalidatedList.addFlags(-len);
+	}
+	else {
+		while (len-- > 0) {
+			invalidatedList.addObject(points[len][0], points[len][1]);
+		}
+	}
+	redraw = true;
+}
+
+void TermWormikGui::drawStatus(unsigned line, const char *sgr, const char *fmt, ...)
+{
+	va_list va;
+	char buf[STATUS_WIDTH+1];
+	int l;
+	va_start(va, fmt);
+	l = vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	if (l < 0)
+		l = 0;
+	// padded to full width, so shorter text overwrites longer one
+	for (; l < STATUS_WIDTH; l++)
+		buf[l] = ' ';
+	buf[STATUS_WIDTH] = '\0';
+	if (statusSgr[line] == sgr && strcmp(statusShown[line], buf) == 0)
+		return;
+	moveTo(STATUS_COL, STATUS_FIRST_ROW+line+(line >= STATUS_SCORE)+(line >= STATUS_HEALTH));
+	setSgr(sgr);
+	append(buf, STATUS_WIDTH);
+	cursorX += STATUS_WIDTH;
+	memcpy(statusShown[line], buf, sizeof(buf));
+	statusSgr[line] = sgr;
+}
+
+void TermWormikGui::drawBoardDiff()
+{
+	for (int y = 0; y < WormikGame::GAME_YSIZE; y++) {
+		const unsigned char *want = cells[y];
+		unsigned char *have = shown[y];
+		int x = 0;
+		for (;;) {
+			int end, gap;
+			while (x < WormikGame::GAME_XSIZE && want[x] == have[x])
+				x++;
+			if (x >= WormikGame::GAME_XSIZE)
+				break;
+			// extend run over short unchanged gaps, cheaper than cursor move
+			for (end = x+1, gap = 0; end < WormikGame::GAME_XSIZE && gap <= RUN_GAP_MAX; end++) {
+				if (want[end] == have[end]) {
+					gap++;
+				}
+				else {
+					gap = 0;
+				}
+			}
+			end -= gap;
+			moveTo(BOARD_COL+x*CELL_WIDTH, BOARD_ROW+y);
+			for (; x < end; x++) {
+				setSgr(styles[want[x]].sgr);
+				append(styles[want[x]].glyph, CELL_WIDTH);
+				have[x] = want[x];
+			}
+			cursorX = BOARD_COL+end*CELL_WIDTH;
+		}
+	}
+}
+
+unsigned TermWormikGui::drawBase(void)
+{
+	unsigned ret = 0;
+	InvalidatedList *currentIl = &invalidatedList;
+
+	if ((currentIl->flags&INVO_BOARD) != 0) {
+		memcpy(cells, statics, sizeof(cells));
+		game->outGame(NULL, 0, 0, WormikGame::GAME_XSIZE-1, WormikGame::GAME_YSIZE-1);
+		// newdefs are not part of outGame
+		currentIl->flags |= INVO_NEW_DEFS;
+	}
+	else {
+		for (unsigned i = 0; i < currentIl->invalidatedLength; i++) {
+			unsigned x = currentIl->invalidatedList[i][0], y = currentIl->invalidatedList[i][1];
+			cells[y][x] = statics[y][x];
+			game->outPoint(NULL, x, y);
+		}
+	}
+	currentIl->invalidatedLength = 0;
+
+	if ((currentIl->flags&INVO_NEW_DEFS) != 0) {
+		if (game->outNewdefs(NULL) > 0)
+			ret |= INVO_NEW_DEFS;
+	}
+	drawBoardDiff();
+
+	if ((currentIl->flags&INVO_RECORD) != 0) {
+		struct tm t; char tc[32];
+		int record; time_t rectime; bool isNow;
+		isNow = game->getRecord(&record, &rectime);
+		t = *localtime(&rectime); strftime(tc, sizeof(tc), "%Y-%m-%d %H:%M", &t);
+		drawStatus(STATUS_RECORD, isNow ? SGR_EXCEPTION : SGR_MENU, "Record: %d", record);
+		drawStatus(STATUS_RECORD_TIME, isNow ? SGR_EXCEPTION : SGR_MENU, "%s", (rectime == 0) ? "" : tc);
+	}
+	if ((currentIl->flags&(INVO_SCORE|INVO_GAME_STATE)) != 0) {
+		int score, total, exit;
+		int level;
+		game->getState(&level, NULL);
+		exit = game->getScore(&score, &total);
+		drawStatus(STATUS_SCORE, (score >= exit) ? SGR_EXCEPTION : SGR_MENU, "Score: %d", total);
+		drawStatus(STATUS_LEVEL, (score >= exit) ? SGR_EXCEPTION : SGR_MENU, "Level: %d/%d", level, (total-score)+exit);
+	}
+	if ((currentIl->flags&(INVO_HEALTH|INVO_LENGTH)) != 0) {
+		int health, length;
+		game->getSnakeInfo(&health, &length);
+		drawStatus(STATUS_HEALTH, (health <= 1) ? SGR_EXCEPTION : SGR_MENU, "Health: %d", health);
+		drawStatus(STATUS_LENGTH, SGR_MENU, "Length: %d", length);
+	}
+
+	return ret;
+}
+
+void TermWormikGui::drawAnnounce(unsigned n, const char *const text[])
+{
+	int w = 0;
+	int col0, row0;
+
+	for (unsigned i = 0; i < n; i++) {
+		if ((int)strlen(text[i]) > w)
+			w = strlen(text[i]);
+	}
+	w += 4;
+	col0 = BOARD_COL+(WormikGame::GAME_XSIZE*CELL_WIDTH-w)/2;
+	row0 = BOARD_ROW+(WormikGame::GAME_YSIZE-(int)n-2)/2;
+	setSgr(SGR_ANNOUNCEMENT);
+	for (int r = 0; r < (int)n+2; r++) {
+		char line[WormikGame::GAME_XSIZE*CELL_WIDTH+1];
+		memset(line, ' ', w);
+		if (r > 0 && r <= (int)n) {
+			int l = strlen(text[r-1]);
+			memcpy(line+(w-l)/2, text[r-1], l);
+		}
+		moveTo(col0, row0+r);
+		append(line, w);
+		cursorX += w;
+		// cells below the box have to be redrawn after it disappears
+		for (int c = (col0-BOARD_COL)/CELL_WIDTH; c <= (col0+w-1-BOARD_COL)/CELL_WIDTH; c++)
+			shown[row0+r-BOARD_ROW][c] = ST_INVALID;
+	}
+}
+
+void TermWormikGui::drawFinish(unsigned rerenderFlags)
+{
+	// park cursor out of board, some terminals show it anyway
+	moveTo(SCREEN_COLS, SCREEN_ROWS);
+	flush();
+	invalidatedList.resetFlags(rerenderFlags);
+	redraw = false;
+	statsFrames++;
+}
+
+int TermWormikGui::readKey()
+{
+	unsigned char buf[ESCAPE_MAX+32];
+	ssize_t rd;
+	size_t n;
+	int key = KEY_NONE;
+
+	// escape sequence may come split by link, its start is kept from previous read
+	memcpy(buf, escape, escapeLength);
+	if ((rd = read(inputFd, buf+escapeLength, sizeof(buf)-escapeLength)) <= 0) {
+		if (rd < 0 && (errno == EINTR || errno == EAGAIN))
+			return KEY_NONE;
+		// input closed, continue unattended
+		inputFd = -1;
+		escapeLength = 0;
+		return KEY_NONE;
+	}
+	n = escapeLength+rd;
+	escapeLength = 0;
+	// all pending keys are processed, the last one wins except quit
+	for (size_t i = 0; i < n; i++) {
+		switch (buf[i]) {
+		case 27: {
+			static const int arrows[] = { WormikGame::SDIR_NORTH, WormikGame::SDIR_SOUTH, WormikGame::SDIR_EAST, WormikGame::SDIR_WEST };
+			size_t end = i+1;
+			if (end < n && buf[end] == '[') {
+				// CSI: parameter and intermediate bytes up to final byte
+				for (end++; end < n && (buf[end] < 0x40 || buf[end] > 0x7e); end++) ;
+			}
+			else if (end < n && buf[end] == 'O') {
+				end++;
+			}
+			else if (end < n) {
+				return KEY_QUIT;
+			}
+			if (end >= n) {
+				// unfinished, too long sequences are dropped
+				if (n-i <= ESCAPE_MAX) {
+					escapeLength = n-i;
+					memcpy(escape, buf+i, escapeLength);
+				}
+				i = n;
+				break;
+			}
+			// unknown final bytes are ignored
+			if (buf[end] >= 'A' && buf[end] <= 'D')
+				key = arrows[buf[end]-'A'];
+			i = end;
+			break;
+		}
+
+		case 'q':
+		case 3:
+			return KEY_QUIT;
+
+		case 'p':
+			key = KEY_PAUSE;
+			break;
+
+		case ' ':
+		case '\r':
+		case '\n':
+			key = KEY_CONFIRM;
+			break;
+
+		case 'h':
+			key = WormikGame::SDIR_WEST;
+			break;
+
+		case 'j':
+			key = WormikGame::SDIR_SOUTH;
+			break;
+
+		case 'k':
+			key = WormikGame::SDIR_NORTH;
+			break;
+
+		case 'l':
+			key = WormikGame::SDIR_EAST;
+			break;
+		}
+	}
+	if (escapeLength != 0) {
+		// rest is read by next call, lone escape quits only when nothing follows it shortly
+		struct pollfd pfd = { inputFd, POLLIN, 0 };
+		int r;
+		while ((r = poll(&pfd, 1, ESCAPE_WAIT_MS)) < 0 && errno == EINTR) ;
+		if (r == 0) {
+			if (escapeLength == 1)
+				key = KEY_QUIT;
+			escapeLength = 0;
+		}
+	}
+	return key;
+}
+
+bool TermWormikGui::announce(int announcement)
+{
+	int ntext = 0;
+	const char *text[2];
+
+	switch (announcement) {
+	case ANC_DEAD:
+		text[ntext++] = "You are dead!";
+		break;
+
+	case ANC_EXIT:
+		text[ntext++] = "You moved to next level,";
+		text[ntext++] = "congratulations!";
+		break;
+
+	default:
+		assert(0);
+	}
+	double expire = getDoubleTime()+ANNOUNCE_TIME;
+	redraw = true;
+	for (;;) {
+		if (resized) {
+			resized = 0;
+			forgetScreen();
+		}
+		if (redraw) {
+			drawBase();
+			drawAnnounce(ntext, text);
+			drawFinish(0);
+		}
+		struct pollfd pfd = { inputFd, POLLIN, 0 };
+		int timeout = -1;
+		if (inputFd < 0) {
+			double left = expire-getDoubleTime();
+			if (left <= 0)
+				break;
+			timeout = (int)ceil(left*1000);
+		}
+		int r = poll(&pfd, inputFd < 0 ? 0 : 1, timeout);
+		if (r < 0 && errno != EINTR)
+			game->fatal("failed to poll terminal: %s\n", strerror(errno));
+		if (r <= 0)
+			continue;
+		int key = readKey();
+		if (key == KEY_QUIT)
+			return true;
+		if (key == KEY_CONFIRM)
+			break;
+	}
+	invalidateOutput(-INVO_FULL, NULL);
+	return false;
+}
+
+bool TermWormikGui::waitStart()
+{
+	return waitNext(INFINITY);
+}
+
+bool TermWormikGui::waitNext(double waitInterval)
+{
+	double nextRedraw = (invalidatedList.flags&INVO_DYN_FLAGS) != 0 ? getDoubleTime()+REDRAW_TIME : INFINITY;
+	for (;;) {
+		double currentTime;
+		if (resized) {
+			resized = 0;
+			forgetScreen();
+		}
+		if (waitInterval == INFINITY && inputFd < 0) {
+			// nobody to press the key
+			lastMove = getDoubleTime();
+			return false;
+		}
+		currentTime = getDoubleTime();
+		if (lastMove+waitInterval <= currentTime) {
+			lastMove = lastMove+waitInterval;
+			return false;
+		}
+		if (nextRedraw <= currentTime)
+			redraw = true;
+		if (redraw) {
+			unsigned rerenderFlags;
+			if ((diffGameTime = currentTime-lastMove) > waitInterval) {
+				diffGameTime = waitInterval;
+			}
+			else if (diffGameTime < 0 || waitInterval == INFINITY) {
+				diffGameTime = 0;
+			}
+			rerenderFlags = drawBase();
+			drawFinish(rerenderFlags);
+			nextRedraw = rerenderFlags != 0 && waitInterval != INFINITY ? currentTime+REDRAW_TIME : INFINITY;
+		}
+		double expire = lastMove+waitInterval < nextRedraw ? lastMove+waitInterval : nextRedraw;
+		double waitMs = ceil((expire-getDoubleTime())*1000);
+		struct pollfd pfd = { inputFd, POLLIN, 0 };
+		int r = poll(&pfd, inputFd < 0 ? 0 : 1, waitMs < 0 ? 0 : waitMs > INT_MAX ? -1 : (int)waitMs);
+		if (r < 0 && errno != EINTR)
+			game->fatal("failed to poll terminal: %s\n", strerror(errno));
+		if (r <= 0)
+			continue;
+		int key = readKey();
+		switch (key) {
+		case KEY_QUIT:
+			return true;
+
+		case KEY_PAUSE:
+			// paused until next direction key
+			lastMove = 0;
+			diffGameTime = waitInterval;
+			waitInterval = INFINITY;
+			nextRedraw = INFINITY;
+			break;
+
+		case KEY_NONE:
+		case KEY_CONFIRM:
+			break;
+
+		default:
+			game->changeDirection(key);
+			if (waitInterval == INFINITY) {
+				lastMove = getDoubleTime();
+				return false;
+			}
+			break;
+		}
+	}
+}
+
+WormikGui *create_TermWormikGui()
+{
+	return new TermWormikGui();
+}
+
+
+} } } };
+
+#else
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+WormikGui *create_TermWormikGui()
+{
+	// no ANSI terminal support
+	return NULL;
+}
+
+
+} } } };
+
+#endif
@@ -0,0 +1,419 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Batch environment for training agents
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/WormikEnv.hxx"
+
+#include "cz/znj/sw/wormik/wormik_env.h"
+
+#if (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+# define OBS_ENCODE_X86
+# include <immintrin.h>
+#endif
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+enum {
+	OBSP_NONE			= 0xff,
+};
+
+/* observation plane of full board type, OBSP_NONE for empty */
+static constexpr uint8_t obsPlane(unsigned t)
+{
+	switch (t) {
+	case WormikGame::GR_WALL:
+		return WormikEnv::OBSP_WALL;
+	case WormikGame::GR_POSITIVE:
+		return WormikEnv::OBSP_POSITIVE;
+	case WormikGame::GR_POSITIVE_2:
+		return WormikEnv::OBSP_POSITIVE_2;
+	case WormikGame::GR_NEGATIVE:
+		return WormikEnv::OBSP_NEGATIVE;
+	case WormikGame::GR_DEATH:
+		return WormikEnv::OBSP_DEATH;
+	case WormikGame::GR_EXIT:
+		return WormikEnv::OBSP_EXIT;
+	case WormikGame::GR_NEW_DEF:
+		return WormikEnv::OBSP_NEW_DEF;
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_BODY:
+		return WormikEnv::OBSP_SNAKE_BODY;
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_HEAD:
+		return WormikEnv::OBSP_SNAKE_HEAD;
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_TAIL:
+		return WormikEnv::OBSP_SNAKE_TAIL;
+	}
+	return OBSP_NONE;
+}
+
+/* indexed by full type (low nibble of board_def), usable as pshufb table */
+alignas(16) static constexpr uint8_t obs_plane_lut[16] =
+{
+	obsPlane(0), obsPlane(1), obsPlane(2), obsPlane(3),
+	obsPlane(4), obsPlane(5), obsPlane(6), obsPlane(7),
+	obsPlane(8), obsPlane(9), obsPlane(10), obsPlane(11),
+	obsPlane(12), obsPlane(13), obsPlane(14), obsPlane(15),
+};
+
+static inline void encodeTail(uint8_t *dst, size_t planeSize, const uint8_t *cells, unsigned i, unsigned n)
+{
+	for (; i < n; i++) {
+		uint8_t plane = obs_plane_lut[cells[i]&15];
+		for (unsigned p = 0; p < WormikEnv::OBS_PLANES; p++)
+			dst[p*planeSize+i] = plane == p;
+	}
+}
+
+static void encodeScalar(uint8_t *dst, size_t planeSize, const uint8_t *cells, unsigned n)
+{
+	for (unsigned p = 0; p < WormikEnv::OBS_PLANES; p++)
+		memset(dst+p*planeSize, 0, n);
+	for (unsigned i = 0; i < n; i++) {
+		uint8_t plane = obs_plane_lut[cells[i]&15];
+		if (plane != OBSP_NONE)
+			dst[plane*planeSize+i] = 1;
+	}
+}
+
+static const obs_kernels scalarKernels = { "scalar", &encodeScalar };
+
+#ifdef OBS_ENCODE_X86
+__attribute__((target("ssse3")))
+static void encodeSsse3(uint8_t *dst, size_t planeSize, const uint8_t *cells, unsigned n)
+{
+	const __m128i lut = _mm_load_si128((const __m128i *)obs_plane_lut);
+	const __m128i low = _mm_set1_epi8(0x0f);
+	const __m128i one = _mm_set1_epi8(1);
+	unsigned i;
+	for (i = 0; i+16 <= n; i += 16) {
+		__m128i planes = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_loadu_si128((const __m128i *)(cells+i)), low));
+		for (unsigned p = 0; p < WormikEnv::OBS_PLANES; p++)
+			_mm_storeu_si128((__m128i *)(dst+p*planeSize+i), _mm_and_si128(_mm_cmpeq_epi8(planes, _mm_set1_epi8(p)), one));
+	}
+	encodeTail(dst, planeSize, cells, i, n);
+}
+
+static const obs_kernels ssse3Kernels = { "ssse3", &encodeSsse3 };
+
+__attribute__((target("avx2")))
+static void encodeAvx2(uint8_t *dst, size_t planeSize, const uint8_t *cells, unsigned n)
+{
+	// pshufb works within 128-bit lanes, so both get the same table
+	const __m256i lut = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)obs_plane_lut));
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	const __m256i one = _mm256_set1_epi8(1);
+	unsigned i;
+	for (i = 0; i+32 <= n; i += 32) {
+		__m256i planes = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(cells+i)), low));
+		for (unsigned p = 0; p < WormikEnv::OBS_PLANES; p++)
+			_mm256_storeu_si256((__m256i *)(dst+p*planeSize+i), _mm256_and_si256(_mm256_cmpeq_epi8(planes, _mm256_set1_epi8(p)), one));
+	}
+	encodeTail(dst, planeSize, cells, i, n);
+}
+
+static const obs_kernels avx2Kernels = { "avx2", &encodeAvx2 };
+
+#endif
+
+const obs_kernels *selectObsKernels(const char *name)
+{
+	bool best = name == NULL || strcmp(name, "auto") == 0;
+#ifdef OBS_ENCODE_X86
+	__builtin_cpu_init();
+	if ((best || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+		return &avx2Kernels;
+	if ((best || strcmp(name, "ssse3") == 0) && __builtin_cpu_supports("ssse3"))
+		return &ssse3Kernels;
+#endif
+	if (best || strcmp(name, "scalar") == 0)
+		return &scalarKernels;
+	return NULL;
+}
+
+
+WormikEnv::WormikEnv():
+	count(0),
+	games(NULL),
+	episodeSteps(NULL),
+	workers(NULL),
+	threadsCount(1),
+	generation(0),
+	pending(0),
+	job(JOB_NONE)
+{
+}
+
+WormikEnv::~WormikEnv()
+{
+	if (workers != NULL) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = JOB_QUIT;
+			generation++;
+		}
+		wake.notify_all();
+		for (unsigned w = 1; w < threadsCount; w++)
+			workers[w-1].join();
+		delete[] workers;
+	}
+	delete[] games;
+	delete[] episodeSteps;
+}
+
+int WormikEnv::init(const env_config *config)
+{
+	unsigned n = config->count;
+	if (n == 0)
+		return -1;
+	switch (config->observation) {
+	case OBS_BOARD:
+		obsSide = WormikGame::GAME_XSIZE;
+		break;
+
+	case OBS_WINDOW:
+		if (config->windowRadius == 0 || config->windowRadius > WINDOW_RADIUS_MAX)
+			return -1;
+		obsSide = 2*config->windowRadius+1;
+		break;
+
+	default:
+		return -1;
+	}
+	if ((kernels = selectObsKernels(config->kernels)) == NULL)
+		return -1;
+	observation = config->observation;
+	windowRadius = config->windowRadius;
+
+	games = new rules_state[n];
+	episodeSteps = new uint32_t[n];
+	for (count = 0; count < n; count++) {
+		rulesSetSeed(&games[count], count);
+		rulesStartLevel(&games[count], NULL, WormikGame::GA_DEAD);
+		episodeSteps[count] = 0;
+	}
+
+	if ((threadsCount = config->threads) == 0 && (threadsCount = std::thread::hardware_concurrency()) == 0)
+		threadsCount = 1;
+	if (threadsCount > count)
+		threadsCount = count;
+	workers = new std::thread[threadsCount-1];
+	for (unsigned w = 1; w < threadsCount; w++)
+		workers[w-1] = std::thread(&WormikEnv::workerMain, this, w);
+	return 0;
+}
+
+unsigned WormikEnv::getCount() const
+{
+	return count;
+}
+
+size_t WormikEnv::getObservationSize() const
+{
+	return (size_t)OBS_PLANES*obsSide*obsSide;
+}
+
+unsigned WormikEnv::getObservationSide() const
+{
+	return obsSide;
+}
+
+void WormikEnv::reset(const uint32_t *seeds, uint8_t *observations)
+{
+	jobSeeds = seeds;
+	jobObservations = observations;
+	run(JOB_RESET);
+}
+
+void WormikEnv::step(const uint8_t *actions, float *rewards, uint8_t *dones, uint8_t *observations)
+{
+	jobActions = actions;
+	jobRewards = rewards;
+	jobDones = dones;
+	jobObservations = observations;
+	run(JOB_STEP);
+}
+
+void WormikEnv::getInfo(unsigned i, int *total, int *level, int *length, uint32_t *steps) const
+{
+	*total = games[i].state_totscore;
+	*level = games[i].state_level;
+	*length = games[i].snake_len;
+	*steps = episodeSteps[i];
+}
+
+void WormikEnv::getBoardView(unsigned i, WormikGame::board_view *view) const
+{
+	const rules_cell *head = rulesSnakeCell(&games[i], 0);
+	view->board = &games[i].board[0][0];
+	view->stride = WormikGame::GAME_XSIZE;
+	view->newdefs = games[i].newdefs;
+	view->newdefsLength = games[i].ndlen;
+	view->headX = head->x; view->headY = head->y;
+}
+
+void WormikEnv::run(int job_)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = job_;
+		pending = threadsCount-1;
+		generation++;
+	}
+	wake.notify_all();
+	process(0, count/threadsCount);
+	std::unique_lock<std::mutex> guard(lock);
+	while (pending > 0)
+		finished.wait(guard);
+}
+
+void WormikEnv::workerMain(unsigned worker)
+{
+	unsigned seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (generation == seen)
+				wake.wait(guard);
+			seen = generation;
+			if (job == JOB_QUIT)
+				return;
+		}
+		process(worker*count/threadsCount, (worker+1)*count/threadsCount);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (--pending == 0)
+				finished.notify_one();
+		}
+	}
+}
+
+void WormikEnv::process(unsigned begin, unsigned end)
+{
+	size_t obsSize = getObservationSize();
+	for (unsigned i = begin; i < end; i++) {
+		if (job == JOB_RESET) {
+			if (jobSeeds != NULL)
+				rulesSetSeed(&games[i], jobSeeds[i]);
+			rulesStartLevel(&games[i], NULL, WormikGame::GA_DEAD);
+			episodeSteps[i] = 0;
+		}
+		else {
+			int outcome, cause;
+			rules_state *game = &games[i];
+			uint32_t total = game->state_totscore;
+			if (jobActions[i] < 4)
+				rulesChangeDirection(game, jobActions[i]);
+			outcome = rulesStep(game, NULL, &cause);
+			episodeSteps[i]++;
+			jobRewards[i] = (float)(game->state_totscore-total);
+			jobDones[i] = outcome == WormikGame::GA_DEAD;
+			if (outcome != WormikGame::GA_CONTINUE) {
+				rulesStartLevel(game, NULL, outcome);
+				if (outcome == WormikGame::GA_DEAD)
+					episodeSteps[i] = 0;
+			}
+		}
+		if (jobObservations != NULL)
+			observe(i, jobObservations+i*obsSize);
+	}
+}
+
+void WormikEnv::observe(unsigned i, uint8_t *dst)
+{
+	uint8_t cells[(2*WINDOW_RADIUS_MAX+1)*(2*WINDOW_RADIUS_MAX+1)];
+	const uint8_t *src = cells;
+	unsigned planeSize = obsSide*obsSide;
+
+	if (observation == OBS_BOARD) {
+		src = &games[i].board[0][0];
+	}
+	else {
+		enum { XSIZE = WormikGame::GAME_XSIZE, YSIZE = WormikGame::GAME_YSIZE };
+		const rules_cell *head = rulesSnakeCell(&games[i], 0);
+		int x0 = (int)head->x-(int)windowRadius, y0 = (int)head->y-(int)windowRadius;
+		// columns of window inside board
+		int cx0 = x0 < 0 ? -x0 : 0;
+		int cx1 = x0+(int)obsSide > XSIZE ? XSIZE-x0 : (int)obsSide;
+		for (unsigned wy = 0; wy < obsSide; wy++) {
+			uint8_t *row = cells+wy*obsSide;
+			int y = y0+(int)wy;
+			if (y < 0 || y >= YSIZE) {
+				memset(row, WormikGame::GR_WALL, obsSide);
+				continue;
+			}
+			memset(row, WormikGame::GR_WALL, cx0);
+			memcpy(row+cx0, &games[i].board[y][x0+cx0], cx1-cx0);
+			memset(row+cx1, WormikGame::GR_WALL, obsSide-cx1);
+		}
+	}
+	kernels->encode(dst, planeSize, src, planeSize);
+}
+
+
+} } } };
+
+using namespace cz::znj::sw::wormik;
+
+struct wormik_env
+{
+	WormikEnv			env;
+};
+
+wormik_env *wormik_env_create(unsigned count, int observation, unsigned windowRadius, unsigned threads)
+{
+	WormikEnv::env_config config;
+	wormik_env *env = new wormik_env();
+	config.count = count;
+	config.observation = observation;
+	config.windowRadius = windowRadius;
+	config.threads = threads;
+	config.kernels = getenv("WORMIK_ENV_KERNELS");
+	if (env->env.init(&config) < 0) {
+		delete env;
+		return NULL;
+	}
+	return env;
+}
+
+void wormik_env_destroy(wormik_env *env)
+{
+	delete env;
+}
+
+unsigned wormik_env_count(const wormik_env *env)
+{
+	return env->env.getCount();
+}
+
+size_t wormik_env_observation_size(const wormik_env *env)
+{
+	return env->env.getObservationSize();
+}
+
+unsigned wormik_env_observation_side(const wormik_env *env)
+{
+	return env->env.getObservationSide();
+}
+
+void wormik_env_reset(wormik_env *env, const uint32_t *seeds, uint8_t *observations)
+{
+	env->env.reset(seeds, observations);
+}
+
+void wormik_env_step(wormik_env *env, const uint8_t *actions, float *rewards, uint8_t *dones, uint8_t *observations)
+{
+	env->env.step(actions, rewards, dones, observations);
+}
+
+void wormik_env_info(const wormik_env *env, unsigned i, int *total, int *level, int *length, uint32_t *steps)
+{
+	env->env.getInfo(i, total, level, length, steps);
+}
@@ -0,0 +1,176 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Batch environment for training agents
+ */
+
+#ifndef WormikEnv_hxx__
+# define WormikEnv_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/game_rules.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Observation layout (per environment, uint8 0/1 values):
+ *	planes[OBS_PLANES][height][width]
+ * with width = height = GAME_XSIZE for OBS_BOARD, 2*radius+1 for
+ * OBS_WINDOW centered at snake head (cells outside board are walls).
+ * Empty cells have no plane set.
+ */
+struct obs_kernels
+{
+	const char *			name;
+	/* encodes n cells (board_def) to OBS_PLANES planes planeSize bytes apart */
+	void				(*encode)(uint8_t *dst, size_t planeSize, const uint8_t *cells, unsigned n);
+};
+
+/*
+ * returns kernels by name ("scalar", "ssse3", "avx2"), or the best ones
+ * supported by CPU for NULL or "auto", NULL if not available
+ */
+const obs_kernels *selectObsKernels(const char *name);
+
+
+/**
+ * Steps many independent games at once, without gui and without waits.
+ *
+ * Game states are kept by environment itself in array indexed by game and
+ * stepped by rules of game_rules.hxx shared with WormikGameImpl, without
+ * hooks, so seeded games are identical to the ones played by WormikGame
+ * stepping functions (envbench verifies that). No config is read and no
+ * record is kept. Games are split to contiguous ranges stepped in
+ * parallel by worker threads. Finished (dead) games are started again
+ * immediately, done flag marks the first observation of new game.
+ */
+class WormikEnv
+{
+public:
+	enum {
+		OBS_BOARD			= 0,
+		OBS_WINDOW			= 1,
+	};
+
+	/* observation planes */
+	enum {
+		OBSP_WALL			= 0,
+		OBSP_POSITIVE			= 1,
+		OBSP_POSITIVE_2			= 2,
+		OBSP_NEGATIVE			= 3,
+		OBSP_DEATH			= 4,
+		OBSP_EXIT			= 5,
+		OBSP_NEW_DEF			= 6,
+		OBSP_SNAKE_BODY			= 7,
+		OBSP_SNAKE_HEAD			= 8,
+		OBSP_SNAKE_TAIL			= 9,
+		OBS_PLANES			= 10,
+	};
+
+	/* actions, other values keep direction */
+	enum {
+		ACT_EAST			= 0,
+		ACT_NORTH			= 1,
+		ACT_WEST			= 2,
+		ACT_SOUTH			= 3,
+		ACT_NONE			= 255,
+	};
+
+	typedef struct env_config
+	{
+		unsigned			count;		/**< number of environments */
+		int				observation;	/**< OBS_* */
+		unsigned			windowRadius;	/**< OBS_WINDOW radius, up to WINDOW_RADIUS_MAX */
+		unsigned			threads;	/**< worker threads, 0 for all cores */
+		const char *			kernels;	/**< observation kernels, NULL for best */
+	} env_config;
+
+	enum {
+		WINDOW_RADIUS_MAX		= 30,
+	};
+
+protected:
+	enum {
+		JOB_NONE,
+		JOB_RESET,
+		JOB_STEP,
+		JOB_QUIT,
+	};
+
+	unsigned			count;
+	int				observation;
+	unsigned			windowRadius;
+	unsigned			obsSide;		/**< observation width and height */
+	const obs_kernels *		kernels;
+
+	rules_state *			games;			/**< game states, indexed by environment */
+	uint32_t *			episodeSteps;		/**< steps since game start */
+
+	/* workers, worker 0 is the calling thread */
+	std::thread *			workers;
+	unsigned			threadsCount;
+	std::mutex			lock;
+	std::condition_variable		wake;
+	std::condition_variable		finished;
+	unsigned			generation;
+	unsigned			pending;
+
+	/* current job */
+	int				job;
+	const uint32_t *		jobSeeds;
+	const uint8_t *			jobActions;
+	float *				jobRewards;
+	uint8_t *			jobDones;
+	uint8_t *			jobObservations;
+
+public:
+	/* constructor */		WormikEnv();
+	/* destructor */		~WormikEnv();
+
+public:
+	/** creates games and workers, returns negative on invalid config */
+	int				init(const env_config *config);
+
+	unsigned			getCount() const;
+	/** observation bytes per environment */
+	size_t				getObservationSize() const;
+	/** observation width (and height) */
+	unsigned			getObservationSide() const;
+
+	/**
+	 * starts new games seeded by seeds[count] (NULL keeps generators
+	 * running), writes observations[count][getObservationSize()] if not NULL
+	 */
+	void				reset(const uint32_t *seeds, uint8_t *observations);
+	/**
+	 * steps all games with actions[count] (ACT_*), writes score gained to
+	 * rewards[count], 1 to dones[count] when game ended and was started
+	 * again, and observations if not NULL
+	 */
+	void				step(const uint8_t *actions, float *rewards, uint8_t *dones, uint8_t *observations);
+
+	/** reads score, level, length and steps of current game of environment */
+	void				getInfo(unsigned i, int *total, int *level, int *length, uint32_t *steps) const;
+	/** gets board of environment, valid until next step or reset */
+	void				getBoardView(unsigned i, WormikGame::board_view *view) const;
+
+protected:
+	void				run(int job);
+	void				workerMain(unsigned worker);
+	void				process(unsigned begin, unsigned end);
+	void				observe(unsigned i, uint8_t *dst);
+};
+
+
+} } } };
+
+#endif
@@ -8,10 +8,14 @@
 #ifndef WormikGame_hxx__
 # define WormikGame_hxx__
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace cz { namespace znj { namespace sw { namespace wormik {
 
 
 class WormikGui;
+class PerfCounters;
 
 class WormikGame
 {
@@ -32,6 +36,12 @@ public:
 		GAME_YSIZE			= 30,
 	};
 
+	/* game time in microseconds, integer so timers expire exactly the same on every build */
+	typedef int32_t game_time;
+	enum {
+		GAME_TIME_SECOND		= 1000000,
+	};
+
 	/* game states */
 	enum {
 		GS_WAITING,
@@ -39,6 +49,24 @@ public:
 		GS_ASKAGAIN,
 	};
 
+	/* step outcomes */
+	enum {
+		GA_CONTINUE,
+		GA_EXIT,
+		GA_DEAD,
+	};
+
+	/* causes of level end */
+	enum {
+		GE_NONE,					/* level not ended, or left unfinished */
+		GE_EXIT,
+		GE_WALL,					/* hit wall */
+		GE_DEATH,					/* ate death tile */
+		GE_HEALTH,					/* health exhausted by negative tile */
+		GE_SELF_BITE,					/* health exhausted by biting itself */
+		GE_COUNT,
+	};
+
 	enum {
 		SDIR_EAST,
 		SDIR_NORTH,
@@ -65,23 +93,64 @@ public:
 		GSF_SNAKE_TAIL			= 2,
 	};
 
-	constexpr static float TIMEOUT_EXIT     = 0.75f;
-	constexpr static float TIMEOUT_POSITIVE = 0.3f;
+	/* snake motion flags */
+	enum {
+		SM_HEAD				= 1,
+		SM_TAIL				= 2,
+	};
+
+	/* snake movement in last step, for drawing in between steps */
+	typedef struct snake_motion
+	{
+		unsigned char			headX, headY;	/* new head cell */
+		unsigned char			headDir;	/* direction head came from previous cell */
+		unsigned char			tailX, tailY;	/* new tail cell */
+		unsigned char			tailDir;	/* direction tail came from previous cell */
+		unsigned char			tailOut;	/* out-direction of new tail */
+	} snake_motion;
+
+	/* def being generated (fading in), its board cell holds GR_NEW_DEF */
+	typedef struct board_newdef
+	{
+		short				x, y;
+		board_def			def;		/* generated type */
+		unsigned char			defsi;		/* game internal def counter */
+		game_time			timeout;	/* remaining time */
+		game_time			total;		/* whole generating time */
+	} board_newdef;
+
+	/* read-only view of game board, valid until next game step */
+	typedef struct board_view
+	{
+		const board_def *		board;		/* cell x, y is board[y*stride+x] */
+		unsigned			stride;		/* cells between rows */
+		const board_newdef *		newdefs;
+		unsigned			newdefsLength;
+		unsigned char			headX, headY;	/* snake head cell */
+	} board_view;
+
+	/* percent of generating time left when eaten newdef is still removed */
+	enum {
+		TIMEOUT_EXIT_PERCENT		= 75,
+		TIMEOUT_POSITIVE_PERCENT	= 30,
+	};
 
 public:
 	/* board macros */
 	/* get base type GR_INVALID, ..., GR_BASE_SNAKE */
-	static board_def		GR_GET_BASE_TYPE(board_def n);
+	static constexpr board_def	GR_GET_BASE_TYPE(board_def n);
 	/* get full type GR_INVALID, ..., GR_BASE_SNAKE/head, ... */
-	static board_def		GR_GET_FULL_TYPE(board_def n);
+	static constexpr board_def	GR_GET_FULL_TYPE(board_def n);
 	/* get snake type */
-	static board_def		GR_GET_SNAKE_TYPE(board_def n);
+	static constexpr board_def	GR_GET_SNAKE_TYPE(board_def n);
 	/* get snake in-direction */
-	static board_def		GR_GET_IN(board_def n);
+	static constexpr board_def	GR_GET_IN(board_def n);
 	/* get snake out-direction */
-	static board_def		GR_GET_OUT(board_def n);
+	static constexpr board_def	GR_GET_OUT(board_def n);
 	/* create snake definition */
-	static board_def		GR_SNAKE(board_def type, int in, int out);
+	static constexpr board_def	GR_SNAKE(board_def type, int in, int out);
+	/* converts game time to seconds, for gui waits and fading only */
+	static constexpr double		GT_SECONDS(game_time t);
 
 public:
 	virtual				~WormikGame() {}
@@ -91,6 +160,32 @@ public:
 	virtual void			setGui(WormikGui *gui) = 0;
 	virtual void			run(void) = 0;
 
+	/* stepping functions, game driven by caller instead of run() and gui waits */
+	/*  seeds game random generator */
+	virtual void			setSeed(unsigned seed) = 0;
+	/*  starts next level after GA_EXIT, new game after GA_DEAD */
+	virtual void			startLevel(int outcome) = 0;
+	/*  moves snake by one step, returns GA_* */
+	virtual int			stepGame() = 0;
+	/*  returns GE_* cause of level end after stepGame returned GA_EXIT or GA_DEAD */
+	virtual int			getEndCause() = 0;
+
+	/* replay seeking functions, called by gui during wait of run() */
+	/*  stores compact state of game in the current wait, returns its size or 0 if buffer is too small */
+	virtual size_t			saveState(void *buf, size_t size) = 0;
+	/*  restores state stored by saveState, run() continues from its wait, returns negative if invalid */
+	virtual int			restoreState(const void *buf, size_t size) = 0;
+	/*  finishes current wait without gui and continues game up to the next wait */
+	virtual void			skipWait() = 0;
+
+	/* instant replay of recent waits kept in memory, called by gui during wait of run() */
+	/*  rewinds game up to waits back, returns number of waits to play or 0 if nothing is kept */
+	virtual unsigned		rewindRecent(unsigned waits) = 0;
+	/*  plays next rewound wait, returns false when game is back in the wait of rewindRecent */
+	virtual bool			playRecent() = 0;
+	/*  returns game to the wait of rewindRecent right away */
+	virtual void			stopRecent() = 0;
+
 	/* config functions */
 	/*  returns full string length (as sprintf) */
 	virtual int			getConfigStr(const char *name, char *buf, int blen) = 0;
@@ -100,6 +195,8 @@ public:
 	virtual void			setConfig(const char *name, int value) = 0;
 	/*  sets config string */
 	virtual void			setConfig(const char *name, const char *value) = 0;
+	/*  overrides config value for this session only, later setConfig of the name is not persisted either */
+	virtual void			overrideConfig(const char *name, const char *value) = 0;
 
 	/* error reporting functions */
 	/*  debug message */
@@ -119,6 +216,8 @@ public:
 	virtual int			getScore(int *score, int *total) = 0;
 	/*  get health, length */
 	virtual void			getSnakeInfo(int *health, int *length) = 0;
+	/*  get snake movement in last step, returns SM_HEAD and SM_TAIL flags of moved parts */
+	virtual int			getSnakeMotion(snake_motion *motion) = 0;
 	/*  get record, returns if current is record */
 	virtual bool			getRecord(int *record, time_t *rectime) = 0;
 
@@ -131,34 +230,45 @@ public:
 	virtual void			outStatic(void *gc, unsigned x0, unsigned y0, unsigned x1, unsigned y1) = 0;
 	/*  draws all newdefs, returns number of still timing */
 	virtual int			outNewdefs(void *gc) = 0;
+	/*  gets board for drawing in bulk, without call per cell */
+	virtual void			getBoardView(board_view *view) = 0;
+	/*  gets 64-bit Zobrist hash of board, snake direction, health and newdefs, same on every build */
+	virtual uint64_t		getStateHash() = 0;
+	/*  gets hardware counters of main thread (perfcounters config), NULL if disabled */
+	virtual PerfCounters *		getPerfCounters() = 0;
 };
 
-inline WormikGame::board_def WormikGame::GR_SNAKE(board_def type, int in, int out)
+inline constexpr WormikGame::board_def WormikGame::GR_SNAKE(board_def type, int in, int out)
 {
 	return (GR_BASE_SNAKE+type)|(in<<4)|(out<<6);
 }
 
-inline WormikGame::board_def WormikGame::GR_GET_BASE_TYPE(board_def n)
+inline constexpr double WormikGame::GT_SECONDS(game_time t)
+{
+	return (double)t/GAME_TIME_SECOND;
+}
+
+inline constexpr WormikGame::board_def WormikGame::GR_GET_BASE_TYPE(board_def n)
 {
 	return ((n&15) >= GR_BASE_SNAKE)?GR_BASE_SNAKE:n;
 }
 
-inline WormikGame::board_def WormikGame::GR_GET_FULL_TYPE(board_def n)
+inline constexpr WormikGame::board_def WormikGame::GR_GET_FULL_TYPE(board_def n)
 {
 	return n&15;
 }
 
-inline WormikGame::board_def WormikGame::GR_GET_SNAKE_TYPE(board_def n)
+inline constexpr WormikGame::board_def WormikGame::GR_GET_SNAKE_TYPE(board_def n)
 {
 	return n&3;
 }
 
-inline WormikGame::board_def WormikGame::GR_GET_IN(board_def n)
+inline constexpr WormikGame::board_def WormikGame::GR_GET_IN(board_def n)
 {
 	return (n>>4)&3;
 }
 
-inline WormikGame::board_def WormikGame::GR_GET_OUT(board_def n)
+inline constexpr WormikGame::board_def WormikGame::GR_GET_OUT(board_def n)
 {
 	return (n>>6)&3;
 }
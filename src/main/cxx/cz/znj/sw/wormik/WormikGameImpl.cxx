@@ -10,6 +10,7 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <errno.h>
 
 #include <limits.h>
 #include <fcntl.h>
@@ -27,10 +28,21 @@
 #include "cz/znj/sw/wormik/WormikGame.hxx"
 #include "cz/znj/sw/wormik/WormikGui.hxx"
 
+#include "cz/znj/sw/wormik/replay.hxx"
+#include "cz/znj/sw/wormik/live_export.hxx"
+#include "cz/znj/sw/wormik/analytics.hxx"
+#include "cz/znj/sw/wormik/perf_counters.hxx"
+#include "cz/znj/sw/wormik/game_rules.hxx"
+
 namespace cz { namespace znj { namespace sw { namespace wormik {
 
 
-class WormikGameImpl: public WormikGame
+/*
+ * Board, snake, timers, scores and generator are in rules_state, stepped by
+ * the rules shared with batch environment, this class adds gui, hash,
+ * recording and config around them as their hooks.
+ */
+class WormikGameImpl: public WormikGame, protected rules_state, protected RulesHooks
 {
 protected:
 	/* gui interface */
@@ -39,54 +51,101 @@ protected:
 	/* game state */
 	int				state_game;			/* game state */
 
-	unsigned			state_level;
 	unsigned			state_season;
-	unsigned			state_exitscore;
-	unsigned			state_levscore;
-	unsigned			state_totscore;
-
-	typedef struct element_pos
-	{
-		unsigned char			x, y;
-	} element_pos;
+	int				state_cause;			/* GE_* of level end */
 
 	/* stats */
 	int				stats_record;
 	time_t				stats_rectime;
 
-	/* snake data */
-	unsigned			snake_dir;
-	element_pos			snake_pos[GAME_XSIZE*GAME_YSIZE];
-	unsigned			snake_len;
-	int				snake_grow;
-	unsigned			snake_health;
-
 	/* board state */
+	uint64_t			board_hash;		/* Zobrist hash of board and newdefs, updated on every change */
+
+	bool				isDebug;
+
+	/* replay recording */
+	ReplayWriter			replayWriter;
+	uint32_t			replayStep;		/* finished gui waits */
+
+	/* run loop position, in members so run() continues from restored state */
+	enum {
+		RW_START,
+		RW_NEXT,
+		RW_EXIT,
+		RW_DEAD,
+	};
+
+	int				run_wait;		/* RW_* wait in progress */
+
+	/* compact state of saveState, followed by ndlen newdefs and snake_len snake positions */
 	enum {
-		DEFCNTSMAX			= 4,
+		SAVED_STATE_MAGIC		= 0x3153574b,
+		DEFCNTSMAX			= RULES_DEFS,
 	};
 
-	typedef struct def_state
+	typedef struct saved_state
 	{
-		board_def			def;
-		unsigned			cnt;
-		unsigned			max;
-		float				timeout;
-	} def_state;
-
-	typedef struct new_def {
-		short				x, y;
-		unsigned			defsi;
-		float				timeout;
-	} new_def;
-
-	board_def			board[GAME_YSIZE][GAME_XSIZE];	/* game board */
-	def_state			defcnts[DEFCNTSMAX];	/* regenerable defs count */
-	unsigned			freecnt;		/* count of empty tiles */
-	new_def				newdefs[32];		/* newly generated defs */
-	unsigned			ndlen;			/* (and their count) */
+		uint32_t			magic;
+		uint32_t			replayStep;
+		uint32_t			random_state;
+		uint8_t				run_wait;
+		uint8_t				state_game;
+		uint8_t				snake_dir;
+		uint8_t				snake_moved;
+		uint32_t			state_level;
+		uint32_t			state_season;
+		uint32_t			state_exitscore;
+		uint32_t			state_levscore;
+		uint32_t			state_totscore;
+		int32_t				snake_grow;
+		uint32_t			snake_len;
+		uint32_t			snake_health;
+		game_time			step_interval;
+		game_time			health_add;
+		game_time			health_timeout;
+		uint32_t			defcnts[DEFCNTSMAX][2];	/* cnt and max (exit one is opened) */
+		uint32_t			freecnt;
+		uint32_t			ndlen;
+		snake_motion			snake_step;
+		board_def			board[GAME_YSIZE][GAME_XSIZE];
+	} saved_state;
+
+	/* recent waits kept for instant replay */
+	FlightRecorder			flightRecorder;
+	bool				recent_playing;		/* rewound by rewindRecent, recording is suspended */
+	uint32_t			recent_end;		/* wait of rewindRecent */
+	uint32_t			recent_event;		/* next flight recorder event to apply */
+	size_t				recent_size;		/* size of state saved by rewindRecent */
+	int				recent_record;		/* record before playing back, it is raised again meanwhile */
+	time_t				recent_rectime;
+
+	/* state export for external tools */
+	LiveExport			liveExport;
+
+	/* level outcomes store, not maintained across restoreState */
+	AnalyticsWriter			analyticsWriter;
+	analytics_level			analyticsLevel;		/* level in progress */
+	uint32_t			analyticsGame;		/* games started in session */
+
+	/* hardware counters, opened on first getPerfCounters */
+	PerfCounters			perfCounters;
+	bool				perfChecked;		/* perfcounters config was read */
+	int				perfStep;		/* site of advance in run() */
+	int				perfWalls;		/* site of generateWalls */
+
+	/* session config overrides */
+	enum {
+		CONFIG_OVERRIDES_MAX		= 16,
+	};
 
-	bool				isDebug;
+	typedef struct config_override
+	{
+		char				name[32];
+		char				value[256];
+	} config_override;
+
+	config_override			configOverrides[CONFIG_OVERRIDES_MAX];
+	unsigned			configOverridesLen;
 
 public:
 	/* constructor */		WormikGameImpl();
@@ -95,10 +154,24 @@ public:
 	virtual void			setGui(WormikGui *gui);
 	virtual void			run(void);
 
+	virtual void			setSeed(unsigned seed);
+	virtual void			startLevel(int outcome);
+	virtual int			stepGame();
+	virtual int			getEndCause();
+
+	virtual size_t			saveState(void *buf, size_t size);
+	virtual int			restoreState(const void *buf, size_t size);
+	virtual void			skipWait();
+
+	virtual unsigned		rewindRecent(unsigned waits);
+	virtual bool			playRecent();
+	virtual void			stopRecent();
+
 	virtual int			getConfigStr(const char *name, char *buf, int blen);
 	virtual int			getConfigInt(const char *name, int defval);
 	virtual void			setConfig(const char *name, int value);
 	virtual void			setConfig(const char *name, const char *value);
+	virtual void			overrideConfig(const char *name, const char *value);
 
 	virtual int			debug(const char *fmt, ...);
 	virtual int			error(const char *fmt, ...);
@@ -109,52 +182,92 @@ public:
 	virtual int			getState(int *level, int *season);
 	virtual int			getScore(int *score, int *total);
 	virtual void			getSnakeInfo(int *health, int *length);
+	virtual int			getSnakeMotion(snake_motion *motion);
 	virtual bool 			getRecord(int *record, time_t *rectime);
 
 	virtual void			outPoint(void *gc, unsigned x, unsigned y);
 	virtual void			outStatic(void *gc, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
 	virtual void			outGame(void *gc, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
 	virtual int			outNewdefs(void *gc);
+	virtual void			getBoardView(board_view *view);
+	virtual uint64_t		getStateHash();
+	virtual PerfCounters *		getPerfCounters();
 
 protected:
-	void				initBoard();
-	void				generateType(board_def type, int num, board_def old);
-	int				generateWalls(unsigned headx, unsigned heady);
+	/* rules hooks */
+	virtual void			cellChanged(unsigned x, unsigned y, board_def old, board_def def);
+	virtual void			newdefToggled(const board_newdef *nd);
+	virtual void			invalidateCell(unsigned x, unsigned y);
+	virtual void			invalidateFlags(int flags);
+	virtual void			generateWalls(rules_state *s, unsigned headx, unsigned heady);
 
-	void				decDefs(board_def def);
-	int				genDef(float latency);
-	bool				deleteNewDef(unsigned x, unsigned y);
+	uint64_t			computeBoardHash();
 
 	void				saveRecord();
 
+	bool				stepDone(bool quit);
+	void				advance();
+	void				writeKeyframe();
+	void				writeAnalytics();
+
+	config_override *		findConfigOverride(const char *name);
+
 	void				exit(int n);
 
 	void				printLogTimestamp();
 };
 
-static const int direction_moves[4][2] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1} };
+/* Zobrist key kinds, keys are splitmix64 of kind and value instead of random tables */
+enum {
+	ZK_CELL,
+	ZK_NEWDEF,
+	ZK_DIRECTION,
+	ZK_HEALTH,
+};
+
+static inline uint64_t zobristKey(unsigned kind, uint64_t value)
+{
+	uint64_t z = (((uint64_t)kind<<60)|value)*0x9e3779b97f4a7c15u+0x632be59bd9b4e019u;
+	z = (z^(z>>30))*0xbf58476d1ce4e5b9u;
+	z = (z^(z>>27))*0x94d049bb133111ebu;
+	return z^(z>>31);
+}
+
+static inline uint64_t cellKey(unsigned x, unsigned y, WormikGame::board_def def)
+{
+	return zobristKey(ZK_CELL, (y*WormikGame::GAME_XSIZE+x)<<8|def);
+}
+
+static inline uint64_t newdefKey(const WormikGame::board_newdef *nd)
+{
+	return zobristKey(ZK_NEWDEF, (uint64_t)(nd->y*WormikGame::GAME_XSIZE+nd->x)<<40|(uint64_t)nd->defsi<<32|(uint32_t)nd->timeout);
+}
 
-static int randrange(int min, int max)
+void WormikGameImpl::setSeed(unsigned seed)
 {
-	return min+(int)(rand()*(uint64_t)(max-min+1)/((uint64_t)RAND_MAX+1));
+	rulesSetSeed(this, seed);
 }
 
 WormikGameImpl::WormikGameImpl()
 {
 	char buf[1024];
-	int i = 0;
+	configOverridesLen = 0;
+	replayStep = 0;
+	run_wait = RW_START;
+	recent_playing = false;
+	state_cause = GE_NONE;
+	analyticsGame = 0;
+	memset(&analyticsLevel, 0, sizeof(analyticsLevel));
+	perfChecked = false;
+	perfStep = -1;
+	perfWalls = -1;
+	setSeed(0);
 	if ((unsigned)getConfigStr("record", buf, sizeof(buf)) >= sizeof(buf) || sscanf(buf, "%d/%ld", &stats_record, &stats_rectime) < 2) {
 		stats_record = 0;
 		stats_rectime = 0;
 	}
 
 	isDebug = getConfigInt("debug", 0) != 0;
-
-	defcnts[i].def = GR_EXIT; defcnts[i].max = 0; defcnts[i].timeout = 2.0; i++;
-	defcnts[i].def = GR_POSITIVE; defcnts[i].max = TILES_COUNT_POSITIVE; defcnts[i].timeout = 2.0; i++;
-	defcnts[i].def = GR_POSITIVE_2; defcnts[i].max = TILES_COUNT_POSITIVE_2; defcnts[i].timeout = 2.0; i++;
-	defcnts[i].def = GR_NEGATIVE; defcnts[i].max = TILES_COUNT_NEGATIVE; defcnts[i].timeout = 2.0; i++;
-	assert(i == DEFCNTSMAX);
 }
 
 void WormikGameImpl::setGui(WormikGui *gui_)
@@ -192,6 +305,31 @@ void WormikGameImpl::setConfig(const char *name, int value)
 	setConfig(name, buf);
 }
 
+WormikGameImpl::config_override *WormikGameImpl::findConfigOverride(const char *name)
+{
+	for (unsigned i = 0; i < configOverridesLen; i++) {
+		if (strcmp(configOverrides[i].name, name) == 0)
+			return &configOverrides[i];
+	}
+	return NULL;
+}
+
+void WormikGameImpl::overrideConfig(const char *name, const char *value)
+{
+	config_override *o;
+	if ((o = findConfigOverride(name)) == NULL) {
+		if (configOverridesLen == CONFIG_OVERRIDES_MAX || strlen(name) >= sizeof(o->name)) {
+			error("cannot override config %s\n", name);
+			return;
+		}
+		o = &configOverrides[configOverridesLen++];
+		strcpy(o->name, name);
+	}
+	snprintf(o->value, sizeof(o->value), "%s", value);
+	if (strcmp(name, "debug") == 0)
+		isDebug = getConfigInt("debug", 0) != 0;
+}
+
 void WormikGameImpl::setConfig(const char *name, const char *value)
 {
 	char buf[256];
@@ -199,6 +337,10 @@ void WormikGameImpl::setConfig(const char *name, const char *value)
 	int nl;
 	int ll;
 	int rc;
+	if (findConfigOverride(name) != NULL) {
+		overrideConfig(name, value);
+		return;
+	}
 	if (!(cf = openConfig(O_RDWR)))
 		return;
 	nl = strlen(name);
@@ -242,6 +384,13 @@ int WormikGameImpl::getConfigStr(const char *name, char *str, int buflen)
 	FILE *cf;
 	int nl;
 	int vl = -1;
+	config_override *o;
+	if ((o = findConfigOverride(name)) != NULL) {
+		vl = strlen(o->value);
+		memcpy(str, o->value, (vl >= buflen)?buflen:vl);
+		(vl < buflen) && (str[vl] = '\0');
+		return vl;
+	}
 	if (!(cf = openConfig(O_RDONLY)))
 		return -1;
 	nl = strlen(name);
@@ -266,8 +415,11 @@ int WormikGameImpl::getConfigStr(const char *name, char *str, int buflen)
 
 void WormikGameImpl::changeDirection(int dir_)
 {
-	if (dir_ != GR_GET_IN(board[snake_pos[0].y][snake_pos[0].x]))
-		snake_dir = dir_;
+	if (!recent_playing) {
+		replayWriter.addEvent(replayStep, RE_DIRECTION, dir_);
+		flightRecorder.addEvent(replayStep, RE_DIRECTION, dir_);
+	}
+	rulesChangeDirection(this, dir_);
 }
 
 int WormikGameImpl::getState(int *level, int *season)
@@ -292,6 +444,12 @@ void WormikGameImpl::getSnakeInfo(int *health, int *length)
 	*length = snake_len;
 }
 
+int WormikGameImpl::getSnakeMotion(snake_motion *motion)
+{
+	*motion = snake_step;
+	return snake_moved;
+}
+
 bool WormikGameImpl::getRecord(int *record, time_t *rectime)
 {
 	*rectime = stats_rectime;
@@ -339,603 +497,445 @@ int WormikGameImpl::outNewdefs(void *gc)
 	int ret = 0;
 	unsigned i;
 	for (i = 0; i < ndlen; i++) {
-		ret += gui->drawNewdef(gc, newdefs[i].x, newdefs[i].y, defcnts[newdefs[i].defsi].def, newdefs[i].timeout, defcnts[newdefs[i].defsi].timeout);
+		ret += gui->drawNewdef(gc, newdefs[i].x, newdefs[i].y, newdefs[i].def, GT_SECONDS(newdefs[i].timeout), GT_SECONDS(newdefs[i].total));
 	}
 	return ret;
 }
 
-static void gwCheckAccess(short (*access)[WormikGameImpl::GAME_XSIZE], unsigned x, unsigned y)
+void WormikGameImpl::getBoardView(board_view *view)
 {
-	unsigned tlen;
-	short tlist[WormikGameImpl::GAME_YSIZE*WormikGameImpl::GAME_XSIZE][2];
+	view->board = &board[0][0];
+	view->stride = GAME_XSIZE;
+	view->newdefs = newdefs;
+	view->newdefsLength = ndlen;
+	view->headX = rulesSnakeCell(this, 0)->x; view->headY = rulesSnakeCell(this, 0)->y;
+}
 
-	tlen = 0;
-	tlist[tlen][0] = x; tlist[tlen][1] = y; tlen++;
+uint64_t WormikGameImpl::getStateHash()
+{
+	// scalars change in many places, so they are mixed in here, board is hashed incrementally
+	return board_hash^zobristKey(ZK_DIRECTION, snake_dir)^zobristKey(ZK_HEALTH, snake_health);
+}
 
-	while (tlen > 0) {
-		unsigned bi = 0; unsigned bx, by;
-		for (unsigned i = 1; i < tlen; i++) {
-			if (access[tlist[i][1]][tlist[i][0]] < access[tlist[bi][1]][tlist[bi][0]])
-				bi = i;
-		}
-		bx = tlist[bi][0]; by = tlist[bi][1];
-		memmove(tlist+bi, tlist+bi+1, (--tlen-bi)*sizeof(tlist[0]));
-		for (unsigned dm = 0; dm < 4; dm++) {
-			unsigned cx, cy;
-			cx = bx+direction_moves[dm][0]; cy = by+direction_moves[dm][1];
-			if (access[cy][cx] < 0)
-				continue;
-			if (access[cy][cx] == SHRT_MAX) {
-				tlist[tlen][0] = cx; tlist[tlen][1] = cy;
-				tlen++;
-			}
-			if (access[cy][cx] > access[by][bx]+1)
-				access[cy][cx] = access[by][bx]+1;
-		}
-	}
+void WormikGameImpl::cellChanged(unsigned x, unsigned y, board_def old, board_def def)
+{
+	board_hash ^= cellKey(x, y, old)^cellKey(x, y, def);
+}
+
+void WormikGameImpl::newdefToggled(const board_newdef *nd)
+{
+	board_hash ^= newdefKey(nd);
+}
+
+void WormikGameImpl::invalidateCell(unsigned x, unsigned y)
+{
+	unsigned p[1][2] = { { x, y } };
+	gui->invalidateOutput(1, p);
+}
+
+void WormikGameImpl::invalidateFlags(int flags)
+{
+	gui->invalidateOutput(-flags, NULL);
 }
 
-int WormikGameImpl::generateWalls(unsigned headx, unsigned heady)
+void WormikGameImpl::generateWalls(rules_state *s, unsigned headx, unsigned heady)
 {
-	unsigned wallcnt, deathcnt;
-	short access[GAME_YSIZE][GAME_XSIZE];
+	if (perfWalls >= 0) {
+		perf_sample sample;
+		perfCounters.begin(&sample);
+		rulesGenerateWalls(s, headx, heady);
+		perfCounters.end(perfWalls, &sample);
+	}
+	else {
+		rulesGenerateWalls(s, headx, heady);
+	}
+}
 
+uint64_t WormikGameImpl::computeBoardHash()
+{
+	uint64_t hash = 0;
 	for (unsigned y = 0; y < GAME_YSIZE; y++) {
-		access[y][0] = -1; access[y][GAME_XSIZE-1] = -1;
-		for (unsigned x = 0; x < GAME_XSIZE; x++) {
-			if (board[y][x] == GR_INVALID || board[y][x] == GR_NONE)
-				access[y][x] = SHRT_MAX;
-			else {
-				access[y][x] = -1;
-			}
-		}
+		for (unsigned x = 0; x < GAME_XSIZE; x++)
+			hash ^= cellKey(x, y, board[y][x]);
 	}
-	access[heady][headx] = 0;
-	access[heady+1][headx] = -1;
-
-	for (wallcnt = 0; wallcnt < TILES_COUNT_WALLS; ) {
-		unsigned x, y;
-		unsigned l;
-		bool isok = true;
-		unsigned cacc;
-		l = randrange(1, freecnt);
-		assert(l > 0 && l <= freecnt);
-		for (y = 1; ; y++) {
-			assert(y < GAME_YSIZE-1);
-			for (x = 1; x < GAME_XSIZE-1; x++) {
-				if (board[y][x] != GR_INVALID)
-					continue;
-				if (--l == 0)
-					break;
-			}
-			if (l == 0)
-				break;
-		}
-		assert(board[y][x] == GR_INVALID);
-		cacc = access[y][x];
-		access[y][x] = -1;
-		if (cacc == SHRT_MAX) {
-			isok = false;
-		}
-		else {
-			for (unsigned dm = 0; dm < 4; dm++) {
-				unsigned dm2;
-				unsigned cx, cy;
-				cx = x+direction_moves[dm][0]; cy = y+direction_moves[dm][1];
-				if (access[cy][cx] < 0)
-					continue;
-				if (access[cy][cx] <= (short)cacc)
-					continue;
-				for (dm2 = 0; dm2 < 4; dm2++) {
-					unsigned tx, ty;
-					if (dm2 == ((dm+2)&3))
-						continue;
-					tx = cx+direction_moves[dm2][0]; ty = cy+direction_moves[dm2][1];
-					if (access[ty][tx] < 0)
-						continue;
-					if ((unsigned)access[ty][tx] <= cacc+1)
-						break;
-				}
-				if (dm2 < 4)
-					continue;
-				isok = false;
-				break;
-			}
-		}
-		if (!isok) {
-			{ // keep gcc quiet about ISO C++
-				for (unsigned y = 1; y < GAME_YSIZE-1; y++) {
-					for (unsigned x = 1; x < GAME_XSIZE-1; x++) {
-						if (access[y][x] > 0)
-							access[y][x] = SHRT_MAX;
-					}
-				}
-			}
-			gwCheckAccess(access, headx, heady);
-			isok = true;
-			for (unsigned dm = 0; dm < 4; dm++) {
-				unsigned cx, cy;
-				cx = x+direction_moves[dm][0]; cy = y+direction_moves[dm][1];
-				if (access[cy][cx] < 0)
-					continue;
-				if (access[cy][cx] < SHRT_MAX)
-					continue;
-				isok = false;
-				break;
-			}
-		}
-		if (!isok) {
-			board[y][x] = GR_NONE;
-			freecnt--;
-			access[y][x] = cacc;
-		}
-		else {
-			board[y][x] = GR_WALL;
-			freecnt--;
-			wallcnt++;
-		}
+	for (unsigned i = 0; i < ndlen; i++)
+		hash ^= newdefKey(&newdefs[i]);
+	return hash;
+}
+
+void WormikGameImpl::startLevel(int outcome)
+{
+	if (outcome == GA_DEAD) {
+		state_season = 0;
+#ifdef TESTOPTS
+		state_season = getConfigInt("initseason", state_season);
+#endif
+		stats_record = abs(stats_record);
 	}
-	for (deathcnt = 0; deathcnt < TILES_COUNT_DEATH; deathcnt++) {
-		unsigned x, y;
-		unsigned l;
-		l = randrange(1, wallcnt-deathcnt);
-		assert(l > 0 && l <= wallcnt-deathcnt);
-		for (y = 1; ; y++) {
-			assert(y < GAME_YSIZE-1);
-			for (x = 1; x < GAME_XSIZE-1; x++) {
-				if (board[y][x] != GR_WALL)
-					continue;
-				if (--l == 0)
-					break;
-			}
-			if (l == 0)
-				break;
-		}
-		board[y][x] = GR_DEATH;
+	else {
+		state_season++;
 	}
-	return wallcnt+deathcnt;
+	state_cause = GE_NONE;
+	state_game = GS_WAITING;
+	rulesStartLevel(this, this, outcome);
+#ifdef TESTOPTS
+	if (outcome == GA_DEAD)
+		state_exitscore = getConfigInt("exitscore", state_exitscore);
+#endif
+	board_hash = computeBoardHash();
+
+	state_season = gui->newLevel(state_season);
 }
 
-void WormikGameImpl::generateType(board_def type, int num, unsigned char old)
+int WormikGameImpl::stepGame()
 {
-	unsigned x, y;
-	while (num--) {
-		do {
-			x = rand()%GAME_XSIZE;
-			y = rand()%GAME_YSIZE;
-		} while (board[y][x] != old);
-		board[y][x] = type;
-		freecnt--;
+	int action;
+	int cause;
+	unsigned oldscore = state_levscore;
+
+	action = rulesStep(this, this, &cause);
+	if (action != GA_CONTINUE)
+		state_cause = cause;
+	if (state_levscore != oldscore && (stats_record < 0 || state_totscore > (unsigned)stats_record)) {
+		stats_record = -state_totscore;
+		stats_rectime = time(NULL);
+		gui->invalidateOutput(-WormikGui::INVO_RECORD, NULL);
 	}
+	assert(board_hash == computeBoardHash());
+	return action;
 }
 
-void WormikGameImpl::initBoard()
+PerfCounters *WormikGameImpl::getPerfCounters()
 {
-	unsigned x, y;
+	if (!perfChecked) {
+		perfChecked = true;
+		if (getConfigInt("perfcounters", 0) != 0) {
+			if (perfCounters.open() < 0)
+				error("hardware performance counters are not available (%s), counting time only\n", strerror(errno));
+			perfStep = perfCounters.addSite("step");
+			perfWalls = perfCounters.addSite("walls");
+		}
+	}
+	return perfCounters.isOpen() ? &perfCounters : NULL;
+}
 
-	for (y = 1; y < GAME_YSIZE-1; y++) {
-		for (x = 1; x < GAME_XSIZE-1; x++)
-			board[y][x] = GR_INVALID;
+int WormikGameImpl::getEndCause()
+{
+	return state_cause;
+}
+
+void WormikGameImpl::run(void)
+{
+	char replayPath[PATH_MAX];
+	char liveName[64];
+	char analyticsPath[PATH_MAX];
+
+	setSeed(getConfigInt("seed", 0));
+	replayStep = 0;
+	if ((unsigned)getConfigStr("recordreplay", replayPath, sizeof(replayPath)) < sizeof(replayPath)) {
+		if (replayWriter.open(replayPath, getConfigInt("seed", 0)) < 0)
+			error("failed to create replay %s: %s\n", replayPath, strerror(errno));
 	}
-	for (x = 0; x < GAME_XSIZE; x++) {
-		board[0][x] = GR_WALL;
-		board[GAME_YSIZE-1][x] = GR_WALL;
+	if ((unsigned)getConfigStr("liveexport", liveName, sizeof(liveName)) < sizeof(liveName)) {
+		if (liveExport.open(liveName, getConfigInt("liveexportpoll", 20)) < 0)
+			error("failed to create live export %s: %s\n", liveName, strerror(errno));
 	}
-	for (y = 1; y < GAME_YSIZE-1; y++) {
-		board[y][0] = GR_WALL;
-		board[y][GAME_XSIZE-1] = GR_WALL;
+	if ((unsigned)getConfigStr("analytics", analyticsPath, sizeof(analyticsPath)) < sizeof(analyticsPath) && analyticsPath[0] != '\0') {
+		if (analyticsWriter.open(analyticsPath) < 0)
+			error("failed to open analytics store %s: %s\n", analyticsPath, strerror(errno));
 	}
-	freecnt = GAME_YSIZE*GAME_XSIZE-2*GAME_XSIZE-2*(GAME_YSIZE-2);
+	if (flightRecorder.open() < 0)
+		error("failed to allocate flight recorder: %s\n", strerror(errno));
+	analyticsGame = 0;
+	memset(&analyticsLevel, 0, sizeof(analyticsLevel));
+	getPerfCounters();
+	startLevel(GA_DEAD);
+	run_wait = RW_START;
+	if (liveExport.isOpen())
+		liveExport.publish(this);
+	// whole position is in members, gui may replace it by restoreState during any wait
+	for (;;) {
+		bool quit;
+		// level start is a keyframe too, so seeking never generates level
+		if ((flightRecorder.isOpen() || replayWriter.isOpen()) && (replayStep%FLIGHT_KEYFRAME_INTERVAL == 0 || run_wait == RW_START))
+			writeKeyframe();
+		switch (run_wait) {
+		case RW_START:
+			quit = gui->waitStart();
+			break;
 
-	snake_dir = SDIR_SOUTH;
-	//snake_grow = 0;
-	snake_health = 4;
+		case RW_NEXT:
+			quit = gui->waitNext(GT_SECONDS(step_interval));
+			break;
 
-	snake_pos[0].x = GAME_XSIZE/2; snake_pos[0].y = GAME_YSIZE/2+1;
-	snake_pos[1].x = GAME_XSIZE/2; snake_pos[1].y = GAME_YSIZE/2+0;
-	snake_pos[2].x = GAME_XSIZE/2; snake_pos[2].y = GAME_YSIZE/2-1;
-	snake_pos[3].x = GAME_XSIZE/2; snake_pos[3].y = GAME_YSIZE/2-2;
-	snake_len = 4;
+		case RW_EXIT:
+			quit = gui->announce(WormikGui::ANC_EXIT);
+			break;
 
-	board[GAME_YSIZE/2-2][GAME_XSIZE/2] = GR_SNAKE(GSF_SNAKE_TAIL, SDIR_NORTH, SDIR_SOUTH);
-	board[GAME_YSIZE/2-1][GAME_XSIZE/2] = GR_SNAKE(GSF_SNAKE_BODY, SDIR_NORTH, SDIR_SOUTH);
-	board[GAME_YSIZE/2+0][GAME_XSIZE/2] = GR_SNAKE(GSF_SNAKE_BODY, SDIR_NORTH, SDIR_SOUTH);
-	board[GAME_YSIZE/2+1][GAME_XSIZE/2] = GR_SNAKE(GSF_SNAKE_HEAD, SDIR_NORTH, SDIR_SOUTH);
-	board[GAME_YSIZE/2+2][GAME_XSIZE/2] = GR_NONE;
-	board[GAME_YSIZE/2+3][GAME_XSIZE/2] = GR_NONE;
-	freecnt -= 6;
+		default:
+			quit = gui->announce(WormikGui::ANC_DEAD);
+			break;
+		}
+		if (stepDone(quit)) {
+			// level left in the middle is recorded too, announced ones already are
+			if ((run_wait == RW_START || run_wait == RW_NEXT) && analyticsLevel.ticks != 0)
+				writeAnalytics();
+			break;
+		}
+		if (perfStep >= 0) {
+			perf_sample sample;
+			perfCounters.begin(&sample);
+			advance();
+			perfCounters.end(perfStep, &sample);
+		}
+		else {
+			advance();
+		}
+	}
+	exit(0);
+}
 
-	//{ board[2][1] = GR_WALL; board[2][2] = GR_WALL; freecnt -= 2; } // test
+void WormikGameImpl::advance()
+{
+	int action;
+	switch (run_wait) {
+	case RW_START:
+		state_game = GS_RUNNING;
+		/* fall through */
+	case RW_NEXT:
+		action = stepGame();
+		if (action == GA_CONTINUE) {
+			run_wait = RW_NEXT;
+		}
+		else {
+			run_wait = (action == GA_EXIT) ? RW_EXIT : RW_DEAD;
+		}
+		// played back waits were recorded already
+		if (recent_playing)
+			return;
+		analyticsStep(&analyticsLevel, snake_len);
+		if (action != GA_CONTINUE) {
+			if (stats_record < 0)
+				saveRecord();
+			writeAnalytics();
+		}
+		break;
 
-	generateWalls(GAME_XSIZE/2, GAME_YSIZE/2+1);
+	case RW_EXIT:
+		startLevel(GA_EXIT);
+		run_wait = RW_START;
+		break;
 
-#if 0
-	generateType(GR_POSITIVE, 50, GR_INVALID);
-	generateType(GR_POSITIVE_2, 30, GR_INVALID);
-	generateType(GR_NEGATIVE, 20, GR_INVALID);
-#endif
-	assert(defcnts[0].def == GR_EXIT); defcnts[0].max = 0;
-	for (int i = 0; i < DEFCNTSMAX; i++)
-		defcnts[i].cnt = 0;
-
-	for (y = 0; y < GAME_YSIZE; y++) {
-		for (x = 0; x < GAME_XSIZE; x++) {
-			if (board[y][x] == GR_INVALID)
-				board[y][x] = GR_NONE;
-			else if (board[y][x] == GR_NONE)
-				freecnt++;
-		}
+	case RW_DEAD:
+		startLevel(GA_DEAD);
+		run_wait = RW_START;
+		if (!recent_playing)
+			analyticsGame++;
+		break;
 	}
-	ndlen = 0;
-
-	state_season = gui->newLevel(state_season);
+	if (liveExport.isOpen() && !recent_playing)
+		liveExport.publish(this);
 }
 
-void WormikGameImpl::decDefs(board_def def)
+void WormikGameImpl::skipWait()
 {
-	unsigned i;
-	for (i = 0; ; i++) {
-		assert(i < DEFCNTSMAX);
-		if (defcnts[i].def == def)
-			break;
-	}
-	assert(defcnts[i].cnt > 0);
-	defcnts[i].cnt--;
-	freecnt++;
+	stepDone(false);
+	advance();
 }
 
-int WormikGameImpl::genDef(float latency)
+size_t WormikGameImpl::saveState(void *buf, size_t size)
 {
-	unsigned x, y;
-	unsigned l;
-	int i;
-	int bi = -1;
-	int br = INT_MAX;
-	if (freecnt == 0)
-		return 0;
-	if (ndlen == sizeof(newdefs)/sizeof(newdefs[0]))
-		return 0;
-	for (i = 0; i < DEFCNTSMAX; i++) {
-		int r;
-		if (defcnts[i].cnt == defcnts[i].max && (1 || defcnts[i].max == 0)) // another test - generate full board (switch 0/1)
-			continue;
-		if ((r = 65536*defcnts[i].cnt/defcnts[i].max) >= br)
-			continue;
-		bi = i; br = r;
-	}
-	if (bi < 0)
+	saved_state st;
+	char *p = (char *)buf;
+	size_t length = sizeof(st)+ndlen*sizeof(board_newdef)+snake_len*sizeof(rules_cell);
+
+	if (length > size)
 		return 0;
-	l = randrange(1, freecnt);
-	for (y = 1; ; y++) {
-		assert(y < GAME_YSIZE-1);
-		for (x = 1; x < GAME_XSIZE-1; x++) {
-			if (board[y][x] != GR_NONE)
-				continue;
-			if (--l == 0)
-				break;
-		}
-		if (l == 0)
-			break;
+	memset(&st, 0, sizeof(st));
+	st.magic = SAVED_STATE_MAGIC;
+	st.replayStep = replayStep;
+	st.random_state = random_state;
+	st.run_wait = run_wait;
+	st.state_game = state_game;
+	st.snake_dir = snake_dir;
+	st.snake_moved = snake_moved;
+	st.state_level = state_level;
+	st.state_season = state_season;
+	st.state_exitscore = state_exitscore;
+	st.state_levscore = state_levscore;
+	st.state_totscore = state_totscore;
+	st.snake_grow = snake_grow;
+	st.snake_len = snake_len;
+	st.snake_health = snake_health;
+	st.step_interval = step_interval;
+	st.health_add = health_add;
+	st.health_timeout = health_timeout;
+	for (int i = 0; i < DEFCNTSMAX; i++) {
+		st.defcnts[i][0] = defcnts[i];
+		st.defcnts[i][1] = i == 0 ? exit_open : rules_defs[i].max;
 	}
-	if (0) { // another testing code
-		unsigned nx, ny;
-		nx = snake_pos[0].x+4*direction_moves[snake_dir][0]; ny = snake_pos[0].y+4*direction_moves[snake_dir][1];
-		if (board[ny][nx] == GR_NONE)
-			x = nx, y = ny;
+	st.freecnt = freecnt;
+	st.ndlen = ndlen;
+	st.snake_step = snake_step;
+	memcpy(st.board, board, sizeof(board));
+
+	memcpy(p, &st, sizeof(st)); p += sizeof(st);
+	memcpy(p, newdefs, ndlen*sizeof(board_newdef)); p += ndlen*sizeof(board_newdef);
+	for (unsigned i = 0; i < snake_len; i++) {
+		memcpy(p, rulesSnakeCell(this, i), sizeof(rules_cell)); p += sizeof(rules_cell);
 	}
-	assert(board[y][x] == GR_NONE);
-	newdefs[ndlen].defsi = bi;
-	newdefs[ndlen].x = x; newdefs[ndlen].y = y;
-	newdefs[ndlen].timeout = defcnts[bi].timeout+latency;
-	ndlen++;
-	defcnts[bi].cnt++;
-	board[y][x] = GR_NEW_DEF;
-	freecnt--;
-	gui->invalidateOutput(-WormikGui::INVO_NEW_DEFS, NULL);
-	return 1;
+	return length;
 }
 
-bool WormikGameImpl::deleteNewDef(unsigned x, unsigned y)
+int WormikGameImpl::restoreState(const void *buf, size_t size)
 {
-	unsigned p[2];
-	board_def def;
-	unsigned i;
-	unsigned di;
-	bool deleteIt;
-	assert(board[y][x] == GR_NEW_DEF);
-	for (i = 0; ; i++) {
-		assert(i < ndlen);
-		if (newdefs[i].x == (int)x && newdefs[i].y == (int)y)
-			break;
+	saved_state st;
+	const char *p = (const char *)buf;
+
+	if (size < sizeof(st))
+		return -1;
+	memcpy(&st, p, sizeof(st)); p += sizeof(st);
+	if (st.magic != SAVED_STATE_MAGIC || st.run_wait > RW_DEAD || st.snake_dir > SDIR_SOUTH ||
+			st.snake_len == 0 || st.snake_len > GAME_XSIZE*GAME_YSIZE || st.ndlen > sizeof(newdefs)/sizeof(newdefs[0]) ||
+			size != sizeof(st)+st.ndlen*sizeof(board_newdef)+st.snake_len*sizeof(rules_cell))
+		return -1;
+	// positions are checked before anything is changed, as they index the board
+	for (unsigned i = 0; i < st.ndlen; i++) {
+		board_newdef nd;
+		memcpy(&nd, p+i*sizeof(nd), sizeof(nd));
+		if ((unsigned)nd.x >= GAME_XSIZE || (unsigned)nd.y >= GAME_YSIZE)
+			return -1;
+	}
+	for (unsigned i = 0; i < st.snake_len; i++) {
+		rules_cell pos;
+		memcpy(&pos, p+st.ndlen*sizeof(board_newdef)+i*sizeof(pos), sizeof(pos));
+		if (pos.x >= GAME_XSIZE || pos.y >= GAME_YSIZE)
+			return -1;
 	}
-	di = newdefs[i].defsi;
-	def = defcnts[di].def;
-	switch (def) {
-	case GR_EXIT:
-		deleteIt = newdefs[i].timeout/defcnts[di].timeout > TIMEOUT_EXIT;
-		break;
 
-	case GR_POSITIVE:
-	case GR_POSITIVE_2:
-		deleteIt = newdefs[i].timeout/defcnts[di].timeout > TIMEOUT_POSITIVE;
-		break;
+	replayStep = st.replayStep;
+	random_state = st.random_state;
+	run_wait = st.run_wait;
+	state_game = st.state_game;
+	snake_dir = st.snake_dir;
+	snake_moved = st.snake_moved;
+	state_level = st.state_level;
+	state_season = st.state_season;
+	state_exitscore = st.state_exitscore;
+	state_levscore = st.state_levscore;
+	state_totscore = st.state_totscore;
+	snake_grow = st.snake_grow;
+	snake_len = st.snake_len;
+	snake_health = st.snake_health;
+	step_interval = st.step_interval;
+	health_add = st.health_add;
+	health_timeout = st.health_timeout;
+	for (int i = 0; i < DEFCNTSMAX; i++)
+		defcnts[i] = st.defcnts[i][0];
+	exit_open = st.defcnts[0][1] != 0;
+	freecnt = st.freecnt;
+	ndlen = st.ndlen;
+	snake_step = st.snake_step;
+	memcpy(board, st.board, sizeof(board));
+	memcpy(newdefs, p, ndlen*sizeof(board_newdef)); p += ndlen*sizeof(board_newdef);
+	snake_head = 0;
+	memcpy(snake_ring, p, snake_len*sizeof(rules_cell));
+	board_hash = computeBoardHash();
+
+	// level may differ, statics are drawn again
+	state_season = gui->newLevel(state_season);
+	gui->invalidateOutput(-WormikGui::INVO_FULL, NULL);
+	return 0;
+}
 
-	default:
-		deleteIt = true;
-		break;
-	}
-	memmove(newdefs+i, newdefs+i+1, (--ndlen-i)*sizeof(newdefs[0]));
-	if (deleteIt) {
-		decDefs(def);
-		board[y][x] = GR_NONE;
+unsigned WormikGameImpl::rewindRecent(unsigned waits)
+{
+	uint32_t target = replayStep > waits ? replayStep-waits : 0;
+	const void *state;
+	size_t size, spareSize;
+	void *spare;
+	int64_t keyframe;
+
+	if (recent_playing || !flightRecorder.isOpen())
+		return 0;
+	if ((keyframe = flightRecorder.findKeyframe(target, &state, &size)) < 0 || keyframe >= replayStep)
+		return 0;
+	// current wait is restored at the end instead of trusting the simulation to reach it
+	spare = flightRecorder.spareBuffer(&spareSize);
+	if ((recent_size = saveState(spare, spareSize)) == 0)
+		return 0;
+	recent_end = replayStep;
+	recent_record = stats_record;
+	recent_rectime = stats_rectime;
+	recent_playing = true;
+	if (restoreState(state, size) < 0) {
+		stopRecent();
+		return 0;
 	}
-	else {
-		p[0] = x; p[1] = y;
-		gui->invalidateOutput(1, &p);
-		board[y][x] = def;
+	recent_event = flightRecorder.findEvent(replayStep);
+	// keyframes are sparse, waits before target are not shown
+	while (replayStep < target && playRecent()) {
 	}
-	return deleteIt;
+	return recent_end-replayStep;
 }
 
-void WormikGameImpl::run(void)
+bool WormikGameImpl::playRecent()
 {
-	int action = 2; /* exit: 1; dead: 2, quit: 3 */
+	const replay_event *event;
 
-	while (action != 3) {
-		double interval = 0.400000;
-		double tadd_health = 5.0;
-		double tout_health = tadd_health+interval;
+	if (!recent_playing)
+		return false;
+	for (; (event = flightRecorder.getEvent(recent_event)) != NULL && event->step <= replayStep; recent_event++) {
+		if (event->step == replayStep && event->type == RE_DIRECTION)
+			changeDirection(replayEventValue(event));
+	}
+	stepDone(false);
+	advance();
+	if (replayStep < recent_end)
+		return true;
+	stopRecent();
+	return false;
+}
 
-		if (action == 2) {
-			snake_grow = 0;
-			state_level = 0;
-			state_season = 0;
-#ifdef TESTOPTS
-			state_season = getConfigInt("initseason", state_season);
-#endif
-			state_exitscore = 80;
-#ifdef TESTOPTS
-			state_exitscore = getConfigInt("exitscore", state_exitscore);
-#endif
-			state_totscore = 0;
-			stats_record = abs(stats_record);
-		}
-		else {
-			state_level++;
-			state_season++;
-			state_exitscore += 16+8*(state_level/4);
-		}
-		state_levscore = 0;
-		state_game = GS_WAITING;
-		action = 0;
-		initBoard();
+void WormikGameImpl::stopRecent()
+{
+	size_t size;
 
-		if (gui->waitStart())
-			goto quit;
-		state_game = GS_RUNNING;
-		for (;;) {
-			int invof = 0;
-			unsigned npos[2];
-			unsigned oldscore = state_levscore;
-
-			if ((tout_health -= interval) <= 0) {
-				snake_health++;
-				invof |= WormikGui::INVO_HEALTH;
-				if (tadd_health < 8.0)
-					tadd_health += 2.0;
-				else if (tadd_health < 12.0)
-					tadd_health += 1.5;
-				else if (tadd_health < 16.0)
-					tadd_health += 1.0;
-				else if (tadd_health < 20.0)
-					tadd_health += 0.7;
-				else if (tadd_health < 25.0)
-					tadd_health += 0.5;
-				tout_health += tadd_health;
-			}
-
-			if (ndlen > 0) {
-				unsigned il = 0;
-				unsigned inval[sizeof(newdefs)/sizeof(newdefs[0])][2];
-				unsigned ni, di;
-				for (di = ni = 0; ni < ndlen; ni++) {
-					if ((newdefs[ni].timeout -= interval) <= 0) {
-						board[newdefs[ni].y][newdefs[ni].x] = defcnts[newdefs[ni].defsi].def;
-						inval[il][0] = newdefs[ni].x; inval[il][1] = newdefs[ni].y;
-						il++;
-					}
-					else {
-						newdefs[di++] = newdefs[ni];
-					}
-				}
-				ndlen = di;
-				gui->invalidateOutput(il, inval);
-			}
-
-			npos[0] = snake_pos[0].x+direction_moves[snake_dir][0];
-			npos[1] = snake_pos[0].y+direction_moves[snake_dir][1];
-
-step_hit:
-			switch (board[npos[1]][npos[0]]) {
-			case GR_WALL:
-			case GR_DEATH:
-				action = 2;
-				invof |= WormikGui::INVO_HEALTH;
-				break;
-
-			default: // snake
-				if (GR_GET_FULL_TYPE(board[npos[1]][npos[0]]) == GR_BASE_SNAKE+GSF_SNAKE_TAIL)
-					snake_health--;
-				else
-					snake_health /= 2;
-				if (snake_health > 0) {
-					unsigned il = 0;
-					unsigned inval[17][2];
-					for (;;) {
-						element_pos *p = &snake_pos[--snake_len];
-						if (il == sizeof(inval)/sizeof(inval[0])-1) {
-							gui->invalidateOutput(il, inval);
-							il = 0;
-						}
-						inval[il][0] = p->x; inval[il][1] = p->y; il++;
-						board[p->y][p->x] = GR_NONE; freecnt++;
-						if (p->x == npos[0] && p->y == npos[1])
-							break;
-						assert(defcnts[0].def == GR_EXIT);
-						if (defcnts[0].max != 0)
-							state_levscore++;
-					}
-					board[snake_pos[snake_len-1].y][snake_pos[snake_len-1].x] = GR_SNAKE(GSF_SNAKE_TAIL, 0, GR_GET_OUT(board[snake_pos[snake_len-1].y][snake_pos[snake_len-1].x]));
-					inval[il][0] = snake_pos[snake_len-1].x; inval[il][1] = snake_pos[snake_len-1].y; il++;
-					gui->invalidateOutput(il, inval);
-					gui->invalidateOutput(-WormikGui::INVO_LENGTH, NULL);
-				}
-				invof |= WormikGui::INVO_HEALTH;
-				break;
-
-			case GR_NEW_DEF:
-				if (!deleteNewDef(npos[0], npos[1]))
-					goto step_hit;
-				// fall through
-			case GR_NONE:
-				break;
-
-			case GR_POSITIVE:
-				snake_grow += 1;
-				state_levscore += 2;
-				decDefs(GR_POSITIVE);
-				break;
-
-			case GR_POSITIVE_2:
-				snake_grow += 2;
-				state_levscore += 5;
-				decDefs(GR_POSITIVE_2);
-				break;
-
-			case GR_NEGATIVE:
-				invof |= WormikGui::INVO_HEALTH;
-				if ((snake_health -= 1) <= 0)
-					break;
-				decDefs(GR_NEGATIVE);
-				snake_grow--;
-				break;
-
-			case GR_EXIT:
-				state_levscore += 12*state_level+8*(state_level/4);
-				invof |= WormikGui::INVO_SCORE;
-				action = 1;
-				break;
-			}
-			if (snake_health == 0) {
-				action = 2;
-			}
-			if (state_levscore != oldscore) {
-				state_totscore += state_levscore-oldscore;
-				gui->invalidateOutput(-WormikGui::INVO_SCORE, NULL);
-				if ((stats_record < 0 || state_totscore > (unsigned)stats_record)) {
-					stats_record = -state_totscore;
-					stats_rectime = time(NULL);
-					gui->invalidateOutput(-WormikGui::INVO_RECORD, NULL);
-				}
-			}
-			if (action == 0) {
-				unsigned old_len = snake_len;
-				memmove(snake_pos+1, snake_pos+0, snake_len*sizeof(snake_pos[0]));
-				snake_pos[0].x = npos[0]; snake_pos[0].y = npos[1];
-				board[npos[1]][npos[0]] = GR_SNAKE(GSF_SNAKE_HEAD, (snake_dir+2)&3, snake_dir);
-				{
-					unsigned inval[2][2];
-					element_pos *p;
-
-					p = &snake_pos[1];
-					board[p->y][p->x] = GR_SNAKE(GSF_SNAKE_BODY, GR_GET_IN(board[p->y][p->x]), snake_dir);
-					inval[0][0] = p->x; inval[0][1] = p->y;
-
-					p = &snake_pos[0];
-					board[p->y][p->x] = GR_SNAKE(GSF_SNAKE_HEAD, (snake_dir+2)&3, snake_dir);
-					inval[1][0] = p->x; inval[1][1] = p->y;
-
-					gui->invalidateOutput(2, inval);
-				}
-				if (--snake_grow >= 0) {
-					snake_len++;
-					invof |= WormikGui::INVO_LENGTH;
-					freecnt--;
-				}
-				else {
-					unsigned il = 0;
-					unsigned inval[8][2];
-					element_pos *p;
-
-					for (;;) {
-						p = &snake_pos[snake_len];
-						board[p->y][p->x] = GR_NONE;
-						inval[il][0] = p->x; inval[il][1] = p->y; il++;
-						if (++snake_grow == 0 || snake_len <= 2)
-							break;
-						snake_len--;
-						freecnt++;
-					}
-					p = &snake_pos[snake_len-1];
-					board[p->y][p->x] = GR_SNAKE(GSF_SNAKE_TAIL, 0, GR_GET_OUT(board[p->y][p->x]));
-					inval[il][0] = p->x; inval[il][1] = p->y; il++;
-					gui->invalidateOutput(il, inval);
-				}
-				if (snake_health > snake_len) {
-					snake_health = snake_len;
-				}
-				if (state_levscore >= state_exitscore) {
-					assert(defcnts[0].def == GR_EXIT);
-					defcnts[0].max = 1;
-				}
-				if (old_len != snake_len) {
-					double c;
-					if (interval > 0.30)
-						c = 0.002;
-					else if (interval > 0.25)
-						c = 0.0012;
-					else if (interval > 0.20)
-						c = 0.0007;
-					else if (interval > 0.15)
-						c = 0.0005;
-					else
-						c = 0;
-					if (snake_len < old_len)
-						c *= 1.5;
-					if ((interval -= c) < 0.15)
-						interval = 0.15;
-					//printf("speed: %4.2f (%6.4f)\n", 1.0/interval, interval);
-				}
-				for (float latency = (float)interval/8; latency < interval; latency += (float)interval/4) {
-					if (genDef(latency) == 0 || 0)
-						break;
-				}
-			}
-			gui->invalidateOutput(-invof, NULL);
-			if (action != 0)
-				break;
-			if (gui->waitNext(interval))
-				goto quit;
-		}
-		if (stats_record < 0)
-			saveRecord();
-		switch (action) {
-		case 1:
-			if (gui->announce(WormikGui::ANC_EXIT))
-				goto quit;
-			break;
+	if (!recent_playing)
+		return;
+	restoreState(flightRecorder.spareBuffer(&size), recent_size);
+	stats_record = recent_record;
+	stats_rectime = recent_rectime;
+	gui->invalidateOutput(-WormikGui::INVO_RECORD, NULL);
+	recent_playing = false;
+}
 
-		case 2:
-			if (gui->announce(WormikGui::ANC_DEAD))
-				goto quit;
-			break;
-		}
-		if (false) {
-quit:
-			action = 3;
-		}
+void WormikGameImpl::writeKeyframe()
+{
+	char buf[sizeof(saved_state)+sizeof(newdefs)+GAME_XSIZE*GAME_YSIZE*sizeof(rules_cell)];
+	void *state = buf;
+	size_t size = sizeof(buf);
+
+	static_assert(sizeof(buf) <= FLIGHT_STATE_SIZE, "state must fit to flight recorder");
+	// state is saved once, straight to flight recorder slot
+	if (flightRecorder.isOpen())
+		state = flightRecorder.keyframeBuffer(&size);
+	size = saveState(state, size);
+	if (flightRecorder.isOpen())
+		flightRecorder.commitKeyframe(replayStep, size);
+	if (replayWriter.isOpen() && (replayStep%REPLAY_KEYFRAME_INTERVAL == 0 || run_wait == RW_START))
+		replayWriter.addKeyframe(replayStep, state, size);
+}
+
+void WormikGameImpl::writeAnalytics()
+{
+	int32_t row[AC_COUNT];
+	if (analyticsWriter.isOpen()) {
+		analyticsFillRow(row, this, &analyticsLevel, getConfigInt("seed", 0), analyticsGame);
+		if (analyticsWriter.append(row) < 0)
+			error("failed to write analytics: %s\n", strerror(errno));
 	}
-	exit(0);
+	memset(&analyticsLevel, 0, sizeof(analyticsLevel));
 }
 
 void WormikGameImpl::printLogTimestamp()
@@ -996,8 +996,39 @@ void WormikGameImpl::saveRecord()
 	setConfig("record", recs);
 }
 
+bool WormikGameImpl::stepDone(bool quit)
+{
+	int dir;
+	// played back waits are in the replay already, live commands are left for the live game
+	if (recent_playing) {
+		replayStep++;
+		return false;
+	}
+	// live commands are input of the finished wait, like gui ones, so replay applies them at the same time
+	if (!quit && (dir = liveExport.takeDirection()) >= 0)
+		changeDirection(dir);
+	if (quit)
+		replayWriter.addEvent(replayStep, RE_QUIT, 0);
+	else if (replayStep%REPLAY_CHECKSUM_INTERVAL == 0)
+		replayWriter.addEvent(replayStep, RE_CHECKSUM, getStateHash()&0xffffff);
+	replayStep++;
+	return quit;
+}
+
 void WormikGameImpl::exit(int n)
 {
+	if (replayWriter.isOpen() && replayWriter.close() < 0)
+		error("failed to write replay: %s\n", strerror(errno));
+	liveExport.close();
+	analyticsWriter.close();
+	flightRecorder.close();
+	// run loop is over, gui sites are complete too
+	for (unsigned i = 0; i < perfCounters.getSitesCount(); i++) {
+		char stats[512];
+		perfCounters.format(i, stats, sizeof(stats));
+		error("perf %s\n", stats);
+	}
+	perfCounters.close();
 	gui->shutdown(this);
 	delete gui;
 	delete this;
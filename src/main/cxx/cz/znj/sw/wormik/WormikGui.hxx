@@ -33,6 +33,10 @@ public:
 		INVO_FULL = (INVO_BOARD|INVO_NEW_DEFS|INVO_RECORD|INVO_SCORE|INVO_HEALTH|INVO_LENGTH|INVO_GAME_STATE),
 	};
 
+	enum {
+		SEASONS_STOCK = 4,		/* season images shipped with the game, wormik_0.png to wormik_3.png */
+	};
+
 public:
 	virtual				~WormikGui() {}
 
@@ -40,9 +44,12 @@ public:
 	virtual int			init(WormikGame *game) = 0;
 	virtual void			shutdown(WormikGame *game) = 0;
 
-	/* season init function */
+	/* season init function, returns season really used (0 if there is no image for it) */
 	virtual int			newLevel(int season) = 0;
 
+	/* season used by guis without images, the same as image guis use with stock images */
+	static int			stockSeason(int season);
+
 	/* output functions */
 
 	/*  draws "static" point */
@@ -66,6 +73,11 @@ public:
 	virtual bool			announce(int type) = 0;
 };
 
+inline int WormikGui::stockSeason(int season)
+{
+	return season >= 0 && season < SEASONS_STOCK ? season : 0;
+}
+
 
 } } } };
 
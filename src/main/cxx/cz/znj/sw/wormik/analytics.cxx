@@ -0,0 +1,300 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Columnar store of level outcomes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+# include <fcntl.h>
+# include <sys/file.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# define ANALYTICS_POSIX
+#endif
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/analytics.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+const char *const analytics_column_names[AC_COUNT] = {
+	"seed", "time", "game", "level", "season", "score", "total", "ticks", "cause", "length",
+	"hist0", "hist1", "hist2", "hist3", "hist4", "hist5", "hist6", "hist7",
+};
+
+const char *const analytics_cause_names[WormikGame::GE_COUNT] = {
+	"none", "exit", "wall", "death", "health", "bite",
+};
+
+void analyticsFillRow(int32_t *row, WormikGame *game, const analytics_level *level, uint32_t seed, uint32_t gameNumber)
+{
+	int lev, season, score, total, health, length;
+
+	game->getState(&lev, &season);
+	game->getScore(&score, &total);
+	game->getSnakeInfo(&health, &length);
+	row[AC_SEED] = seed;
+	row[AC_TIME] = time(NULL);
+	row[AC_GAME] = gameNumber;
+	row[AC_LEVEL] = lev;
+	row[AC_SEASON] = season;
+	row[AC_SCORE] = score;
+	row[AC_TOTAL] = total;
+	row[AC_TICKS] = level->ticks;
+	row[AC_CAUSE] = game->getEndCause();
+	row[AC_LENGTH] = length;
+	for (unsigned i = 0; i < ANALYTICS_HIST_BUCKETS; i++)
+		row[AC_HIST+i] = level->hist[i];
+}
+
+int analyticsFindColumn(const char *name)
+{
+	for (int i = 0; i < AC_COUNT; i++) {
+		if (strcmp(analytics_column_names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+#ifdef ANALYTICS_POSIX
+static int openColumn(const char *dir, int column, int flags)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s/%s.col", dir, analytics_column_names[column]) >= (int)sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return ::open(path, flags|O_CLOEXEC, 0666);
+}
+
+static bool checkHeader(const analytics_header *header, int column)
+{
+	return memcmp(header->magic, ANALYTICS_MAGIC, sizeof(header->magic)) == 0 && header->version == ANALYTICS_VERSION && header->column == (uint32_t)column;
+}
+#endif
+
+
+AnalyticsWriter::AnalyticsWriter()
+{
+	for (int i = 0; i < AC_COUNT; i++)
+		fds[i] = -1;
+}
+
+AnalyticsWriter::~AnalyticsWriter()
+{
+	close();
+}
+
+int AnalyticsWriter::open(const char *dir)
+{
+#ifdef ANALYTICS_POSIX
+	int err = 0;
+
+	close();
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST)
+		return -1;
+	for (int i = 0; i < AC_COUNT; i++) {
+		if ((fds[i] = openColumn(dir, i, O_RDWR|O_CREAT)) < 0) {
+			err = errno;
+			close();
+			errno = err;
+			return -1;
+		}
+	}
+	// headers of new store are written by whoever gets the lock first
+	while (flock(fds[0], LOCK_EX) < 0) {
+		if (errno != EINTR) {
+			err = errno;
+			goto out;
+		}
+	}
+	for (int i = 0; i < AC_COUNT; i++) {
+		analytics_header header;
+		struct stat st;
+		if (fstat(fds[i], &st) < 0) {
+			err = errno;
+			break;
+		}
+		if (st.st_size == 0) {
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, ANALYTICS_MAGIC, sizeof(header.magic));
+			header.version = ANALYTICS_VERSION;
+			header.column = i;
+			strncpy(header.name, analytics_column_names[i], sizeof(header.name)-1);
+			if (pwrite(fds[i], &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+				err = errno != 0 ? errno : EIO;
+				break;
+			}
+		}
+		else if (pread(fds[i], &header, sizeof(header), 0) != (ssize_t)sizeof(header) || !checkHeader(&header, i)) {
+			err = EINVAL;
+			break;
+		}
+	}
+	flock(fds[0], LOCK_UN);
+out:
+	if (err != 0) {
+		close();
+		errno = err;
+		return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void AnalyticsWriter::close()
+{
+#ifdef ANALYTICS_POSIX
+	for (int i = 0; i < AC_COUNT; i++) {
+		if (fds[i] >= 0)
+			::close(fds[i]);
+		fds[i] = -1;
+	}
+#endif
+}
+
+int AnalyticsWriter::append(const int32_t *row)
+{
+#ifdef ANALYTICS_POSIX
+	off_t sizes[AC_COUNT];
+	off_t end;
+	int err = 0;
+
+	while (flock(fds[0], LOCK_EX) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	// the shortest column tells the row count, longer ones hold rest of interrupted append
+	end = -1;
+	for (int i = 0; i < AC_COUNT; i++) {
+		struct stat st;
+		if (fstat(fds[i], &st) < 0) {
+			err = errno;
+			goto out;
+		}
+		sizes[i] = st.st_size;
+		if (end < 0 || st.st_size < end)
+			end = st.st_size;
+	}
+	end = sizeof(analytics_header)+(end-sizeof(analytics_header))/sizeof(int32_t)*sizeof(int32_t);
+	for (int i = 0; i < AC_COUNT; i++) {
+		if (pwrite(fds[i], &row[i], sizeof(row[i]), end) != (ssize_t)sizeof(row[i])) {
+			err = errno != 0 ? errno : EIO;
+			goto out;
+		}
+		if (sizes[i] > end+(off_t)sizeof(row[i]) && ftruncate(fds[i], end+sizeof(row[i])) < 0) {
+			err = errno;
+			goto out;
+		}
+	}
+out:
+	flock(fds[0], LOCK_UN);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+
+AnalyticsReader::AnalyticsReader()
+{
+	for (int i = 0; i < AC_COUNT; i++) {
+		maps[i] = NULL;
+		sizes[i] = 0;
+	}
+	rows = 0;
+}
+
+AnalyticsReader::~AnalyticsReader()
+{
+	close();
+}
+
+int AnalyticsReader::open(const char *dir)
+{
+#ifdef ANALYTICS_POSIX
+	close();
+	for (int i = 0; i < AC_COUNT; i++) {
+		struct stat st;
+		int fd, err;
+		size_t count;
+		if ((fd = openColumn(dir, i, O_RDONLY)) < 0)
+			goto fail;
+		if (fstat(fd, &st) < 0 || (maps[i] = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			err = errno;
+			maps[i] = NULL;
+			::close(fd);
+			errno = err;
+			goto fail;
+		}
+		::close(fd);
+		sizes[i] = st.st_size;
+		if (sizes[i] < sizeof(analytics_header) || !checkHeader((const analytics_header *)maps[i], i)) {
+			errno = EINVAL;
+			goto fail;
+		}
+		count = (sizes[i]-sizeof(analytics_header))/sizeof(int32_t);
+		if (i == 0 || count < rows)
+			rows = count;
+	}
+	return 0;
+
+fail:
+	{
+		int err = errno;
+		close();
+		errno = err;
+	}
+	return -1;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void AnalyticsReader::prefetch(int column)
+{
+#ifdef ANALYTICS_POSIX
+# ifdef MADV_POPULATE_READ
+	if (madvise(maps[column], sizes[column], MADV_POPULATE_READ) == 0)
+		return;
+# endif
+	madvise(maps[column], sizes[column], MADV_WILLNEED);
+#endif
+}
+
+void AnalyticsReader::close()
+{
+#ifdef ANALYTICS_POSIX
+	for (int i = 0; i < AC_COUNT; i++) {
+		if (maps[i] != NULL)
+			munmap(maps[i], sizes[i]);
+		maps[i] = NULL;
+		sizes[i] = 0;
+	}
+	rows = 0;
+#endif
+}
+
+
+} } } };
@@ -0,0 +1,156 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Columnar store of level outcomes
+ */
+
+#ifndef analytics_hxx__
+# define analytics_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Store is a directory with one file per column (native byte order):
+ *	analytics_header
+ *	int32_t values[rows]
+ *
+ * Every finished or abandoned level appends one row, i.e. one value to
+ * every column, under exclusive flock of the first column, so any number
+ * of games and tournaments may append to the same store. Row count is the
+ * shortest column; rows partially written by killed process are cut off by
+ * the next append. Values start at 64 bytes offset, so mapped columns are
+ * aligned for vector loads.
+ */
+enum {
+	ANALYTICS_VERSION	= 1,
+	ANALYTICS_HIST_BUCKETS	= 8,			/**< snake length buckets, <4, 4-7, 8-15, ..., 256 and more */
+};
+
+#define ANALYTICS_MAGIC "WRMKCOL\n"
+
+/* columns */
+enum {
+	AC_SEED,					/**< random seed of the session or match */
+	AC_TIME,					/**< unix time of level end */
+	AC_GAME,					/**< game number within session */
+	AC_LEVEL,
+	AC_SEASON,
+	AC_SCORE,					/**< level score */
+	AC_TOTAL,					/**< total score of the game */
+	AC_TICKS,					/**< steps played in level */
+	AC_CAUSE,					/**< WormikGame::GE_* of level end */
+	AC_LENGTH,					/**< snake length at the end */
+	AC_HIST,					/**< steps played with snake length in each bucket */
+	AC_COUNT		= AC_HIST+ANALYTICS_HIST_BUCKETS,
+};
+
+extern const char *const analytics_column_names[AC_COUNT];
+extern const char *const analytics_cause_names[WormikGame::GE_COUNT];
+
+struct analytics_header
+{
+	char				magic[8];		/**< ANALYTICS_MAGIC */
+	uint32_t			version;		/**< ANALYTICS_VERSION */
+	uint32_t			column;			/**< AC_* */
+	char				name[16];		/**< column name */
+	uint32_t			reserved[8];
+};
+
+static_assert(sizeof(analytics_header) == 64, "values must stay aligned");
+
+/** statistics of level in progress */
+struct analytics_level
+{
+	uint32_t			ticks;
+	uint32_t			hist[ANALYTICS_HIST_BUCKETS];
+};
+
+/** counts played step */
+inline void analyticsStep(analytics_level *level, unsigned length)
+{
+	unsigned bucket = 0;
+	for (length >>= 2; length != 0 && bucket < ANALYTICS_HIST_BUCKETS-1; length >>= 1)
+		bucket++;
+	level->ticks++;
+	level->hist[bucket]++;
+}
+
+/** fills row with current state of game and level statistics */
+void analyticsFillRow(int32_t *row, WormikGame *game, const analytics_level *level, uint32_t seed, uint32_t gameNumber);
+
+/** returns column index by name, -1 if unknown */
+int analyticsFindColumn(const char *name);
+
+/**
+ * Appends rows to store.
+ */
+class AnalyticsWriter
+{
+protected:
+	int				fds[AC_COUNT];		/**< column files, -1 if closed */
+
+public:
+	/* constructor */		AnalyticsWriter();
+	/* destructor */		~AnalyticsWriter();
+
+public:
+	/** opens store directory, creating it if missing, returns negative on error */
+	int				open(const char *dir);
+	void				close();
+	bool				isOpen() const;
+	/** appends row of AC_COUNT values, returns negative on error */
+	int				append(const int32_t *row);
+};
+
+/**
+ * Maps columns of store read-only.
+ */
+class AnalyticsReader
+{
+protected:
+	void *				maps[AC_COUNT];		/**< whole mapped files */
+	size_t				sizes[AC_COUNT];
+	size_t				rows;
+
+public:
+	/* constructor */		AnalyticsReader();
+	/* destructor */		~AnalyticsReader();
+
+public:
+	/** maps store directory, returns negative on error */
+	int				open(const char *dir);
+	void				close();
+
+	size_t				getRows() const;
+	/** values of column, getRows() of them */
+	const int32_t *			getColumn(int column) const;
+	/** maps whole column ahead of scanning, instead of page faults one by one */
+	void				prefetch(int column);
+};
+
+inline bool AnalyticsWriter::isOpen() const
+{
+	return fds[0] >= 0;
+}
+
+inline size_t AnalyticsReader::getRows() const
+{
+	return rows;
+}
+
+inline const int32_t *AnalyticsReader::getColumn(int column) const
+{
+	return (const int32_t *)((const char *)maps[column]+sizeof(analytics_header));
+}
+
+
+} } } };
+
+#endif
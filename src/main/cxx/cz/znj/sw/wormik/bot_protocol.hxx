@@ -0,0 +1,48 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Protocol between tournament runner and bot processes
+ */
+
+#ifndef bot_protocol_hxx__
+# define bot_protocol_hxx__
+
+#include <stdint.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Bot is started once per match with pipes on stdin and stdout, binary
+ * messages in native byte order:
+ *	runner -> bot: bot_observation before every move
+ *	bot -> runner: one byte, SDIR_* to turn or BOT_KEEP to keep direction
+ *
+ * Bot must answer every observation within move time limit (the first one
+ * also within startup limit) and must not write anything else; match ends
+ * by closing bot stdin and killing it. Bot stderr is left to the runner.
+ */
+enum {
+	BOT_KEEP			= 0xff,			/**< action keeping direction */
+};
+
+struct bot_observation
+{
+	uint32_t			size;			/**< sizeof(bot_observation), changes with layout */
+	uint32_t			step;			/**< moves since match start */
+	uint64_t			hash;			/**< WormikGame::getStateHash(), usable as transposition key */
+	int32_t				level;
+	int32_t				score, total, exit;
+	int32_t				health, length;
+	uint8_t				headX, headY;
+	uint8_t				reserved[2];
+	uint8_t				board[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< WormikGame::board_def */
+};
+
+
+} } } };
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Column scanning kernels
+ */
+
+#include <string.h>
+
+#include "cz/znj/sw/wormik/column_scan.hxx"
+
+#if (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+# define COLUMN_SCAN_X86
+# include <immintrin.h>
+#endif
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+static void aggregateInit(scan_aggregate *result)
+{
+	result->count = 0;
+	result->sum = 0;
+	result->min = INT32_MAX;
+	result->max = INT32_MIN;
+}
+
+/* adds selected values of words [from, to) */
+static void aggregateWords(scan_aggregate *result, const int32_t *col, const uint64_t *selection, size_t from, size_t to)
+{
+	for (size_t w = from; w < to; w++) {
+		for (uint64_t bits = selection[w]; bits != 0; bits &= bits-1) {
+			int32_t v = col[w*64+__builtin_ctzll(bits)];
+			result->count++;
+			result->sum += v;
+			if (v < result->min)
+				result->min = v;
+			if (v > result->max)
+				result->max = v;
+		}
+	}
+}
+
+static void filterScalar(uint64_t *selection, const int32_t *col, size_t count, int32_t lo, int32_t hi, bool first)
+{
+	for (size_t w = 0; w*64 < count; w++) {
+		size_t n = count-w*64 < 64 ? count-w*64 : 64;
+		uint64_t bits = 0;
+		if (!first && selection[w] == 0)
+			continue;
+		for (size_t j = 0; j < n; j++)
+			bits |= (uint64_t)(col[w*64+j] >= lo && col[w*64+j] <= hi) << j;
+		selection[w] = first ? bits : selection[w]&bits;
+	}
+}
+
+static void aggregateScalar(scan_aggregate *result, const int32_t *col, const uint64_t *selection, size_t count)
+{
+	aggregateInit(result);
+	aggregateWords(result, col, selection, 0, (count+63)/64);
+}
+
+static const scan_kernels scalarKernels = { "scalar", &filterScalar, &aggregateScalar };
+
+#ifdef COLUMN_SCAN_X86
+
+__attribute__((target("sse2")))
+static void filterSse2(uint64_t *selection, const int32_t *col, size_t count, int32_t lo, int32_t hi, bool first)
+{
+	const __m128i vlo = _mm_set1_epi32(lo);
+	const __m128i vhi = _mm_set1_epi32(hi);
+	size_t words = count/64;
+	for (size_t w = 0; w < words; w++) {
+		const int32_t *p = col+w*64;
+		uint64_t bits = 0;
+		// rows already filtered out are not read at all
+		if (!first && selection[w] == 0)
+			continue;
+		for (unsigned j = 0; j < 64; j += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(p+j));
+			__m128i out = _mm_or_si128(_mm_cmplt_epi32(v, vlo), _mm_cmpgt_epi32(v, vhi));
+			bits |= (uint64_t)(~_mm_movemask_ps(_mm_castsi128_ps(out))&0xf) << j;
+		}
+		selection[w] = first ? bits : selection[w]&bits;
+	}
+	filterScalar(selection+words, col+words*64, count-words*64, lo, hi, first);
+}
+
+__attribute__((target("sse2")))
+static void aggregateSse2(scan_aggregate *result, const int32_t *col, const uint64_t *selection, size_t count)
+{
+	const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+	__m128i sum = _mm_setzero_si128();
+	__m128i vmin = _mm_set1_epi32(INT32_MAX);
+	__m128i vmax = _mm_set1_epi32(INT32_MIN);
+	size_t words = count/64;
+	int64_t sums[2];
+	int32_t mins[4], maxs[4];
+
+	aggregateInit(result);
+	for (size_t w = 0; w < words; w++) {
+		uint64_t bits = selection[w];
+		if (bits == 0)
+			continue;
+		result->count += __builtin_popcountll(bits);
+		for (unsigned j = 0; j < 64; j += 4) {
+			unsigned nibble = (bits>>j)&0xf;
+			if (nibble == 0)
+				continue;
+			__m128i v = _mm_loadu_si128((const __m128i *)(col+w*64+j));
+			__m128i m = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(nibble), lanes), lanes);
+			__m128i sv = _mm_and_si128(v, m);
+			__m128i sign = _mm_srai_epi32(sv, 31);
+			sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(sv, sign));
+			sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(sv, sign));
+			// no min and max of 32-bit integers before SSE4.1
+			__m128i lt = _mm_and_si128(_mm_cmplt_epi32(v, vmin), m);
+			vmin = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, vmin));
+			__m128i gt = _mm_and_si128(_mm_cmpgt_epi32(v, vmax), m);
+			vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax));
+		}
+	}
+	_mm_storeu_si128((__m128i *)sums, sum);
+	_mm_storeu_si128((__m128i *)mins, vmin);
+	_mm_storeu_si128((__m128i *)maxs, vmax);
+	result->sum = sums[0]+sums[1];
+	for (unsigned i = 0; i < 4; i++) {
+		if (mins[i] < result->min)
+			result->min = mins[i];
+		if (maxs[i] > result->max)
+			result->max = maxs[i];
+	}
+	aggregateWords(result, col, selection, words, (count+63)/64);
+}
+
+static const scan_kernels sse2Kernels = { "sse2", &filterSse2, &aggregateSse2 };
+
+__attribute__((target("avx2")))
+static void filterAvx2(uint64_t *selection, const int32_t *col, size_t count, int32_t lo, int32_t hi, bool first)
+{
+	const __m256i vlo = _mm256_set1_epi32(lo);
+	const __m256i vhi = _mm256_set1_epi32(hi);
+	size_t words = count/64;
+	for (size_t w = 0; w < words; w++) {
+		const int32_t *p = col+w*64;
+		uint64_t bits = 0;
+		if (!first && selection[w] == 0)
+			continue;
+		for (unsigned j = 0; j < 64; j += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(p+j));
+			__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, v), _mm256_cmpgt_epi32(v, vhi));
+			bits |= (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(out))&0xff) << j;
+		}
+		selection[w] = first ? bits : selection[w]&bits;
+	}
+	filterScalar(selection+words, col+words*64, count-words*64, lo, hi, first);
+}
+
+__attribute__((target("avx2")))
+static void aggregateAvx2(scan_aggregate *result, const int32_t *col, const uint64_t *selection, size_t count)
+{
+	const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m256i none_min = _mm256_set1_epi32(INT32_MAX);
+	const __m256i none_max = _mm256_set1_epi32(INT32_MIN);
+	__m256i sum = _mm256_setzero_si256();
+	__m256i vmin = none_min;
+	__m256i vmax = none_max;
+	size_t words = count/64;
+	int64_t sums[4];
+	int32_t mins[8], maxs[8];
+
+	aggregateInit(result);
+	for (size_t w = 0; w < words; w++) {
+		uint64_t bits = selection[w];
+		if (bits == 0)
+			continue;
+		result->count += __builtin_popcountll(bits);
+		for (unsigned j = 0; j < 64; j += 8) {
+			unsigned byte = (bits>>j)&0xff;
+			if (byte == 0)
+				continue;
+			__m256i v = _mm256_loadu_si256((const __m256i *)(col+w*64+j));
+			__m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(byte), lanes), lanes);
+			__m256i sv = _mm256_and_si256(v, m);
+			sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(sv)));
+			sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(sv, 1)));
+			vmin = _mm256_min_epi32(vmin, _mm256_blendv_epi8(none_min, v, m));
+			vmax = _mm256_max_epi32(vmax, _mm256_blendv_epi8(none_max, v, m));
+		}
+	}
+	_mm256_storeu_si256((__m256i *)sums, sum);
+	_mm256_storeu_si256((__m256i *)mins, vmin);
+	_mm256_storeu_si256((__m256i *)maxs, vmax);
+	result->sum = sums[0]+sums[1]+sums[2]+sums[3];
+	for (unsigned i = 0; i < 8; i++) {
+		if (mins[i] < result->min)
+			result->min = mins[i];
+		if (maxs[i] > result->max)
+			result->max = maxs[i];
+	}
+	aggregateWords(result, col, selection, words, (count+63)/64);
+}
+
+static const scan_kernels avx2Kernels = { "avx2", &filterAvx2, &aggregateAvx2 };
+
+#endif
+
+const scan_kernels *selectScanKernels(const char *name)
+{
+	bool best = name == NULL || strcmp(name, "auto") == 0;
+#ifdef COLUMN_SCAN_X86
+	__builtin_cpu_init();
+	if ((best || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+		return &avx2Kernels;
+	if ((best || strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2"))
+		return &sse2Kernels;
+#endif
+	if (best || strcmp(name, "scalar") == 0)
+		return &scalarKernels;
+	return NULL;
+}
+
+size_t scanGather(int32_t *out, const int32_t *col, const uint64_t *selection, size_t count)
+{
+	size_t n = 0;
+	for (size_t w = 0; w < (count+63)/64; w++) {
+		uint64_t bits = selection[w];
+		if (bits == ~(uint64_t)0) {
+			memcpy(out+n, col+w*64, 64*sizeof(*out));
+			n += 64;
+			continue;
+		}
+		for (; bits != 0; bits &= bits-1)
+			out[n++] = col[w*64+__builtin_ctzll(bits)];
+	}
+	return n;
+}
+
+
+} } } };
@@ -0,0 +1,52 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Column scanning kernels
+ */
+
+#ifndef column_scan_hxx__
+# define column_scan_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/* aggregates of selected values */
+struct scan_aggregate
+{
+	uint64_t			count;
+	int64_t				sum;
+	int32_t				min;			/**< INT32_MAX if nothing selected */
+	int32_t				max;			/**< INT32_MIN if nothing selected */
+};
+
+/*
+ * Kernels scan count int32 values of column, selection is bitmap with bit
+ * i%64 of word i/64 set for selected row i, (count+63)/64 words, bits past
+ * count are always clear. All implementations give identical results.
+ */
+struct scan_kernels
+{
+	const char *			name;
+	/* selects rows with lo <= col[i] <= hi, intersecting with existing selection unless first */
+	void				(*filter)(uint64_t *selection, const int32_t *col, size_t count, int32_t lo, int32_t hi, bool first);
+	/* computes aggregates of selected values */
+	void				(*aggregate)(scan_aggregate *result, const int32_t *col, const uint64_t *selection, size_t count);
+};
+
+/*
+ * returns kernels by name ("scalar", "sse2", "avx2"), or the best ones
+ * supported by CPU for NULL or "auto", NULL if not available
+ */
+const scan_kernels *selectScanKernels(const char *name);
+
+/* copies selected values to out, returns their number */
+size_t scanGather(int32_t *out, const int32_t *col, const uint64_t *selection, size_t count);
+
+
+} } } };
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Embedded bitmap font, used when no TTF font can be found
+ */
+
+#ifndef embedded_font_hxx__
+# define embedded_font_hxx__
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+enum {
+	EMBEDDED_FONT_FIRST	= 32,		/**< first glyph, space */
+	EMBEDDED_FONT_GLYPHS	= 95,		/**< printable ASCII */
+	EMBEDDED_FONT_WIDTH	= 5,		/**< glyph width, bit 4 is the leftmost */
+	EMBEDDED_FONT_HEIGHT	= 7,		/**< glyph height */
+	EMBEDDED_FONT_ADVANCE	= 6,		/**< pen advance including spacing */
+	EMBEDDED_FONT_LINE	= 9,		/**< line height including spacing */
+};
+
+/* glyph rows, top to bottom */
+extern const unsigned char embedded_font[EMBEDDED_FONT_GLYPHS][EMBEDDED_FONT_HEIGHT];
+
+
+} } } };
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * batch environment benchmark, checks environment plays the same games as
+ * game core and measures resets and steps
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/WormikEnv.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+extern WormikGame *create_WormikGame();
+extern WormikGui *create_NullWormikGui();
+
+} } } };
+
+using namespace cz::znj::sw::wormik;
+
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik-envbench [-n count] [-s steps] [-t threads] [-w radius] [-c count]\n"
+		"  -n count        games stepped at once (default 1024)\n"
+		"  -s steps        steps of every game (default 1000)\n"
+		"  -t threads      worker threads, 0 for all cores (default 0)\n"
+		"  -w radius       observes window around snake head instead of whole board\n"
+		"  -c count        games checked step by step against game core first (default 16, 0 skips)\n");
+}
+
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t nextRandom(uint32_t *state)
+{
+	*state ^= *state<<13;
+	*state ^= *state>>17;
+	*state ^= *state<<5;
+	return *state;
+}
+
+static bool isDeadly(WormikGame::board_def def)
+{
+	return def == WormikGame::GR_WALL || def == WormikGame::GR_DEATH || WormikGame::GR_GET_BASE_TYPE(def) == WormikGame::GR_BASE_SNAKE;
+}
+
+/*
+ * keeps direction, sometimes turns, avoids deadly cells ahead when it can,
+ * so games last long and steps are not dominated by level generation
+ */
+static uint8_t choose(const WormikGame::board_view *view, uint32_t *random)
+{
+	static const int moves[4][2] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1 } };
+	unsigned dir = WormikGame::GR_GET_OUT(view->board[view->headY*view->stride+view->headX]);
+	uint32_t r = nextRandom(random);
+	if (r%8 == 0)
+		dir = (dir+(r&8 ? 1 : 3))&3;
+	for (unsigned t = 0; t < 4; t++) {
+		unsigned d = (dir+t)&3;
+		if (!isDeadly(view->board[(view->headY+moves[d][1])*view->stride+view->headX+moves[d][0]]))
+			return d;
+	}
+	return dir;
+}
+
+static int check(unsigned count, unsigned steps)
+{
+	WormikEnv env;
+	WormikEnv::env_config config;
+	WormikGui *gui = create_NullWormikGui();
+	WormikGame **games = new WormikGame *[count];
+	uint32_t *seeds = new uint32_t[count];
+	uint8_t *actions = new uint8_t[count];
+	float *rewards = new float[count];
+	uint8_t *dones = new uint8_t[count];
+	int *totals = new int[count];
+	uint32_t random = 1;
+	unsigned long dead = 0;
+	int err = 0;
+
+	config.count = count;
+	config.observation = WormikEnv::OBS_BOARD;
+	config.windowRadius = 0;
+	config.threads = 1;
+	config.kernels = NULL;
+	if (env.init(&config) < 0)
+		return -1;
+	for (unsigned i = 0; i < count; i++) {
+		seeds[i] = i*7+1;
+		games[i] = create_WormikGame();
+		games[i]->setGui(gui);
+		games[i]->setSeed(seeds[i]);
+		games[i]->startLevel(WormikGame::GA_DEAD);
+		totals[i] = 0;
+	}
+	env.reset(seeds, NULL);
+
+	for (unsigned s = 0; s < steps && err == 0; s++) {
+		for (unsigned i = 0; i < count; i++) {
+			WormikGame::board_view view;
+			env.getBoardView(i, &view);
+			actions[i] = choose(&view, &random);
+		}
+		env.step(actions, rewards, dones, NULL);
+		for (unsigned i = 0; i < count && err == 0; i++) {
+			WormikGame *game = games[i];
+			WormikGame::board_view view, gameView;
+			int outcome, score, total, level, gameLevel, length, health, gameLength;
+			uint32_t episodeSteps;
+
+			game->changeDirection(actions[i]);
+			outcome = game->stepGame();
+			game->getScore(&score, &total);
+			if (rewards[i] != (float)(total-totals[i]) || dones[i] != (outcome == WormikGame::GA_DEAD)) {
+				fprintf(stderr, "game %u step %u: reward %g done %d, game core %d done %d\n", i, s, rewards[i], dones[i], total-totals[i], outcome == WormikGame::GA_DEAD);
+				err = 1;
+				break;
+			}
+			totals[i] = total;
+			if (outcome != WormikGame::GA_CONTINUE) {
+				game->startLevel(outcome);
+				if (outcome == WormikGame::GA_DEAD) {
+					totals[i] = 0;
+					dead++;
+				}
+			}
+
+			env.getBoardView(i, &view);
+			env.getInfo(i, &total, &level, &length, &episodeSteps);
+			game->getBoardView(&gameView);
+			game->getState(&gameLevel, NULL);
+			game->getSnakeInfo(&health, &gameLength);
+			if (total != totals[i] || level != gameLevel || length != gameLength) {
+				fprintf(stderr, "game %u step %u: total %d level %d length %d, game core %d %d %d\n", i, s, total, level, length, totals[i], gameLevel, gameLength);
+				err = 1;
+			}
+			else if (view.headX != gameView.headX || view.headY != gameView.headY || view.newdefsLength != gameView.newdefsLength) {
+				fprintf(stderr, "game %u step %u: head or newdefs differ from game core\n", i, s);
+				err = 1;
+			}
+			else if (memcmp(view.newdefs, gameView.newdefs, view.newdefsLength*sizeof(view.newdefs[0])) != 0) {
+				fprintf(stderr, "game %u step %u: newdefs differ from game core\n", i, s);
+				err = 1;
+			}
+			else {
+				for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++) {
+					if (memcmp(view.board+y*view.stride, gameView.board+y*gameView.stride, WormikGame::GAME_XSIZE) != 0) {
+						fprintf(stderr, "game %u step %u: board row %u differs from game core\n", i, s, y);
+						err = 1;
+						break;
+					}
+				}
+			}
+		}
+	}
+	if (err == 0)
+		printf("check: %u games, %u steps, %lu deaths, same as game core\n", count, steps, dead);
+
+	for (unsigned i = 0; i < count; i++)
+		delete games[i];
+	delete[] games;
+	delete[] seeds;
+	delete[] actions;
+	delete[] rewards;
+	delete[] dones;
+	delete[] totals;
+	delete gui;
+	return err;
+}
+
+static void bench(WormikEnv *env, unsigned steps, uint8_t *observations)
+{
+	unsigned count = env->getCount();
+	uint8_t *actions = new uint8_t[count];
+	float *rewards = new float[count];
+	uint8_t *dones = new uint8_t[count];
+	uint32_t random = 1;
+	unsigned long dead = 0;
+	double time = 0;
+
+	for (unsigned s = 0; s < steps; s++) {
+		double start;
+		for (unsigned i = 0; i < count; i++) {
+			WormikGame::board_view view;
+			env->getBoardView(i, &view);
+			actions[i] = choose(&view, &random);
+		}
+		start = getTime();
+		env->step(actions, rewards, dones, observations);
+		time += getTime()-start;
+		for (unsigned i = 0; i < count; i++)
+			dead += dones[i];
+	}
+	printf("step%s: %.0f steps/s, %.3f us per step, %lu games restarted\n", observations == NULL ? "" : " with observations",
+		count*(double)steps/time, time*1e6/count/steps, dead);
+
+	delete[] actions;
+	delete[] rewards;
+	delete[] dones;
+}
+
+int main(int argc, char **argv)
+{
+	WormikEnv env;
+	WormikEnv::env_config config;
+	unsigned steps = 1000;
+	unsigned checked = 16;
+	uint32_t *seeds;
+	uint8_t *observations;
+	double start;
+	int opt;
+
+	config.count = 1024;
+	config.observation = WormikEnv::OBS_BOARD;
+	config.windowRadius = 0;
+	config.threads = 0;
+	config.kernels = getenv("WORMIK_ENV_KERNELS");
+	while ((opt = getopt(argc, argv, "n:s:t:w:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			config.count = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			steps = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			config.threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'w':
+			config.observation = WormikEnv::OBS_WINDOW;
+			config.windowRadius = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'c':
+			checked = strtoul(optarg, NULL, 0);
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind != argc) {
+		usage();
+		return 2;
+	}
+
+	if (checked != 0 && check(checked, steps) != 0) {
+		fprintf(stderr, "environment does not play the same games as game core\n");
+		return 1;
+	}
+
+	start = getTime();
+	if (env.init(&config) < 0) {
+		fprintf(stderr, "invalid environment configuration\n");
+		return 2;
+	}
+	printf("init: %u games in %.3f ms\n", config.count, (getTime()-start)*1e3);
+	seeds = new uint32_t[config.count];
+	observations = new uint8_t[config.count*env.getObservationSize()];
+	for (unsigned i = 0; i < config.count; i++)
+		seeds[i] = i*7+1;
+	start = getTime();
+	env.reset(seeds, observations);
+	printf("reset: %.3f us per game\n", (getTime()-start)*1e6/config.count);
+
+	bench(&env, steps, NULL);
+	bench(&env, steps, observations);
+
+	delete[] seeds;
+	delete[] observations;
+	return 0;
+}
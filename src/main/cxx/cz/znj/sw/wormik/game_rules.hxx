@@ -0,0 +1,729 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Game rules shared by game core and batch environment
+ */
+
+#ifndef game_rules_hxx__
+# define game_rules_hxx__
+
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+enum {
+	RULES_DEFS		= 4,			/**< regenerable defs, exit first */
+	RULES_NEWDEFS_MAX	= 32,
+	RULES_SNAKE_RING	= 1024,			/**< snake ring size, power of two above board size */
+};
+
+/** regenerable def, indexed by board_newdef defsi */
+struct rules_def
+{
+	WormikGame::board_def		def;
+	unsigned			max;			/**< on board at once, exit has 1 once opened */
+	WormikGame::game_time		timeout;		/**< generating time */
+};
+
+static const rules_def rules_defs[RULES_DEFS] = {
+	{ WormikGame::GR_EXIT,		0,					2*WormikGame::GAME_TIME_SECOND },
+	{ WormikGame::GR_POSITIVE,	WormikGame::TILES_COUNT_POSITIVE,	2*WormikGame::GAME_TIME_SECOND },
+	{ WormikGame::GR_POSITIVE_2,	WormikGame::TILES_COUNT_POSITIVE_2,	2*WormikGame::GAME_TIME_SECOND },
+	{ WormikGame::GR_NEGATIVE,	WormikGame::TILES_COUNT_NEGATIVE,	2*WormikGame::GAME_TIME_SECOND },
+};
+
+/* cell offsets of SDIR_* directions */
+static const int rules_moves[4][2] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1} };
+
+struct rules_cell
+{
+	unsigned char			x, y;
+};
+
+/**
+ * State of single game, plain data stepped by rules* functions below. Game
+ * core is one, batch environment keeps array of them.
+ */
+struct rules_state
+{
+	WormikGame::board_def		board[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];
+	rules_cell			snake_ring[RULES_SNAKE_RING];	/**< snake cells, head at snake_head, going to tail */
+	unsigned			snake_head;
+	unsigned			snake_len;
+	unsigned			snake_dir;
+	int				snake_grow;		/**< cells to grow, negative to shrink */
+	unsigned			snake_health;
+	WormikGame::snake_motion	snake_step;		/**< movement in last step */
+	int				snake_moved;		/**< SM_* flags of snake_step */
+
+	WormikGame::game_time		step_interval;		/**< game time of one step */
+	WormikGame::game_time		health_add;		/**< time to gain next health */
+	WormikGame::game_time		health_timeout;		/**< time left to gain health */
+
+	WormikGame::board_newdef	newdefs[RULES_NEWDEFS_MAX];	/**< defs being generated */
+	unsigned			ndlen;
+	unsigned			defcnts[RULES_DEFS];	/**< regenerable defs on board */
+	bool				exit_open;		/**< level score reached exit score, exit may be generated */
+	unsigned			freecnt;		/**< empty cells */
+
+	unsigned			state_level;
+	unsigned			state_exitscore;	/**< level score opening exit */
+	unsigned			state_levscore;
+	unsigned			state_totscore;
+
+	uint32_t			random_state;		/**< own generator, games may run in parallel */
+};
+
+/**
+ * Side effects of rules on the game around them. Rules take NULL when there
+ * are none, so the batch environment pays no calls.
+ */
+class RulesHooks
+{
+public:
+	virtual				~RulesHooks() {}
+
+public:
+	/** board cell changes from old to def, except while generating level */
+	virtual void			cellChanged(unsigned x, unsigned y, WormikGame::board_def old, WormikGame::board_def def) = 0;
+	/** newdef appears or disappears, its timeout change is reported as both */
+	virtual void			newdefToggled(const WormikGame::board_newdef *nd) = 0;
+	/** cell has to be redrawn */
+	virtual void			invalidateCell(unsigned x, unsigned y) = 0;
+	/** WormikGui::INVO_* parts have to be redrawn */
+	virtual void			invalidateFlags(int flags) = 0;
+	/** generates walls of new level, by rulesGenerateWalls */
+	virtual void			generateWalls(rules_state *s, unsigned headx, unsigned heady) = 0;
+};
+
+
+inline void rulesSetSeed(rules_state *s, unsigned seed)
+{
+	// xorshift state must not be zero
+	s->random_state = seed*2654435761u^0x9e3779b9u;
+	if (s->random_state == 0)
+		s->random_state = 1;
+}
+
+inline int rulesRandRange(rules_state *s, int min, int max)
+{
+	uint32_t r = s->random_state;
+	r ^= r<<13;
+	r ^= r>>17;
+	r ^= r<<5;
+	s->random_state = r;
+	return min+(int)((uint64_t)r*(uint64_t)(max-min+1)>>32);
+}
+
+/** n-th cell of snake, counted from head */
+inline rules_cell *rulesSnakeCell(rules_state *s, unsigned n)
+{
+	return &s->snake_ring[(s->snake_head+n)&(RULES_SNAKE_RING-1)];
+}
+
+inline const rules_cell *rulesSnakeCell(const rules_state *s, unsigned n)
+{
+	return &s->snake_ring[(s->snake_head+n)&(RULES_SNAKE_RING-1)];
+}
+
+inline void rulesSetCell(rules_state *s, RulesHooks *h, unsigned x, unsigned y, WormikGame::board_def def)
+{
+	if (h != NULL)
+		h->cellChanged(x, y, s->board[y][x], def);
+	s->board[y][x] = def;
+}
+
+/** turns snake, except back to itself */
+inline void rulesChangeDirection(rules_state *s, unsigned dir)
+{
+	const rules_cell *head = rulesSnakeCell(s, 0);
+	if (dir != WormikGame::GR_GET_IN(s->board[head->y][head->x]))
+		s->snake_dir = dir;
+}
+
+/* bit x set where row[x] is def, for x inside board (borders are walls) */
+inline uint32_t rulesRowMask(const WormikGame::board_def *row, WormikGame::board_def def)
+{
+	uint32_t m = 0;
+	for (unsigned x = 1; x < WormikGame::GAME_XSIZE-1; x++)
+		m |= (uint32_t)(row[x] == def)<<x;
+	return m;
+}
+
+/*
+ * sets distances from x, y to cells open for snake (bit x of open[y]) as
+ * breadth first search by whole rows, SHRT_MAX to open cells not reachable
+ */
+inline void rulesCheckAccess(short (*access)[WormikGame::GAME_XSIZE], const uint32_t *open, unsigned x, unsigned y)
+{
+	enum { YSIZE = WormikGame::GAME_YSIZE };
+	uint32_t seen[YSIZE];
+	uint32_t front[YSIZE+2];				/* padded by empty row above and below */
+	unsigned lo = y, hi = y;				/* rows of front */
+
+	memset(seen, 0, sizeof(seen));
+	memset(front, 0, sizeof(front));
+	seen[y] = front[y+1] = 1u<<x;
+	for (short d = 1; ; d++) {
+		uint32_t next[YSIZE+2];
+		unsigned nlo = YSIZE, nhi = 0;
+		unsigned r0 = lo > 0 ? lo-1 : 0, r1 = hi < YSIZE-1 ? hi+1 : YSIZE-1;
+		for (unsigned r = r0; r <= r1; r++) {
+			uint32_t n = (front[r+1]<<1|front[r+1]>>1|front[r]|front[r+2])&open[r]&~seen[r];
+			next[r+1] = n;
+			if (n == 0)
+				continue;
+			seen[r] |= n;
+			nlo = r < nlo ? r : nlo;
+			nhi = r;
+			for (; n != 0; n &= n-1)
+				access[r][__builtin_ctz(n)] = d;
+		}
+		if (nlo > nhi)
+			break;
+		for (unsigned r = r0; r <= r1; r++)
+			front[r+1] = r >= nlo && r <= nhi ? next[r+1] : 0;
+		lo = nlo; hi = nhi;
+	}
+	for (unsigned r = 0; r < YSIZE; r++) {
+		for (uint32_t n = open[r]&~seen[r]; n != 0; n &= n-1)
+			access[r][__builtin_ctz(n)] = SHRT_MAX;
+	}
+}
+
+/**
+ * places walls to GR_INVALID cells, turning the rejected ones to GR_NONE,
+ * so that every free cell stays reachable from snake head, and makes some
+ * of them deadly
+ */
+inline void rulesGenerateWalls(rules_state *s, unsigned headx, unsigned heady)
+{
+	enum { XSIZE = WormikGame::GAME_XSIZE, YSIZE = WormikGame::GAME_YSIZE };
+	WormikGame::board_def (*board)[XSIZE] = s->board;
+	unsigned wallcnt, deathcnt;
+	short access[YSIZE][XSIZE];
+	uint32_t open[YSIZE];					/* bit x set where access[y][x] >= 0 */
+	/* free cells, then walls, in order of board scan, so the n-th one is
+	 * picked without scanning (y*XSIZE+x) */
+	uint16_t cells[XSIZE*YSIZE];
+	unsigned ncells = 0;
+
+	for (unsigned y = 0; y < YSIZE; y++) {
+		for (unsigned x = 0; x < XSIZE; x++) {
+			if (board[y][x] == WormikGame::GR_INVALID || board[y][x] == WormikGame::GR_NONE)
+				access[y][x] = SHRT_MAX;
+			else
+				access[y][x] = -1;
+			if (board[y][x] == WormikGame::GR_INVALID)
+				cells[ncells++] = y*XSIZE+x;
+		}
+	}
+	access[heady][headx] = 0;
+	access[heady+1][headx] = -1;
+	for (unsigned y = 0; y < YSIZE; y++) {
+		open[y] = 0;
+		for (unsigned x = 0; x < XSIZE; x++)
+			open[y] |= (uint32_t)(access[y][x] >= 0)<<x;
+	}
+
+	for (wallcnt = 0; wallcnt < WormikGame::TILES_COUNT_WALLS; ) {
+		unsigned x, y;
+		unsigned l;
+		bool isok = true;
+		unsigned cacc;
+		// free cells are the invalid ones
+		l = rulesRandRange(s, 1, s->freecnt);
+		assert(l > 0 && l <= ncells);
+		y = cells[l-1]/XSIZE; x = cells[l-1]%XSIZE;
+		memmove(cells+l-1, cells+l, (--ncells-(l-1))*sizeof(cells[0]));
+		cacc = access[y][x];
+		access[y][x] = -1;
+		open[y] &= ~(1u<<x);
+		if (cacc == SHRT_MAX) {
+			isok = false;
+		}
+		else {
+			for (unsigned dm = 0; dm < 4; dm++) {
+				unsigned dm2;
+				unsigned cx, cy;
+				cx = x+rules_moves[dm][0]; cy = y+rules_moves[dm][1];
+				if (access[cy][cx] < 0)
+					continue;
+				if (access[cy][cx] <= (short)cacc)
+					continue;
+				for (dm2 = 0; dm2 < 4; dm2++) {
+					unsigned tx, ty;
+					if (dm2 == ((dm+2)&3))
+						continue;
+					tx = cx+rules_moves[dm2][0]; ty = cy+rules_moves[dm2][1];
+					if (access[ty][tx] < 0)
+						continue;
+					if ((unsigned)access[ty][tx] <= cacc+1)
+						break;
+				}
+				if (dm2 < 4)
+					continue;
+				isok = false;
+				break;
+			}
+		}
+		if (!isok) {
+			rulesCheckAccess(access, open, headx, heady);
+			isok = true;
+			for (unsigned dm = 0; dm < 4; dm++) {
+				unsigned cx, cy;
+				cx = x+rules_moves[dm][0]; cy = y+rules_moves[dm][1];
+				if (access[cy][cx] < 0)
+					continue;
+				if (access[cy][cx] < SHRT_MAX)
+					continue;
+				isok = false;
+				break;
+			}
+		}
+		if (!isok) {
+			board[y][x] = WormikGame::GR_NONE;
+			s->freecnt--;
+			access[y][x] = cacc;
+			open[y] |= 1u<<x;
+		}
+		else {
+			board[y][x] = WormikGame::GR_WALL;
+			s->freecnt--;
+			wallcnt++;
+		}
+	}
+	ncells = 0;
+	for (unsigned y = 1; y < YSIZE-1; y++) {
+		for (unsigned x = 1; x < XSIZE-1; x++) {
+			if (board[y][x] == WormikGame::GR_WALL)
+				cells[ncells++] = y*XSIZE+x;
+		}
+	}
+	for (deathcnt = 0; deathcnt < WormikGame::TILES_COUNT_DEATH; deathcnt++) {
+		unsigned l;
+		l = rulesRandRange(s, 1, wallcnt-deathcnt);
+		assert(l > 0 && l <= ncells);
+		(&board[0][0])[cells[l-1]] = WormikGame::GR_DEATH;
+		memmove(cells+l-1, cells+l, (--ncells-(l-1))*sizeof(cells[0]));
+	}
+}
+
+/** sets up board and snake of new level */
+inline void rulesInitBoard(rules_state *s, RulesHooks *h)
+{
+	enum { XSIZE = WormikGame::GAME_XSIZE, YSIZE = WormikGame::GAME_YSIZE };
+	WormikGame::board_def (*board)[XSIZE] = s->board;
+	unsigned x, y;
+
+	for (y = 1; y < YSIZE-1; y++) {
+		for (x = 1; x < XSIZE-1; x++)
+			board[y][x] = WormikGame::GR_INVALID;
+	}
+	for (x = 0; x < XSIZE; x++) {
+		board[0][x] = WormikGame::GR_WALL;
+		board[YSIZE-1][x] = WormikGame::GR_WALL;
+	}
+	for (y = 1; y < YSIZE-1; y++) {
+		board[y][0] = WormikGame::GR_WALL;
+		board[y][XSIZE-1] = WormikGame::GR_WALL;
+	}
+	s->freecnt = XSIZE*YSIZE-2*XSIZE-2*(YSIZE-2);
+
+	s->snake_dir = WormikGame::SDIR_SOUTH;
+	s->snake_health = 4;
+	s->snake_head = 0;
+	s->snake_len = 4;
+	for (unsigned n = 0; n < 4; n++) {
+		s->snake_ring[n].x = XSIZE/2; s->snake_ring[n].y = YSIZE/2+1-n;
+	}
+	s->snake_moved = 0;
+
+	board[YSIZE/2-2][XSIZE/2] = WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_TAIL, WormikGame::SDIR_NORTH, WormikGame::SDIR_SOUTH);
+	board[YSIZE/2-1][XSIZE/2] = WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_BODY, WormikGame::SDIR_NORTH, WormikGame::SDIR_SOUTH);
+	board[YSIZE/2+0][XSIZE/2] = WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_BODY, WormikGame::SDIR_NORTH, WormikGame::SDIR_SOUTH);
+	board[YSIZE/2+1][XSIZE/2] = WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_HEAD, WormikGame::SDIR_NORTH, WormikGame::SDIR_SOUTH);
+	board[YSIZE/2+2][XSIZE/2] = WormikGame::GR_NONE;
+	board[YSIZE/2+3][XSIZE/2] = WormikGame::GR_NONE;
+	s->freecnt -= 6;
+
+	if (h != NULL)
+		h->generateWalls(s, XSIZE/2, YSIZE/2+1);
+	else
+		rulesGenerateWalls(s, XSIZE/2, YSIZE/2+1);
+
+	s->exit_open = false;
+	memset(s->defcnts, 0, sizeof(s->defcnts));
+
+	for (y = 0; y < YSIZE; y++) {
+		for (x = 0; x < XSIZE; x++) {
+			if (board[y][x] == WormikGame::GR_INVALID)
+				board[y][x] = WormikGame::GR_NONE;
+			else if (board[y][x] == WormikGame::GR_NONE)
+				s->freecnt++;
+		}
+	}
+	s->ndlen = 0;
+}
+
+/** starts next level after outcome (GA_*), GA_DEAD starts new game */
+inline void rulesStartLevel(rules_state *s, RulesHooks *h, int outcome)
+{
+	if (outcome == WormikGame::GA_DEAD) {
+		s->snake_grow = 0;
+		s->state_level = 0;
+		s->state_exitscore = 80;
+		s->state_totscore = 0;
+	}
+	else {
+		s->state_level++;
+		s->state_exitscore += 16+8*(s->state_level/4);
+	}
+	s->state_levscore = 0;
+	s->step_interval = 400000;
+	s->health_add = 5*WormikGame::GAME_TIME_SECOND;
+	s->health_timeout = s->health_add+s->step_interval;
+	rulesInitBoard(s, h);
+}
+
+inline void rulesDecDefs(rules_state *s, WormikGame::board_def def)
+{
+	unsigned i;
+	for (i = 0; ; i++) {
+		assert(i < RULES_DEFS);
+		if (rules_defs[i].def == def)
+			break;
+	}
+	assert(s->defcnts[i] > 0);
+	s->defcnts[i]--;
+	s->freecnt++;
+}
+
+/** starts generating def least present relative to its maximum, returns 0 if none is */
+inline int rulesGenDef(rules_state *s, RulesHooks *h, WormikGame::game_time latency)
+{
+	WormikGame::board_newdef *nd;
+	unsigned x, y;
+	unsigned l;
+	int bi = -1;
+	int br = INT_MAX;
+	if (s->freecnt == 0)
+		return 0;
+	if (s->ndlen == RULES_NEWDEFS_MAX)
+		return 0;
+	for (int i = 0; i < RULES_DEFS; i++) {
+		unsigned max = i == 0 ? s->exit_open : rules_defs[i].max;
+		int r;
+		if (s->defcnts[i] == max)
+			continue;
+		if ((r = 65536*s->defcnts[i]/max) >= br)
+			continue;
+		bi = i; br = r;
+	}
+	if (bi < 0)
+		return 0;
+	// l-th empty cell in order of rows, whole rows are skipped by their counts
+	l = rulesRandRange(s, 1, s->freecnt);
+	for (y = 1; ; y++) {
+		uint32_t m = rulesRowMask(s->board[y], WormikGame::GR_NONE);
+		unsigned n = __builtin_popcount(m);
+		assert(y < WormikGame::GAME_YSIZE-1);
+		if (l > n) {
+			l -= n;
+			continue;
+		}
+		for (; --l > 0; m &= m-1);
+		x = __builtin_ctz(m);
+		break;
+	}
+	assert(s->board[y][x] == WormikGame::GR_NONE);
+	nd = &s->newdefs[s->ndlen++];
+	nd->defsi = bi;
+	nd->def = rules_defs[bi].def;
+	nd->total = rules_defs[bi].timeout;
+	nd->x = x; nd->y = y;
+	nd->timeout = rules_defs[bi].timeout+latency;
+	if (h != NULL)
+		h->newdefToggled(nd);
+	s->defcnts[bi]++;
+	rulesSetCell(s, h, x, y, WormikGame::GR_NEW_DEF);
+	s->freecnt--;
+	if (h != NULL)
+		h->invalidateFlags(WormikGui::INVO_NEW_DEFS);
+	return 1;
+}
+
+/**
+ * removes newdef hit by snake, returns true if the cell became empty, false
+ * if it was generated far enough to stay
+ */
+inline bool rulesDeleteNewDef(rules_state *s, RulesHooks *h, unsigned x, unsigned y)
+{
+	WormikGame::board_newdef *nd = s->newdefs;
+	WormikGame::board_def def;
+	unsigned i;
+	unsigned di;
+	bool deleteIt;
+	assert(s->board[y][x] == WormikGame::GR_NEW_DEF);
+	for (i = 0; ; i++) {
+		assert(i < s->ndlen);
+		if (nd[i].x == (int)x && nd[i].y == (int)y)
+			break;
+	}
+	di = nd[i].defsi;
+	def = rules_defs[di].def;
+	switch (def) {
+	case WormikGame::GR_EXIT:
+		deleteIt = 100*(int64_t)nd[i].timeout > WormikGame::TIMEOUT_EXIT_PERCENT*(int64_t)rules_defs[di].timeout;
+		break;
+
+	case WormikGame::GR_POSITIVE:
+	case WormikGame::GR_POSITIVE_2:
+		deleteIt = 100*(int64_t)nd[i].timeout > WormikGame::TIMEOUT_POSITIVE_PERCENT*(int64_t)rules_defs[di].timeout;
+		break;
+
+	default:
+		deleteIt = true;
+		break;
+	}
+	if (h != NULL)
+		h->newdefToggled(&nd[i]);
+	memmove(nd+i, nd+i+1, (--s->ndlen-i)*sizeof(nd[0]));
+	if (deleteIt) {
+		rulesDecDefs(s, def);
+		rulesSetCell(s, h, x, y, WormikGame::GR_NONE);
+	}
+	else {
+		if (h != NULL)
+			h->invalidateCell(x, y);
+		rulesSetCell(s, h, x, y, def);
+	}
+	return deleteIt;
+}
+
+/**
+ * moves snake by one step in its direction
+ *
+ * @return
+ * 	GA_* outcome, with GE_* cause of level end in cause
+ */
+inline int rulesStep(rules_state *s, RulesHooks *h, int *cause)
+{
+	WormikGame::board_def (*board)[WormikGame::GAME_XSIZE] = s->board;
+	int action = WormikGame::GA_CONTINUE;
+	int invof = 0;
+	unsigned dir = s->snake_dir;
+	unsigned npos[2];
+	unsigned oldscore = s->state_levscore;
+	rules_cell *p;
+
+	*cause = WormikGame::GE_NONE;
+	s->snake_moved = 0;
+
+	if ((s->health_timeout -= s->step_interval) <= 0) {
+		WormikGame::game_time add = s->health_add;
+		s->snake_health++;
+		invof |= WormikGui::INVO_HEALTH;
+		if (add < 8000000)
+			add += 2000000;
+		else if (add < 12000000)
+			add += 1500000;
+		else if (add < 16000000)
+			add += 1000000;
+		else if (add < 20000000)
+			add += 700000;
+		else if (add < 25000000)
+			add += 500000;
+		s->health_add = add;
+		s->health_timeout += add;
+	}
+
+	if (s->ndlen > 0) {
+		WormikGame::board_newdef *nd = s->newdefs;
+		unsigned ni, di;
+		for (di = ni = 0; ni < s->ndlen; ni++) {
+			if (h != NULL)
+				h->newdefToggled(&nd[ni]);
+			if ((nd[ni].timeout -= s->step_interval) <= 0) {
+				rulesSetCell(s, h, nd[ni].x, nd[ni].y, rules_defs[nd[ni].defsi].def);
+				if (h != NULL)
+					h->invalidateCell(nd[ni].x, nd[ni].y);
+			}
+			else {
+				if (h != NULL)
+					h->newdefToggled(&nd[ni]);
+				nd[di++] = nd[ni];
+			}
+		}
+		s->ndlen = di;
+	}
+
+	p = rulesSnakeCell(s, 0);
+	npos[0] = p->x+rules_moves[dir][0];
+	npos[1] = p->y+rules_moves[dir][1];
+
+step_hit:
+	switch (board[npos[1]][npos[0]]) {
+	case WormikGame::GR_WALL:
+	case WormikGame::GR_DEATH:
+		action = WormikGame::GA_DEAD;
+		*cause = board[npos[1]][npos[0]] == WormikGame::GR_WALL ? WormikGame::GE_WALL : WormikGame::GE_DEATH;
+		invof |= WormikGui::INVO_HEALTH;
+		break;
+
+	default: // snake
+		if (WormikGame::GR_GET_FULL_TYPE(board[npos[1]][npos[0]]) == WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_TAIL)
+			s->snake_health--;
+		else
+			s->snake_health /= 2;
+		*cause = WormikGame::GE_SELF_BITE;
+		if (s->snake_health > 0) {
+			for (;;) {
+				p = rulesSnakeCell(s, --s->snake_len);
+				if (h != NULL)
+					h->invalidateCell(p->x, p->y);
+				rulesSetCell(s, h, p->x, p->y, WormikGame::GR_NONE);
+				s->freecnt++;
+				if (p->x == npos[0] && p->y == npos[1])
+					break;
+				if (s->exit_open)
+					s->state_levscore++;
+			}
+			p = rulesSnakeCell(s, s->snake_len-1);
+			rulesSetCell(s, h, p->x, p->y, WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_TAIL, 0, WormikGame::GR_GET_OUT(board[p->y][p->x])));
+			if (h != NULL)
+				h->invalidateCell(p->x, p->y);
+			invof |= WormikGui::INVO_LENGTH;
+		}
+		invof |= WormikGui::INVO_HEALTH;
+		break;
+
+	case WormikGame::GR_NEW_DEF:
+		if (!rulesDeleteNewDef(s, h, npos[0], npos[1]))
+			goto step_hit;
+		// fall through
+	case WormikGame::GR_NONE:
+		break;
+
+	case WormikGame::GR_POSITIVE:
+		s->snake_grow += 1;
+		s->state_levscore += 2;
+		rulesDecDefs(s, WormikGame::GR_POSITIVE);
+		break;
+
+	case WormikGame::GR_POSITIVE_2:
+		s->snake_grow += 2;
+		s->state_levscore += 5;
+		rulesDecDefs(s, WormikGame::GR_POSITIVE_2);
+		break;
+
+	case WormikGame::GR_NEGATIVE:
+		invof |= WormikGui::INVO_HEALTH;
+		*cause = WormikGame::GE_HEALTH;
+		if ((s->snake_health -= 1) == 0)
+			break;
+		rulesDecDefs(s, WormikGame::GR_NEGATIVE);
+		s->snake_grow--;
+		break;
+
+	case WormikGame::GR_EXIT:
+		s->state_levscore += 12*s->state_level+8*(s->state_level/4);
+		invof |= WormikGui::INVO_SCORE;
+		action = WormikGame::GA_EXIT;
+		*cause = WormikGame::GE_EXIT;
+		break;
+	}
+	if (s->snake_health == 0)
+		action = WormikGame::GA_DEAD;
+	if (s->state_levscore != oldscore) {
+		s->state_totscore += s->state_levscore-oldscore;
+		invof |= WormikGui::INVO_SCORE;
+	}
+	if (action == WormikGame::GA_CONTINUE) {
+		unsigned oldLen = s->snake_len;
+		s->snake_head = (s->snake_head-1)&(RULES_SNAKE_RING-1);
+		p = rulesSnakeCell(s, 0);
+		p->x = npos[0]; p->y = npos[1];
+		rulesSetCell(s, h, npos[0], npos[1], WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_HEAD, (dir+2)&3, dir));
+		p = rulesSnakeCell(s, 1);
+		rulesSetCell(s, h, p->x, p->y, WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_BODY, WormikGame::GR_GET_IN(board[p->y][p->x]), dir));
+		if (h != NULL) {
+			h->invalidateCell(p->x, p->y);
+			h->invalidateCell(npos[0], npos[1]);
+		}
+		s->snake_step.headX = npos[0]; s->snake_step.headY = npos[1];
+		s->snake_step.headDir = dir;
+		s->snake_moved |= WormikGame::SM_HEAD;
+		if (--s->snake_grow >= 0) {
+			s->snake_len++;
+			invof |= WormikGui::INVO_LENGTH;
+			s->freecnt--;
+		}
+		else {
+			// tail moving by single cell can be drawn in between steps
+			p = rulesSnakeCell(s, s->snake_len);
+			s->snake_step.tailDir = WormikGame::GR_GET_OUT(board[p->y][p->x]);
+			if (s->snake_grow == -1 || s->snake_len <= 2)
+				s->snake_moved |= WormikGame::SM_TAIL;
+			for (;;) {
+				p = rulesSnakeCell(s, s->snake_len);
+				rulesSetCell(s, h, p->x, p->y, WormikGame::GR_NONE);
+				if (h != NULL)
+					h->invalidateCell(p->x, p->y);
+				if (++s->snake_grow == 0 || s->snake_len <= 2)
+					break;
+				s->snake_len--;
+				s->freecnt++;
+			}
+			p = rulesSnakeCell(s, s->snake_len-1);
+			rulesSetCell(s, h, p->x, p->y, WormikGame::GR_SNAKE(WormikGame::GSF_SNAKE_TAIL, 0, WormikGame::GR_GET_OUT(board[p->y][p->x])));
+			s->snake_step.tailX = p->x; s->snake_step.tailY = p->y;
+			s->snake_step.tailOut = WormikGame::GR_GET_OUT(board[p->y][p->x]);
+			if (h != NULL)
+				h->invalidateCell(p->x, p->y);
+		}
+		if (s->snake_health > s->snake_len)
+			s->snake_health = s->snake_len;
+		if (s->state_levscore >= s->state_exitscore)
+			s->exit_open = true;
+		if (oldLen != s->snake_len) {
+			WormikGame::game_time interval = s->step_interval;
+			WormikGame::game_time c;
+			if (interval > 300000)
+				c = 2000;
+			else if (interval > 250000)
+				c = 1200;
+			else if (interval > 200000)
+				c = 700;
+			else if (interval > 150000)
+				c = 500;
+			else
+				c = 0;
+			if (s->snake_len < oldLen)
+				c += c/2;
+			if ((interval -= c) < 150000)
+				interval = 150000;
+			s->step_interval = interval;
+		}
+		for (WormikGame::game_time latency = s->step_interval/8; latency < s->step_interval; latency += s->step_interval/4) {
+			if (rulesGenDef(s, h, latency) == 0)
+				break;
+		}
+	}
+	if (h != NULL)
+		h->invalidateFlags(invof);
+	return action;
+}
+
+
+} } } };
+
+#endif
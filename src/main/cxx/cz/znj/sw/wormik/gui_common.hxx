@@ -12,7 +12,7 @@ namespace cz { namespace znj { namespace sw { namespace wormik { namespace gui4x
 {
 
 
-/* canvas sizes */
+/* canvas sizes (of source images, front ends may draw scaled copies) */
 enum {
 	GRECT_XSIZE = 16,
 	GRECT_YSIZE = 16,
@@ -30,15 +30,136 @@ enum {
 	SIMG_HEIGTH = 7*GRECT_YSIZE,
 };
 
+/* pre-faded newdef tiles, placed below season tiles in background image */
+enum {
+	FADE_LEVELS = 16,
+	FADE_TYPES = WormikGame::GR_EXIT-WormikGame::GR_POSITIVE+1,
+	SP_FADE_Y = 7,
+	BGIMG_WIDTH = FADE_LEVELS*GRECT_XSIZE,
+	BGIMG_HEIGHT = SIMG_HEIGTH+FADE_TYPES*GRECT_YSIZE,
+};
+
+/* position in season image */
+enum {
+	SP_NONE_X	= 2,
+	SP_NONE_Y	= 6,
+	SP_WALL_X	= 1,
+	SP_WALL_Y	= 6,
+	SP_POSIT_X	= 0,
+	SP_POSIT_Y	= 5,
+	SP_POSIT2_X	= 1,
+	SP_POSIT2_Y	= 5,
+	SP_NEGAT_X	= 2,
+	SP_NEGAT_Y	= 5,
+	SP_DEATH_X	= 3,
+	SP_DEATH_Y	= 5,
+	SP_EXIT_X	= 0,
+	SP_EXIT_Y	= 6,
+};
+
 /* snake body: in, out -> { x, y } */
-extern const int body_image_pos[4][4][2];
+inline constexpr int body_image_pos[4][4][2] =
+{
+	{
+		{ 9, 9 },
+		{ 0, 3 },
+		{ 0, 4 },
+		{ 2, 2 },
+	},
+	{
+		{ 2, 3 },
+		{ 9, 9 },
+		{ 1, 3 },
+		{ 1, 4 },
+	},
+	{
+		{ 2, 4 },
+		{ 3, 3 },
+		{ 9, 9 },
+		{ 1, 2 },
+	},
+	{
+		{ 0, 2 },
+		{ 3, 4 },
+		{ 3, 2 },
+		{ 9, 9 },
+	},
+};
+
 /* snake head: in -> { x, y } */
-extern const int head_image_pos[4][2];
+inline constexpr int head_image_pos[4][2] =
+{
+	{ 0, 0 },
+	{ 1, 0 },
+	{ 0, 1 },
+	{ 1, 1 },
+};
+
 /* snake tail: out -> { x, y } */
-extern const int tail_image_pos[4][2];
+inline constexpr int tail_image_pos[4][2] =
+{
+	{ 2, 0 },
+	{ 3, 0 },
+	{ 2, 1 },
+	{ 3, 1 },
+};
+
+/* tile position in season image, in tiles */
+typedef struct image_pos
+{
+	unsigned char			x, y;
+} image_pos;
+
+/* tile position of board-type, invalid types (including GR_NEW_DEF) get empty field */
+constexpr image_pos computeImagePos(WormikGame::board_def t)
+{
+	switch (WormikGame::GR_GET_FULL_TYPE(t)) {
+	case WormikGame::GR_WALL:
+		return { SP_WALL_X, SP_WALL_Y };
+	case WormikGame::GR_POSITIVE:
+		return { SP_POSIT_X, SP_POSIT_Y };
+	case WormikGame::GR_POSITIVE_2:
+		return { SP_POSIT2_X, SP_POSIT2_Y };
+	case WormikGame::GR_NEGATIVE:
+		return { SP_NEGAT_X, SP_NEGAT_Y };
+	case WormikGame::GR_DEATH:
+		return { SP_DEATH_X, SP_DEATH_Y };
+	case WormikGame::GR_EXIT:
+		return { SP_EXIT_X, SP_EXIT_Y };
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_HEAD:
+		return { (unsigned char)head_image_pos[WormikGame::GR_GET_IN(t)][0], (unsigned char)head_image_pos[WormikGame::GR_GET_IN(t)][1] };
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_BODY:
+		if (WormikGame::GR_GET_IN(t) == WormikGame::GR_GET_OUT(t))
+			break;
+		return { (unsigned char)body_image_pos[WormikGame::GR_GET_IN(t)][WormikGame::GR_GET_OUT(t)][0], (unsigned char)body_image_pos[WormikGame::GR_GET_IN(t)][WormikGame::GR_GET_OUT(t)][1] };
+	case WormikGame::GR_BASE_SNAKE+WormikGame::GSF_SNAKE_TAIL:
+		return { (unsigned char)tail_image_pos[WormikGame::GR_GET_OUT(t)][0], (unsigned char)tail_image_pos[WormikGame::GR_GET_OUT(t)][1] };
+	}
+	return { SP_NONE_X, SP_NONE_Y };
+}
+
+typedef struct image_pos_table
+{
+	image_pos			pos[256];
+
+	constexpr const image_pos &	operator[](WormikGame::board_def t) const { return pos[t]; }
+} image_pos_table;
+
+constexpr image_pos_table computeImagePosTable()
+{
+	image_pos_table table = {};
+	for (unsigned t = 0; t < 256; t++)
+		table.pos[t] = computeImagePos(t);
+	return table;
+}
+
+/* board_def -> tile position in season image, for drawing board in bulk */
+inline constexpr image_pos_table board_image_pos = computeImagePosTable();
 
-/* returns image positions for board-type */
-void findImagePos(WormikGame::board_def t, unsigned *x, unsigned *y);
+/* returns image positions for board-type, in image scaled to xsize*ysize tiles */
+void findImagePos(WormikGame::board_def t, unsigned *x, unsigned *y, unsigned xsize = GRECT_XSIZE, unsigned ysize = GRECT_YSIZE);
+/* returns background image position of board-type faded in to level (0 - empty field, FADE_LEVELS-1 - fully drawn), false if not available */
+bool findFadePos(WormikGame::board_def t, unsigned level, unsigned *x, unsigned *y, unsigned xsize = GRECT_XSIZE, unsigned ysize = GRECT_YSIZE);
 
 class InvalidatedList
 {
@@ -0,0 +1,192 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Live game state export to shared memory
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <chrono>
+#include <new>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# define LIVE_EXPORT_SHM
+#endif
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/live_export.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+const double LiveExport::IDLE_TIME = 1.0;
+
+LiveExport::LiveExport():
+	segment(NULL),
+	pollInterval(0),
+	quit(false),
+	pending(0),
+	appliedCommand(0)
+{
+	name[0] = '\0';
+}
+
+LiveExport::~LiveExport()
+{
+	close();
+}
+
+int LiveExport::open(const char *name_, unsigned pollInterval_)
+{
+#ifdef LIVE_EXPORT_SHM
+	int fd;
+	void *mem;
+
+	close();
+	if (snprintf(name, sizeof(name), "%s%s", name_[0] == '/' ? "" : "/", name_) >= (int)sizeof(name)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	// stale segment of crashed game may have different layout
+	shm_unlink(name);
+	if ((fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600)) < 0)
+		return -1;
+	if (ftruncate(fd, sizeof(live_segment)) < 0 || (mem = mmap(NULL, sizeof(live_segment), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		int err = errno;
+		::close(fd);
+		shm_unlink(name);
+		errno = err;
+		return -1;
+	}
+	::close(fd);
+	segment = new(mem) live_segment();
+	memcpy(segment->magic, LIVE_MAGIC, sizeof(segment->magic));
+	segment->version = LIVE_VERSION;
+	segment->size = sizeof(live_segment);
+
+	pollInterval = pollInterval_;
+	quit.store(false);
+	pending.store(0);
+	appliedCommand = 0;
+	poller = std::thread(&LiveExport::pollMain, this);
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void LiveExport::close()
+{
+#ifdef LIVE_EXPORT_SHM
+	if (segment == NULL)
+		return;
+	quit.store(true, std::memory_order_seq_cst);
+	liveWakePoller(segment);
+	poller.join();
+	munmap(segment, sizeof(live_segment));
+	shm_unlink(name);
+	segment = NULL;
+#endif
+}
+
+void LiveExport::publish(WormikGame *game)
+{
+	live_state *state = &segment->state;
+	WormikGame::board_view view;
+	uint32_t seq = segment->sequence.load(std::memory_order_relaxed);
+
+	segment->sequence.store(seq+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	state->tick++;
+	state->appliedCommand = appliedCommand;
+	state->gameState = game->getState(&state->level, NULL);
+	state->exit = game->getScore(&state->score, &state->total);
+	game->getSnakeInfo(&state->health, &state->length);
+	game->getBoardView(&view);
+	state->headX = view.headX; state->headY = view.headY;
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++)
+		memcpy(state->board[y], view.board+y*view.stride, WormikGame::GAME_XSIZE);
+
+	segment->sequence.store(seq+2, std::memory_order_seq_cst);
+	// stepping again, poller has to poll
+	if (segment->pollerWaiting.load(std::memory_order_seq_cst) != 0)
+		liveWakePoller(segment);
+}
+
+int LiveExport::takeDirection()
+{
+	uint64_t command;
+	if (segment == NULL || (command = pending.exchange(0, std::memory_order_acquire)) == 0)
+		return -1;
+	appliedCommand = (uint32_t)(command>>32);
+	return command&0xff;
+}
+
+void LiveExport::pollSleep(uint32_t head, uint32_t sequence)
+{
+	uint32_t wake;
+	segment->pollerWaiting.store(1, std::memory_order_seq_cst);
+	wake = segment->pollerWake.load(std::memory_order_seq_cst);
+	// anything coming after this check increments pollerWake, so the wait returns right away
+	if (!quit.load(std::memory_order_seq_cst) && segment->commandHead.load(std::memory_order_seq_cst) == head && segment->sequence.load(std::memory_order_seq_cst) == sequence) {
+#ifdef LIVE_EXPORT_FUTEX
+		syscall(SYS_futex, &segment->pollerWake, FUTEX_WAIT, wake, NULL, NULL, 0);
+#else
+		// no futex, idle polling is just slow
+		(void)wake;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#endif
+	}
+	segment->pollerWaiting.store(0, std::memory_order_relaxed);
+}
+
+void LiveExport::pollMain()
+{
+	uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+	auto active = std::chrono::steady_clock::now();
+
+	while (!quit.load(std::memory_order_relaxed)) {
+		uint32_t tail = segment->commandTail.load(std::memory_order_relaxed);
+		uint32_t head = segment->commandHead.load(std::memory_order_acquire);
+		uint32_t seq;
+		if (head != tail) {
+			uint32_t id = 0;
+			for (; tail != head; tail++) {
+				live_command command = segment->commands[tail%LIVE_RING_SIZE];
+				id = command.id;
+				if (command.direction < 4)
+					pending.store((uint64_t)id<<32|PENDING_VALID|command.direction, std::memory_order_release);
+			}
+			segment->commandTail.store(tail, std::memory_order_release);
+			segment->commandAck.store(id, std::memory_order_release);
+			active = std::chrono::steady_clock::now();
+			continue;
+		}
+		if ((seq = segment->sequence.load(std::memory_order_relaxed)) != sequence) {
+			sequence = seq;
+			active = std::chrono::steady_clock::now();
+		}
+		else if (std::chrono::duration<double>(std::chrono::steady_clock::now()-active).count() >= IDLE_TIME) {
+			pollSleep(head, sequence);
+			active = std::chrono::steady_clock::now();
+			continue;
+		}
+		if (pollInterval > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(pollInterval));
+	}
+}
+
+
+} } } };
@@ -0,0 +1,189 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Live game state export to shared memory
+ */
+
+#ifndef live_export_hxx__
+# define live_export_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <thread>
+
+#ifdef __linux__
+# include <unistd.h>
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# define LIVE_EXPORT_FUTEX
+#endif
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Shared memory segment layout (native byte order), created by the game
+ * in POSIX shared memory under configured name:
+ *	live_segment
+ *
+ * State is published after every game step, protected by sequence lock:
+ * sequence is odd while game writes, reader copies the state and retries
+ * when sequence was odd or changed meanwhile. Game never waits for readers.
+ *
+ * Commands go through single producer (controller), single consumer (game)
+ * ring: controller fills commands[head%LIVE_RING_SIZE] and increments
+ * commandHead, game acknowledges by moving commandTail and setting
+ * commandAck to id of the last consumed command. Consumed direction is
+ * applied at the next step, its id is then reported in state.
+ *
+ * While the game does not step (start screen, pause, dialogs), the game
+ * side stops polling and sleeps on pollerWake with pollerWaiting set; the
+ * controller wakes it after queuing command, liveSubmitCommand does that.
+ */
+enum {
+	LIVE_VERSION		= 2,
+	LIVE_RING_SIZE		= 64,			/**< power of two */
+	LIVE_CMD_PING		= 0xff,			/**< command direction only acknowledged */
+};
+
+#define LIVE_MAGIC "WRMKLIV\n"
+
+struct live_state
+{
+	uint32_t			tick;			/**< publications since game start */
+	uint32_t			appliedCommand;		/**< id of last command applied to game */
+	int32_t				gameState;		/**< WormikGame::GS_* */
+	int32_t				level;
+	int32_t				score, total, exit;
+	int32_t				health, length;
+	uint8_t				headX, headY;
+	uint8_t				reserved[2];
+	uint8_t				board[WormikGame::GAME_YSIZE][WormikGame::GAME_XSIZE];	/**< WormikGame::board_def */
+};
+
+struct live_command
+{
+	uint32_t			id;			/**< nonzero, chosen by controller */
+	uint8_t				direction;		/**< SDIR_* or LIVE_CMD_PING */
+	uint8_t				reserved[3];
+};
+
+struct live_segment
+{
+	char				magic[8];		/**< LIVE_MAGIC */
+	uint32_t			version;		/**< LIVE_VERSION */
+	uint32_t			size;			/**< sizeof(live_segment) */
+
+	alignas(64) std::atomic<uint32_t> sequence;		/**< odd while state is written */
+	live_state			state;
+
+	alignas(64) std::atomic<uint32_t> commandHead;		/**< written by controller */
+	alignas(64) std::atomic<uint32_t> commandTail;		/**< written by game */
+	std::atomic<uint32_t>		commandAck;		/**< id of last consumed command */
+	live_command			commands[LIVE_RING_SIZE];
+
+	alignas(64) std::atomic<uint32_t> pollerWaiting;		/**< nonzero while game side sleeps */
+	std::atomic<uint32_t>		pollerWake;		/**< futex, incremented to wake game side */
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock free");
+
+/** copies consistent state, spinning while game writes */
+inline void liveReadState(const live_segment *segment, live_state *state)
+{
+	for (;;) {
+		uint32_t seq = segment->sequence.load(std::memory_order_acquire);
+		if ((seq&1) != 0)
+			continue;
+		memcpy(state, &segment->state, sizeof(*state));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (segment->sequence.load(std::memory_order_relaxed) == seq)
+			return;
+	}
+}
+
+/** wakes sleeping game side, whoever changed what it waits for */
+inline void liveWakePoller(live_segment *segment)
+{
+	segment->pollerWake.fetch_add(1, std::memory_order_seq_cst);
+#ifdef LIVE_EXPORT_FUTEX
+	// segment is shared between processes, so no private futex
+	syscall(SYS_futex, &segment->pollerWake, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+/** queues command, returns false if ring is full */
+inline bool liveSubmitCommand(live_segment *segment, uint32_t id, uint8_t direction)
+{
+	uint32_t head = segment->commandHead.load(std::memory_order_relaxed);
+	if (head-segment->commandTail.load(std::memory_order_acquire) >= LIVE_RING_SIZE)
+		return false;
+	segment->commands[head%LIVE_RING_SIZE].id = id;
+	segment->commands[head%LIVE_RING_SIZE].direction = direction;
+	segment->commandHead.store(head+1, std::memory_order_seq_cst);
+	if (segment->pollerWaiting.load(std::memory_order_seq_cst) != 0)
+		liveWakePoller(segment);
+	return true;
+}
+
+
+/**
+ * Game side of the segment: publishes state, consumes commands on poller
+ * thread so they are acknowledged within microseconds. Poller polls only
+ * while the game publishes steps, after LIVE_IDLE_TIME without any it
+ * sleeps until command or next step comes.
+ */
+class LiveExport
+{
+protected:
+	live_segment *			segment;
+	char				name[64];		/**< shared memory name */
+	unsigned			pollInterval;		/**< microseconds, 0 to spin */
+	static const double		IDLE_TIME;		/**< seconds without step before poller sleeps */
+
+	std::thread			poller;
+	std::atomic<bool>		quit;
+	std::atomic<uint64_t>		pending;		/**< id<<32|PENDING_VALID|direction of command to apply */
+	uint32_t			appliedCommand;		/**< id of last taken command */
+
+	enum {
+		PENDING_VALID			= 0x100,
+	};
+
+public:
+	/* constructor */		LiveExport();
+	/* destructor */		~LiveExport();
+
+public:
+	/** creates segment and starts poller, returns negative on error */
+	int				open(const char *name, unsigned pollInterval);
+	void				close();
+	bool				isOpen() const;
+
+	/** publishes current state of game */
+	void				publish(WormikGame *game);
+	/** returns direction of last consumed command (once) or -1 */
+	int				takeDirection();
+
+protected:
+	void				pollMain();
+	/** sleeps until woken, unless command or step came after they were last seen */
+	void				pollSleep(uint32_t head, uint32_t sequence);
+};
+
+inline bool LiveExport::isOpen() const
+{
+	return segment != NULL;
+}
+
+
+} } } };
+
+#endif
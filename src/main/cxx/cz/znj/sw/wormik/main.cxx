@@ -13,6 +13,8 @@
 #include <assert.h>
 #include <time.h>
 
+#include "cz/znj/sw/wormik/platform.hxx"
+
 #include "cz/znj/sw/wormik/WormikGame.hxx"
 #include "cz/znj/sw/wormik/WormikGui.hxx"
 
@@ -20,6 +22,9 @@ namespace cz { namespace znj { namespace sw { namespace wormik {
 
 
 extern WormikGui *create_WormikGui();
+extern WormikGui *create_SoftWormikGui(bool headless);
+extern WormikGui *create_TermWormikGui();
+extern WormikGui *create_ExportWormikGui();
 extern WormikGame *create_WormikGame();
 
 
@@ -28,15 +33,73 @@ extern WormikGame *create_WormikGame();
 using namespace cz::znj::sw::wormik;
 
 
-int main(void)
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik [options]\n"
+		"  -o name=value   override config value for this session\n"
+		"  -T              measure startup, report time to first frame and exit\n"
+		);
+}
+
+int main(int argc, char **argv)
 {
 	WormikGame *game;
 	WormikGui *gui;
-
-	srand(time(NULL));
+	char guiName[32];
+	int opt;
 
 	game = create_WormikGame();
-	gui = create_WormikGui();
+	while ((opt = getopt(argc, argv, "o:T")) != -1) {
+		switch (opt) {
+		case 'o':
+			{
+				char *eq;
+				if ((eq = strchr(optarg, '=')) == NULL) {
+					usage();
+					return 2;
+				}
+				*eq = '\0';
+				game->overrideConfig(optarg, eq+1);
+			}
+			break;
+
+		case 'T':
+			game->overrideConfig("startuptime", "1");
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	{
+		// kept in config, so the game can seed itself and store it to replay
+		char seed[16];
+		snprintf(seed, sizeof(seed), "%d", game->getConfigInt("seed", time(NULL)));
+		game->overrideConfig("seed", seed);
+	}
+	if ((unsigned)game->getConfigStr("gui", guiName, sizeof(guiName)) >= sizeof(guiName) || strcmp(guiName, "sdl") == 0) {
+		gui = create_WormikGui();
+	}
+	else if (strcmp(guiName, "soft") == 0 || strcmp(guiName, "headless") == 0) {
+		gui = create_SoftWormikGui(strcmp(guiName, "headless") == 0);
+	}
+	else if (strcmp(guiName, "export") == 0) {
+		gui = create_ExportWormikGui();
+	}
+	else if (strcmp(guiName, "term") == 0) {
+		if ((gui = create_TermWormikGui()) == NULL) {
+			fprintf(stderr, "terminal gui is not supported on this platform\n");
+			delete game;
+			return 1;
+		}
+	}
+	else {
+		fprintf(stderr, "unknown gui %s, use sdl, soft, headless, term or export\n", guiName);
+		delete game;
+		return 2;
+	}
 	game->setGui(gui);
 	if (gui->init(game) < 0) {
 		delete game;
@@ -0,0 +1,173 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * resource pack builder
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/gui_common.hxx"
+#include "cz/znj/sw/wormik/resource_pack.hxx"
+
+using namespace cz::znj::sw::wormik;
+using namespace cz::znj::sw::wormik::gui4x6x16;
+
+
+enum {
+	MAX_IMAGES		= 64,
+	PACK_FORMAT		= SDL_PIXELFORMAT_ARGB8888,
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik-pack [-s tilesize]... output.pak wormik_0.png wormik_1.png ...\n"
+		"  -s tilesize     add variant pre-scaled to tile size (base %d is always added)\n",
+		GRECT_XSIZE);
+}
+
+static int writePadding(FILE *fo, size_t length)
+{
+	static const char zeros[PACK_ALIGN] = { 0 };
+	if (length%PACK_ALIGN != 0 && fwrite(zeros, 1, PACK_ALIGN-length%PACK_ALIGN, fo) != PACK_ALIGN-length%PACK_ALIGN)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned sizes[16];
+	unsigned sizesCount = 0;
+	SDL_Surface *icons[MAX_IMAGES];
+	pack_entry entries[MAX_IMAGES*sizeof(sizes)/sizeof(sizes[0])];
+	pack_header header;
+	unsigned imagesCount;
+	const char *output;
+	FILE *fo;
+	uint64_t offset;
+	int opt;
+
+	sizes[sizesCount++] = GRECT_XSIZE;
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sizesCount >= sizeof(sizes)/sizeof(sizes[0]) || (sizes[sizesCount] = atoi(optarg)) <= 0) {
+				usage();
+				return 2;
+			}
+			if (sizes[sizesCount] != GRECT_XSIZE)
+				sizesCount++;
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (argc-optind < 2 || argc-optind-1 > MAX_IMAGES) {
+		usage();
+		return 2;
+	}
+	output = argv[optind++];
+	imagesCount = argc-optind;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.version = PACK_VERSION;
+	header.pixelFormat = PACK_FORMAT;
+	header.entryCount = imagesCount*sizesCount;
+	offset = (sizeof(header)+header.entryCount*sizeof(pack_entry)+PACK_ALIGN-1)/PACK_ALIGN*PACK_ALIGN;
+
+	for (unsigned season = 0; season < imagesCount; season++) {
+		const char *fname = argv[optind+season];
+		SDL_Surface *img, *converted;
+		if ((img = IMG_Load(fname)) == NULL) {
+			fprintf(stderr, "failed to process image %s: %s\n", fname, SDL_GetError());
+			return 1;
+		}
+		if (img->w != SIMG_WIDTH || img->h != SIMG_HEIGTH+1 || img->format->BytesPerPixel != 4) {
+			fprintf(stderr, "%s: image has to be %dx%dx32 sized (is %dx%dx%d)\n", fname, SIMG_WIDTH, SIMG_HEIGTH+1, img->w, img->h, img->format->BytesPerPixel*8);
+			return 1;
+		}
+		if ((converted = SDL_ConvertSurfaceFormat(img, PACK_FORMAT, 0)) == NULL) {
+			fprintf(stderr, "%s: failed to convert image: %s\n", fname, SDL_GetError());
+			return 1;
+		}
+		SDL_FreeSurface(img);
+		icons[season] = converted;
+
+		for (unsigned si = 0; si < sizesCount; si++) {
+			pack_entry *entry = &entries[season*sizesCount+si];
+			memset(entry, 0, sizeof(*entry));
+			entry->season = season;
+			entry->tileWidth = entry->tileHeight = sizes[si];
+			entry->width = SIMG_WIDTH*sizes[si]/GRECT_XSIZE;
+			entry->height = SIMG_HEIGTH*sizes[si]/GRECT_YSIZE;
+			entry->pitch = (entry->width*4+PACK_ALIGN-1)/PACK_ALIGN*PACK_ALIGN;
+			entry->offset = offset;
+			for (unsigned i = 0; i < PACK_COLORS; i++)
+				entry->colors[i] = *(Uint32 *)((char *)converted->pixels+SIMG_HEIGTH*converted->pitch+i*4)|0xff000000;
+			offset += ((uint64_t)entry->pitch*entry->height+PACK_ALIGN-1)/PACK_ALIGN*PACK_ALIGN;
+		}
+	}
+
+	if ((fo = fopen(output, "wb")) == NULL) {
+		fprintf(stderr, "failed to open %s: %s\n", output, strerror(errno));
+		return 1;
+	}
+	if (fwrite(&header, sizeof(header), 1, fo) != 1 || fwrite(entries, sizeof(pack_entry), header.entryCount, fo) != header.entryCount)
+		goto werr;
+	if (writePadding(fo, sizeof(header)+header.entryCount*sizeof(pack_entry)) < 0)
+		goto werr;
+	for (unsigned i = 0; i < header.entryCount; i++) {
+		pack_entry *entry = &entries[i];
+		SDL_Surface *src = icons[entry->season];
+		SDL_Surface *onlyIcons, *scaled;
+		onlyIcons = SDL_CreateRGBSurfaceWithFormatFrom(src->pixels, src->w, SIMG_HEIGTH, 32, src->pitch, PACK_FORMAT);
+		scaled = SDL_CreateRGBSurfaceWithFormat(0, entry->width, entry->height, 32, PACK_FORMAT);
+		if (!onlyIcons || !scaled) {
+			fprintf(stderr, "cannot create surfaces: %s\n", SDL_GetError());
+			return 1;
+		}
+		SDL_SetSurfaceBlendMode(onlyIcons, SDL_BLENDMODE_NONE);
+		if (SDL_BlitScaled(onlyIcons, NULL, scaled, NULL) < 0) {
+			fprintf(stderr, "cannot scale image: %s\n", SDL_GetError());
+			return 1;
+		}
+		// rows padded to aligned pitch, so every entry stays aligned too
+		for (unsigned y = 0; y < entry->height; y++) {
+			if (fwrite((char *)scaled->pixels+y*scaled->pitch, 4, entry->width, fo) != entry->width)
+				goto werr;
+			if (writePadding(fo, entry->width*4) < 0)
+				goto werr;
+		}
+		SDL_FreeSurface(scaled);
+		SDL_FreeSurface(onlyIcons);
+	}
+	if (fclose(fo) != 0) {
+		fo = NULL;
+		goto werr;
+	}
+	for (unsigned season = 0; season < imagesCount; season++)
+		SDL_FreeSurface(icons[season]);
+	return 0;
+
+werr:
+	fprintf(stderr, "failed to write %s: %s\n", output, strerror(errno));
+	if (fo)
+		fclose(fo);
+	remove(output);
+	return 1;
+}
@@ -0,0 +1,206 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Hardware performance counters for instrumentation
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <chrono>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# define PERF_COUNTERS_LINUX
+#endif
+
+#include "cz/znj/sw/wormik/perf_counters.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+static const char *const event_names[PC_COUNT] = {
+	"cycles", "instructions", "branch misses", "cache misses",
+};
+
+#ifdef PERF_COUNTERS_LINUX
+static const uint64_t event_configs[PC_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_BRANCH_MISSES,
+	PERF_COUNT_HW_CACHE_MISSES,
+};
+#endif
+
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+PerfCounters::PerfCounters()
+{
+	enabled = false;
+	for (int i = 0; i < PC_COUNT; i++) {
+		fds[i] = -1;
+		positions[i] = -1;
+	}
+	eventsCount = 0;
+	sitesCount = 0;
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+int PerfCounters::open()
+{
+	close();
+	enabled = true;
+#ifdef PERF_COUNTERS_LINUX
+	int err = ENOENT;
+	int leader = -1;
+	// single group is scheduled together and read by one call, the first event available leads it
+	for (int i = 0; i < PC_COUNT; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = event_configs[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP|PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+		if ((fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC)) < 0) {
+			err = errno;
+			fds[i] = -1;
+			continue;
+		}
+		if (leader < 0)
+			leader = fds[i];
+		positions[i] = eventsCount++;
+	}
+	if (eventsCount == 0) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void PerfCounters::close()
+{
+#ifdef PERF_COUNTERS_LINUX
+	// members first, leader last
+	for (int i = PC_COUNT-1; i >= 0; i--) {
+		if (fds[i] >= 0)
+			::close(fds[i]);
+		fds[i] = -1;
+		positions[i] = -1;
+	}
+#endif
+	eventsCount = 0;
+	enabled = false;
+}
+
+int PerfCounters::addSite(const char *name)
+{
+	perf_site *site;
+	if (sitesCount == PERF_MAX_SITES)
+		return -1;
+	site = &sites[sitesCount];
+	memset(site, 0, sizeof(*site));
+	site->name = name;
+	return sitesCount++;
+}
+
+void PerfCounters::read(perf_sample *sample)
+{
+	memset(sample->values, 0, sizeof(sample->values));
+	sample->enabled = 0;
+	sample->running = 0;
+#ifdef PERF_COUNTERS_LINUX
+	if (eventsCount != 0) {
+		uint64_t buf[3+PC_COUNT];
+		int leader = -1;
+		for (int i = 0; i < PC_COUNT && leader < 0; i++)
+			leader = fds[i];
+		// nr, time enabled, time running, values in order of opening
+		if (::read(leader, buf, sizeof(buf)) < (ssize_t)((3+eventsCount)*sizeof(uint64_t)))
+			return;
+		sample->enabled = buf[1];
+		sample->running = buf[2];
+		for (int i = 0; i < PC_COUNT; i++) {
+			if (positions[i] >= 0)
+				sample->values[i] = buf[3+positions[i]];
+		}
+	}
+#endif
+}
+
+void PerfCounters::begin(perf_sample *sample)
+{
+	sample->time = getTime();
+	read(sample);
+}
+
+void PerfCounters::end(int site, const perf_sample *sample)
+{
+	perf_sample now;
+	perf_site *s = &sites[site];
+
+	read(&now);
+	now.time = getTime();
+	s->calls++;
+	s->time += now.time-sample->time;
+	s->enabled += now.enabled-sample->enabled;
+	s->running += now.running-sample->running;
+	for (int i = 0; i < PC_COUNT; i++)
+		s->values[i] += now.values[i]-sample->values[i];
+}
+
+int PerfCounters::format(int site, char *buf, size_t blen) const
+{
+	const perf_site *s = &sites[site];
+	double values[PC_COUNT];
+	double scale;
+	size_t len;
+
+	len = snprintf(buf, blen, "%s: %lu calls, %.2f us", s->name, s->calls, s->calls == 0 ? 0 : s->time*1000000/s->calls);
+	if (eventsCount == 0) {
+		len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", no hardware counters");
+		return len;
+	}
+	if (s->calls == 0 || s->running == 0)
+		return len;
+	// group shared the counters with other events for part of the time, extrapolate
+	scale = (double)s->enabled/s->running;
+	for (int i = 0; i < PC_COUNT; i++) {
+		values[i] = s->values[i]*scale;
+		if (positions[i] >= 0)
+			len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", %.1f %s", values[i]/s->calls, event_names[i]);
+	}
+	if (positions[PC_CYCLES] >= 0 && positions[PC_INSTRUCTIONS] >= 0 && values[PC_CYCLES] != 0)
+		len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", IPC %.2f", values[PC_INSTRUCTIONS]/values[PC_CYCLES]);
+	if (positions[PC_INSTRUCTIONS] >= 0 && values[PC_INSTRUCTIONS] != 0) {
+		for (int i = PC_BRANCH_MISSES; i <= PC_CACHE_MISSES; i++) {
+			if (positions[i] >= 0)
+				len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", %.2f %s per 1000 instructions", values[i]*1000/values[PC_INSTRUCTIONS], event_names[i]);
+		}
+	}
+	if (s->running < s->enabled)
+		len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, " (scaled, counted %.0f%% of time)", (double)s->running*100/s->enabled);
+	return len;
+}
+
+
+} } } };
@@ -0,0 +1,132 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Hardware performance counters for instrumentation
+ */
+
+#ifndef perf_counters_hxx__
+# define perf_counters_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/* counted events */
+enum {
+	PC_CYCLES,
+	PC_INSTRUCTIONS,
+	PC_BRANCH_MISSES,
+	PC_CACHE_MISSES,				/**< last level cache */
+	PC_COUNT,
+};
+
+enum {
+	PERF_MAX_SITES		= 8,
+};
+
+/** counter values at start of measured block */
+struct perf_sample
+{
+	uint64_t			values[PC_COUNT];
+	uint64_t			enabled;		/**< time the group was enabled, ns */
+	uint64_t			running;		/**< time the group was counting, ns */
+	double				time;			/**< wall time, seconds */
+};
+
+/** totals of measured call site */
+struct perf_site
+{
+	const char *			name;
+	unsigned long			calls;
+	uint64_t			values[PC_COUNT];
+	uint64_t			enabled;
+	uint64_t			running;
+	double				time;
+};
+
+/**
+ * Counts cycles, instructions, branch and cache misses of the calling thread
+ * (Linux perf_event_open, user space only) for blocks of code, summed per
+ * call site. Blocks may nest, the outer ones include the inner ones. Events
+ * the CPU or kernel does not provide are left out, without any of them the
+ * sites still count calls and wall time. Not synchronized, used by the thread
+ * which opened it.
+ */
+class PerfCounters
+{
+protected:
+	bool				enabled;		/**< open was called */
+	int				fds[PC_COUNT];		/**< event files, -1 if not available */
+	int				positions[PC_COUNT];	/**< index in group read, -1 if not available */
+	unsigned			eventsCount;		/**< opened events */
+	perf_site			sites[PERF_MAX_SITES];
+	unsigned			sitesCount;
+
+public:
+	/* constructor */		PerfCounters();
+	/* destructor */		~PerfCounters();
+
+public:
+	/**
+	 * opens counters for calling thread
+	 *
+	 * @return
+	 * 	negative if no hardware event is available (errno set), sites are
+	 * 	enabled anyway
+	 */
+	int				open();
+	void				close();
+	bool				isOpen() const;
+	/** returns whether event is counted */
+	bool				hasEvent(int event) const;
+
+	/** registers call site, returns its index, -1 if there are too many */
+	int				addSite(const char *name);
+	unsigned			getSitesCount() const;
+	const perf_site *		getSite(int site) const;
+
+	/** starts measured block */
+	void				begin(perf_sample *sample);
+	/** finishes block started by begin and adds it to site */
+	void				end(int site, const perf_sample *sample);
+
+	/**
+	 * formats per call averages and derived ratios of site into buffer
+	 *
+	 * @return
+	 * 	full string length (as snprintf)
+	 */
+	int				format(int site, char *buf, size_t blen) const;
+
+protected:
+	/** reads current values */
+	void				read(perf_sample *sample);
+};
+
+inline bool PerfCounters::isOpen() const
+{
+	return enabled;
+}
+
+inline bool PerfCounters::hasEvent(int event) const
+{
+	return positions[event] >= 0;
+}
+
+inline unsigned PerfCounters::getSitesCount() const
+{
+	return sitesCount;
+}
+
+inline const perf_site *PerfCounters::getSite(int site) const
+{
+	return &sites[site];
+}
+
+
+} } } };
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * live export probe, measures state reads and command round trips
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/live_export.hxx"
+
+using namespace cz::znj::sw::wormik;
+
+
+enum {
+	MAX_SAMPLES		= 1000000,
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik-probe [-n count] [name]\n"
+		"  -n count        number of command round trips to measure (default 10000)\n"
+		"  name            shared memory name set by liveexport option (default /wormik)\n");
+}
+
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printLatencies(const char *what, double *samples, unsigned count)
+{
+	std::sort(samples, samples+count);
+	printf("%s: %u samples, min %.2f us, median %.2f us, 99%% %.2f us, max %.2f us\n", what, count,
+		samples[0]*1e6, samples[count/2]*1e6, samples[count*99/100]*1e6, samples[count-1]*1e6);
+}
+
+int main(int argc, char **argv)
+{
+#if (defined _WIN32) || (defined _WIN64)
+	fprintf(stderr, "live export is not supported on this platform\n");
+	return 1;
+#else
+	const char *name = "/wormik";
+	unsigned count = 10000;
+	int fd;
+	struct stat st;
+	live_segment *segment;
+	live_state state;
+	double *samples;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			if (count == 0 || count > MAX_SAMPLES) {
+				usage();
+				return 2;
+			}
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind < argc)
+		name = argv[optind++];
+	if (optind != argc) {
+		usage();
+		return 2;
+	}
+
+	if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+		fprintf(stderr, "failed to open %s, is the game running with -o liveexport=%s? %s\n", name, name, strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(live_segment) || (segment = (live_segment *)mmap(NULL, sizeof(live_segment), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "failed to map %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+	close(fd);
+	if (memcmp(segment->magic, LIVE_MAGIC, sizeof(segment->magic)) != 0 || segment->version != LIVE_VERSION || segment->size != sizeof(live_segment)) {
+		fprintf(stderr, "%s is not compatible live export segment\n", name);
+		return 1;
+	}
+	if ((samples = (double *)malloc(count*sizeof(double))) == NULL) {
+		fprintf(stderr, "failed to allocate samples\n");
+		return 1;
+	}
+
+	liveReadState(segment, &state);
+	printf("tick %u, state %d, level %d, score %d/%d (exit %d), health %d, length %d, head %u,%u\n",
+		state.tick, state.gameState, state.level, state.score, state.total, state.exit, state.health, state.length, state.headX, state.headY);
+
+	for (unsigned i = 0; i < count; i++) {
+		double start = getTime();
+		liveReadState(segment, &state);
+		samples[i] = getTime()-start;
+	}
+	printLatencies("state read", samples, count);
+
+	// pings are only acknowledged, the snake is not steered
+	uint32_t id = segment->commandAck.load(std::memory_order_acquire);
+	for (unsigned i = 0; i < count; i++) {
+		double start;
+		if (++id == 0)
+			id = 1;
+		start = getTime();
+		while (!liveSubmitCommand(segment, id, LIVE_CMD_PING)) {
+		}
+		while (segment->commandAck.load(std::memory_order_acquire) != id) {
+			if (getTime()-start > 1.0) {
+				fprintf(stderr, "game does not consume commands\n");
+				return 1;
+			}
+		}
+		samples[i] = getTime()-start;
+	}
+	printLatencies("command round trip", samples, count);
+
+	free(samples);
+	munmap(segment, sizeof(live_segment));
+	return 0;
+#endif
+}
@@ -0,0 +1,491 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Game replay recording
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/replay.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+enum {
+	RECORD_ALIGN		= 8,			/**< keyframe state is padded to this */
+};
+
+static inline size_t alignRecord(size_t size)
+{
+	return (size+RECORD_ALIGN-1)&~(size_t)(RECORD_ALIGN-1);
+}
+
+ReplayWriter::ReplayWriter()
+{
+	fo = NULL;
+	offset = 0;
+	lastStep = 0;
+	index = NULL;
+	indexLength = 0;
+	indexCapacity = 0;
+
+	static_assert(sizeof(replay_header)%RECORD_ALIGN == 0 && sizeof(replay_event) == RECORD_ALIGN);
+}
+
+ReplayWriter::~ReplayWriter()
+{
+	close();
+}
+
+int ReplayWriter::open(const char *path, uint32_t seed)
+{
+	replay_header header;
+
+	close();
+	if ((fo = fopen(path, "wb")) == NULL)
+		return -1;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+	header.version = REPLAY_VERSION;
+	header.seed = seed;
+	if (fwrite(&header, sizeof(header), 1, fo) != 1) {
+		close();
+		return -1;
+	}
+	offset = sizeof(header);
+	lastStep = 0;
+	return 0;
+}
+
+int ReplayWriter::close()
+{
+	int err = 0;
+	if (fo) {
+		replay_trailer trailer;
+		memset(&trailer, 0, sizeof(trailer));
+		memcpy(trailer.magic, REPLAY_INDEX_MAGIC, sizeof(trailer.magic));
+		trailer.indexOffset = offset;
+		trailer.count = indexLength;
+		trailer.lastStep = lastStep;
+		write(index, indexLength*sizeof(replay_index_entry));
+		write(&trailer, sizeof(trailer));
+		if (ferror(fo) || fclose(fo) != 0)
+			err = -1;
+		fo = NULL;
+	}
+	free(index);
+	index = NULL;
+	indexLength = 0;
+	indexCapacity = 0;
+	return err;
+}
+
+void ReplayWriter::write(const void *data, size_t size)
+{
+	// errors are reported by close
+	fwrite(data, 1, size, fo);
+	offset += size;
+}
+
+void ReplayWriter::addEvent(uint32_t step, int type, uint32_t value)
+{
+	replay_event event;
+	if (fo == NULL)
+		return;
+	memset(&event, 0, sizeof(event));
+	event.step = step;
+	event.type = type;
+	event.value = value;
+	event.extra = value>>8;
+	// flushed right away, so killed game still leaves usable replay
+	write(&event, sizeof(event));
+	fflush(fo);
+	lastStep = step;
+}
+
+void ReplayWriter::addKeyframe(uint32_t step, const void *state, size_t size)
+{
+	static const char padding[RECORD_ALIGN] = { 0 };
+	if (fo == NULL || size == 0)
+		return;
+	if (indexLength == indexCapacity) {
+		size_t capacity = indexCapacity ? 2*indexCapacity : 64;
+		replay_index_entry *n = (replay_index_entry *)realloc(index, capacity*sizeof(replay_index_entry));
+		// replay stays playable without index, keyframe is just not indexed
+		if (n != NULL) {
+			index = n;
+			indexCapacity = capacity;
+		}
+	}
+	if (indexLength < indexCapacity) {
+		index[indexLength].step = step;
+		index[indexLength].size = size;
+		index[indexLength].offset = offset;
+		indexLength++;
+	}
+	// reader drops keyframe cut by killed game
+	addEvent(step, RE_KEYFRAME, size);
+	write(state, size);
+	write(padding, alignRecord(size)-size);
+	fflush(fo);
+}
+
+ReplayReader::ReplayReader()
+{
+	memset(&header, 0, sizeof(header));
+	data = NULL;
+	eventsEnd = 0;
+	position = 0;
+	lastStep = 0;
+	index = NULL;
+	indexLength = 0;
+}
+
+ReplayReader::~ReplayReader()
+{
+	close();
+}
+
+int ReplayReader::open(const char *path)
+{
+	FILE *fi;
+	long length;
+
+	close();
+	if ((fi = fopen(path, "rb")) == NULL)
+		return -1;
+	if (fseek(fi, 0, SEEK_END) < 0 || (length = ftell(fi)) < 0 || fseek(fi, 0, SEEK_SET) < 0)
+		goto err;
+	if ((data = (unsigned char *)malloc(length+1)) == NULL)
+		goto err;
+	if (fread(data, 1, length, fi) != (size_t)length || (size_t)length < sizeof(header))
+		goto invalid;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 || header.version != REPLAY_VERSION)
+		goto invalid;
+	if (!readIndex(length) && scanIndex(length) < 0)
+		goto err;
+	position = sizeof(header);
+	fclose(fi);
+	return 0;
+
+invalid:
+	errno = EINVAL;
+err:
+	fclose(fi);
+	close();
+	return -1;
+}
+
+void ReplayReader::close()
+{
+	free(data);
+	data = NULL;
+	free(index);
+	index = NULL;
+	indexLength = 0;
+	eventsEnd = 0;
+	position = 0;
+	lastStep = 0;
+}
+
+size_t ReplayReader::recordSize(const replay_event *event)
+{
+	return sizeof(replay_event)+(event->type == RE_KEYFRAME ? alignRecord(replayEventValue(event)) : 0);
+}
+
+bool ReplayReader::readIndex(size_t length)
+{
+	replay_trailer trailer;
+	size_t indexOffset;
+
+	if (length < sizeof(header)+sizeof(trailer))
+		return false;
+	memcpy(&trailer, data+length-sizeof(trailer), sizeof(trailer));
+	if (memcmp(trailer.magic, REPLAY_INDEX_MAGIC, sizeof(trailer.magic)) != 0 || trailer.indexOffset < sizeof(header) || trailer.indexOffset > length-sizeof(trailer) ||
+			length-sizeof(trailer)-trailer.indexOffset != (uint64_t)trailer.count*sizeof(replay_index_entry))
+		return false;
+	indexOffset = trailer.indexOffset;
+	if ((index = (replay_index_entry *)malloc(trailer.count*sizeof(replay_index_entry)+1)) == NULL)
+		return false;
+	memcpy(index, data+indexOffset, trailer.count*sizeof(replay_index_entry));
+	// entries must point to keyframe events, the rest is checked while reading events
+	for (size_t i = 0; i < trailer.count; i++) {
+		replay_event event;
+		if (index[i].offset < sizeof(header) || index[i].offset > indexOffset-sizeof(event) || index[i].offset%RECORD_ALIGN != 0 ||
+				(i > 0 && index[i].step < index[i-1].step))
+			goto invalid;
+		memcpy(&event, data+index[i].offset, sizeof(event));
+		if (event.type != RE_KEYFRAME || event.step != index[i].step || replayEventValue(&event) != index[i].size ||
+				index[i].offset+recordSize(&event) > indexOffset)
+			goto invalid;
+	}
+	indexLength = trailer.count;
+	eventsEnd = indexOffset;
+	lastStep = trailer.lastStep;
+	return true;
+
+invalid:
+	free(index);
+	index = NULL;
+	return false;
+}
+
+int ReplayReader::scanIndex(size_t length)
+{
+	size_t capacity = 0;
+	size_t offset;
+
+	// events of killed game end at the last complete one
+	for (offset = sizeof(header); offset+sizeof(replay_event) <= length; ) {
+		const replay_event *event = (const replay_event *)(data+offset);
+		size_t size = recordSize(event);
+		if (offset+size > length)
+			break;
+		if (offset > sizeof(header) && event->step < lastStep) {
+			errno = EINVAL;
+			return -1;
+		}
+		lastStep = event->step;
+		if (event->type == RE_KEYFRAME) {
+			if (indexLength == capacity) {
+				replay_index_entry *n;
+				capacity = capacity ? 2*capacity : 64;
+				if ((n = (replay_index_entry *)realloc(index, capacity*sizeof(replay_index_entry))) == NULL)
+					return -1;
+				index = n;
+			}
+			index[indexLength].step = event->step;
+			index[indexLength].size = replayEventValue(event);
+			index[indexLength].offset = offset;
+			indexLength++;
+		}
+		offset += size;
+	}
+	eventsEnd = offset;
+	return 0;
+}
+
+const replay_event *ReplayReader::next(uint32_t step)
+{
+	while (position+sizeof(replay_event) <= eventsEnd) {
+		const replay_event *event = (const replay_event *)(data+position);
+		if (event->step > step)
+			return NULL;
+		position += recordSize(event);
+		if (event->type != RE_KEYFRAME)
+			return event;
+	}
+	position = eventsEnd;
+	return NULL;
+}
+
+const replay_index_entry *ReplayReader::findKeyframe(uint32_t step) const
+{
+	size_t low = 0, high = indexLength;
+	// the first entry after the step
+	while (low < high) {
+		size_t mid = (low+high)/2;
+		if (index[mid].step <= step)
+			low = mid+1;
+		else
+			high = mid;
+	}
+	return low > 0 ? &index[low-1] : NULL;
+}
+
+const void *ReplayReader::seekKeyframe(const replay_index_entry *keyframe)
+{
+	const replay_event *event = (const replay_event *)(data+keyframe->offset);
+	position = keyframe->offset+recordSize(event);
+	return event+1;
+}
+
+ReplayPlayer::ReplayPlayer()
+{
+	game = NULL;
+	step = 0;
+}
+
+int ReplayPlayer::open(WormikGame *game_, const char *path)
+{
+	char buf[64];
+	game = game_;
+	step = 0;
+	if (reader.open(path) < 0)
+		return -1;
+	// the game must generate the same boards as when recorded
+	snprintf(buf, sizeof(buf), "%d", (int)reader.getSeed());
+	game->overrideConfig("seed", buf);
+	// played game shall not touch player's record
+	if ((unsigned)game->getConfigStr("record", buf, sizeof(buf)) >= sizeof(buf))
+		strcpy(buf, "0/0");
+	game->overrideConfig("record", buf);
+	// nor append its levels to analytics again
+	game->overrideConfig("analytics", "");
+	return 0;
+}
+
+void ReplayPlayer::close()
+{
+	reader.close();
+}
+
+bool ReplayPlayer::finishWait()
+{
+	const replay_event *event;
+	bool quit = false;
+	while ((event = reader.next(step)) != NULL) {
+		switch (event->type) {
+		case RE_DIRECTION:
+			game->changeDirection(event->value);
+			break;
+
+		case RE_QUIT:
+			quit = true;
+			break;
+
+		case RE_CHECKSUM:
+			if ((game->getStateHash()&0xffffff) != replayEventValue(event)) {
+				game->error("Replay diverged at step %u, it was recorded by different game version\n", step);
+				quit = true;
+			}
+			break;
+		}
+	}
+	step++;
+	return quit;
+}
+
+int ReplayPlayer::seek(uint32_t target)
+{
+	const replay_index_entry *keyframe;
+
+	if (target > reader.getLastStep())
+		target = reader.getLastStep();
+	keyframe = reader.findKeyframe(target);
+	// simulating forward is cheaper unless keyframe is closer
+	if (target < step || (keyframe != NULL && target-keyframe->step < target-step)) {
+		if (keyframe == NULL || game->restoreState(reader.seekKeyframe(keyframe), keyframe->size) < 0) {
+			game->error("Replay has no valid keyframe before step %u\n", target);
+			return -1;
+		}
+		step = keyframe->step;
+	}
+	while (step < target) {
+		if (finishWait())
+			return -1;
+		game->skipWait();
+	}
+	return 0;
+}
+
+
+FlightRecorder::FlightRecorder()
+{
+	keyframes = NULL;
+	keyframesCount = 0;
+	eventsCount = 0;
+	eventsLost = false;
+	lostStep = 0;
+}
+
+FlightRecorder::~FlightRecorder()
+{
+	close();
+}
+
+int FlightRecorder::open()
+{
+	close();
+	if ((keyframes = (flight_keyframe *)malloc((FLIGHT_KEYFRAMES+1)*sizeof(*keyframes))) == NULL)
+		return -1;
+	keyframesCount = 0;
+	eventsCount = 0;
+	eventsLost = false;
+	return 0;
+}
+
+void FlightRecorder::close()
+{
+	free(keyframes);
+	keyframes = NULL;
+}
+
+void *FlightRecorder::keyframeBuffer(size_t *size)
+{
+	*size = sizeof(keyframes->state);
+	return keyframes[keyframesCount%FLIGHT_KEYFRAMES].state;
+}
+
+void FlightRecorder::commitKeyframe(uint32_t step, size_t size)
+{
+	flight_keyframe *keyframe = &keyframes[keyframesCount%FLIGHT_KEYFRAMES];
+	keyframe->step = step;
+	keyframe->size = size;
+	keyframesCount++;
+}
+
+void FlightRecorder::addEvent(uint32_t step, int type, uint32_t value)
+{
+	replay_event *event = &events[eventsCount%FLIGHT_EVENTS];
+	if (eventsCount >= FLIGHT_EVENTS) {
+		eventsLost = true;
+		lostStep = event->step;
+	}
+	event->step = step;
+	event->type = type;
+	event->value = value;
+	event->extra = value>>8;
+	eventsCount++;
+}
+
+int64_t FlightRecorder::findKeyframe(uint32_t step, const void **state, size_t *size) const
+{
+	const flight_keyframe *best = NULL;
+	uint32_t count = keyframesCount < FLIGHT_KEYFRAMES ? keyframesCount : FLIGHT_KEYFRAMES;
+
+	for (uint32_t i = keyframesCount-count; i < keyframesCount; i++) {
+		const flight_keyframe *keyframe = &keyframes[i%FLIGHT_KEYFRAMES];
+		// inputs of the waits from lost event on are incomplete
+		if (keyframe->size == 0 || (eventsLost && keyframe->step <= lostStep))
+			continue;
+		// slots go from the oldest one
+		if (best == NULL || keyframe->step <= step)
+			best = keyframe;
+	}
+	if (best == NULL)
+		return -1;
+	*state = best->state;
+	*size = best->size;
+	return best->step;
+}
+
+uint32_t FlightRecorder::findEvent(uint32_t step) const
+{
+	uint32_t index = eventsCount < FLIGHT_EVENTS ? 0 : eventsCount-FLIGHT_EVENTS;
+	while (index < eventsCount && events[index%FLIGHT_EVENTS].step < step)
+		index++;
+	return index;
+}
+
+const replay_event *FlightRecorder::getEvent(uint32_t index) const
+{
+	if (index >= eventsCount || eventsCount-index > FLIGHT_EVENTS)
+		return NULL;
+	return &events[index%FLIGHT_EVENTS];
+}
+
+void *FlightRecorder::spareBuffer(size_t *size)
+{
+	*size = sizeof(keyframes->state);
+	return keyframes[FLIGHT_KEYFRAMES].state;
+}
+
+} } } };
@@ -0,0 +1,318 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Game replay recording
+ */
+
+#ifndef replay_hxx__
+# define replay_hxx__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Replay file layout (native byte order):
+ *	replay_header
+ *	replay_event[], ordered by step, RE_KEYFRAME ones followed by state
+ *	replay_index_entry[], one for every keyframe
+ *	replay_trailer
+ *
+ * Game is fully determined by random seed and inputs, so only these are
+ * stored. Step counts finished GUI waits (waitStart, waitNext, announce),
+ * each event happened during the wait with its step number. Checksums of
+ * state hash every REPLAY_CHECKSUM_INTERVAL waits let player notice
+ * divergence right where it happens.
+ *
+ * Every REPLAY_KEYFRAME_INTERVAL waits and at start of every level, full
+ * game state (saveState) at the start of the wait is stored too, so player
+ * seeks by restoring the nearest preceding keyframe and simulating the rest
+ * without gui. Index and trailer
+ * are appended on close; replay of killed game lacks them and its keyframes
+ * are found by reading all events.
+ */
+enum {
+	REPLAY_VERSION		= 4,			/**< 2: game uses own random generator instead of rand(), 3: integer game time, 4: keyframes and index */
+};
+
+enum {
+	RE_DIRECTION		= 1,			/**< direction changed, value is SDIR_* */
+	RE_QUIT			= 2,			/**< user quit the game */
+	RE_CHECKSUM		= 3,			/**< low 24 bits of game state hash after the wait, value and extra */
+	RE_KEYFRAME		= 4,			/**< game state at start of the wait follows, value and extra are its size, padded to 8 bytes */
+};
+
+enum {
+	REPLAY_CHECKSUM_INTERVAL = 32,			/**< waits between checksum events */
+	REPLAY_KEYFRAME_INTERVAL = 256,			/**< waits between keyframes, seeking simulates at most that many */
+};
+
+#define REPLAY_MAGIC "WRMKRPL\n"
+#define REPLAY_INDEX_MAGIC "WRMKIDX\n"
+
+struct replay_header
+{
+	char				magic[8];		/**< REPLAY_MAGIC */
+	uint32_t			version;		/**< REPLAY_VERSION */
+	uint32_t			seed;			/**< random seed of the game */
+	uint32_t			reserved[2];
+};
+
+struct replay_event
+{
+	uint32_t			step;			/**< wait during which the event happened */
+	uint8_t				type;			/**< RE_* */
+	uint8_t				value;			/**< type specific value */
+	uint16_t			extra;			/**< type specific value, higher bits */
+};
+
+struct replay_index_entry
+{
+	uint32_t			step;			/**< step of keyframe */
+	uint32_t			size;			/**< state size */
+	uint64_t			offset;			/**< file offset of keyframe event */
+};
+
+struct replay_trailer
+{
+	char				magic[8];		/**< REPLAY_INDEX_MAGIC */
+	uint64_t			indexOffset;		/**< file offset of index */
+	uint32_t			count;			/**< number of index entries */
+	uint32_t			lastStep;		/**< step of the last event */
+};
+
+/** returns whole value of event, stored in value and extra */
+inline uint32_t replayEventValue(const replay_event *event)
+{
+	return event->value|(uint32_t)event->extra<<8;
+}
+
+
+/**
+ * Appends events of running game to replay file.
+ */
+class ReplayWriter
+{
+protected:
+	FILE *				fo;			/**< replay file */
+	uint64_t			offset;			/**< bytes written */
+	uint32_t			lastStep;		/**< step of the last event */
+
+	replay_index_entry *		index;			/**< keyframes written so far */
+	size_t				indexLength;
+	size_t				indexCapacity;
+
+public:
+	/* constructor */		ReplayWriter();
+	/* destructor */		~ReplayWriter();
+
+public:
+	/** creates replay file, returns negative on error */
+	int				open(const char *path, uint32_t seed);
+	/** writes index, flushes and closes, returns negative on write error */
+	int				close();
+
+	bool				isOpen() const;
+	/** adds event, value bits above 8 go to extra */
+	void				addEvent(uint32_t step, int type, uint32_t value);
+	/** adds keyframe event with game state */
+	void				addKeyframe(uint32_t step, const void *state, size_t size);
+
+protected:
+	void				write(const void *data, size_t size);
+};
+
+/**
+ * Reads whole replay to memory and returns its events step by step.
+ */
+class ReplayReader
+{
+protected:
+	replay_header			header;			/**< replay header */
+	unsigned char *			data;			/**< whole file */
+	size_t				eventsEnd;		/**< offset where events end */
+	size_t				position;		/**< offset of next event to return */
+	uint32_t			lastStep;		/**< step of the last event */
+
+	replay_index_entry *		index;			/**< all keyframes */
+	size_t				indexLength;
+
+public:
+	/* constructor */		ReplayReader();
+	/* destructor */		~ReplayReader();
+
+public:
+	/** reads and validates replay, returns negative on error */
+	int				open(const char *path);
+	void				close();
+
+	uint32_t			getSeed() const;
+	uint32_t			getLastStep() const;
+	/** returns next event of the step, NULL if there is no more, keyframes are skipped */
+	const replay_event *		next(uint32_t step);
+	/** returns true if all events were returned */
+	bool				isFinished() const;
+
+	/** returns the last keyframe at or before the step, NULL if there is none */
+	const replay_index_entry *	findKeyframe(uint32_t step) const;
+	/** returns state of the keyframe and continues with events after it */
+	const void *			seekKeyframe(const replay_index_entry *keyframe);
+
+protected:
+	/** returns size of event record including keyframe state */
+	static size_t			recordSize(const replay_event *event);
+	/** takes index from trailer, returns false if there is no valid one */
+	bool				readIndex(size_t length);
+	/** builds index by reading all events, returns negative on error */
+	int				scanIndex(size_t length);
+};
+
+/**
+ * Plays replay into game: applies recorded inputs as gui waits finish and
+ * seeks by restoring keyframes.
+ */
+class ReplayPlayer
+{
+protected:
+	WormikGame *			game;			/**< played game */
+	ReplayReader			reader;			/**< replay events */
+	uint32_t			step;			/**< wait in progress */
+
+public:
+	/* constructor */		ReplayPlayer();
+
+public:
+	/** reads replay and overrides game config to play it, returns negative on error */
+	int				open(WormikGame *game, const char *path);
+	void				close();
+
+	/** applies events of finished wait, returns true to quit */
+	bool				finishWait();
+	/**
+	 * moves game into the target wait, before its events, the gui wait in
+	 * progress shall finish right away, returns negative on error
+	 */
+	int				seek(uint32_t target);
+
+	uint32_t			getStep() const;
+	/** returns step of the last recorded wait */
+	uint32_t			getLastStep() const;
+	/** returns true if all events were applied */
+	bool				isFinished() const;
+};
+
+/*
+ * Flight recorder keeps the recent waits of running game in memory, for
+ * instant replay without any replay file: keyframes every
+ * FLIGHT_KEYFRAME_INTERVAL waits and at start of every level go to
+ * FLIGHT_KEYFRAMES slots, inputs to ring of FLIGHT_EVENTS events, the
+ * oldest ones are overwritten. Memory is allocated once by open, so it
+ * stays the same in sessions of any length and recording never allocates.
+ */
+enum {
+	FLIGHT_KEYFRAME_INTERVAL = 16,			/**< waits between keyframes */
+	FLIGHT_KEYFRAMES	= 4,			/**< keyframe slots, at least (FLIGHT_KEYFRAMES-1)*FLIGHT_KEYFRAME_INTERVAL waits are kept */
+	FLIGHT_EVENTS		= 256,			/**< input events kept, power of two */
+	FLIGHT_STATE_SIZE	= 4096,			/**< maximum saveState size kept */
+};
+
+static_assert(REPLAY_KEYFRAME_INTERVAL%FLIGHT_KEYFRAME_INTERVAL == 0, "replay keyframes are taken from flight recorder");
+
+class FlightRecorder
+{
+protected:
+	struct flight_keyframe
+	{
+		uint32_t			step;			/**< wait the state is at start of */
+		uint32_t			size;			/**< state size, 0 if it did not fit */
+		unsigned char			state[FLIGHT_STATE_SIZE];
+	};
+
+	flight_keyframe *		keyframes;		/**< FLIGHT_KEYFRAMES slots and one for caller's state */
+	uint32_t			keyframesCount;		/**< keyframes committed so far */
+	replay_event			events[FLIGHT_EVENTS];
+	uint32_t			eventsCount;		/**< events added so far */
+	bool				eventsLost;		/**< some events were overwritten */
+	uint32_t			lostStep;		/**< step of the last overwritten event */
+
+public:
+	/* constructor */		FlightRecorder();
+	/* destructor */		~FlightRecorder();
+
+public:
+	/** allocates keyframe slots, returns negative on error */
+	int				open();
+	void				close();
+	bool				isOpen() const;
+
+	/** returns slot for the next keyframe, saveState fills it and commitKeyframe stores it */
+	void *				keyframeBuffer(size_t *size);
+	/** stores keyframe of the step, size 0 marks it unusable */
+	void				commitKeyframe(uint32_t step, size_t size);
+	/** adds input event, overwriting the oldest one when full */
+	void				addEvent(uint32_t step, int type, uint32_t value);
+
+	/**
+	 * finds the newest keyframe at or before step with all following events
+	 * kept, or the oldest usable one if all are later, returns its step or
+	 * -1 if there is none
+	 */
+	int64_t				findKeyframe(uint32_t step, const void **state, size_t *size) const;
+	/** returns index of the first kept event at or after step */
+	uint32_t			findEvent(uint32_t step) const;
+	/** returns event by index, NULL if not kept or not added yet */
+	const replay_event *		getEvent(uint32_t index) const;
+	/** returns slot for state of caller, not used by recording */
+	void *				spareBuffer(size_t *size);
+};
+
+inline bool ReplayWriter::isOpen() const
+{
+	return fo != NULL;
+}
+
+inline uint32_t ReplayReader::getSeed() const
+{
+	return header.seed;
+}
+
+inline uint32_t ReplayReader::getLastStep() const
+{
+	return lastStep;
+}
+
+inline bool ReplayReader::isFinished() const
+{
+	return position >= eventsEnd;
+}
+
+inline bool FlightRecorder::isOpen() const
+{
+	return keyframes != NULL;
+}
+
+inline uint32_t ReplayPlayer::getStep() const
+{
+	return step;
+}
+
+inline uint32_t ReplayPlayer::getLastStep() const
+{
+	return reader.getLastStep();
+}
+
+inline bool ReplayPlayer::isFinished() const
+{
+	return reader.isFinished();
+}
+
+
+} } } };
+
+#endif
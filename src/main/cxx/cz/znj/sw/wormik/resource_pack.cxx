@@ -0,0 +1,133 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Pre-decoded resource pack
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+#include <sys/mman.h>
+#endif
+
+#include "cz/znj/sw/wormik/resource_pack.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+ResourcePack::ResourcePack()
+{
+	base = NULL;
+	length = 0;
+#if (defined _WIN32) || (defined _WIN64)
+	mapping = NULL;
+#endif
+}
+
+ResourcePack::~ResourcePack()
+{
+	close();
+}
+
+int ResourcePack::open(const char *path)
+{
+	close();
+#if (defined _WIN32) || (defined _WIN64)
+	HANDLE fh;
+	LARGE_INTEGER size;
+	if ((fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+		return -1;
+	if (!GetFileSizeEx(fh, &size) || (size_t)size.QuadPart < sizeof(pack_header)) {
+		CloseHandle(fh);
+		return -1;
+	}
+	length = (size_t)size.QuadPart;
+	// copy on write, surfaces created over mapping get non-const pixels
+	mapping = CreateFileMappingA(fh, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(fh);
+	if (mapping == NULL)
+		return -1;
+	if ((base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0)) == NULL) {
+		close();
+		return -1;
+	}
+#else
+	int fd;
+	struct stat st;
+	if ((fd = ::open(path, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(pack_header)) {
+		::close(fd);
+		return -1;
+	}
+	length = st.st_size;
+	// copy on write, surfaces created over mapping get non-const pixels
+	base = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (base == MAP_FAILED) {
+		base = NULL;
+		return -1;
+	}
+#endif
+	if (validate() < 0) {
+		close();
+		return -1;
+	}
+	return 0;
+}
+
+void ResourcePack::close()
+{
+#if (defined _WIN32) || (defined _WIN64)
+	if (base)
+		UnmapViewOfFile(base);
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+#else
+	if (base)
+		munmap(base, length);
+#endif
+	base = NULL;
+	length = 0;
+}
+
+int ResourcePack::validate() const
+{
+	const pack_header *header = getHeader();
+	if (memcmp(header->magic, PACK_MAGIC, sizeof(header->magic)) != 0 || header->version != PACK_VERSION)
+		return -1;
+	if (header->entryCount > (length-sizeof(pack_header))/sizeof(pack_entry))
+		return -1;
+	for (unsigned i = 0; i < header->entryCount; i++) {
+		const pack_entry *entry = &getEntries()[i];
+		if (entry->offset%PACK_ALIGN != 0 || entry->pitch < entry->width*4)
+			return -1;
+		if (entry->offset > length || (uint64_t)entry->pitch*entry->height > length-entry->offset)
+			return -1;
+	}
+	return 0;
+}
+
+const pack_entry *ResourcePack::find(unsigned season, unsigned tileWidth, unsigned tileHeight) const
+{
+	if (!base)
+		return NULL;
+	for (unsigned i = 0; i < getHeader()->entryCount; i++) {
+		const pack_entry *entry = &getEntries()[i];
+		if (entry->season == season && entry->tileWidth == tileWidth && entry->tileHeight == tileHeight)
+			return entry;
+	}
+	return NULL;
+}
+
+
+} } } };
@@ -0,0 +1,120 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Pre-decoded resource pack
+ */
+
+#ifndef resource_pack_hxx__
+# define resource_pack_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Pack file layout (native byte order, built on the target machine by
+ * wormik-pack):
+ *	pack_header
+ *	pack_entry[entryCount]
+ *	pixel data of entries, each aligned to PACK_ALIGN
+ *
+ * Each entry holds season tiles (without the palette row) decoded to
+ * pixelFormat and scaled to given tile size. Entry with base tile size
+ * is always present, others are optional pre-scaled variants.
+ */
+enum {
+	PACK_VERSION		= 1,
+	PACK_ALIGN		= 64,
+	PACK_COLORS		= 4,			/**< palette colors per season */
+};
+
+#define PACK_MAGIC "WRMKPAK\n"
+
+struct pack_header
+{
+	char				magic[8];		/**< PACK_MAGIC */
+	uint32_t			version;		/**< PACK_VERSION */
+	uint32_t			pixelFormat;		/**< SDL pixel format of all entries */
+	uint32_t			entryCount;		/**< number of entries */
+	uint32_t			reserved;
+};
+
+struct pack_entry
+{
+	uint32_t			season;			/**< season number */
+	uint32_t			tileWidth;		/**< tile size the image is scaled to */
+	uint32_t			tileHeight;
+	uint32_t			width;			/**< image size */
+	uint32_t			height;
+	uint32_t			pitch;			/**< bytes per image row */
+	uint64_t			offset;			/**< pixel data offset from start of file */
+	uint32_t			colors[PACK_COLORS];	/**< palette row as 0xAARRGGBB */
+};
+
+
+/**
+ * Read-only memory mapping of resource pack.
+ */
+class ResourcePack
+{
+protected:
+	void *				base;			/**< mapped file */
+	size_t				length;			/**< mapped length */
+#if (defined _WIN32) || (defined _WIN64)
+	void *				mapping;		/**< file mapping handle */
+#endif
+
+public:
+	/* constructor */		ResourcePack();
+	/* destructor */		~ResourcePack();
+
+public:
+	/** maps and validates the pack, returns negative on error */
+	int				open(const char *path);
+	void				close();
+
+	bool				isOpen() const;
+	uint32_t			getPixelFormat() const;
+	/** finds season image for tile size, returns NULL if not present */
+	const pack_entry *		find(unsigned season, unsigned tileWidth, unsigned tileHeight) const;
+	/** returns pixel data of the entry, directly from mapping */
+	void *				getPixels(const pack_entry *entry) const;
+
+protected:
+	const pack_header *		getHeader() const;
+	const pack_entry *		getEntries() const;
+	int				validate() const;
+};
+
+inline bool ResourcePack::isOpen() const
+{
+	return base != NULL;
+}
+
+inline const pack_header *ResourcePack::getHeader() const
+{
+	return (const pack_header *)base;
+}
+
+inline const pack_entry *ResourcePack::getEntries() const
+{
+	return (const pack_entry *)(getHeader()+1);
+}
+
+inline uint32_t ResourcePack::getPixelFormat() const
+{
+	return getHeader()->pixelFormat;
+}
+
+inline void *ResourcePack::getPixels(const pack_entry *entry) const
+{
+	return (char *)base+entry->offset;
+}
+
+
+} } } };
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Resource (font, images) file resolver
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/resource_resolver.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+enum {
+	RESOLVED_CACHE_SIZE	= 16,
+	SEARCH_MAX_DEPTH	= 8,		/**< limits symlink loops too */
+};
+
+typedef struct resolved_entry
+{
+	char				name[64];
+	char				path[PATH_MAX];
+} resolved_entry;
+
+static resolved_entry resolved_cache[RESOLVED_CACHE_SIZE];
+static unsigned resolved_next;
+
+static bool isRegularFile(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static bool searchTree(char *path, size_t plen, size_t dlen, const char *fname, unsigned depth)
+{
+	DIR *dir;
+	struct dirent *de;
+	bool found = false;
+
+	if ((dir = opendir(path)) == NULL)
+		return false;
+	// files in this directory first, subdirectories after
+	if (snprintf(path+dlen, plen-dlen, "/%s", fname) < (int)(plen-dlen) && isRegularFile(path)) {
+		closedir(dir);
+		return true;
+	}
+	path[dlen] = '\0';
+	while (!found && depth < SEARCH_MAX_DEPTH && (de = readdir(dir)) != NULL) {
+		struct stat st;
+		size_t nlen;
+		if (de->d_name[0] == '.')
+			continue;
+		if ((nlen = snprintf(path+dlen, plen-dlen, "/%s", de->d_name)) >= plen-dlen)
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (de->d_type != DT_DIR && de->d_type != DT_LNK && de->d_type != DT_UNKNOWN)
+			continue;
+#endif
+		if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+			continue;
+		found = searchTree(path, plen, dlen+nlen, fname, depth+1);
+	}
+	if (!found)
+		path[dlen] = '\0';
+	closedir(dir);
+	return found;
+}
+
+static const char *findCached(const char *fname)
+{
+	for (unsigned i = 0; i < RESOLVED_CACHE_SIZE; i++) {
+		if (strcmp(resolved_cache[i].name, fname) == 0)
+			return resolved_cache[i].path;
+	}
+	return NULL;
+}
+
+int resolveResource(char *path, size_t plen, const char *fname, ...)
+{
+	const char *kind;
+	const char *cached;
+	bool found = false;
+	va_list va;
+
+	if ((cached = findCached(fname)) != NULL) {
+		if (snprintf(path, plen, "%s", cached) >= (int)plen)
+			return -1;
+		return 0;
+	}
+
+	va_start(va, fname);
+	while (!found && (kind = va_arg(va, const char *))) {
+		const char *arg = va_arg(va, const char *);
+		switch (*kind) {
+		case 'd':
+			if (snprintf(path, plen, "%s/%s", arg, fname) >= (int)plen)
+				break;
+			found = isRegularFile(path);
+			break;
+
+		case 's':
+			if (snprintf(path, plen, "%s", arg) >= (int)plen)
+				break;
+			found = searchTree(path, plen, strlen(path), fname, 0);
+			break;
+
+		default:
+			assert(0);
+			break;
+		}
+	}
+	va_end(va);
+	if (!found)
+		return -1;
+
+	if (strlen(fname) < sizeof(resolved_cache[0].name) && strlen(path) < sizeof(resolved_cache[0].path)) {
+		resolved_entry *e = &resolved_cache[resolved_next++%RESOLVED_CACHE_SIZE];
+		strcpy(e->name, fname);
+		strcpy(e->path, path);
+	}
+	return 0;
+}
+
+void forgetResource(const char *fname)
+{
+	for (unsigned i = 0; i < RESOLVED_CACHE_SIZE; i++) {
+		if (strcmp(resolved_cache[i].name, fname) == 0)
+			resolved_cache[i].name[0] = '\0';
+	}
+}
+
+
+} } } };
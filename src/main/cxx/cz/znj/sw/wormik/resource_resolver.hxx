@@ -0,0 +1,34 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Resource (font, images) file resolver
+ */
+
+#ifndef resource_resolver_hxx__
+# define resource_resolver_hxx__
+
+#include <stddef.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * Resolves file name using list of (kind, argument) pairs terminated by
+ * NULL kind:
+ *	"d", dir	- file directly in dir
+ *	"s", dir	- search dir tree (symlinks followed), first match wins
+ *
+ * Successful results are cached for the process lifetime, so repeated
+ * lookups do not touch the disk. Returns 0 and fills path on success,
+ * -1 otherwise.
+ */
+int resolveResource(char *path, size_t plen, const char *fname, ...);
+
+/* drops cached result for fname (e.g. when the file became unreadable) */
+void forgetResource(const char *fname);
+
+
+} } } };
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Software blitting kernels
+ */
+
+#include <string.h>
+
+#include "cz/znj/sw/wormik/soft_blit.hxx"
+
+#if (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+# define SOFT_BLIT_X86
+# include <immintrin.h>
+#endif
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+static inline uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x+(x>>8))>>8;
+}
+
+static inline uint32_t blendPixel(uint32_t s, uint32_t d, unsigned alpha)
+{
+	uint32_t a = div255((s>>24)*alpha);
+	uint32_t ia = 255-a;
+	return 0xff000000
+		|(div255(((s>>16)&0xff)*a+((d>>16)&0xff)*ia)<<16)
+		|(div255(((s>>8)&0xff)*a+((d>>8)&0xff)*ia)<<8)
+		|(div255(((s>>0)&0xff)*a+((d>>0)&0xff)*ia)<<0);
+}
+
+static void copyScalar(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h)
+{
+	for (; h > 0; h--, dst += dpitch, src += spitch)
+		memcpy(dst, src, w*sizeof(*dst));
+}
+
+static void blendScalar(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h, unsigned alpha)
+{
+	for (; h > 0; h--, dst += dpitch, src += spitch) {
+		for (unsigned x = 0; x < w; x++)
+			dst[x] = blendPixel(src[x], dst[x], alpha);
+	}
+}
+
+static void fillScalar(uint32_t *dst, size_t dpitch, unsigned w, unsigned h, uint32_t color)
+{
+	for (; h > 0; h--, dst += dpitch) {
+		for (unsigned x = 0; x < w; x++)
+			dst[x] = color;
+	}
+}
+
+static const blit_kernels scalarKernels = { "scalar", &copyScalar, &blendScalar, &fillScalar };
+
+#ifdef SOFT_BLIT_X86
+
+__attribute__((target("sse2")))
+static inline __m128i div255Sse2(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* blends two pixels unpacked to 16-bit channels */
+__attribute__((target("sse2")))
+static inline __m128i blend2Sse2(__m128i s, __m128i d, __m128i alpha)
+{
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+	a = div255Sse2(_mm_mullo_epi16(a, alpha));
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	return div255Sse2(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)));
+}
+
+__attribute__((target("sse2")))
+static void copySse2(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h)
+{
+	for (; h > 0; h--, dst += dpitch, src += spitch) {
+		unsigned x = 0;
+		for (; x+4 <= w; x += 4)
+			_mm_storeu_si128((__m128i *)(dst+x), _mm_loadu_si128((const __m128i *)(src+x)));
+		for (; x < w; x++)
+			dst[x] = src[x];
+	}
+}
+
+__attribute__((target("sse2")))
+static void blendSse2(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h, unsigned alpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(0xff000000);
+	const __m128i ga = _mm_set1_epi16(alpha);
+	for (; h > 0; h--, dst += dpitch, src += spitch) {
+		unsigned x = 0;
+		for (; x+4 <= w; x += 4) {
+			__m128i s = _mm_loadu_si128((const __m128i *)(src+x));
+			__m128i d = _mm_loadu_si128((const __m128i *)(dst+x));
+			__m128i lo = blend2Sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), ga);
+			__m128i hi = blend2Sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), ga);
+			_mm_storeu_si128((__m128i *)(dst+x), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+		}
+		for (; x < w; x++)
+			dst[x] = blendPixel(src[x], dst[x], alpha);
+	}
+}
+
+__attribute__((target("sse2")))
+static void fillSse2(uint32_t *dst, size_t dpitch, unsigned w, unsigned h, uint32_t color)
+{
+	const __m128i c = _mm_set1_epi32(color);
+	for (; h > 0; h--, dst += dpitch) {
+		unsigned x = 0;
+		for (; x+4 <= w; x += 4)
+			_mm_storeu_si128((__m128i *)(dst+x), c);
+		for (; x < w; x++)
+			dst[x] = color;
+	}
+}
+
+static const blit_kernels sse2Kernels = { "sse2", &copySse2, &blendSse2, &fillSse2 };
+
+__attribute__((target("avx2")))
+static inline __m256i div255Avx2(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/* blends four pixels unpacked to 16-bit channels (two in each lane) */
+__attribute__((target("avx2")))
+static inline __m256i blend4Avx2(__m256i s, __m256i d, __m256i alpha)
+{
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+	a = div255Avx2(_mm256_mullo_epi16(a, alpha));
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	return div255Avx2(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)));
+}
+
+__attribute__((target("avx2")))
+static void copyAvx2(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h)
+{
+	for (; h > 0; h--, dst += dpitch, src += spitch) {
+		unsigned x = 0;
+		for (; x+8 <= w; x += 8)
+			_mm256_storeu_si256((__m256i *)(dst+x), _mm256_loadu_si256((const __m256i *)(src+x)));
+		for (; x < w; x++)
+			dst[x] = src[x];
+	}
+}
+
+__attribute__((target("avx2")))
+static void blendAvx2(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h, unsigned alpha)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opaque = _mm256_set1_epi32(0xff000000);
+	const __m256i ga = _mm256_set1_epi16(alpha);
+	for (; h > 0; h--, dst += dpitch, src += spitch) {
+		unsigned x = 0;
+		// unpack and pack both work within 128-bit lanes, so the pixel
+		// order is preserved
+		for (; x+8 <= w; x += 8) {
+			__m256i s = _mm256_loadu_si256((const __m256i *)(src+x));
+			__m256i d = _mm256_loadu_si256((const __m256i *)(dst+x));
+			__m256i lo = blend4Avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), ga);
+			__m256i hi = blend4Avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), ga);
+			_mm256_storeu_si256((__m256i *)(dst+x), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+		}
+		for (; x < w; x++)
+			dst[x] = blendPixel(src[x], dst[x], alpha);
+	}
+}
+
+__attribute__((target("avx2")))
+static void fillAvx2(uint32_t *dst, size_t dpitch, unsigned w, unsigned h, uint32_t color)
+{
+	const __m256i c = _mm256_set1_epi32(color);
+	for (; h > 0; h--, dst += dpitch) {
+		unsigned x = 0;
+		for (; x+8 <= w; x += 8)
+			_mm256_storeu_si256((__m256i *)(dst+x), c);
+		for (; x < w; x++)
+			dst[x] = color;
+	}
+}
+
+static const blit_kernels avx2Kernels = { "avx2", &copyAvx2, &blendAvx2, &fillAvx2 };
+
+#endif
+
+const blit_kernels *selectBlitKernels(const char *name)
+{
+	bool best = name == NULL || strcmp(name, "auto") == 0;
+#ifdef SOFT_BLIT_X86
+	__builtin_cpu_init();
+	if ((best || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+		return &avx2Kernels;
+	if ((best || strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2"))
+		return &sse2Kernels;
+#endif
+	if (best || strcmp(name, "scalar") == 0)
+		return &scalarKernels;
+	return NULL;
+}
+
+
+} } } };
@@ -0,0 +1,47 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Software blitting kernels
+ */
+
+#ifndef soft_blit_hxx__
+# define soft_blit_hxx__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/*
+ * All kernels work on 32-bit ARGB pixels (alpha in top byte, straight
+ * alpha), pitches are in pixels. Destination is treated as opaque.
+ *
+ * Blend computes for each channel c:
+ *	a = div255(src.alpha*alpha)
+ *	dst.c = div255(src.c*a+dst.c*(255-a))
+ * with div255(x) = (x+128+((x+128)>>8))>>8 and result alpha set to 255,
+ * all implementations give bit-exact results.
+ */
+struct blit_kernels
+{
+	const char *			name;
+	/* copies w*h pixels */
+	void				(*copy)(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h);
+	/* blends w*h pixels over destination with global alpha */
+	void				(*blend)(uint32_t *dst, size_t dpitch, const uint32_t *src, size_t spitch, unsigned w, unsigned h, unsigned alpha);
+	/* fills w*h pixels with color */
+	void				(*fill)(uint32_t *dst, size_t dpitch, unsigned w, unsigned h, uint32_t color);
+};
+
+/*
+ * returns kernels by name ("scalar", "sse2", "avx2"), or the best ones
+ * supported by CPU for NULL or "auto", NULL if not available
+ */
+const blit_kernels *selectBlitKernels(const char *name);
+
+
+} } } };
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * analytics store query tool
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+
+#include "cz/znj/sw/wormik/analytics.hxx"
+#include "cz/znj/sw/wormik/column_scan.hxx"
+
+using namespace cz::znj::sw::wormik;
+
+
+enum {
+	MAX_FILTERS		= 32,
+	MAX_PERCENTILES		= 16,
+	MAX_GROUPS		= 10000,
+};
+
+struct query_filter
+{
+	int				column;
+	int32_t				lo, hi;
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik-stats [options] dir\n"
+		"  -w column=value      keep rows with value, or range min:max (either may be empty), repeatable\n"
+		"  -c column            aggregated column (default score)\n"
+		"  -g column            aggregate every value of column separately, e.g. level\n"
+		"  -p percent           percentile to report, repeatable (default 50, 90, 95, 99)\n"
+		"  -k kernels           scanning code: auto, scalar, sse2, avx2\n"
+		"  -l                   list columns and rows count\n"
+		"  -t                   print query time\n"
+		"Cause values are named: ");
+	for (int i = 0; i < WormikGame::GE_COUNT; i++)
+		fprintf(stderr, "%s%s", i == 0 ? "" : ", ", analytics_cause_names[i]);
+	fprintf(stderr, ".\n");
+}
+
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int findColumn(const char *name)
+{
+	int column;
+	if ((column = analyticsFindColumn(name)) < 0)
+		fprintf(stderr, "unknown column %s\n", name);
+	return column;
+}
+
+/* parses single value of column, empty one gives defval */
+static bool parseValue(int column, const char *s, size_t length, int32_t defval, int32_t *value)
+{
+	char buf[32];
+	char *end;
+	long v;
+
+	if (length == 0) {
+		*value = defval;
+		return true;
+	}
+	if (length >= sizeof(buf))
+		return false;
+	memcpy(buf, s, length);
+	buf[length] = '\0';
+	if (column == AC_CAUSE) {
+		for (int i = 0; i < WormikGame::GE_COUNT; i++) {
+			if (strcmp(buf, analytics_cause_names[i]) == 0) {
+				*value = i;
+				return true;
+			}
+		}
+	}
+	errno = 0;
+	v = strtol(buf, &end, 0);
+	if (*end != '\0' || errno != 0 || v < INT32_MIN || v > INT32_MAX)
+		return false;
+	*value = v;
+	return true;
+}
+
+/* parses column=value or column=min:max */
+static bool parseFilter(const char *s, query_filter *filter)
+{
+	char name[32];
+	const char *eq, *value, *colon;
+
+	if ((eq = strchr(s, '=')) == NULL || (size_t)(eq-s) >= sizeof(name)) {
+		fprintf(stderr, "invalid filter %s\n", s);
+		return false;
+	}
+	memcpy(name, s, eq-s);
+	name[eq-s] = '\0';
+	if ((filter->column = findColumn(name)) < 0)
+		return false;
+	value = eq+1;
+	if ((colon = strchr(value, ':')) == NULL) {
+		if (*value == '\0' || !parseValue(filter->column, value, strlen(value), 0, &filter->lo)) {
+			fprintf(stderr, "invalid filter %s\n", s);
+			return false;
+		}
+		filter->hi = filter->lo;
+	}
+	else if (!parseValue(filter->column, value, colon-value, INT32_MIN, &filter->lo) || !parseValue(filter->column, colon+1, strlen(colon+1), INT32_MAX, &filter->hi)) {
+		fprintf(stderr, "invalid filter %s\n", s);
+		return false;
+	}
+	return true;
+}
+
+static bool isEmpty(const uint64_t *selection, size_t words)
+{
+	for (size_t w = 0; w < words; w++) {
+		if (selection[w] != 0)
+			return false;
+	}
+	return true;
+}
+
+static void printHeader(int groupColumn, const double *percents, unsigned percentsCount)
+{
+	printf("%-8s %10s %12s %10s %10s", groupColumn < 0 ? "" : analytics_column_names[groupColumn], "count", "mean", "min", "max");
+	for (unsigned i = 0; i < percentsCount; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "p%g", percents[i]);
+		printf(" %10s", name);
+	}
+	printf("\n");
+}
+
+/* prints aggregates of selected rows, values is scratch space for all rows */
+static void printAggregates(const char *group, const scan_kernels *kernels, const int32_t *col, const uint64_t *selection, size_t rows, int32_t *values, const double *percents, unsigned percentsCount)
+{
+	scan_aggregate agg;
+	size_t count, done;
+
+	kernels->aggregate(&agg, col, selection, rows);
+	printf("%-8s %10llu", group, (unsigned long long)agg.count);
+	if (agg.count == 0) {
+		printf("\n");
+		return;
+	}
+	printf(" %12.2f %10d %10d", (double)agg.sum/agg.count, agg.min, agg.max);
+	if (percentsCount == 0) {
+		printf("\n");
+		return;
+	}
+	count = scanGather(values, col, selection, rows);
+	// percents are ascending, so each selection continues in the upper part left by the previous one
+	done = 0;
+	for (unsigned i = 0; i < percentsCount; i++) {
+		double rank = ceil(percents[i]/100*count);
+		size_t k = rank < 1 ? 0 : rank >= count ? count-1 : (size_t)rank-1;
+		if (k >= done) {
+			std::nth_element(values+done, values+k, values+count);
+			done = k;
+		}
+		printf(" %10d", values[k]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	query_filter filters[MAX_FILTERS];
+	unsigned filtersCount = 0;
+	double percents[MAX_PERCENTILES] = { 50, 90, 95, 99 };
+	unsigned percentsCount = 0;
+	int aggColumn = AC_SCORE;
+	int groupColumn = -1;
+	const char *kernelsName = NULL;
+	const scan_kernels *kernels;
+	bool list = false, timing = false;
+	AnalyticsReader reader;
+	size_t rows, words;
+	uint64_t *selection;
+	int32_t *values;
+	double start;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:c:g:p:k:lt")) != -1) {
+		switch (opt) {
+		case 'w':
+			if (filtersCount == MAX_FILTERS) {
+				fprintf(stderr, "too many filters\n");
+				return 2;
+			}
+			if (!parseFilter(optarg, &filters[filtersCount++]))
+				return 2;
+			break;
+
+		case 'c':
+			if ((aggColumn = findColumn(optarg)) < 0)
+				return 2;
+			break;
+
+		case 'g':
+			if ((groupColumn = findColumn(optarg)) < 0)
+				return 2;
+			break;
+
+		case 'p':
+			if (percentsCount == MAX_PERCENTILES || (percents[percentsCount] = strtod(optarg, NULL)) <= 0 || percents[percentsCount] > 100) {
+				usage();
+				return 2;
+			}
+			percentsCount++;
+			break;
+
+		case 'k':
+			kernelsName = optarg;
+			break;
+
+		case 'l':
+			list = true;
+			break;
+
+		case 't':
+			timing = true;
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind+1 != argc) {
+		usage();
+		return 2;
+	}
+	if (percentsCount == 0)
+		percentsCount = 4;
+	std::sort(percents, percents+percentsCount);
+	if ((kernels = selectScanKernels(kernelsName)) == NULL) {
+		fprintf(stderr, "scanning code %s is not supported\n", kernelsName);
+		return 2;
+	}
+
+	if (reader.open(argv[optind]) < 0) {
+		fprintf(stderr, "failed to open analytics store %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	rows = reader.getRows();
+	if (list) {
+		printf("%zu rows, columns:", rows);
+		for (int i = 0; i < AC_COUNT; i++)
+			printf(" %s", analytics_column_names[i]);
+		printf("\n");
+		return 0;
+	}
+
+	words = (rows+63)/64;
+	if ((selection = (uint64_t *)malloc((words+1)*sizeof(*selection))) == NULL || (values = (int32_t *)malloc((rows+1)*sizeof(*values))) == NULL) {
+		fprintf(stderr, "failed to allocate selection of %zu rows\n", rows);
+		return 1;
+	}
+
+	start = getTime();
+	reader.prefetch(aggColumn);
+	if (groupColumn >= 0)
+		reader.prefetch(groupColumn);
+	for (unsigned i = 0; i < filtersCount; i++)
+		reader.prefetch(filters[i].column);
+	if (filtersCount == 0) {
+		kernels->filter(selection, reader.getColumn(aggColumn), rows, INT32_MIN, INT32_MAX, true);
+	}
+	for (unsigned i = 0; i < filtersCount; i++)
+		kernels->filter(selection, reader.getColumn(filters[i].column), rows, filters[i].lo, filters[i].hi, i == 0);
+
+	printHeader(groupColumn, percents, percentsCount);
+	if (groupColumn < 0) {
+		printAggregates("all", kernels, reader.getColumn(aggColumn), selection, rows, values, percents, percentsCount);
+	}
+	else {
+		const int32_t *groups = reader.getColumn(groupColumn);
+		uint64_t *groupSelection;
+		scan_aggregate range;
+
+		kernels->aggregate(&range, groups, selection, rows);
+		if (range.count != 0 && (int64_t)range.max-range.min >= MAX_GROUPS) {
+			fprintf(stderr, "column %s has too many values to group by\n", analytics_column_names[groupColumn]);
+			return 1;
+		}
+		if ((groupSelection = (uint64_t *)malloc((words+1)*sizeof(*groupSelection))) == NULL) {
+			fprintf(stderr, "failed to allocate selection of %zu rows\n", rows);
+			return 1;
+		}
+		for (int64_t g = range.min; range.count != 0 && g <= range.max; g++) {
+			char name[16];
+			memcpy(groupSelection, selection, words*sizeof(*selection));
+			kernels->filter(groupSelection, groups, rows, g, g, false);
+			if (groupColumn == AC_CAUSE && g >= 0 && g < WormikGame::GE_COUNT)
+				snprintf(name, sizeof(name), "%s", analytics_cause_names[g]);
+			else
+				snprintf(name, sizeof(name), "%lld", (long long)g);
+			if (!isEmpty(groupSelection, words))
+				printAggregates(name, kernels, reader.getColumn(aggColumn), groupSelection, rows, values, percents, percentsCount);
+		}
+		free(groupSelection);
+	}
+	if (timing)
+		fprintf(stderr, "%zu rows scanned by %s code in %.3f ms\n", rows, kernels->name, (getTime()-start)*1000);
+
+	free(values);
+	free(selection);
+	return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Timing histogram for instrumentation
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cz/znj/sw/wormik/timing_histogram.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+TimingHistogram::TimingHistogram()
+{
+	reset();
+}
+
+void TimingHistogram::reset()
+{
+	memset(counts, 0, sizeof(counts));
+	samples = 0;
+	sum = 0;
+	max = 0;
+}
+
+void TimingHistogram::add(double seconds)
+{
+	unsigned bucket = 0;
+	if (seconds < 0)
+		seconds = 0;
+	// upper bound of first bucket is 0.25 ms, doubled with each next
+	for (double bound = 0.00025; seconds >= bound && bucket < BUCKETS-1; bound *= 2)
+		bucket++;
+	counts[bucket]++;
+	samples++;
+	sum += seconds;
+	if (seconds > max)
+		max = seconds;
+}
+
+int TimingHistogram::format(char *buf, size_t blen) const
+{
+	size_t len;
+	double bound = 0.25;
+	len = snprintf(buf, blen, "%lu samples, avg %.3f ms, max %.3f ms", samples, samples == 0 ? 0 : sum*1000/samples, max*1000);
+	for (unsigned i = 0; i < BUCKETS; i++, bound *= 2) {
+		if (counts[i] == 0)
+			continue;
+		if (i < BUCKETS-1)
+			len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", <%g ms: %lu", bound, counts[i]);
+		else
+			len += snprintf(len < blen ? buf+len : NULL, len < blen ? blen-len : 0, ", >=%g ms: %lu", bound/2, counts[i]);
+	}
+	return len;
+}
+
+
+} } } };
@@ -0,0 +1,60 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * Timing histogram for instrumentation
+ */
+
+#ifndef timing_histogram_hxx__
+# define timing_histogram_hxx__
+
+#include <stddef.h>
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+
+/**
+ * Counts durations in power of two millisecond buckets, from below 0.25 ms
+ * to 64 ms and more. Not synchronized, each histogram has to be updated by
+ * single thread.
+ */
+class TimingHistogram
+{
+public:
+	enum {
+		BUCKETS			= 10,
+	};
+
+protected:
+	unsigned long			counts[BUCKETS];	/**< samples per bucket */
+	unsigned long			samples;		/**< samples in total */
+	double				sum;			/**< sum of samples, seconds */
+	double				max;			/**< largest sample, seconds */
+
+public:
+	/* constructor */		TimingHistogram();
+
+public:
+	void				reset();
+	/** adds duration in seconds, negative counts as zero */
+	void				add(double seconds);
+	unsigned long			getSamples() const;
+
+	/**
+	 * formats summary and non-empty buckets into buffer
+	 *
+	 * @return
+	 * 	full string length (as snprintf)
+	 */
+	int				format(char *buf, size_t blen) const;
+};
+
+inline unsigned long TimingHistogram::getSamples() const
+{
+	return samples;
+}
+
+
+} } } };
+
+#endif
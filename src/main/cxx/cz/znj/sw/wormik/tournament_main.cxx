@@ -0,0 +1,453 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * tournament runner, plays seeded matches of external bot processes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <chrono>
+
+#include "cz/znj/sw/wormik/platform.hxx"
+
+#if !(defined _WIN32) && !(defined _WIN64)
+# include <fcntl.h>
+# include <poll.h>
+# include <signal.h>
+# include <sys/resource.h>
+# include <sys/wait.h>
+#endif
+
+#include "cz/znj/sw/wormik/WormikGame.hxx"
+#include "cz/znj/sw/wormik/WormikGui.hxx"
+
+#include "cz/znj/sw/wormik/bot_protocol.hxx"
+#include "cz/znj/sw/wormik/analytics.hxx"
+
+namespace cz { namespace znj { namespace sw { namespace wormik {
+
+extern WormikGame *create_WormikGame();
+extern WormikGui *create_NullWormikGui();
+
+} } } };
+
+using namespace cz::znj::sw::wormik;
+
+
+#if !(defined _WIN32) && !(defined _WIN64)
+
+enum {
+	MATCH_DEAD,					/* snake died */
+	MATCH_STEPS,					/* step limit reached */
+	MATCH_CRASH,					/* bot exited, failed to start or broke protocol */
+	MATCH_TIMEOUT,					/* bot did not answer in time */
+	MATCH_RESULTS,
+};
+
+static const char *const match_result_names[MATCH_RESULTS] = { "dead", "steps", "crash", "timeout" };
+
+struct bot_stats
+{
+	const char *			path;
+	unsigned			matches;
+	unsigned			results[MATCH_RESULTS];
+	long long			total;			/**< sum of match scores */
+	int				best;
+	unsigned long long		moves;
+	double				thinking;		/**< seconds spent waiting for moves */
+};
+
+/** running match, slots are reused by next matches */
+struct match_slot
+{
+	WormikGame *			game;			/**< created once per slot */
+	bool				active;
+	unsigned			bot;
+	unsigned			seed;
+	pid_t				pid;
+	int				toBot;			/**< bot stdin */
+	int				fromBot;		/**< bot stdout */
+	uint32_t			steps;
+	analytics_level			level;			/**< statistics of level in progress */
+	double				sent;			/**< time of last observation */
+	double				deadline;		/**< of current move */
+};
+
+static bot_stats *bots;
+static unsigned botsCount;
+static unsigned moveLimit = 100;
+static unsigned startLimit = 1000;
+static uint32_t stepsLimit = 100000;
+static bool verbose = false;
+static bool quietBots = false;
+static AnalyticsWriter analytics;
+
+static void usage()
+{
+	fprintf(stderr,
+		"Usage: wormik-tournament [options] bot...\n"
+		"  -n matches      matches played by each bot (default 100)\n"
+		"  -j count        concurrently running matches (default 100)\n"
+		"  -s seed         seed of the first match, next ones increment it (default 1)\n"
+		"  -t ms           move time limit (default 100)\n"
+		"  -w ms           time limit of the first move, including bot startup (default 1000)\n"
+		"  -l steps        match step limit (default 100000)\n"
+		"  -q              discard bots stderr\n"
+		"  -v              print result of every match\n"
+		"  -a dir          append outcome of every level to analytics store\n"
+		"Every bot plays the same seeds, protocol is described in bot_protocol.hxx.\n");
+}
+
+static double getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* starts bot process with pipes on its stdin and stdout, returns negative on error */
+static int startBot(match_slot *slot, const char *path)
+{
+	int toBot[2], fromBot[2];
+
+	if (pipe2(toBot, O_CLOEXEC) < 0)
+		return -1;
+	if (pipe2(fromBot, O_CLOEXEC) < 0) {
+		close(toBot[0]); close(toBot[1]);
+		return -1;
+	}
+	if ((slot->pid = fork()) < 0) {
+		close(toBot[0]); close(toBot[1]);
+		close(fromBot[0]); close(fromBot[1]);
+		return -1;
+	}
+	if (slot->pid == 0) {
+		// only the dup-ed descriptors survive exec
+		dup2(toBot[0], 0);
+		dup2(fromBot[1], 1);
+		if (quietBots) {
+			int null = open("/dev/null", O_WRONLY);
+			if (null >= 0)
+				dup2(null, 2);
+		}
+		signal(SIGPIPE, SIG_DFL);
+		execl(path, path, (char *)NULL);
+		_exit(127);
+	}
+	close(toBot[0]);
+	close(fromBot[1]);
+	slot->toBot = toBot[1];
+	slot->fromBot = fromBot[0];
+	fcntl(slot->toBot, F_SETFL, O_NONBLOCK);
+	fcntl(slot->fromBot, F_SETFL, O_NONBLOCK);
+	return 0;
+}
+
+/* writes observation of current game state, false if bot does not read */
+static bool sendObservation(match_slot *slot)
+{
+	bot_observation obs;
+	WormikGame::board_view view;
+
+	obs.size = sizeof(obs);
+	obs.step = slot->steps;
+	obs.hash = slot->game->getStateHash();
+	slot->game->getState(&obs.level, NULL);
+	obs.exit = slot->game->getScore(&obs.score, &obs.total);
+	slot->game->getSnakeInfo(&obs.health, &obs.length);
+	slot->game->getBoardView(&view);
+	obs.headX = view.headX; obs.headY = view.headY;
+	obs.reserved[0] = obs.reserved[1] = 0;
+	for (unsigned y = 0; y < WormikGame::GAME_YSIZE; y++)
+		memcpy(obs.board[y], view.board+y*view.stride, WormikGame::GAME_XSIZE);
+
+	// bot reads every observation before answering, so pipe is empty and
+	// the whole message fits (it is smaller than PIPE_BUF)
+	return write(slot->toBot, &obs, sizeof(obs)) == (ssize_t)sizeof(obs);
+}
+
+/* appends finished or abandoned level to analytics store */
+static void writeAnalytics(match_slot *slot)
+{
+	int32_t row[AC_COUNT];
+	if (analytics.isOpen()) {
+		analyticsFillRow(row, slot->game, &slot->level, slot->seed, 0);
+		if (analytics.append(row) < 0)
+			fprintf(stderr, "failed to write analytics: %s\n", strerror(errno));
+	}
+	memset(&slot->level, 0, sizeof(slot->level));
+}
+
+static void startMatch(match_slot *slot, unsigned bot, unsigned seed, double now)
+{
+	slot->active = true;
+	slot->bot = bot;
+	slot->seed = seed;
+	slot->steps = 0;
+	memset(&slot->level, 0, sizeof(slot->level));
+	slot->game->setSeed(seed);
+	slot->game->startLevel(WormikGame::GA_DEAD);
+	if (startBot(slot, bots[bot].path) < 0) {
+		fprintf(stderr, "failed to start %s: %s\n", bots[bot].path, strerror(errno));
+		exit(1);
+	}
+	slot->sent = now;
+	slot->deadline = now+startLimit/1000.0;
+	// write failure is noticed as hangup of the output
+	sendObservation(slot);
+}
+
+static void finishMatch(match_slot *slot, int result)
+{
+	bot_stats *stats = &bots[slot->bot];
+	int score, total;
+
+	close(slot->toBot);
+	close(slot->fromBot);
+	kill(slot->pid, SIGKILL);
+	while (waitpid(slot->pid, NULL, 0) < 0 && errno == EINTR) {
+	}
+	slot->active = false;
+
+	// dead level is written by moveMatch already
+	if (result != MATCH_DEAD && slot->level.ticks != 0)
+		writeAnalytics(slot);
+	slot->game->getScore(&score, &total);
+	stats->matches++;
+	stats->results[result]++;
+	stats->total += total;
+	if (stats->matches == 1 || total > stats->best)
+		stats->best = total;
+	stats->moves += slot->steps;
+	if (verbose)
+		printf("%s seed %u: %s, score %d, steps %u\n", stats->path, slot->seed, match_result_names[result], total, slot->steps);
+}
+
+/* applies answer of bot and sends next observation, returns match result or -1 to continue */
+static int moveMatch(match_slot *slot, uint8_t action, double now)
+{
+	int outcome;
+
+	bots[slot->bot].thinking += now-slot->sent;
+	if (action < 4)
+		slot->game->changeDirection(action);
+	else if (action != BOT_KEEP)
+		return MATCH_CRASH;
+	outcome = slot->game->stepGame();
+	slot->steps++;
+	if (analytics.isOpen()) {
+		int health, length;
+		slot->game->getSnakeInfo(&health, &length);
+		analyticsStep(&slot->level, length);
+		if (outcome != WormikGame::GA_CONTINUE)
+			writeAnalytics(slot);
+	}
+	if (outcome == WormikGame::GA_DEAD)
+		return MATCH_DEAD;
+	if (outcome == WormikGame::GA_EXIT)
+		slot->game->startLevel(outcome);
+	if (slot->steps >= stepsLimit)
+		return MATCH_STEPS;
+	if (!sendObservation(slot))
+		return MATCH_CRASH;
+	slot->sent = now;
+	slot->deadline = now+moveLimit/1000.0;
+	return -1;
+}
+
+/* raises descriptors limit for slots, two per match, returns slots that fit */
+static unsigned raiseFilesLimit(unsigned slots)
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur >= 2*slots+16)
+		return slots;
+	limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > 2*slots+16 ? 2*slots+16 : limit.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &limit) < 0 && getrlimit(RLIMIT_NOFILE, &limit) < 0)
+		return slots;
+	return limit.rlim_cur >= 2*slots+16 ? slots : limit.rlim_cur < 2+16 ? 1 : (limit.rlim_cur-16)/2;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+#if (defined _WIN32) || (defined _WIN64)
+	fprintf(stderr, "tournament is not supported on this platform\n");
+	return 1;
+#else
+	unsigned matchesPerBot = 100;
+	unsigned slotsCount = 100;
+	unsigned firstSeed = 1;
+	unsigned matchesCount, started, finished, fitting;
+	match_slot *slots;
+	struct pollfd *fds;
+	unsigned *fdSlots;
+	WormikGui *gui;
+	double begin, elapsed;
+	const char *analyticsPath = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:j:s:t:w:l:qva:")) != -1) {
+		switch (opt) {
+		case 'n':
+			matchesPerBot = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'j':
+			slotsCount = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			firstSeed = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			moveLimit = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'w':
+			startLimit = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'l':
+			stepsLimit = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'q':
+			quietBots = true;
+			break;
+
+		case 'v':
+			verbose = true;
+			break;
+
+		case 'a':
+			analyticsPath = optarg;
+			break;
+
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind == argc || matchesPerBot == 0 || slotsCount == 0 || moveLimit == 0 || stepsLimit == 0) {
+		usage();
+		return 2;
+	}
+
+	botsCount = argc-optind;
+	bots = (bot_stats *)calloc(botsCount, sizeof(bot_stats));
+	for (unsigned b = 0; b < botsCount; b++)
+		bots[b].path = argv[optind+b];
+	matchesCount = matchesPerBot*botsCount;
+	if (slotsCount > matchesCount)
+		slotsCount = matchesCount;
+
+	if (analyticsPath != NULL && analytics.open(analyticsPath) < 0) {
+		fprintf(stderr, "failed to open analytics store %s: %s\n", analyticsPath, strerror(errno));
+		return 1;
+	}
+
+	// dead bots must not kill the runner
+	signal(SIGPIPE, SIG_IGN);
+	if ((fitting = raiseFilesLimit(slotsCount)) < slotsCount) {
+		fprintf(stderr, "open files limit allows only %u concurrent matches\n", fitting);
+		slotsCount = fitting;
+	}
+
+	gui = create_NullWormikGui();
+	slots = new match_slot[slotsCount];
+	fds = new struct pollfd[slotsCount];
+	fdSlots = new unsigned[slotsCount];
+	for (unsigned i = 0; i < slotsCount; i++) {
+		slots[i].game = create_WormikGame();
+		slots[i].game->setGui(gui);
+		slots[i].active = false;
+	}
+
+	begin = getTime();
+	started = finished = 0;
+	while (finished < matchesCount) {
+		double now = getTime();
+		double nearest = now+1;
+		unsigned polled = 0;
+		int timeout;
+
+		// bots take turns on each seed, so partial results stay comparable
+		for (unsigned i = 0; i < slotsCount && started < matchesCount; i++) {
+			if (!slots[i].active) {
+				startMatch(&slots[i], started%botsCount, firstSeed+started/botsCount, now);
+				started++;
+			}
+		}
+
+		for (unsigned i = 0; i < slotsCount; i++) {
+			if (!slots[i].active)
+				continue;
+			if (slots[i].deadline < nearest)
+				nearest = slots[i].deadline;
+			fds[polled].fd = slots[i].fromBot;
+			fds[polled].events = POLLIN;
+			fds[polled].revents = 0;
+			fdSlots[polled++] = i;
+		}
+		timeout = nearest <= now ? 0 : (int)((nearest-now)*1000)+1;
+		if (poll(fds, polled, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "poll failed: %s\n", strerror(errno));
+			return 1;
+		}
+
+		now = getTime();
+		for (unsigned p = 0; p < polled; p++) {
+			match_slot *slot = &slots[fdSlots[p]];
+			int result = -1;
+			if (fds[p].revents != 0) {
+				uint8_t answer[2];
+				ssize_t got = read(slot->fromBot, answer, sizeof(answer));
+				if (got < 0 && (errno == EAGAIN || errno == EINTR))
+					continue;
+				// anything but single byte is crash, bot cannot answer ahead
+				result = got == 1 ? moveMatch(slot, answer[0], now) : MATCH_CRASH;
+			}
+			else if (now >= slot->deadline) {
+				result = MATCH_TIMEOUT;
+			}
+			if (result >= 0) {
+				finishMatch(slot, result);
+				finished++;
+			}
+		}
+	}
+	elapsed = getTime()-begin;
+
+	printf("%-24s %8s %10s %8s %8s %8s %8s %8s %9s\n", "bot", "matches", "mean", "best", "dead", "steps", "crash", "timeout", "move ms");
+	for (unsigned b = 0; b < botsCount; b++) {
+		bot_stats *stats = &bots[b];
+		printf("%-24s %8u %10.1f %8d %8u %8u %8u %8u %9.3f\n", stats->path, stats->matches,
+			(double)stats->total/stats->matches, stats->best,
+			stats->results[MATCH_DEAD], stats->results[MATCH_STEPS], stats->results[MATCH_CRASH], stats->results[MATCH_TIMEOUT],
+			stats->moves == 0 ? 0 : stats->thinking*1000/stats->moves);
+	}
+	{
+		unsigned long long moves = 0;
+		for (unsigned b = 0; b < botsCount; b++)
+			moves += bots[b].moves;
+		fprintf(stderr, "%u matches, %llu moves in %.2f s (%.0f moves/s, %u concurrent)\n", matchesCount, moves, elapsed, moves/elapsed, slotsCount);
+	}
+
+	for (unsigned i = 0; i < slotsCount; i++)
+		delete slots[i].game;
+	delete[] slots;
+	delete[] fds;
+	delete[] fdSlots;
+	delete gui;
+	free(bots);
+	analytics.close();
+	return 0;
+#endif
+}
@@ -0,0 +1,76 @@
+/*
+ * Wormik, game by Zbynek Vyskovsky, under GPL license
+ * http://atrey.karlin.mff.cuni.cz/~rat/wormik/
+ *
+ * C interface of batch environment for training agents (libwormikenv)
+ */
+
+#ifndef wormik_env_h__
+# define wormik_env_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* observation types */
+#define WORMIK_ENV_OBS_BOARD		0	/* whole 30x30 board */
+#define WORMIK_ENV_OBS_WINDOW		1	/* (2*radius+1)^2 window around snake head */
+
+/* observation planes, observation is uint8 planes[10][side][side] of 0/1 */
+#define WORMIK_ENV_OBSP_WALL		0
+#define WORMIK_ENV_OBSP_POSITIVE	1
+#define WORMIK_ENV_OBSP_POSITIVE_2	2
+#define WORMIK_ENV_OBSP_NEGATIVE	3
+#define WORMIK_ENV_OBSP_DEATH		4
+#define WORMIK_ENV_OBSP_EXIT		5
+#define WORMIK_ENV_OBSP_NEW_DEF		6
+#define WORMIK_ENV_OBSP_SNAKE_BODY	7
+#define WORMIK_ENV_OBSP_SNAKE_HEAD	8
+#define WORMIK_ENV_OBSP_SNAKE_TAIL	9
+#define WORMIK_ENV_OBS_PLANES		10
+
+/* actions, other values keep direction */
+#define WORMIK_ENV_ACT_EAST		0
+#define WORMIK_ENV_ACT_NORTH		1
+#define WORMIK_ENV_ACT_WEST		2
+#define WORMIK_ENV_ACT_SOUTH		3
+#define WORMIK_ENV_ACT_NONE		255
+
+typedef struct wormik_env wormik_env;
+
+/*
+ * creates count games stepped by threads workers (0 for all cores),
+ * returns NULL on invalid arguments; observation kernels can be forced
+ * by WORMIK_ENV_KERNELS environment variable (scalar, ssse3, avx2)
+ */
+wormik_env *wormik_env_create(unsigned count, int observation, unsigned windowRadius, unsigned threads);
+void wormik_env_destroy(wormik_env *env);
+
+unsigned wormik_env_count(const wormik_env *env);
+/* observation bytes per game */
+size_t wormik_env_observation_size(const wormik_env *env);
+/* observation width and height */
+unsigned wormik_env_observation_side(const wormik_env *env);
+
+/* starts new games with seeds[count] (NULL continues generators), observations may be NULL */
+void wormik_env_reset(wormik_env *env, const uint32_t *seeds, uint8_t *observations);
+/*
+ * steps all games with actions[count], rewards[count] get score gained,
+ * dones[count] are set when game ended (it is started again and its
+ * observation is already of the new game), observations may be NULL
+ */
+void wormik_env_step(wormik_env *env, const uint8_t *actions, float *rewards, uint8_t *dones, uint8_t *observations);
+
+/* total score, level, snake length and steps of current game */
+void wormik_env_info(const wormik_env *env, unsigned i, int *total, int *level, int *length, uint32_t *steps);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif